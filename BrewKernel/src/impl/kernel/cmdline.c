@@ -0,0 +1,110 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "cmdline.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Multiboot2 boot information: fixed header followed by 8 byte aligned tags
+#define MB2_TAG_END     0
+#define MB2_TAG_CMDLINE 1
+
+// Sanity limits for the info pointer: it must be 8 byte aligned and lie
+// entirely in the identity-mapped first 1GB
+#define MB2_IDENTITY_LIMIT 0x40000000UL
+#define MB2_INFO_MAX       0x100000UL
+
+struct mb2_info {
+    uint32_t total_size;
+    uint32_t reserved;
+};
+
+struct mb2_tag {
+    uint32_t type;
+    uint32_t size;
+};
+
+static char cmdline[CMDLINE_MAX];
+
+void cmdline_init(void* multiboot_info) {
+    cmdline[0] = '\0';
+    uintptr_t addr = (uintptr_t)multiboot_info;
+    if (!addr || (addr & 7) || addr >= MB2_IDENTITY_LIMIT - sizeof(struct mb2_info)) return;
+
+    struct mb2_info* info = (struct mb2_info*)multiboot_info;
+    if (info->total_size < sizeof(struct mb2_info) + sizeof(struct mb2_tag) ||
+        info->total_size > MB2_INFO_MAX ||
+        addr + info->total_size > MB2_IDENTITY_LIMIT) {
+        return;  // Not a multiboot2 info block
+    }
+    uint8_t* p = (uint8_t*)multiboot_info + sizeof(struct mb2_info);
+    uint8_t* end = (uint8_t*)multiboot_info + info->total_size;
+
+    while (p + sizeof(struct mb2_tag) <= end) {
+        struct mb2_tag* tag = (struct mb2_tag*)p;
+        if (tag->type == MB2_TAG_END || tag->size < sizeof(struct mb2_tag)) {
+            break;
+        }
+        if (tag->type == MB2_TAG_CMDLINE) {
+            const char* s = (const char*)(p + sizeof(struct mb2_tag));
+            size_t max = tag->size - sizeof(struct mb2_tag);
+            size_t i = 0;
+            while (i < max && i < CMDLINE_MAX - 1 && s[i]) {
+                cmdline[i] = s[i];
+                i++;
+            }
+            cmdline[i] = '\0';
+            return;
+        }
+        p += (tag->size + 7) & ~7u;
+    }
+}
+
+const char* cmdline_get(void) {
+    return cmdline;
+}
+
+int cmdline_get_uint(const char* key, uint32_t* value) {
+    if (!key || !value) return -1;
+
+    const char* p = cmdline;
+    while (*p) {
+        while (*p == ' ') p++;
+
+        // Compare this word against "key="
+        const char* k = key;
+        const char* w = p;
+        while (*k && *w == *k) {
+            k++;
+            w++;
+        }
+        if (*k == '\0' && *w == '=' && w[1] >= '0' && w[1] <= '9') {
+            uint32_t v = 0;
+            w++;
+            while (*w >= '0' && *w <= '9') {
+                v = v * 10 + (uint32_t)(*w - '0');
+                w++;
+            }
+            *value = v;
+            return 0;
+        }
+
+        while (*p && *p != ' ') p++;
+    }
+    return -1;
+}
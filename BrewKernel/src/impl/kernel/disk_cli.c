@@ -0,0 +1,416 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "disk_cli.h"
+#include "block.h"
+#include "bcache.h"
+#include "fat32.h"
+#include "filesys.h"
+#include "fslog.h"
+#include "print.h"
+#include "memory.h"
+#include "timer.h"
+#include <stdint.h>
+
+// DISKBENCH parameters: 4KB reads with up to BENCH_DEPTH requests outstanding
+#define BENCH_DEPTH        32
+#define BENCH_IO_SECTORS   8
+#define BENCH_SEQ_OPS      8192   // 32MB sequential
+#define BENCH_RANDOM_OPS   4096
+
+static int disk_strncmp(const char *s1, const char *s2, int n) {
+    for (int i = 0; i < n; i++) {
+        if (s1[i] != s2[i] || s1[i] == '\0' || s2[i] == '\0') {
+            return (unsigned char)s1[i] - (unsigned char)s2[i];
+        }
+    }
+    return 0;
+}
+
+static int disk_strcmp(const char *s1, const char *s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+static void handle_diskinfo(void) {
+    brew_str("\n");
+    int count = block_get_device_count();
+    if (count == 0) {
+        brew_str("No block devices found.\n");
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        block_device_t* dev = block_get_device(i);
+        brew_str(dev->name);
+        brew_str(" (");
+        brew_str(dev->driver);
+        brew_str("): ");
+        print_uint((unsigned int)(dev->sector_count / 2048));
+        brew_str(" MB, ");
+        print_uint((unsigned int)dev->sector_count);
+        brew_str(" sectors, queue depth ");
+        print_uint((unsigned int)dev->queue_depth);
+        brew_str("\n");
+
+        brew_str("  Requests: ");
+        print_uint(dev->stat_requests);
+        brew_str("  Merged: ");
+        print_uint(dev->stat_merges);
+        brew_str("  Dispatched: ");
+        print_uint(dev->stat_dispatched);
+        brew_str("  Errors: ");
+        print_uint(dev->stat_errors);
+        brew_str("\n  Read: ");
+        print_uint((unsigned int)(dev->stat_sectors_read / 2));
+        brew_str(" KB  Written: ");
+        print_uint((unsigned int)(dev->stat_sectors_written / 2));
+        brew_str(" KB\n");
+    }
+
+    bcache_stats_t stats;
+    bcache_get_stats(&stats);
+    brew_str("Buffer cache: ");
+    print_uint(stats.hits);
+    brew_str(" hits, ");
+    print_uint(stats.misses);
+    brew_str(" misses, ");
+    print_uint(stats.readahead);
+    brew_str(" read-ahead, ");
+    print_uint(stats.writebacks);
+    brew_str(" written back, ");
+    print_uint(stats.dirty);
+    brew_str(" dirty\n");
+}
+
+static uint64_t bench_rand_state = 88172645463325252ull;
+
+static uint64_t bench_rand(void) {
+    bench_rand_state ^= bench_rand_state << 13;
+    bench_rand_state ^= bench_rand_state >> 7;
+    bench_rand_state ^= bench_rand_state << 17;
+    return bench_rand_state;
+}
+
+// Keep 'depth' reads in flight until 'ops' have completed.
+// Returns elapsed TSC cycles, or 0 on error.
+static uint64_t disk_bench_run(block_device_t* dev, uint8_t* buffers, int depth, int random, uint32_t ops) {
+    static block_request_t reqs[BENCH_DEPTH];
+    int active[BENCH_DEPTH];
+    uint64_t span = dev->sector_count / BENCH_IO_SECTORS;
+    uint64_t next_seq = 0;
+    uint32_t issued = 0;
+    uint32_t completed = 0;
+    int errors = 0;
+
+    for (int i = 0; i < BENCH_DEPTH; i++) {
+        active[i] = 0;
+    }
+
+    uint64_t start = timer_read_tsc();
+    while (completed < ops) {
+        block_plug(dev);
+        for (int i = 0; i < depth; i++) {
+            if (active[i]) {
+                if (!reqs[i].done) continue;
+                active[i] = 0;
+                completed++;
+                if (reqs[i].status != 0) errors++;
+            }
+            if (issued < ops) {
+                uint64_t block = random ? bench_rand() % span : next_seq++ % span;
+                block_request_t* req = &reqs[i];
+                req->dev = dev;
+                req->lba = block * BENCH_IO_SECTORS;
+                req->count = BENCH_IO_SECTORS;
+                req->buffer = buffers + (size_t)i * BENCH_IO_SECTORS * BLOCK_SECTOR_SIZE;
+                req->write = 0;
+                req->complete = NULL;
+                req->private_data = NULL;
+                if (block_submit(req) != 0) {
+                    block_unplug(dev);
+                    return 0;
+                }
+                active[i] = 1;
+                issued++;
+            }
+        }
+        block_unplug(dev);
+
+        if (dev->poll) {
+            dev->poll(dev);
+        }
+    }
+    uint64_t cycles = timer_read_tsc() - start;
+    return errors ? 0 : (cycles ? cycles : 1);
+}
+
+static void disk_bench_report(const char* label, uint32_t ops, uint64_t cycles) {
+    uint64_t us = cycles * 1000 / timer_get_tsc_khz();
+    if (us == 0) us = 1;
+    uint64_t iops = (uint64_t)ops * 1000000 / us;
+    uint64_t kb_per_sec = (uint64_t)ops * (BENCH_IO_SECTORS / 2) * 1000000 / us;
+
+    brew_str(label);
+    print_uint(ops);
+    brew_str(" ops in ");
+    print_uint((unsigned int)(us / 1000));
+    brew_str(" ms, ");
+    print_uint((unsigned int)iops);
+    brew_str(" IOPS, ");
+    print_uint((unsigned int)(kb_per_sec / 1024));
+    brew_str(".");
+    print_uint((unsigned int)((kb_per_sec % 1024) * 10 / 1024));
+    brew_str(" MB/s\n");
+}
+
+static void handle_diskbench(const char* command_buffer) {
+    brew_str("\n");
+    const char* arg = command_buffer + 9;  // Skip "DISKBENCH"
+    while (*arg == ' ') arg++;
+
+    // Optional device name, then optional queue depth
+    char name[8];
+    int len = 0;
+    while (*arg && *arg != ' ' && len < 7) {
+        name[len++] = *arg++;
+    }
+    name[len] = '\0';
+    while (*arg == ' ') arg++;
+
+    int depth = 0;
+    while (*arg >= '0' && *arg <= '9') {
+        depth = depth * 10 + (*arg++ - '0');
+    }
+    if (depth < 1 || depth > BENCH_DEPTH) {
+        depth = BENCH_DEPTH;
+    }
+
+    block_device_t* dev = len ? block_find_device(name) : block_get_device(0);
+    if (!dev) {
+        brew_str("No such block device. Use DISKINFO to list devices.\n");
+        return;
+    }
+    if (dev->sector_count < BENCH_IO_SECTORS) {
+        brew_str("Device too small.\n");
+        return;
+    }
+
+    uint8_t* buffers = (uint8_t*)fs_allocate_aligned(BENCH_DEPTH * BENCH_IO_SECTORS * BLOCK_SECTOR_SIZE, 4096);
+    if (!buffers) {
+        brew_str("Out of memory.\n");
+        return;
+    }
+
+    brew_str("Benchmarking ");
+    brew_str(dev->name);
+    brew_str(" (4KB reads, queue depth ");
+    print_uint((unsigned int)depth);
+    brew_str(")\n");
+
+    uint64_t cycles = disk_bench_run(dev, buffers, depth, 0, BENCH_SEQ_OPS);
+    if (cycles) {
+        disk_bench_report("  Sequential: ", BENCH_SEQ_OPS, cycles);
+    } else {
+        brew_str("  Sequential: I/O error\n");
+    }
+
+    cycles = disk_bench_run(dev, buffers, depth, 1, BENCH_RANDOM_OPS);
+    if (cycles) {
+        disk_bench_report("  Random:     ", BENCH_RANDOM_OPS, cycles);
+    } else {
+        brew_str("  Random: I/O error\n");
+    }
+
+    fs_free_aligned(buffers);
+}
+
+static void handle_mount(const char* command_buffer) {
+    brew_str("\n");
+    const char* arg = command_buffer + 5;  // Skip "MOUNT"
+    while (*arg == ' ') arg++;
+
+    if (*arg == '\0') {
+        if (!fat32_is_mounted()) {
+            brew_str("No volume mounted. Usage: MOUNT <device>\n");
+            return;
+        }
+        brew_str(fat32_get_device()->name);
+        brew_str(" (FAT32) on " FS_MOUNT_POINT ", ");
+        print_uint((unsigned int)(fat32_get_free_bytes() / (1024 * 1024)));
+        brew_str(" MB free\n");
+
+        fat32_stats_t stats;
+        fat32_get_stats(&stats);
+        brew_str("  Extent cache: ");
+        print_uint(stats.extent_hits);
+        brew_str(" hits, ");
+        print_uint(stats.extent_misses);
+        brew_str(" misses\n  Directory index: ");
+        print_uint(stats.dir_index_hits);
+        brew_str(" hits, ");
+        print_uint(stats.dir_index_builds);
+        brew_str(" builds\n  FAT sectors written: ");
+        print_uint(stats.fat_sectors_written);
+        brew_str("\n");
+        return;
+    }
+
+    block_device_t* dev = block_find_device(arg);
+    if (!dev) {
+        brew_str("No such block device. Use DISKINFO to list devices.\n");
+        return;
+    }
+    if (fat32_is_mounted()) {
+        fs_unmount();
+    }
+    if (!fs_mount(dev)) {
+        brew_str("No FAT32 volume found on ");
+        brew_str(dev->name);
+        brew_str("\n");
+        return;
+    }
+    brew_str("Mounted ");
+    brew_str(dev->name);
+    brew_str(" on " FS_MOUNT_POINT "\n");
+}
+
+static void handle_persist(const char* command_buffer) {
+    brew_str("\n");
+    const char* arg = command_buffer + 7;  // Skip "PERSIST"
+    while (*arg == ' ') arg++;
+
+    if (*arg == '\0') {
+        block_device_t* dev = fslog_get_device();
+        if (!dev) {
+            brew_str("Filesystem is not persistent. Usage: PERSIST <device> [FORCE]\n");
+            return;
+        }
+        fslog_stats_t stats;
+        fslog_get_stats(&stats);
+        brew_str("Filesystem log on ");
+        brew_str(dev->name);
+        brew_str("\n  Syncs: ");
+        print_uint(stats.syncs);
+        brew_str("  Records: ");
+        print_uint(stats.records);
+        brew_str("  Checkpoints: ");
+        print_uint(stats.checkpoints);
+        brew_str("\n  Written: ");
+        print_uint(stats.sectors_written / 2);
+        brew_str(" KB  Replayed at boot: ");
+        print_uint(stats.replayed_segments);
+        brew_str(" segments, ");
+        print_uint(stats.replayed_records);
+        brew_str(" records\n");
+        if (stats.no_space) {
+            brew_str("  Checkpoints refused for lack of space: ");
+            print_uint(stats.no_space);
+            brew_str("\n");
+        }
+        return;
+    }
+
+    char name[8];
+    int len = 0;
+    while (*arg && *arg != ' ' && len < 7) {
+        name[len++] = *arg++;
+    }
+    name[len] = '\0';
+    while (*arg == ' ') arg++;
+    int force = disk_strncmp(arg, "FORCE", 5) == 0 || disk_strncmp(arg, "force", 5) == 0;
+
+    block_device_t* dev = block_find_device(name);
+    if (!dev) {
+        brew_str("No such block device. Use DISKINFO to list devices.\n");
+        return;
+    }
+    if (dev == fat32_get_device()) {
+        brew_str("Device is mounted on " FS_MOUNT_POINT ". UMOUNT it first.\n");
+        return;
+    }
+
+    // Refuse to overwrite something that looks like a boot sector or partition table
+    static uint8_t sector[BLOCK_SECTOR_SIZE] __attribute__((aligned(16)));
+    if (!force && block_read(dev, 0, 1, sector) == 0 && sector[510] == 0x55 && sector[511] == 0xAA) {
+        brew_str("Device holds a partition table or filesystem. Use PERSIST ");
+        brew_str(dev->name);
+        brew_str(" FORCE to overwrite it.\n");
+        return;
+    }
+
+    if (fslog_format(dev) != 0) {
+        brew_str("Failed to write the filesystem log.\n");
+        return;
+    }
+    brew_str("Filesystem is now saved to ");
+    brew_str(dev->name);
+    brew_str(". Use SYNC to write changes.\n");
+}
+
+int disk_handle_command(const char* cmd_upper, const char* command_buffer, int* return_to_prompt) {
+    (void)return_to_prompt;
+
+    if (disk_strcmp(cmd_upper, "DISKINFO") == 0) {
+        handle_diskinfo();
+        return 1;
+    }
+    if (disk_strcmp(cmd_upper, "DISKBENCH") == 0 || disk_strncmp(cmd_upper, "DISKBENCH ", 10) == 0) {
+        handle_diskbench(command_buffer);
+        return 1;
+    }
+    if (disk_strcmp(cmd_upper, "MOUNT") == 0 || disk_strncmp(cmd_upper, "MOUNT ", 6) == 0) {
+        handle_mount(command_buffer);
+        return 1;
+    }
+    if (disk_strcmp(cmd_upper, "PERSIST") == 0 || disk_strncmp(cmd_upper, "PERSIST ", 8) == 0) {
+        handle_persist(command_buffer);
+        return 1;
+    }
+    if (disk_strcmp(cmd_upper, "SYNC") == 0) {
+        int rc;
+        brew_str("\n");
+        if (fat32_is_mounted() && fat32_sync() != 0) {
+            brew_str("Error writing " FS_MOUNT_POINT "\n");
+        }
+        if (!fslog_get_device()) {
+            brew_str("Filesystem is not persistent. Use PERSIST <device> first.\n");
+        } else if ((rc = fslog_sync()) == FSLOG_NO_SPACE) {
+            brew_str("Filesystem too large for the log region; remove files and SYNC again.\n");
+        } else if (rc != 0) {
+            brew_str("Error writing the filesystem log.\n");
+        } else {
+            brew_str("Filesystem synced.\n");
+        }
+        return 1;
+    }
+    if (disk_strcmp(cmd_upper, "UMOUNT") == 0) {
+        brew_str("\n");
+        if (!fat32_is_mounted()) {
+            brew_str("No volume mounted.\n");
+        } else {
+            fs_unmount();
+            brew_str("Volume synced and unmounted.\n");
+        }
+        return 1;
+    }
+    return 0;
+}
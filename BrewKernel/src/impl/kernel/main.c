@@ -44,14 +44,19 @@
 #include "APPS/about_dump.h"
 #include "memory.h"
 #include "filesys.h"
+#include "fslog.h"
 #include "pic.h"
 #include "irq.h"
+#include "apic.h"
 #include "timer.h"
 #include "pci.h"
 #include "network.h"
 #include "e1000.h"
 #include "network_cli.h"
 #include "shell_cli.h"
+#include "block.h"
+#include "disk_cli.h"
+#include "cmdline.h"
 #include "APPS/calc.h"
 
 // External assembly function to initialize IDT
@@ -312,27 +317,31 @@ static void process_command(void) {
                             p++;
                         }
                         
-                        // Send UDP packet(s) with file content (chunked if necessary)
-                        const size_t chunk_size = 512;
+                        // Send UDP packet(s) with file content, as much per packet as the MTU allows
+                        const size_t chunk_size = network_get_mtu() - sizeof(ipv4_header_t) - sizeof(udp_header_t);
                         size_t offset = 0;
                         int chunk_count = 0;
                         int sent_bytes = 0;
                         
+                        udp_socket_t sock;
+                        udp_socket_connect(&sock, &dest_ip, (uint16_t)port, 54321);
+                        network_tx_batch_begin();
                         while (offset < file_size) {
                             size_t to_send = file_size - offset;
                             if (to_send > chunk_size) {
                                 to_send = chunk_size;
                             }
                             
-                            // Send directly from file content pointer
-                            int result = udp_send_packet(&dest_ip, (uint16_t)port, 54321, 
-                                                        (const void*)(file_content + offset), to_send);
+                            // Send directly from file content pointer (no payload copy)
+                            int result = udp_socket_send_ref(&sock, (const void*)(file_content + offset), to_send);
                             if (result == 0) {
                                 chunk_count++;
                                 sent_bytes += to_send;
                             }
                             offset += to_send;
                         }
+                        network_tx_batch_end();
+                        network_tx_flush();  // The file buffer is read by the NIC
                         
                         if (sent_bytes > 0) {
                             brew_str("UDP packets sent successfully (");
@@ -594,6 +603,8 @@ static void process_command(void) {
     }
     else if (net_handle_command(cmd_upper, command_buffer, (int*)&return_to_prompt)) {
     }
+    else if (disk_handle_command(cmd_upper, command_buffer, (int*)&return_to_prompt)) {
+    }
     else if (strcmp_kernel(cmd_upper, "EXIT") == 0) {
         shutdown_command();
         
@@ -664,6 +675,17 @@ static void process_command(void) {
     }
 }
 
+// Halt until the next interrupt unless the NIC already has work queued.
+// "sti; hlt" is atomic, so an interrupt arriving after the check still wakes us.
+static void idle_wait(void) {
+    __asm__ __volatile__("cli");
+    if (network_poll_pending()) {
+        __asm__ __volatile__("sti");
+        return;
+    }
+    __asm__ __volatile__("sti; hlt");
+}
+
 void kernel_main(void* multiboot_info) {
     print_clear();
     
@@ -671,11 +693,18 @@ void kernel_main(void* multiboot_info) {
     init_idt();                      
     pic_init();                           
     irq_init();                            
+    lapic_init();                    // For MSI/MSI-X vectors, if present
     timer_init(TIMER_FREQUENCY);           
+    pic_irq_enable(IRQ0_TIMER);      // Timer and keyboard wake the idle loop
+    pic_irq_enable(IRQ1_KEYBOARD);
     
     __asm__ __volatile__("sti");
+    cmdline_init(multiboot_info);
     sys_memory_init(multiboot_info);
     fs_init();
+    block_init();  // Probe disks (IDE DMA)
+    fslog_init();    // Replay the persistent ramfs log, if a disk has one
+    fs_mount(NULL);  // Mount the first FAT32 disk on /mnt
     init_uptime();
     create_log_txt_file();  // Generate system log at boot
     // these colors might not be accurate since other parts can modify the palette.. (i know this is cursed but i'm lazy and it works)
@@ -755,10 +784,8 @@ void kernel_main(void* multiboot_info) {
 #endif
 
     while (1) {
-        // Process network frames continuously
-        for (int i = 0; i < 10; i++) {
-            network_process_frames();
-        }
+        // Service the NIC if its interrupt left work behind
+        network_process_frames();
         net_check_udp_received();  // Check for and print UDP receive notifications
         
         if (check_keyboard()) {
@@ -806,9 +833,7 @@ void kernel_main(void* multiboot_info) {
                         }
                         
                         // Process network frames after command execution
-                        for (int i = 0; i < 10; i++) {
-                            network_process_frames();
-                        }
+                        network_process_frames();
                         net_check_udp_received();
                     } else if (buffer_pos < sizeof(command_buffer) - 1) {
                         history_current = -1;
@@ -819,6 +844,8 @@ void kernel_main(void* multiboot_info) {
             }
             
             brewing(10000000); 
+        } else {
+            idle_wait();
         }
     }
 }
@@ -211,6 +211,24 @@ void fs_free(void* ptr) {
     coalesce_blocks();
 }
 
+void* fs_allocate_aligned(size_t size, size_t align) {
+    if (align < ALIGNMENT) align = ALIGNMENT;
+    if ((align & (align - 1)) != 0) return NULL;
+
+    // Over-allocate and keep the original pointer just below the aligned block
+    char* raw = (char*)fs_allocate(size + align + sizeof(void*));
+    if (!raw) return NULL;
+
+    uintptr_t aligned = ((uintptr_t)raw + sizeof(void*) + align - 1) & ~(uintptr_t)(align - 1);
+    ((void**)aligned)[-1] = raw;
+    return (void*)aligned;
+}
+
+void fs_free_aligned(void* ptr) {
+    if (!ptr) return;
+    fs_free(((void**)ptr)[-1]);
+}
+
 // Get memory statistics
 size_t fs_get_total_memory(void) {
     return MEMORY_SIZE;
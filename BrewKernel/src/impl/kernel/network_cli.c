@@ -20,6 +20,12 @@
 #include "network.h"
 #include "pci.h"
 #include "e1000.h"
+#include "e1000e.h"
+#include "irq.h"
+#include "virtio_net.h"
+#include "pbuf.h"
+#include "route.h"
+#include "timer.h"
 #include "network_cli.h"
 
 static int strcmp_kernel_cli(const char *s1, const char *s2) {
@@ -191,6 +197,9 @@ static void handle_netinfo(void) {
 		} else {
 			brew_str("Network: Initialized (MAC address unavailable)\n");
 		}
+		brew_str("Driver: ");
+		brew_str(network_get_driver());
+		brew_str("\n");
 		if (network_get_ipv4_address(&ip) == 0) {
 			brew_str("IP Address: ");
 			char num[4];
@@ -271,7 +280,7 @@ static void handle_netinfo(void) {
 		}
 		num[pos] = '\0';
 		brew_str(num);
-		brew_str("\n  e1000 receive calls: ");
+		brew_str("\n  Driver receive calls: ");
 		int e1000_calls = network_get_e1000_receive_calls();
 		pos = 0;
 		if (e1000_calls == 0) {
@@ -290,7 +299,7 @@ static void handle_netinfo(void) {
 		}
 		num[pos] = '\0';
 		brew_str(num);
-		brew_str("\n  e1000 receive empty: ");
+		brew_str("\n  Driver receive empty: ");
 		int e1000_empty = network_get_e1000_receive_empty();
 		pos = 0;
 		if (e1000_empty == 0) {
@@ -328,6 +337,268 @@ static void handle_netinfo(void) {
 		}
 		num[pos] = '\0';
 		brew_str(num);
+		e1000_device_t* nic = e1000_get_device();
+		if (nic) {
+			brew_str("\n  Link: ");
+			brew_str(nic->link_up ? "up" : "down");
+			if (nic->msi_vector >= 0) {
+				brew_str("  Mode: MSI (vector ");
+				print_uint(nic->msi_vector);
+				brew_str(")");
+			} else {
+				brew_str(nic->irq_enabled ? "  Mode: interrupt (IRQ " : "  Mode: polled");
+				if (nic->irq_enabled) {
+					print_uint(nic->irq);
+					brew_str(")");
+				}
+			}
+			brew_str("\n  RX filter: ");
+			if (nic->promisc) {
+				brew_str("promiscuous");
+			} else {
+				brew_str("own address + ");
+				print_uint(nic->mcast_count);
+				brew_str(" multicast groups");
+			}
+			brew_str("\n  MTU: ");
+			print_uint(nic->mtu);
+			brew_str("  Jumbo frames received: ");
+			print_uint(nic->stat_rx_jumbo);
+			brew_str("  Oversize: ");
+			print_uint(nic->stat_rx_oversize);
+			brew_str("\n  Rings: TX ");
+			print_uint(nic->tx_ring_size);
+			brew_str("  RX ");
+			print_uint(nic->rx_ring_size);
+			brew_str("\n  Interrupts: ");
+			print_uint(nic->stat_irqs);
+			brew_str("  Polls: ");
+			print_uint(nic->stat_polls);
+			brew_str("  Budget exhausted: ");
+			print_uint(nic->stat_budget_exhausted);
+			brew_str("  ITR: ");
+			print_uint(nic->itr_current);
+			brew_str(nic->moderation.adaptive ? "/s (adaptive, " : "/s (fixed, ");
+			print_uint(nic->stat_itr_changes);
+			brew_str(" changes)");
+			// Each register access traps under virtualization, and so does
+			// every interrupt (injection plus the PIC EOI)
+			uint32_t exits = e1000_mmio_accesses + nic->stat_irqs * 2;
+			uint32_t frames_total = nic->stat_rx_frames + nic->stat_tx_frames;
+			brew_str("\n  MMIO accesses: ");
+			print_uint(e1000_mmio_accesses);
+			brew_str("  Est. VM exits: ");
+			print_uint(exits);
+			if (frames_total) {
+				brew_str(" (");
+				print_uint((uint32_t)((uint64_t)exits * 100 / frames_total));
+				brew_str(" per 100 frames)");
+			}
+			brew_str("\n  TX ring full: ");
+			print_uint(nic->stat_tx_ring_full);
+			brew_str("  Reclaimed: ");
+			print_uint(nic->stat_tx_reclaimed);
+			brew_str("  Queued: ");
+			print_uint(nic->stat_tx_queued);
+			brew_str("  Dropped: ");
+			print_uint(nic->stat_tx_dropped);
+			brew_str("\n  TX frames: ");
+			print_uint(nic->stat_tx_frames);
+			brew_str(" (");
+			print_uint(nic->stat_tx_doorbells);
+			brew_str(" TDT writes, ");
+			print_uint(nic->stat_tx_sg_refs);
+			brew_str(" zero-copy segments)\n  RX frames: ");
+			print_uint(nic->stat_rx_frames);
+			brew_str(" (");
+			print_uint(nic->stat_rx_doorbells);
+			brew_str(" RDT writes)");
+			brew_str("\n  RX zero-copy: ");
+			print_uint(nic->stat_rx_loaned);
+			brew_str("  Starved: ");
+			print_uint(nic->stat_rx_loan_starved);
+			pbuf_stats_t pst;
+			pbuf_get_stats(&pst);
+			brew_str("\n  Buffers: ");
+			print_uint(pst.in_use);
+			brew_str("/");
+			print_uint(pst.total);
+			brew_str(" in use  High water: ");
+			print_uint(pst.high_water);
+			brew_str("  Exhausted: ");
+			print_uint(pst.exhausted);
+			if (pst.jumbo_total) {
+				brew_str("\n  Jumbo buffers: ");
+				print_uint(pst.jumbo_total - pst.jumbo_free);
+				brew_str("/");
+				print_uint(pst.jumbo_total);
+				brew_str(" in use  Exhausted: ");
+				print_uint(pst.jumbo_exhausted);
+			}
+			uint32_t tx_sw, rx_sw, rx_bad;
+			network_get_csum_stats(&tx_sw, &rx_sw, &rx_bad);
+			brew_str("\n  Checksum offload: ");
+			brew_str(nic->csum_offload ? "on" : "off");
+			brew_str("  TX hw: ");
+			print_uint(nic->stat_tx_csum_hw);
+			brew_str("  TX sw: ");
+			print_uint(nic->stat_tx_csum_sw + tx_sw);
+			brew_str("\n  RX verified: ");
+			print_uint(nic->stat_rx_csum_ok);
+			brew_str("  RX bad: ");
+			print_uint(nic->stat_rx_csum_bad);
+			brew_str("  RX sw: ");
+			print_uint(rx_sw);
+			brew_str("  Dropped: ");
+			print_uint(rx_bad);
+			brew_str("\n  TX policy: ");
+			if (nic->tx_policy == E1000_TX_FAIL) {
+				brew_str("fail");
+			} else if (nic->tx_policy == E1000_TX_SPIN) {
+				brew_str("spin (budget ");
+				print_uint(nic->tx_spin_budget);
+				brew_str(")");
+			} else {
+				brew_str("queue");
+			}
+		}
+		virtio_net_t* vn = virtio_net_get_device();
+		if (vn) {
+			brew_str("\n  Link: ");
+			if (vn->vdev.features & VIRTIO_NET_F_STATUS) {
+				uint16_t status = virtio_config_read16(&vn->vdev, VIRTIO_NET_CFG_STATUS);
+				brew_str((status & VIRTIO_NET_S_LINK_UP) ? "up" : "down");
+			} else {
+				brew_str("up");
+			}
+			if (vn->vdev.vector >= 0) {
+				brew_str("  Mode: MSI-X (vector ");
+				print_uint(vn->vdev.vector);
+				brew_str(")");
+			} else {
+				brew_str(vn->irq_enabled ? "  Mode: interrupt (IRQ " : "  Mode: polled");
+				if (vn->irq_enabled) {
+					print_uint(vn->irq);
+					brew_str(")");
+				}
+			}
+			brew_str("\n  Queue pairs: ");
+			print_uint(vn->pairs);
+			brew_str(" of ");
+			print_uint(vn->max_pairs);
+			brew_str("  Ring: ");
+			print_uint(vn->rxq[0].vq.size);
+			brew_str("\n  MTU: ");
+			print_uint(vn->mtu);
+			brew_str("  Mergeable RX buffers: ");
+			brew_str(vn->mrg_rxbuf ? "on" : "off");
+			brew_str("  Event index: ");
+			brew_str((vn->vdev.features & VIRTIO_RING_F_EVENT_IDX) ? "on" : "off");
+			uint32_t notifies, suppressed;
+			virtio_net_get_kick_stats(&notifies, &suppressed);
+			brew_str("\n  Interrupts: ");
+			print_uint(vn->stat_irqs);
+			brew_str("  Polls: ");
+			print_uint(vn->stat_polls);
+			brew_str("  Notifies: ");
+			print_uint(notifies);
+			brew_str("  Suppressed: ");
+			print_uint(suppressed);
+			brew_str("\n  TX frames: ");
+			print_uint(vn->stat_tx_frames);
+			brew_str(" (");
+			print_uint(vn->stat_tx_sg_refs);
+			brew_str(" zero-copy segments)  Ring full: ");
+			print_uint(vn->stat_tx_ring_full);
+			brew_str("\n  RX frames: ");
+			print_uint(vn->stat_rx_frames);
+			brew_str("  Merged: ");
+			print_uint(vn->stat_rx_merged);
+			brew_str("  Dropped: ");
+			print_uint(vn->stat_rx_dropped);
+			brew_str("  Starved: ");
+			print_uint(vn->stat_rx_starved);
+			uint32_t tx_sw, rx_sw, rx_bad;
+			network_get_csum_stats(&tx_sw, &rx_sw, &rx_bad);
+			brew_str("\n  Checksum offload: ");
+			brew_str(vn->csum_offload ? "on" : "off");
+			brew_str("  TX hw: ");
+			print_uint(vn->stat_tx_csum_hw);
+			brew_str("  TX sw: ");
+			print_uint(tx_sw);
+			brew_str("\n  RX verified: ");
+			print_uint(vn->stat_rx_csum_ok);
+			brew_str("  RX sw: ");
+			print_uint(rx_sw);
+			brew_str("  Dropped: ");
+			print_uint(rx_bad);
+		}
+		e1000e_device_t* ne = e1000e_get_device();
+		if (ne) {
+			brew_str("\n  Link: ");
+			brew_str(ne->link_up ? "up" : "down");
+			if (ne->msix) {
+				brew_str("  Mode: MSI-X");
+			} else if (ne->irq_enabled) {
+				brew_str("  Mode: interrupt (IRQ ");
+				print_uint(ne->irq);
+				brew_str(")");
+			} else {
+				brew_str("  Mode: polled");
+			}
+			brew_str("  RSS: ");
+			brew_str(ne->rss ? "on" : "off");
+			brew_str("  Ring: ");
+			print_uint(ne->rxq[0].size);
+			for (int q = 0; q < E1000E_RX_QUEUES; q++) {
+				brew_str("\n  RX queue ");
+				print_uint(q);
+				brew_str(": ");
+				print_uint(ne->rxq[q].stat_frames);
+				brew_str(" frames  Doorbells: ");
+				print_uint(ne->rxq[q].stat_doorbells);
+				brew_str("  Starved: ");
+				print_uint(ne->rxq[q].stat_starved);
+				if (ne->msix) {
+					brew_str("  Vector ");
+					print_uint(ne->rxq[q].vector);
+					brew_str(": ");
+					print_uint(irq_vector_count(ne->rxq[q].vector));
+				}
+			}
+			brew_str("\n  TX frames: ");
+			print_uint(ne->stat_tx_frames);
+			brew_str(" (");
+			print_uint(ne->stat_tx_sg_refs);
+			brew_str(" zero-copy segments)  Doorbells: ");
+			print_uint(ne->stat_tx_doorbells);
+			brew_str("  Ring full: ");
+			print_uint(ne->stat_tx_ring_full);
+			brew_str("  Dropped: ");
+			print_uint(ne->stat_tx_dropped);
+			if (ne->msix) {
+				brew_str("\n  TX vector ");
+				print_uint(ne->tx_vector);
+				brew_str(": ");
+				print_uint(irq_vector_count(ne->tx_vector));
+				brew_str("  Link vector ");
+				print_uint(ne->other_vector);
+				brew_str(": ");
+				print_uint(irq_vector_count(ne->other_vector));
+			}
+			brew_str("\n  Interrupts: ");
+			print_uint(ne->stat_irqs);
+			brew_str("  Polls: ");
+			print_uint(ne->stat_polls);
+			brew_str("\n  Checksum offload: ");
+			brew_str(ne->csum_offload ? "on" : "off");
+			brew_str("  TX hw: ");
+			print_uint(ne->stat_tx_csum_hw);
+			brew_str("  RX verified: ");
+			print_uint(ne->stat_rx_csum_ok);
+			brew_str("  RX bad: ");
+			print_uint(ne->stat_rx_csum_bad);
+		}
 		brew_str("\n");
 	} else {
 		brew_str("Network: Not initialized\n");
@@ -344,7 +615,11 @@ static void handle_netinit(void) {
 	brew_str("Initializing network...\n");
 
 	pci_device_t device;
-	if (pci_find_device(E1000_VENDOR_ID, E1000_DEVICE_ID_82540EM, &device)) {
+	if (pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_DEVICE_NET_LEGACY, &device)) {
+		brew_str("Found virtio-net device\n");
+	} else if (pci_find_device(E1000_VENDOR_ID, E1000E_DEVICE_ID_82574L, &device)) {
+		brew_str("Found e1000e (82574L) device\n");
+	} else if (pci_find_device(E1000_VENDOR_ID, E1000_DEVICE_ID_82540EM, &device)) {
 		uint32_t bar0 = pci_read_config(device.bus, device.device, device.function, 0x10);
 		brew_str("Found e1000 device\n");
 		brew_str("BAR0: 0x");
@@ -373,7 +648,7 @@ static void handle_netinit(void) {
 			}
 		}
 	} else {
-		brew_str("e1000 device not found\n");
+		brew_str("No virtio-net, e1000e or e1000 device found\n");
 		return;
 	}
 	if (network_init() == 0) {
@@ -563,6 +838,452 @@ static void handle_udpsend(const char* command_buffer) {
 	}
 }
 
+static void handle_txpolicy(const char* command_buffer) {
+	brew_str("\n");
+	if (!network_is_initialized()) {
+		brew_str("Network not initialized\n");
+		return;
+	}
+	if (!e1000_get_device()) {
+		brew_str("Only supported by the e1000 driver\n");
+		return;
+	}
+	const char* p = command_buffer + 8;  // Skip "TXPOLICY"
+	while (*p == ' ') p++;
+
+	char mode[8];
+	int len = 0;
+	while (*p && *p != ' ' && len < 7) {
+		mode[len++] = (*p >= 'a' && *p <= 'z') ? (char)(*p - 32) : *p;
+		p++;
+	}
+	mode[len] = '\0';
+	while (*p == ' ') p++;
+	uint32_t budget = 0;
+	while (*p >= '0' && *p <= '9') {
+		budget = budget * 10 + (uint32_t)(*p - '0');
+		p++;
+	}
+
+	if (strcmp_kernel_cli(mode, "FAIL") == 0) {
+		e1000_set_tx_policy(E1000_TX_FAIL, 0);
+	} else if (strcmp_kernel_cli(mode, "SPIN") == 0) {
+		e1000_set_tx_policy(E1000_TX_SPIN, budget);
+	} else if (strcmp_kernel_cli(mode, "QUEUE") == 0) {
+		e1000_set_tx_policy(E1000_TX_QUEUE, 0);
+	} else {
+		brew_str("Usage: TXPOLICY FAIL | SPIN [budget] | QUEUE\n");
+		return;
+	}
+	brew_str("TX ring full policy set\n");
+}
+
+static void handle_netring(const char* command_buffer) {
+	brew_str("\n");
+	if (!network_is_initialized()) {
+		brew_str("Network not initialized\n");
+		return;
+	}
+	if (!e1000_get_device()) {
+		brew_str("Only supported by the e1000 driver\n");
+		return;
+	}
+	const char* p = command_buffer + 7;  // Skip "NETRING"
+	uint32_t sizes[2] = {0, 0};
+	int count = 0;
+	while (count < 2) {
+		while (*p == ' ') p++;
+		if (*p < '0' || *p > '9') break;
+		while (*p >= '0' && *p <= '9') {
+			sizes[count] = sizes[count] * 10 + (uint32_t)(*p - '0');
+			p++;
+		}
+		count++;
+	}
+
+	e1000_device_t* nic = e1000_get_device();
+	if (count == 2) {
+		if (e1000_set_ring_sizes(sizes[0], sizes[1]) != 0) {
+			brew_str("Resize failed (out of memory or NIC busy); rings unchanged\n");
+		}
+	} else if (count != 0 || *p) {
+		brew_str("Usage: NETRING [<tx> <rx>] (");
+		print_uint(E1000_RING_MIN);
+		brew_str("-");
+		print_uint(E1000_RING_MAX);
+		brew_str(" descriptors)\n");
+		return;
+	}
+	brew_str("TX ring: ");
+	print_uint(nic->tx_ring_size);
+	brew_str("  RX ring: ");
+	print_uint(nic->rx_ring_size);
+	brew_str(" descriptors\n");
+}
+
+static void handle_netmtu(const char* command_buffer) {
+	brew_str("\n");
+	if (!network_is_initialized()) {
+		brew_str("Network not initialized\n");
+		return;
+	}
+	const char* p = command_buffer + 6;  // Skip "NETMTU"
+	while (*p == ' ') p++;
+	uint32_t mtu = 0;
+	int digits = 0;
+	while (*p >= '0' && *p <= '9' && digits < 6) {
+		mtu = mtu * 10 + (uint32_t)(*p - '0');
+		p++;
+		digits++;
+	}
+	while (*p == ' ') p++;
+
+	if (digits > 0 && *p == '\0') {
+		if (mtu < ETH_MTU_MIN || mtu > ETH_MTU_MAX) {
+			brew_str("MTU must be ");
+			print_uint(ETH_MTU_MIN);
+			brew_str("-");
+			print_uint(ETH_MTU_MAX);
+			brew_str("\n");
+			return;
+		}
+		if (network_set_mtu((uint16_t)mtu) != 0) {
+			brew_str("Could not change the MTU (out of memory or TX busy)\n");
+		}
+	} else if (digits > 0 || *p) {
+		brew_str("Usage: NETMTU [<mtu>]\n");
+		return;
+	}
+	brew_str("MTU: ");
+	print_uint(network_get_mtu());
+	brew_str(" bytes\n");
+}
+
+static void handle_netmod(const char* command_buffer) {
+	brew_str("\n");
+	if (!network_is_initialized()) {
+		brew_str("Network not initialized\n");
+		return;
+	}
+	if (!e1000_get_device()) {
+		brew_str("Only supported by the e1000 driver\n");
+		return;
+	}
+	const char* p = command_buffer + 6;  // Skip "NETMOD"
+	while (*p == ' ') p++;
+
+	char key[10];
+	int len = 0;
+	while (*p && *p != ' ' && len < 9) {
+		key[len++] = (*p >= 'a' && *p <= 'z') ? (char)(*p - 32) : *p;
+		p++;
+	}
+	key[len] = '\0';
+	while (*p == ' ') p++;
+	uint32_t value = 0;
+	int digits = 0;
+	while (*p >= '0' && *p <= '9' && digits < 9) {
+		value = value * 10 + (uint32_t)(*p - '0');
+		p++;
+		digits++;
+	}
+	uint32_t delay = value > E1000_DELAY_MAX ? E1000_DELAY_MAX : value;
+
+	e1000_moderation_t mod;
+	e1000_get_moderation(&mod);
+	if (len == 0) {
+		// Show only
+	} else if (strcmp_kernel_cli(key, "ADAPTIVE") == 0 && digits == 0) {
+		mod.adaptive = 1;
+	} else if (strcmp_kernel_cli(key, "ITR") == 0 && digits > 0) {
+		mod.itr = value;
+		mod.adaptive = 0;
+	} else if (strcmp_kernel_cli(key, "RDTR") == 0 && digits > 0) {
+		mod.rdtr = (uint16_t)delay;
+	} else if (strcmp_kernel_cli(key, "RADV") == 0 && digits > 0) {
+		mod.radv = (uint16_t)delay;
+	} else if (strcmp_kernel_cli(key, "TIDV") == 0 && digits > 0) {
+		mod.tidv = (uint16_t)delay;
+	} else if (strcmp_kernel_cli(key, "TADV") == 0 && digits > 0) {
+		mod.tadv = (uint16_t)delay;
+	} else {
+		brew_str("Usage: NETMOD [ADAPTIVE | ITR <irqs/s> | RDTR|RADV|TIDV|TADV <usecs>]\n");
+		return;
+	}
+	if (len != 0) {
+		e1000_set_moderation(&mod);
+	}
+
+	e1000_device_t* nic = e1000_get_device();
+	brew_str("ITR: ");
+	if (mod.adaptive) {
+		brew_str("adaptive, now ");
+	}
+	if (nic->itr_current) {
+		print_uint(nic->itr_current);
+		brew_str(" irqs/s");
+	} else {
+		brew_str("unthrottled");
+	}
+	brew_str("\nRX delay: ");
+	print_uint(mod.rdtr);
+	brew_str(" us (absolute ");
+	print_uint(mod.radv);
+	brew_str(" us)  TX delay: ");
+	print_uint(mod.tidv);
+	brew_str(" us (absolute ");
+	print_uint(mod.tadv);
+	brew_str(" us)\n");
+}
+
+static void handle_netpromisc(const char* command_buffer) {
+	brew_str("\n");
+	if (!network_is_initialized()) {
+		brew_str("Network not initialized\n");
+		return;
+	}
+	if (!e1000_get_device()) {
+		brew_str("Only supported by the e1000 driver\n");
+		return;
+	}
+	const char* p = command_buffer + 10;  // Skip "NETPROMISC"
+	while (*p == ' ') p++;
+
+	char mode[4];
+	int len = 0;
+	while (*p && *p != ' ' && len < 3) {
+		mode[len++] = (*p >= 'a' && *p <= 'z') ? (char)(*p - 32) : *p;
+		p++;
+	}
+	mode[len] = '\0';
+
+	if (strcmp_kernel_cli(mode, "ON") == 0) {
+		e1000_set_promisc(1);
+	} else if (strcmp_kernel_cli(mode, "OFF") == 0) {
+		e1000_set_promisc(0);
+	} else if (len != 0) {
+		brew_str("Usage: NETPROMISC [ON | OFF]\n");
+		return;
+	}
+	brew_str("Promiscuous mode: ");
+	brew_str(e1000_get_device()->promisc ? "on\n" : "off\n");
+}
+
+static void print_ipv4_cli(const ipv4_address_t* ip) {
+	for (int i = 0; i < 4; i++) {
+		if (i > 0) brew_str(".");
+		print_uint(ip->bytes[i]);
+	}
+}
+
+static void print_mac_cli(const mac_address_t* mac) {
+	char hex[] = "0123456789ABCDEF";
+	for (int i = 0; i < 6; i++) {
+		if (i > 0) brew_str(":");
+		char digits[3] = {hex[(mac->bytes[i] >> 4) & 0xF], hex[mac->bytes[i] & 0xF], '\0'};
+		brew_str(digits);
+	}
+}
+
+static void handle_arp(const char* command_buffer) {
+	brew_str("\n");
+	if (!network_is_initialized()) {
+		brew_str("Network not initialized\n");
+		return;
+	}
+	const char* p = command_buffer + 3;  // Skip "ARP"
+	while (*p == ' ') p++;
+	if (*p) {
+		if ((p[0] == 'F' || p[0] == 'f') && (p[1] == 'L' || p[1] == 'l') &&
+		    (p[2] == 'U' || p[2] == 'u') && (p[3] == 'S' || p[3] == 's') &&
+		    (p[4] == 'H' || p[4] == 'h') && (p[5] == '\0' || p[5] == ' ')) {
+			arp_flush();
+			brew_str("ARP table flushed\n");
+		} else {
+			brew_str("Usage: ARP [FLUSH]\n");
+		}
+		return;
+	}
+
+	uint64_t now = timer_get_ticks();
+	int count = 0;
+	for (int i = 0; i < ARP_TABLE_SIZE; i++) {
+		arp_entry_t entry;
+		if (arp_get_entry(i, &entry) != 0) {
+			continue;
+		}
+		count++;
+		brew_str("  ");
+		print_ipv4_cli(&entry.ip);
+		brew_str("  ");
+		if (entry.state == ARP_STATE_REACHABLE) {
+			print_mac_cli(&entry.mac);
+			brew_str("  reachable, ");
+			print_uint((unsigned int)((now - entry.updated) / TIMER_FREQUENCY));
+			brew_str(" s old\n");
+		} else if (entry.state == ARP_STATE_INCOMPLETE) {
+			brew_str("incomplete, ");
+			print_uint(entry.requests);
+			brew_str(" requests, ");
+			print_uint(entry.queue_len);
+			brew_str(" queued\n");
+		} else {
+			brew_str("failed\n");
+		}
+	}
+	if (count == 0) {
+		brew_str("  (empty)\n");
+	}
+
+	arp_stats_t stats;
+	arp_get_stats(&stats);
+	brew_str("Requests: ");
+	print_uint(stats.requests);
+	brew_str(" (");
+	print_uint(stats.rate_limited);
+	brew_str(" suppressed)  Replies: ");
+	print_uint(stats.replies);
+	brew_str("  Failed: ");
+	print_uint(stats.failed);
+	brew_str("\nQueued: ");
+	print_uint(stats.queued);
+	brew_str("  Released: ");
+	print_uint(stats.released);
+	brew_str("  Dropped: ");
+	print_uint(stats.dropped);
+	brew_str("\nExpired: ");
+	print_uint(stats.expired);
+	brew_str("  Evicted: ");
+	print_uint(stats.evicted);
+	brew_str("\n");
+}
+
+// Parse a dotted quad at *p and advance past it
+static int parse_ipv4_cli(const char** p, ipv4_address_t* ip) {
+	const char* s = *p;
+	for (int i = 0; i < 4; i++) {
+		if (i > 0) {
+			if (*s != '.') return -1;
+			s++;
+		}
+		if (*s < '0' || *s > '9') return -1;
+		int n = 0;
+		while (*s >= '0' && *s <= '9') {
+			n = n * 10 + (*s - '0');
+			if (n > 255) return -1;
+			s++;
+		}
+		ip->bytes[i] = (uint8_t)n;
+	}
+	*p = s;
+	return 0;
+}
+
+// Parse "<net>/<len>" (a bare address means /32)
+static int parse_prefix_cli(const char** p, ipv4_address_t* net, uint8_t* prefix_len) {
+	if (parse_ipv4_cli(p, net) != 0) return -1;
+	*prefix_len = 32;
+	if (**p == '/') {
+		(*p)++;
+		int n = 0;
+		if (**p < '0' || **p > '9') return -1;
+		while (**p >= '0' && **p <= '9') {
+			n = n * 10 + (**p - '0');
+			(*p)++;
+		}
+		if (n > 32) return -1;
+		*prefix_len = (uint8_t)n;
+	}
+	return 0;
+}
+
+static int match_word_cli(const char** p, const char* word) {
+	const char* s = *p;
+	while (*word) {
+		char c = (*s >= 'a' && *s <= 'z') ? (char)(*s - 32) : *s;
+		if (c != *word) return 0;
+		s++;
+		word++;
+	}
+	if (*s != '\0' && *s != ' ') return 0;
+	while (*s == ' ') s++;
+	*p = s;
+	return 1;
+}
+
+static void handle_route(const char* command_buffer) {
+	brew_str("\n");
+	if (!network_is_initialized()) {
+		brew_str("Network not initialized\n");
+		return;
+	}
+	const char* p = command_buffer + 5;  // Skip "ROUTE"
+	while (*p == ' ') p++;
+
+	ipv4_address_t net;
+	ipv4_address_t gateway = {{0, 0, 0, 0}};
+	uint8_t prefix_len;
+	if (match_word_cli(&p, "ADD")) {
+		if (parse_prefix_cli(&p, &net, &prefix_len) != 0) {
+			brew_str("Usage: ROUTE ADD <net>/<len> [<gateway>]\n");
+			return;
+		}
+		while (*p == ' ') p++;
+		if (*p && parse_ipv4_cli(&p, &gateway) != 0) {
+			brew_str("Invalid gateway address\n");
+			return;
+		}
+		if (route_add(&net, prefix_len, &gateway, 0) != 0) {
+			brew_str("Routing table full\n");
+			return;
+		}
+	} else if (match_word_cli(&p, "DEL")) {
+		if (parse_prefix_cli(&p, &net, &prefix_len) != 0) {
+			brew_str("Usage: ROUTE DEL <net>/<len>\n");
+			return;
+		}
+		if (route_del(&net, prefix_len) != 0) {
+			brew_str("No such route\n");
+			return;
+		}
+	} else if (match_word_cli(&p, "FLUSH")) {
+		route_flush(0xFF);
+	} else if (*p) {
+		brew_str("Usage: ROUTE [ADD <net>/<len> [<gateway>] | DEL <net>/<len> | FLUSH]\n");
+		return;
+	}
+
+	int count = 0;
+	for (int i = 0; i < ROUTE_MAX; i++) {
+		route_entry_t route;
+		if (route_get(i, &route) != 0) {
+			continue;
+		}
+		count++;
+		brew_str("  ");
+		if (route.prefix_len == 0) {
+			brew_str("default");
+		} else {
+			print_ipv4_cli(&route.dest);
+			brew_str("/");
+			print_uint(route.prefix_len);
+		}
+		if (route.flags & ROUTE_FLAG_GATEWAY) {
+			brew_str(" via ");
+			print_ipv4_cli(&route.gateway);
+		} else {
+			brew_str(" on-link");
+		}
+		if (route.flags & ROUTE_FLAG_DHCP) {
+			brew_str(" (dhcp)");
+		}
+		brew_str("\n");
+	}
+	if (count == 0) {
+		brew_str("  (no routes; every destination is treated as on-link)\n");
+	}
+}
+
 int net_handle_command(const char* cmd_upper, const char* command_buffer, int* return_to_prompt) {
 	if (strcmp_kernel_cli(cmd_upper, "NETINFO") == 0) {
 		handle_netinfo();
@@ -582,6 +1303,41 @@ int net_handle_command(const char* cmd_upper, const char* command_buffer, int* r
 		handle_udptest(return_to_prompt);
 		return 1;
 	}
+	if (strcmp_kernel_cli(cmd_upper, "TXPOLICY") == 0 ||
+	    (brew_strlen_cli(cmd_upper) > 8 && strncmp_kernel_cli(cmd_upper, "TXPOLICY ", 9) == 0)) {
+		handle_txpolicy(command_buffer);
+		return 1;
+	}
+	if (strcmp_kernel_cli(cmd_upper, "NETRING") == 0 ||
+	    (brew_strlen_cli(cmd_upper) > 7 && strncmp_kernel_cli(cmd_upper, "NETRING ", 8) == 0)) {
+		handle_netring(command_buffer);
+		return 1;
+	}
+	if (strcmp_kernel_cli(cmd_upper, "NETMTU") == 0 ||
+	    (brew_strlen_cli(cmd_upper) > 6 && strncmp_kernel_cli(cmd_upper, "NETMTU ", 7) == 0)) {
+		handle_netmtu(command_buffer);
+		return 1;
+	}
+	if (strcmp_kernel_cli(cmd_upper, "NETMOD") == 0 ||
+	    (brew_strlen_cli(cmd_upper) > 6 && strncmp_kernel_cli(cmd_upper, "NETMOD ", 7) == 0)) {
+		handle_netmod(command_buffer);
+		return 1;
+	}
+	if (strcmp_kernel_cli(cmd_upper, "NETPROMISC") == 0 ||
+	    (brew_strlen_cli(cmd_upper) > 10 && strncmp_kernel_cli(cmd_upper, "NETPROMISC ", 11) == 0)) {
+		handle_netpromisc(command_buffer);
+		return 1;
+	}
+	if (strcmp_kernel_cli(cmd_upper, "ARP") == 0 ||
+	    (brew_strlen_cli(cmd_upper) > 3 && strncmp_kernel_cli(cmd_upper, "ARP ", 4) == 0)) {
+		handle_arp(command_buffer);
+		return 1;
+	}
+	if (strcmp_kernel_cli(cmd_upper, "ROUTE") == 0 ||
+	    (brew_strlen_cli(cmd_upper) > 5 && strncmp_kernel_cli(cmd_upper, "ROUTE ", 6) == 0)) {
+		handle_route(command_buffer);
+		return 1;
+	}
 	if (strcmp_kernel_cli(cmd_upper, "UDPSEND") == 0 ||
 	    (brew_strlen_cli(cmd_upper) > 7 && strncmp_kernel_cli(cmd_upper, "UDPSEND ", 8) == 0)) {
 		handle_udpsend(command_buffer);
@@ -0,0 +1,335 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Text search helpers: SIMD literal search, a small regex engine and glob matching.
+
+#include "search.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// SSE2 vector of 16 bytes (GCC vector extension, no libc headers needed)
+typedef char v16qi __attribute__((vector_size(16)));
+
+#define TOK_LITERAL 0
+#define TOK_ANY     1
+#define TOK_CLASS   2
+
+static int search_memeq(const char* a, const char* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline v16qi search_broadcast(char c) {
+    v16qi v = {c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c};
+    return v;
+}
+
+// Compares the first and the last byte of the needle against 16 candidate
+// positions at once, and only runs a full compare where both of them match.
+const char* search_literal(const char* haystack, size_t haystack_len,
+                           const char* needle, size_t needle_len) {
+    if (!haystack || !needle) return NULL;
+    if (needle_len == 0) return haystack;
+    if (needle_len > haystack_len) return NULL;
+
+    const v16qi first = search_broadcast(needle[0]);
+    const v16qi last = search_broadcast(needle[needle_len - 1]);
+    size_t i = 0;
+
+    while (i + needle_len + 15 <= haystack_len) {
+        v16qi block_first = __builtin_ia32_loaddqu(haystack + i);
+        v16qi block_last = __builtin_ia32_loaddqu(haystack + i + needle_len - 1);
+        v16qi eq = __builtin_ia32_pcmpeqb128(block_first, first) &
+                   __builtin_ia32_pcmpeqb128(block_last, last);
+        unsigned int mask = (unsigned int)__builtin_ia32_pmovmskb128(eq);
+
+        while (mask) {
+            unsigned int bit = (unsigned int)__builtin_ctz(mask);
+            const char* candidate = haystack + i + bit;
+            if (needle_len <= 2 || search_memeq(candidate + 1, needle + 1, needle_len - 2)) {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+        i += 16;
+    }
+
+    // Scalar tail
+    for (; i + needle_len <= haystack_len; i++) {
+        if (haystack[i] == needle[0] && haystack[i + needle_len - 1] == needle[needle_len - 1] &&
+            (needle_len <= 2 || search_memeq(haystack + i + 1, needle + 1, needle_len - 2))) {
+            return haystack + i;
+        }
+    }
+    return NULL;
+}
+
+// ----------------------------
+// Regular expressions
+// ----------------------------
+
+static void regex_set_add(regex_token_t* tok, unsigned char c) {
+    tok->set[c >> 3] |= (unsigned char)(1 << (c & 7));
+}
+
+static int regex_token_matches(const regex_token_t* tok, unsigned char c) {
+    switch (tok->type) {
+        case TOK_LITERAL:
+            return c == tok->ch;
+        case TOK_ANY:
+            return c != '\n';
+        case TOK_CLASS: {
+            int in_set = (tok->set[c >> 3] >> (c & 7)) & 1;
+            return tok->negate ? !in_set : in_set;
+        }
+    }
+    return 0;
+}
+
+int regex_compile(regex_t* re, const char* pattern) {
+    if (!re || !pattern) return -1;
+
+    for (size_t i = 0; i < sizeof(regex_t); i++) {
+        ((char*)re)[i] = 0;
+    }
+
+    const char* p = pattern;
+    if (*p == '^') {
+        re->anchored_start = 1;
+        p++;
+    }
+
+    while (*p) {
+        if (p[0] == '$' && p[1] == '\0') {
+            re->anchored_end = 1;
+            break;
+        }
+        if (re->token_count >= REGEX_MAX_TOKENS) {
+            return -1;
+        }
+
+        regex_token_t* tok = &re->tokens[re->token_count];
+
+        if (*p == '*' || *p == '+' || *p == '?') {
+            return -1;  // Quantifier without an atom
+        } else if (*p == '.') {
+            tok->type = TOK_ANY;
+            p++;
+        } else if (*p == '[') {
+            tok->type = TOK_CLASS;
+            p++;
+            if (*p == '^') {
+                tok->negate = 1;
+                p++;
+            }
+            int first = 1;
+            while (*p && (*p != ']' || first)) {
+                unsigned char lo = (unsigned char)*p;
+                if (p[1] == '-' && p[2] && p[2] != ']') {
+                    unsigned char hi = (unsigned char)p[2];
+                    for (unsigned int c = lo; c <= hi; c++) {
+                        regex_set_add(tok, (unsigned char)c);
+                    }
+                    p += 3;
+                } else {
+                    regex_set_add(tok, lo);
+                    p++;
+                }
+                first = 0;
+            }
+            if (*p != ']') {
+                return -1;  // Unterminated class
+            }
+            p++;
+        } else {
+            if (*p == '\\' && p[1]) {
+                p++;
+            }
+            tok->type = TOK_LITERAL;
+            tok->ch = (unsigned char)*p;
+            p++;
+        }
+
+        if (*p == '*' || *p == '+' || *p == '?') {
+            tok->quant = (unsigned char)*p;
+            p++;
+        }
+        re->token_count++;
+    }
+
+    // Find the longest literal run every match has to contain, GREP uses it
+    // to skip straight to candidate lines with search_literal().
+    size_t run_len = 0;
+    char run[sizeof(re->required)];
+    re->is_literal = !re->anchored_start && !re->anchored_end;
+    for (int t = 0; t <= re->token_count; t++) {
+        const regex_token_t* tok = (t < re->token_count) ? &re->tokens[t] : NULL;
+        int extends = tok && tok->type == TOK_LITERAL && (tok->quant == 0 || tok->quant == '+');
+        if (tok && (tok->type != TOK_LITERAL || tok->quant != 0)) {
+            re->is_literal = 0;
+        }
+        if (extends && run_len < sizeof(run) - 1) {
+            run[run_len++] = (char)tok->ch;
+        }
+        if (!extends || tok->quant == '+') {
+            if (run_len > re->required_len) {
+                for (size_t i = 0; i < run_len; i++) {
+                    re->required[i] = run[i];
+                }
+                re->required[run_len] = '\0';
+                re->required_len = run_len;
+            }
+            run_len = 0;
+        }
+    }
+    if (re->required_len != (size_t)re->token_count) {
+        re->is_literal = 0;
+    }
+
+    return 0;
+}
+
+static int regex_match_here(const regex_t* re, int ti, const char* s, const char* end) {
+    if (ti == re->token_count) {
+        return re->anchored_end ? (s == end) : 1;
+    }
+
+    const regex_token_t* tok = &re->tokens[ti];
+
+    if (tok->quant == 0) {
+        return s < end && regex_token_matches(tok, (unsigned char)*s) &&
+               regex_match_here(re, ti + 1, s + 1, end);
+    }
+
+    if (tok->quant == '?') {
+        if (s < end && regex_token_matches(tok, (unsigned char)*s) &&
+            regex_match_here(re, ti + 1, s + 1, end)) {
+            return 1;
+        }
+        return regex_match_here(re, ti + 1, s, end);
+    }
+
+    // '*' and '+': take as many as possible, then back off
+    size_t count = 0;
+    while (s + count < end && regex_token_matches(tok, (unsigned char)s[count])) {
+        count++;
+    }
+    size_t min = (tok->quant == '+') ? 1 : 0;
+    for (size_t k = count + 1; k-- > min;) {
+        if (regex_match_here(re, ti + 1, s + k, end)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int regex_match_line(const regex_t* re, const char* line, size_t len) {
+    if (!re || !line) return 0;
+
+    if (re->required_len > 0 && !search_literal(line, len, re->required, re->required_len)) {
+        return 0;
+    }
+    if (re->is_literal) {
+        return 1;  // The prefilter was the whole pattern
+    }
+
+    const char* end = line + len;
+    if (re->anchored_start) {
+        return regex_match_here(re, 0, line, end);
+    }
+    for (const char* s = line; s <= end; s++) {
+        if (regex_match_here(re, 0, s, end)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ----------------------------
+// Glob matching
+// ----------------------------
+
+static int glob_class_matches(const char** pattern, char c) {
+    const char* p = *pattern + 1;  // Skip '['
+    int negate = 0;
+    int matched = 0;
+
+    if (*p == '!' || *p == '^') {
+        negate = 1;
+        p++;
+    }
+    int first = 1;
+    while (*p && (*p != ']' || first)) {
+        if (p[1] == '-' && p[2] && p[2] != ']') {
+            if (c >= p[0] && c <= p[2]) matched = 1;
+            p += 3;
+        } else {
+            if (c == *p) matched = 1;
+            p++;
+        }
+        first = 0;
+    }
+    if (*p == ']') p++;
+    *pattern = p;
+    return negate ? !matched : matched;
+}
+
+int glob_match(const char* pattern, const char* name) {
+    const char* star_pattern = NULL;
+    const char* star_name = NULL;
+
+    while (*name) {
+        if (*pattern == '*') {
+            star_pattern = ++pattern;
+            star_name = name;
+            continue;
+        }
+
+        const char* next = pattern;
+        int ok = 0;
+        if (*pattern == '?') {
+            ok = 1;
+            next = pattern + 1;
+        } else if (*pattern == '[') {
+            ok = glob_class_matches(&next, *name);
+        } else if (*pattern) {
+            ok = (*pattern == *name);
+            next = pattern + 1;
+        }
+
+        if (ok) {
+            pattern = next;
+            name++;
+        } else if (star_pattern) {
+            // Let the last '*' swallow one more character and retry
+            pattern = star_pattern;
+            name = ++star_name;
+        } else {
+            return 0;
+        }
+    }
+
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
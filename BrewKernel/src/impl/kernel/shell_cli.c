@@ -17,13 +17,180 @@
  */
 
 #include "shell_cli.h"
+#include "filesys.h"
+#include "search.h"
+#include "print.h"
+#include <stddef.h>
+
+static int shell_strncmp(const char *s1, const char *s2, int n) {
+    for (int i = 0; i < n; i++) {
+        if (s1[i] != s2[i] || s1[i] == '\0' || s2[i] == '\0') {
+            return (unsigned char)s1[i] - (unsigned char)s2[i];
+        }
+    }
+    return 0;
+}
+
+static int shell_strcmp(const char *s1, const char *s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+// Copy the next space separated argument into out, returns the rest of the line
+static const char* shell_next_arg(const char* p, char* out, size_t out_size) {
+    while (*p == ' ') p++;
+    size_t i = 0;
+    while (*p && *p != ' ') {
+        if (i < out_size - 1) out[i++] = *p;
+        p++;
+    }
+    out[i] = '\0';
+    return p;
+}
+
+static void shell_print_range(const char* s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        print_char(s[i]);
+    }
+}
+
+// Print every matching line of one file as "path:line: text"
+static int grep_file(const File* file, const regex_t* re) {
+    size_t size = 0;
+    const char* content = file_get_content(file, &size);
+    if (!content || size == 0) return 0;
+
+    char path[256];
+    fs_get_node_path(file, path, sizeof(path));
+
+    const char* end = content + size;
+    const char* pos = content;
+    const char* counted = content;
+    unsigned int line_no = 1;
+    int matches = 0;
+
+    while (pos < end) {
+        const char* line_start = pos;
+
+        // Jump straight to the next line containing the required literal
+        if (re->required_len > 0) {
+            const char* hit = search_literal(pos, end - pos, re->required, re->required_len);
+            if (!hit) break;
+            line_start = hit;
+            while (line_start > pos && line_start[-1] != '\n') line_start--;
+        }
+
+        const char* line_end = line_start;
+        while (line_end < end && *line_end != '\n') line_end++;
+
+        while (counted < line_start) {
+            if (*counted++ == '\n') line_no++;
+        }
+
+        if (regex_match_line(re, line_start, line_end - line_start)) {
+            brew_str(path);
+            brew_str(":");
+            print_uint(line_no);
+            brew_str(": ");
+            shell_print_range(line_start, line_end - line_start);
+            brew_str("\n");
+            matches++;
+        }
+
+        pos = line_end + 1;
+    }
+    return matches;
+}
+
+static void handle_grep(const char* command_buffer) {
+    char pattern[128];
+    char path[256];
+    const char* rest = shell_next_arg(command_buffer + 4, pattern, sizeof(pattern));
+    shell_next_arg(rest, path, sizeof(path));
+
+    brew_str("\n");
+    if (pattern[0] == '\0' || path[0] == '\0') {
+        brew_str("Usage: GREP <pattern> <path>\n");
+        return;
+    }
+
+    regex_t re;
+    if (regex_compile(&re, pattern) != 0) {
+        brew_str("grep: invalid pattern '");
+        brew_str(pattern);
+        brew_str("'\n");
+        return;
+    }
+
+    File* root = fs_resolve_node(path);
+    if (!root) {
+        brew_str("grep: ");
+        brew_str(path);
+        brew_str(": No such file or directory\n");
+        return;
+    }
+
+    int matches = 0;
+    for (File* node = root; node; node = fs_walk_next(root, node)) {
+        if (node->type == 'f') {
+            matches += grep_file(node, &re);
+        }
+    }
+    if (matches == 0) {
+        brew_str("grep: no matches\n");
+    }
+}
+
+static void handle_find(const char* command_buffer) {
+    char root_path[256];
+    char option[16];
+    char glob[128];
+    const char* rest = shell_next_arg(command_buffer + 4, root_path, sizeof(root_path));
+    rest = shell_next_arg(rest, option, sizeof(option));
+    shell_next_arg(rest, glob, sizeof(glob));
+
+    brew_str("\n");
+    if (root_path[0] == '\0') {
+        root_path[0] = '.';
+        root_path[1] = '\0';
+    }
+    if (option[0] != '\0' && (shell_strcmp(option, "-name") != 0 || glob[0] == '\0')) {
+        brew_str("Usage: FIND <root> -name <glob>\n");
+        return;
+    }
+
+    File* root = fs_resolve_node(root_path);
+    if (!root) {
+        brew_str("find: '");
+        brew_str(root_path);
+        brew_str("': No such file or directory\n");
+        return;
+    }
+
+    char path[256];
+    for (File* node = root; node; node = fs_walk_next(root, node)) {
+        if (glob[0] == '\0' || glob_match(glob, node->name)) {
+            fs_get_node_path(node, path, sizeof(path));
+            brew_str(path);
+            brew_str("\n");
+        }
+    }
+}
 
 // Returns 1 if handled, 0 otherwise. May modify *return_to_prompt (1/0).
 int shell_handle_command(const char* cmd_upper, char* command_buffer, int* return_to_prompt) {
-    (void)cmd_upper;
-    (void)command_buffer;
     (void)return_to_prompt;
-    
-    // No shell-specific commands handled yet
+
+    if (shell_strcmp(cmd_upper, "GREP") == 0 || shell_strncmp(cmd_upper, "GREP ", 5) == 0) {
+        handle_grep(command_buffer);
+        return 1;
+    }
+    if (shell_strcmp(cmd_upper, "FIND") == 0 || shell_strncmp(cmd_upper, "FIND ", 5) == 0) {
+        handle_find(command_buffer);
+        return 1;
+    }
     return 0;
 }
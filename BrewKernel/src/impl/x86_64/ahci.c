@@ -0,0 +1,418 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// AHCI SATA driver. Reads and writes are issued as READ/WRITE FPDMA QUEUED
+// (NCQ) so up to 32 commands per port are outstanding at once; the drive
+// reports completions through Set Device Bits FISes.
+
+#include "ahci.h"
+#include "pci.h"
+#include "irq.h"
+#include "pic.h"
+#include "memory.h"
+#include "block.h"
+#include <stdint.h>
+#include <stddef.h>
+
+static volatile uint32_t* ahci_abar = NULL;
+static ahci_port_t* ahci_ports[AHCI_MAX_PORTS];
+static int ahci_port_count = 0;
+static int ahci_initialized = 0;
+
+static inline uint32_t ahci_read(volatile uint32_t* base, uint16_t offset) {
+    return base[offset / 4];
+}
+
+static inline void ahci_write(volatile uint32_t* base, uint16_t offset, uint32_t value) {
+    base[offset / 4] = value;
+}
+
+static void ahci_memset(void* dest, int val, size_t len) {
+    uint8_t* d = (uint8_t*)dest;
+    for (size_t i = 0; i < len; i++) {
+        d[i] = (uint8_t)val;
+    }
+}
+
+static void ahci_port_stop(ahci_port_t* port) {
+    uint32_t cmd = ahci_read(port->regs, AHCI_PxCMD);
+    ahci_write(port->regs, AHCI_PxCMD, cmd & ~AHCI_PxCMD_ST);
+    for (int i = 0; i < 1000000 && (ahci_read(port->regs, AHCI_PxCMD) & AHCI_PxCMD_CR); i++) {
+    }
+    cmd = ahci_read(port->regs, AHCI_PxCMD);
+    ahci_write(port->regs, AHCI_PxCMD, cmd & ~AHCI_PxCMD_FRE);
+    for (int i = 0; i < 1000000 && (ahci_read(port->regs, AHCI_PxCMD) & AHCI_PxCMD_FR); i++) {
+    }
+}
+
+static void ahci_port_start(ahci_port_t* port) {
+    for (int i = 0; i < 1000000 && (ahci_read(port->regs, AHCI_PxCMD) & AHCI_PxCMD_CR); i++) {
+    }
+    uint32_t cmd = ahci_read(port->regs, AHCI_PxCMD);
+    ahci_write(port->regs, AHCI_PxCMD, cmd | AHCI_PxCMD_FRE);
+    ahci_write(port->regs, AHCI_PxCMD, cmd | AHCI_PxCMD_FRE | AHCI_PxCMD_ST);
+}
+
+// Fill command slot 'slot' with a register FIS and the PRDs for req's segments
+static int ahci_build_command(ahci_port_t* port, int slot, uint8_t command,
+                              uint64_t lba, uint32_t count, block_request_t* req,
+                              void* buffer, uint32_t bytes, int write) {
+    ahci_cmd_header_t* hdr = &port->cmd_list[slot];
+    ahci_cmd_table_t* tbl = &port->cmd_tables[slot];
+
+    int n = 0;
+    if (req) {
+        for (block_request_t* seg = req; seg; seg = seg->merge_next) {
+            if (n >= AHCI_PRD_ENTRIES) return -1;
+            uint64_t addr = (uint64_t)(uintptr_t)seg->buffer;
+            tbl->prdt[n].dba = (uint32_t)addr;
+            tbl->prdt[n].dbau = (uint32_t)(addr >> 32);
+            tbl->prdt[n].reserved = 0;
+            tbl->prdt[n].dbc = seg->count * BLOCK_SECTOR_SIZE - 1;
+            n++;
+        }
+    } else {
+        uint64_t addr = (uint64_t)(uintptr_t)buffer;
+        tbl->prdt[0].dba = (uint32_t)addr;
+        tbl->prdt[0].dbau = (uint32_t)(addr >> 32);
+        tbl->prdt[0].reserved = 0;
+        tbl->prdt[0].dbc = bytes - 1;
+        n = 1;
+    }
+
+    fis_reg_h2d_t* fis = (fis_reg_h2d_t*)tbl->cfis;
+    ahci_memset(fis, 0, sizeof(fis_reg_h2d_t));
+    fis->fis_type = FIS_TYPE_REG_H2D;
+    fis->pmport_c = 0x80;
+    fis->command = command;
+    fis->lba0 = (uint8_t)lba;
+    fis->lba1 = (uint8_t)(lba >> 8);
+    fis->lba2 = (uint8_t)(lba >> 16);
+    fis->lba3 = (uint8_t)(lba >> 24);
+    fis->lba4 = (uint8_t)(lba >> 32);
+    fis->lba5 = (uint8_t)(lba >> 40);
+    fis->device = 0x40;  // LBA mode
+
+    if (command == ATA_CMD_READ_FPDMA_QUEUED || command == ATA_CMD_WRITE_FPDMA_QUEUED) {
+        // NCQ: sector count goes in the feature field, the tag in count[7:3]
+        fis->featurel = (uint8_t)count;
+        fis->featureh = (uint8_t)(count >> 8);
+        fis->countl = (uint8_t)(slot << 3);
+    } else {
+        fis->countl = (uint8_t)count;
+        fis->counth = (uint8_t)(count >> 8);
+    }
+
+    hdr->flags = (uint16_t)(sizeof(fis_reg_h2d_t) / 4) | (write ? AHCI_CMD_FLAG_WRITE : 0);
+    hdr->prdtl = (uint16_t)n;
+    hdr->prdbc = 0;
+    return 0;
+}
+
+// IDENTIFY DEVICE through slot 0, polled (interrupts are not enabled yet)
+static int ahci_identify(ahci_port_t* port, uint16_t* id) {
+    if (ahci_build_command(port, 0, ATA_CMD_IDENTIFY_AHCI, 0, 0, NULL, id, 512, 0) != 0) {
+        return -1;
+    }
+    port->cmd_tables[0].cfis[7] = 0;  // Device register
+
+    ahci_write(port->regs, AHCI_PxIS, 0xFFFFFFFF);
+    ahci_write(port->regs, AHCI_PxCI, 1);
+
+    for (int i = 0; i < AHCI_TIMEOUT_POLLS; i++) {
+        if (ahci_read(port->regs, AHCI_PxIS) & AHCI_PxIS_TFES) {
+            return -1;
+        }
+        if (!(ahci_read(port->regs, AHCI_PxCI) & 1)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int ahci_submit(block_device_t* dev, block_request_t* req) {
+    ahci_port_t* port = (ahci_port_t*)dev->driver_data;
+    uint32_t busy = port->issued | port->pending;
+
+    if (!port->ncq && busy) {
+        return -1;  // Without NCQ only one command may be outstanding
+    }
+    uint32_t free_slots = ~busy & port->slot_mask;
+    if (!free_slots) {
+        return -1;
+    }
+
+    int slot = __builtin_ctz(free_slots);
+    uint8_t command;
+    if (port->ncq) {
+        command = req->write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED;
+    } else {
+        command = req->write ? ATA_CMD_WRITE_DMA_EXT_AHCI : ATA_CMD_READ_DMA_EXT_AHCI;
+    }
+
+    if (ahci_build_command(port, slot, command, req->lba, req->total_count, req, NULL, 0, req->write) != 0) {
+        block_complete(dev, req, -1);
+        return 0;
+    }
+
+    port->slot_req[slot] = req;
+    port->pending |= 1u << slot;
+    req->tag = (uint32_t)slot;
+    return 0;
+}
+
+// Issue every command prepared by the last dispatch batch with one doorbell write
+static void ahci_commit(block_device_t* dev) {
+    ahci_port_t* port = (ahci_port_t*)dev->driver_data;
+    uint32_t bits = port->pending;
+    if (!bits) return;
+
+    port->pending = 0;
+    port->issued |= bits;
+    if (port->ncq) {
+        ahci_write(port->regs, AHCI_PxSACT, bits);
+    }
+    ahci_write(port->regs, AHCI_PxCI, bits);
+
+    uint32_t inflight = 0;
+    for (uint32_t b = port->issued; b; b &= b - 1) {
+        inflight++;
+    }
+    if (inflight > port->max_inflight) {
+        port->max_inflight = inflight;
+    }
+}
+
+// Fail everything outstanding and restart the port after an error
+static void ahci_port_recover(ahci_port_t* port) {
+    ahci_port_stop(port);
+    ahci_write(port->regs, AHCI_PxSERR, 0xFFFFFFFF);
+    ahci_write(port->regs, AHCI_PxIS, 0xFFFFFFFF);
+    ahci_port_start(port);
+
+    uint32_t failed = port->issued;
+    port->issued = 0;
+    port->polls = 0;
+    while (failed) {
+        int slot = __builtin_ctz(failed);
+        failed &= failed - 1;
+        block_request_t* req = port->slot_req[slot];
+        port->slot_req[slot] = NULL;
+        if (req) {
+            block_complete(&port->blk, req, -1);
+        }
+    }
+}
+
+static void ahci_port_service(ahci_port_t* port, int from_poll) {
+    unsigned long flags = irq_save();
+
+    uint32_t is = ahci_read(port->regs, AHCI_PxIS);
+    if (is) {
+        ahci_write(port->regs, AHCI_PxIS, is);
+    }
+
+    if ((is & AHCI_PxIS_ERROR) || (from_poll && port->issued && ++port->polls > AHCI_TIMEOUT_POLLS)) {
+        ahci_port_recover(port);
+        irq_restore(flags);
+        return;
+    }
+
+    // A slot is finished once the HBA cleared its CI bit and (for NCQ) the
+    // drive cleared its SACT bit
+    uint32_t still_busy = ahci_read(port->regs, AHCI_PxCI);
+    if (port->ncq) {
+        still_busy |= ahci_read(port->regs, AHCI_PxSACT);
+    }
+    uint32_t done = port->issued & ~still_busy;
+    if (done) {
+        port->polls = 0;
+    }
+
+    port->issued &= ~done;
+    while (done) {
+        int slot = __builtin_ctz(done);
+        done &= done - 1;
+        block_request_t* req = port->slot_req[slot];
+        port->slot_req[slot] = NULL;
+        if (req) {
+            block_complete(&port->blk, req, 0);
+        }
+    }
+
+    irq_restore(flags);
+}
+
+static void ahci_poll(block_device_t* dev) {
+    ahci_port_service((ahci_port_t*)dev->driver_data, 1);
+}
+
+static void ahci_irq_handler(void) {
+    if (!ahci_abar) return;
+
+    uint32_t is = ahci_read(ahci_abar, AHCI_REG_IS);
+    if (!is) return;  // Shared line, not ours
+
+    for (int i = 0; i < ahci_port_count; i++) {
+        if (is & (1u << ahci_ports[i]->index)) {
+            ahci_port_service(ahci_ports[i], 0);
+        }
+    }
+    ahci_write(ahci_abar, AHCI_REG_IS, is);
+}
+
+static void ahci_probe_port(int index, uint32_t slots, int hba_ncq) {
+    volatile uint32_t* regs = (volatile uint32_t*)((uint8_t*)ahci_abar + AHCI_PORT_BASE + index * AHCI_PORT_SIZE);
+
+    uint32_t ssts = ahci_read(regs, AHCI_PxSSTS);
+    if ((ssts & 0x0F) != AHCI_SSTS_DET_PRESENT || ahci_read(regs, AHCI_PxSIG) != AHCI_SIG_ATA) {
+        return;  // Empty port, ATAPI or port multiplier
+    }
+
+    ahci_port_t* port = (ahci_port_t*)fs_allocate(sizeof(ahci_port_t));
+    if (!port) return;
+    ahci_memset(port, 0, sizeof(ahci_port_t));
+    port->regs = regs;
+    port->index = index;
+    port->slot_mask = (slots >= 32) ? 0xFFFFFFFF : ((1u << slots) - 1);
+
+    port->cmd_list = (ahci_cmd_header_t*)fs_allocate_aligned(sizeof(ahci_cmd_header_t) * AHCI_MAX_SLOTS, 1024);
+    port->fis_area = fs_allocate_aligned(256, 256);
+    port->cmd_tables = (ahci_cmd_table_t*)fs_allocate_aligned(sizeof(ahci_cmd_table_t) * AHCI_MAX_SLOTS, 128);
+    uint16_t* id = (uint16_t*)fs_allocate_aligned(512, 16);
+    if (!port->cmd_list || !port->fis_area || !port->cmd_tables || !id) {
+        return;
+    }
+    ahci_memset(port->cmd_list, 0, sizeof(ahci_cmd_header_t) * AHCI_MAX_SLOTS);
+    ahci_memset(port->fis_area, 0, 256);
+    ahci_memset(port->cmd_tables, 0, sizeof(ahci_cmd_table_t) * AHCI_MAX_SLOTS);
+
+    for (int s = 0; s < AHCI_MAX_SLOTS; s++) {
+        uint64_t ctba = (uint64_t)(uintptr_t)&port->cmd_tables[s];
+        port->cmd_list[s].ctba = (uint32_t)ctba;
+        port->cmd_list[s].ctbau = (uint32_t)(ctba >> 32);
+    }
+
+    ahci_port_stop(port);
+    uint64_t clb = (uint64_t)(uintptr_t)port->cmd_list;
+    uint64_t fb = (uint64_t)(uintptr_t)port->fis_area;
+    ahci_write(regs, AHCI_PxCLB, (uint32_t)clb);
+    ahci_write(regs, AHCI_PxCLBU, (uint32_t)(clb >> 32));
+    ahci_write(regs, AHCI_PxFB, (uint32_t)fb);
+    ahci_write(regs, AHCI_PxFBU, (uint32_t)(fb >> 32));
+    ahci_write(regs, AHCI_PxSERR, 0xFFFFFFFF);
+    ahci_write(regs, AHCI_PxIS, 0xFFFFFFFF);
+    ahci_write(regs, AHCI_PxIE, 0);
+    ahci_port_start(port);
+
+    if (ahci_identify(port, id) != 0) {
+        fs_free_aligned(id);
+        ahci_port_stop(port);
+        return;
+    }
+
+    port->sectors = (uint64_t)id[100] | ((uint64_t)id[101] << 16) |
+                    ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48);
+    if (port->sectors == 0) {
+        port->sectors = (uint64_t)id[60] | ((uint64_t)id[61] << 16);
+    }
+
+    int depth = 1;
+    if (hba_ncq && (id[76] & (1 << 8))) {
+        port->ncq = 1;
+        depth = (id[75] & 0x1F) + 1;
+        if (depth > (int)slots) depth = (int)slots;
+        port->slot_mask = (depth >= 32) ? 0xFFFFFFFF : ((1u << depth) - 1);
+    }
+    fs_free_aligned(id);
+
+    block_device_t* blk = &port->blk;
+    blk->name[0] = 's';
+    blk->name[1] = 'd';
+    blk->name[2] = (char)('a' + ahci_port_count);
+    blk->name[3] = '\0';
+    blk->driver = port->ncq ? "ahci-ncq" : "ahci";
+    blk->sector_count = port->sectors;
+    blk->max_sectors = AHCI_MAX_SECTORS;
+    blk->max_segments = AHCI_PRD_ENTRIES;
+    blk->queue_depth = depth;
+    blk->submit = ahci_submit;
+    blk->poll = ahci_poll;
+    blk->commit = ahci_commit;
+    blk->driver_data = port;
+
+    if (block_register_device(blk) != 0) {
+        ahci_port_stop(port);
+        return;
+    }
+    ahci_ports[ahci_port_count++] = port;
+
+    // Completion and error interrupts
+    ahci_write(regs, AHCI_PxIS, 0xFFFFFFFF);
+    ahci_write(regs, AHCI_PxIE, AHCI_PxIS_DHRS | AHCI_PxIS_PSS | AHCI_PxIS_DSS |
+                                AHCI_PxIS_SDBS | AHCI_PxIS_ERROR);
+}
+
+int ahci_init(void) {
+    if (ahci_initialized) {
+        return ahci_port_count > 0 ? 0 : -1;
+    }
+    ahci_initialized = 1;
+
+    pci_device_t pci_dev;
+    if (!pci_find_device_by_class(0x01, PCI_SUBCLASS_SATA, &pci_dev)) {
+        return -1;
+    }
+
+    uint32_t bar5 = pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x24);
+    if (bar5 & 1) {
+        return -1;  // ABAR must be memory mapped
+    }
+    ahci_abar = (volatile uint32_t*)(uintptr_t)(bar5 & ~0xF);
+
+    // Enable memory decoding and bus mastering
+    uint32_t command = pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x04);
+    command |= (1 << 1) | (1 << 2);
+    pci_write_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x04, command);
+
+    ahci_write(ahci_abar, AHCI_REG_GHC, ahci_read(ahci_abar, AHCI_REG_GHC) | AHCI_GHC_AE);
+
+    uint32_t cap = ahci_read(ahci_abar, AHCI_REG_CAP);
+    uint32_t pi = ahci_read(ahci_abar, AHCI_REG_PI);
+    uint32_t slots = ((cap >> AHCI_CAP_NCS_SHIFT) & 0x1F) + 1;
+    int hba_ncq = (cap & AHCI_CAP_SNCQ) != 0;
+
+    for (int i = 0; i < AHCI_MAX_PORTS && ahci_port_count < 26; i++) {
+        if (pi & (1u << i)) {
+            ahci_probe_port(i, slots, hba_ncq);
+        }
+    }
+    if (ahci_port_count == 0) {
+        return -1;
+    }
+
+    // MSI gives the HBA a vector of its own, else share the INTx line
+    uint8_t irq = (uint8_t)(pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x3C) & 0xFF);
+    ahci_write(ahci_abar, AHCI_REG_IS, 0xFFFFFFFF);
+    if (pci_msi_enable(&pci_dev, ahci_irq_handler) < 0 && irq > 0 && irq < 16) {
+        irq_register_shared_handler(irq, ahci_irq_handler);
+        pic_irq_enable(irq);
+    }
+    ahci_write(ahci_abar, AHCI_REG_GHC, ahci_read(ahci_abar, AHCI_REG_GHC) | AHCI_GHC_IE);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "apic.h"
+#include <stdint.h>
+
+static volatile uint32_t* lapic_base = 0;
+
+static inline uint64_t lapic_rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void lapic_wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ __volatile__("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / 4] = value;
+}
+
+int lapic_init(void) {
+    if (lapic_base) {
+        return 0;
+    }
+
+    // CPUID.1:EDX bit 9 reports an on-chip APIC
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ __volatile__("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if (!(edx & (1u << 9))) {
+        return -1;
+    }
+
+    uint64_t msr = lapic_rdmsr(LAPIC_MSR_BASE);
+    uint64_t base = msr & 0xFFFFF000ull;
+    if (base < LAPIC_MMIO_MIN || base >= LAPIC_MMIO_MAX) {
+        return -1;  // Not in the mapped window
+    }
+    if (!(msr & LAPIC_MSR_ENABLE)) {
+        lapic_wrmsr(LAPIC_MSR_BASE, msr | LAPIC_MSR_ENABLE);
+    }
+    lapic_base = (volatile uint32_t*)(uintptr_t)base;
+
+    // Keep the 8259 on LINT0 and NMI on LINT1, accept every priority,
+    // then software-enable the APIC
+    lapic_write(LAPIC_REG_LVT_LINT0, LAPIC_LVT_EXTINT);
+    lapic_write(LAPIC_REG_LVT_LINT1, LAPIC_LVT_NMI);
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    return 0;
+}
+
+int lapic_available(void) {
+    return lapic_base != 0;
+}
+
+uint8_t lapic_id(void) {
+    return lapic_base ? (uint8_t)(lapic_read(LAPIC_REG_ID) >> 24) : 0;
+}
+
+void lapic_eoi(void) {
+    if (lapic_base) {
+        lapic_write(LAPIC_REG_EOI, 0);
+    }
+}
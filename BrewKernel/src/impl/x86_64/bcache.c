@@ -0,0 +1,347 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bcache.h"
+#include "block.h"
+#include <stdint.h>
+#include <stddef.h>
+
+static bcache_buf_t bcache_bufs[BCACHE_ENTRIES];
+static bcache_buf_t* bcache_hash[BCACHE_HASH_SIZE];
+static bcache_buf_t* lru_head = NULL;   // Most recently used
+static bcache_buf_t* lru_tail = NULL;   // Eviction candidates
+static int bcache_initialized = 0;
+static bcache_stats_t bcache_stats;
+
+static void bcache_init(void) {
+    if (bcache_initialized) return;
+
+    for (int i = 0; i < BCACHE_HASH_SIZE; i++) {
+        bcache_hash[i] = NULL;
+    }
+    for (int i = 0; i < BCACHE_ENTRIES; i++) {
+        bcache_buf_t* buf = &bcache_bufs[i];
+        buf->dev = NULL;
+        buf->valid = 0;
+        buf->dirty = 0;
+        buf->refcount = 0;
+        buf->io_pending = 0;
+        buf->ra_trigger = 0;
+        buf->write_error = 0;
+        buf->hash_next = NULL;
+        buf->lru_prev = (i > 0) ? &bcache_bufs[i - 1] : NULL;
+        buf->lru_next = (i < BCACHE_ENTRIES - 1) ? &bcache_bufs[i + 1] : NULL;
+    }
+    lru_head = &bcache_bufs[0];
+    lru_tail = &bcache_bufs[BCACHE_ENTRIES - 1];
+    bcache_initialized = 1;
+}
+
+static uint32_t bcache_hash_index(block_device_t* dev, uint64_t lba) {
+    uint64_t key = lba ^ ((uintptr_t)dev >> 4);
+    key ^= key >> 17;
+    return (uint32_t)(key % BCACHE_HASH_SIZE);
+}
+
+static bcache_buf_t* bcache_lookup(block_device_t* dev, uint64_t lba) {
+    bcache_buf_t* buf = bcache_hash[bcache_hash_index(dev, lba)];
+    while (buf) {
+        if (buf->dev == dev && buf->lba == lba) {
+            return buf;
+        }
+        buf = buf->hash_next;
+    }
+    return NULL;
+}
+
+static void bcache_hash_remove(bcache_buf_t* buf) {
+    if (!buf->dev) return;
+    bcache_buf_t** link = &bcache_hash[bcache_hash_index(buf->dev, buf->lba)];
+    while (*link) {
+        if (*link == buf) {
+            *link = buf->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    buf->hash_next = NULL;
+}
+
+// Move a buffer to the most recently used end
+static void bcache_touch(bcache_buf_t* buf) {
+    if (buf == lru_head) return;
+
+    if (buf->lru_prev) buf->lru_prev->lru_next = buf->lru_next;
+    if (buf->lru_next) buf->lru_next->lru_prev = buf->lru_prev;
+    if (buf == lru_tail) lru_tail = buf->lru_prev;
+
+    buf->lru_prev = NULL;
+    buf->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = buf;
+    lru_head = buf;
+    if (!lru_tail) lru_tail = buf;
+}
+
+// Completion callback, runs in interrupt context
+static void bcache_io_done(block_request_t* req) {
+    bcache_buf_t* buf = (bcache_buf_t*)req->private_data;
+    if (req->write) {
+        if (req->status != 0) {
+            buf->dirty = 1;  // Keep it for the next sync
+            buf->write_error = 1;
+            bcache_stats.write_errors++;
+        } else {
+            buf->write_error = 0;
+        }
+    } else {
+        buf->valid = (req->status == 0);
+    }
+    buf->io_pending = 0;
+}
+
+static int bcache_start_io(bcache_buf_t* buf, int write) {
+    block_request_t* req = &buf->req;
+    req->dev = buf->dev;
+    req->lba = buf->lba;
+    req->count = 1;
+    req->buffer = buf->data;
+    req->write = write;
+    req->complete = bcache_io_done;
+    req->private_data = buf;
+
+    buf->io_pending = 1;
+    if (write) {
+        buf->dirty = 0;
+        bcache_stats.writebacks++;
+    }
+    if (block_submit(req) != 0) {
+        buf->io_pending = 0;
+        if (write) buf->dirty = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static void bcache_wait_io(bcache_buf_t* buf) {
+    while (buf->io_pending) {
+        if (buf->dev && buf->dev->poll) {
+            buf->dev->poll(buf->dev);
+        }
+        __asm__ __volatile__("pause");
+    }
+}
+
+// Find a buffer to reuse, starting from the least recently used end.
+// If allow_writeback is 0, dirty buffers are skipped instead of flushed.
+// A buffer whose write-back fails keeps its data and is passed over, so
+// one bad sector does not stop allocation; bcache_sync() retries it.
+static bcache_buf_t* bcache_alloc(block_device_t* dev, uint64_t lba, int allow_writeback) {
+    bcache_buf_t* buf = lru_tail;
+    while (buf) {
+        if (buf->refcount == 0 && !buf->io_pending &&
+            (!buf->dirty || (allow_writeback && !buf->write_error))) {
+            if (!buf->dirty) {
+                break;
+            }
+            bcache_start_io(buf, 1);
+            bcache_wait_io(buf);
+            if (!buf->dirty) {
+                break;
+            }
+            buf->write_error = 1;  // Write-back failed, keep the data
+        }
+        buf = buf->lru_prev;
+    }
+    if (!buf) return NULL;
+
+    bcache_hash_remove(buf);
+    buf->dev = dev;
+    buf->lba = lba;
+    buf->valid = 0;
+    buf->dirty = 0;
+    buf->ra_trigger = 0;
+    buf->write_error = 0;
+
+    uint32_t idx = bcache_hash_index(dev, lba);
+    buf->hash_next = bcache_hash[idx];
+    bcache_hash[idx] = buf;
+    bcache_touch(buf);
+    return buf;
+}
+
+// Queue asynchronous reads for sectors that are not cached yet.
+// Must be called with the device plugged so the reads merge into one transfer.
+static void bcache_readahead(block_device_t* dev, uint64_t start, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t lba = start + i;
+        if (lba >= dev->sector_count) break;
+        if (bcache_lookup(dev, lba)) continue;
+
+        bcache_buf_t* buf = bcache_alloc(dev, lba, 0);
+        if (!buf) break;
+        if (i == count / 2) {
+            buf->ra_trigger = 1;
+        }
+        if (bcache_start_io(buf, 0) != 0) {
+            bcache_hash_remove(buf);
+            buf->dev = NULL;
+            break;
+        }
+        bcache_stats.readahead++;
+    }
+}
+
+bcache_buf_t* bcache_get(block_device_t* dev, uint64_t lba) {
+    if (!dev || lba >= dev->sector_count) return NULL;
+    bcache_init();
+
+    int sequential = (dev->last_read_lba != (uint64_t)-1 && lba == dev->last_read_lba + 1);
+    dev->last_read_lba = lba;
+
+    bcache_buf_t* buf = bcache_lookup(dev, lba);
+    if (buf) {
+        bcache_stats.hits++;
+        buf->refcount++;
+        bcache_touch(buf);
+
+        // Consuming the middle of a window: prefetch the next one
+        if (buf->ra_trigger) {
+            buf->ra_trigger = 0;
+            block_plug(dev);
+            bcache_readahead(dev, lba + BCACHE_READAHEAD_SECTORS / 2, BCACHE_READAHEAD_SECTORS);
+            block_unplug(dev);
+        }
+    } else {
+        bcache_stats.misses++;
+        buf = bcache_alloc(dev, lba, 1);
+        if (!buf) return NULL;
+        buf->refcount = 1;
+
+        block_plug(dev);
+        int rc = bcache_start_io(buf, 0);
+        if (rc == 0 && sequential) {
+            bcache_readahead(dev, lba + 1, BCACHE_READAHEAD_SECTORS);
+        }
+        block_unplug(dev);
+
+        if (rc != 0) {
+            buf->refcount = 0;
+            return NULL;
+        }
+    }
+
+    bcache_wait_io(buf);
+    if (!buf->valid) {
+        // Failed read-ahead or read error: retry once synchronously
+        if (bcache_start_io(buf, 0) == 0) {
+            bcache_wait_io(buf);
+        }
+        if (!buf->valid) {
+            buf->refcount--;
+            return NULL;
+        }
+    }
+    return buf;
+}
+
+void bcache_release(bcache_buf_t* buf) {
+    if (buf && buf->refcount > 0) {
+        buf->refcount--;
+    }
+}
+
+void bcache_mark_dirty(bcache_buf_t* buf) {
+    if (buf) {
+        buf->dirty = 1;
+    }
+}
+
+int bcache_sync(block_device_t* dev) {
+    bcache_init();
+
+    int count = block_get_device_count();
+    for (int d = 0; d < count; d++) {
+        block_plug(block_get_device(d));
+    }
+
+    // Queue every dirty sector, the elevator merges neighbours into large writes
+    for (int i = 0; i < BCACHE_ENTRIES; i++) {
+        bcache_buf_t* buf = &bcache_bufs[i];
+        if (buf->dirty && !buf->io_pending && buf->dev && (!dev || buf->dev == dev)) {
+            bcache_start_io(buf, 1);
+        }
+    }
+
+    for (int d = 0; d < count; d++) {
+        block_unplug(block_get_device(d));
+    }
+
+    int status = 0;
+    for (int i = 0; i < BCACHE_ENTRIES; i++) {
+        bcache_buf_t* buf = &bcache_bufs[i];
+        if (buf->dev && (!dev || buf->dev == dev)) {
+            bcache_wait_io(buf);
+            if (buf->dirty) {
+                status = -1;
+            }
+        }
+    }
+    return status;
+}
+
+void bcache_invalidate(block_device_t* dev) {
+    bcache_sync(dev);
+    for (int i = 0; i < BCACHE_ENTRIES; i++) {
+        bcache_buf_t* buf = &bcache_bufs[i];
+        if (buf->dev && (!dev || buf->dev == dev) && buf->refcount == 0 && !buf->dirty) {
+            bcache_hash_remove(buf);
+            buf->dev = NULL;
+            buf->valid = 0;
+        }
+    }
+}
+
+void bcache_discard(block_device_t* dev, uint64_t lba, uint32_t count) {
+    if (!dev || !bcache_initialized) return;
+
+    for (uint32_t i = 0; i < count; i++) {
+        bcache_buf_t* buf = bcache_lookup(dev, lba + i);
+        if (!buf) continue;
+        bcache_wait_io(buf);
+        if (buf->refcount == 0) {
+            bcache_hash_remove(buf);
+            buf->dev = NULL;
+            buf->valid = 0;
+            buf->dirty = 0;
+            buf->ra_trigger = 0;
+        }
+    }
+}
+
+void bcache_get_stats(bcache_stats_t* stats) {
+    if (!stats) return;
+    bcache_init();
+
+    *stats = bcache_stats;
+    stats->dirty = 0;
+    for (int i = 0; i < BCACHE_ENTRIES; i++) {
+        if (bcache_bufs[i].dirty) {
+            stats->dirty++;
+        }
+    }
+}
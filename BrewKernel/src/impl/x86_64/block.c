@@ -0,0 +1,302 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "block.h"
+#include "ide.h"
+#include "virtio_blk.h"
+#include "ahci.h"
+#include "irq.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Requests submitted per batch by the synchronous helpers
+#define BLOCK_BATCH 16
+
+static block_device_t* block_devices[BLOCK_MAX_DEVICES];
+static int block_device_count = 0;
+
+static int block_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+// Probe all storage drivers
+void block_init(void) {
+    ide_init();
+    virtio_blk_init();
+    ahci_init();
+}
+
+int block_register_device(block_device_t* dev) {
+    if (!dev || !dev->submit || block_device_count >= BLOCK_MAX_DEVICES) {
+        return -1;
+    }
+
+    if (dev->queue_depth < 1) dev->queue_depth = 1;
+    if (dev->max_segments < 1) dev->max_segments = 1;
+    if (dev->max_sectors < 1) dev->max_sectors = 1;
+
+    dev->queue_head = NULL;
+    dev->in_flight = 0;
+    dev->plugged = 0;
+    dev->last_read_lba = (uint64_t)-1;
+
+    block_devices[block_device_count++] = dev;
+    return 0;
+}
+
+int block_get_device_count(void) {
+    return block_device_count;
+}
+
+block_device_t* block_get_device(int index) {
+    if (index < 0 || index >= block_device_count) {
+        return NULL;
+    }
+    return block_devices[index];
+}
+
+block_device_t* block_find_device(const char* name) {
+    if (!name) return NULL;
+    for (int i = 0; i < block_device_count; i++) {
+        if (block_strcmp(block_devices[i]->name, name) == 0) {
+            return block_devices[i];
+        }
+    }
+    return NULL;
+}
+
+// Try to merge req into an already queued request. Must be called with interrupts off.
+static int block_try_merge(block_device_t* dev, block_request_t* req) {
+    block_request_t* prev = NULL;
+    block_request_t* q = dev->queue_head;
+
+    while (q) {
+        if (q->write == req->write && q->segments < dev->max_segments &&
+            q->total_count + req->count <= dev->max_sectors) {
+            // Back merge: req continues where q ends
+            if (q->lba + q->total_count == req->lba) {
+                block_request_t* tail = q;
+                while (tail->merge_next) {
+                    tail = tail->merge_next;
+                }
+                tail->merge_next = req;
+                q->total_count += req->count;
+                q->segments++;
+                dev->stat_merges++;
+                return 1;
+            }
+            // Front merge: req ends where q starts, req becomes the head
+            if (req->lba + req->count == q->lba) {
+                req->merge_next = q;
+                req->total_count = req->count + q->total_count;
+                req->segments = 1 + q->segments;
+                req->next = q->next;
+                q->next = NULL;
+                if (prev) {
+                    prev->next = req;
+                } else {
+                    dev->queue_head = req;
+                }
+                dev->stat_merges++;
+                return 1;
+            }
+        }
+        prev = q;
+        q = q->next;
+    }
+    return 0;
+}
+
+int block_submit(block_request_t* req) {
+    if (!req || !req->dev || !req->buffer || req->count == 0) {
+        return -1;
+    }
+
+    block_device_t* dev = req->dev;
+    if (req->lba + req->count > dev->sector_count || req->count > dev->max_sectors) {
+        return -1;
+    }
+
+    req->done = 0;
+    req->status = 0;
+    req->total_count = req->count;
+    req->segments = 1;
+    req->next = NULL;
+    req->merge_next = NULL;
+
+    unsigned long flags = irq_save();
+    dev->stat_requests++;
+
+    if (!block_try_merge(dev, req)) {
+        // Elevator insert: keep the queue sorted by LBA
+        block_request_t* prev = NULL;
+        block_request_t* q = dev->queue_head;
+        while (q && q->lba <= req->lba) {
+            prev = q;
+            q = q->next;
+        }
+        req->next = q;
+        if (prev) {
+            prev->next = req;
+        } else {
+            dev->queue_head = req;
+        }
+    }
+    irq_restore(flags);
+
+    if (!dev->plugged) {
+        block_dispatch(dev);
+    }
+    return 0;
+}
+
+void block_plug(block_device_t* dev) {
+    if (dev) dev->plugged++;
+}
+
+void block_unplug(block_device_t* dev) {
+    if (!dev || dev->plugged == 0) return;
+    dev->plugged--;
+    if (dev->plugged == 0) {
+        block_dispatch(dev);
+    }
+}
+
+void block_dispatch(block_device_t* dev) {
+    if (!dev) return;
+
+    unsigned long flags = irq_save();
+    int submitted = 0;
+    while (!dev->plugged && dev->queue_head && dev->in_flight < dev->queue_depth) {
+        block_request_t* req = dev->queue_head;
+        dev->queue_head = req->next;
+        req->next = NULL;
+
+        dev->in_flight++;
+        if (dev->submit(dev, req) != 0) {
+            // Hardware busy, put it back and retry on the next completion
+            dev->in_flight--;
+            req->next = dev->queue_head;
+            dev->queue_head = req;
+            break;
+        }
+        dev->stat_dispatched++;
+        submitted++;
+    }
+    if (submitted && dev->commit) {
+        dev->commit(dev);
+    }
+    irq_restore(flags);
+}
+
+void block_complete(block_device_t* dev, block_request_t* req, int status) {
+    if (!dev || !req) return;
+
+    if (status != 0) {
+        dev->stat_errors++;
+    } else if (req->write) {
+        dev->stat_sectors_written += req->total_count;
+    } else {
+        dev->stat_sectors_read += req->total_count;
+    }
+
+    block_request_t* seg = req;
+    while (seg) {
+        block_request_t* next = seg->merge_next;
+        seg->merge_next = NULL;
+        seg->status = status;
+        seg->done = 1;
+        if (seg->complete) {
+            seg->complete(seg);
+        }
+        seg = next;
+    }
+
+    if (dev->in_flight > 0) {
+        dev->in_flight--;
+    }
+    block_dispatch(dev);
+}
+
+int block_wait(block_request_t* req) {
+    if (!req) return -1;
+    block_device_t* dev = req->dev;
+
+    while (!req->done) {
+        if (dev && dev->poll) {
+            dev->poll(dev);
+        }
+        __asm__ __volatile__("pause");
+    }
+    return req->status;
+}
+
+static int block_transfer(block_device_t* dev, uint64_t lba, uint32_t count, void* buffer, int write) {
+    if (!dev || !buffer) return -1;
+
+    block_request_t reqs[BLOCK_BATCH];
+    uint8_t* buf = (uint8_t*)buffer;
+    int status = 0;
+
+    while (count > 0) {
+        int n = 0;
+        block_plug(dev);
+        while (count > 0 && n < BLOCK_BATCH) {
+            uint32_t chunk = count > dev->max_sectors ? dev->max_sectors : count;
+            block_request_t* req = &reqs[n];
+            req->dev = dev;
+            req->lba = lba;
+            req->count = chunk;
+            req->buffer = buf;
+            req->write = write;
+            req->complete = NULL;
+            req->private_data = NULL;
+            if (block_submit(req) != 0) {
+                status = -1;
+                break;
+            }
+            n++;
+            lba += chunk;
+            count -= chunk;
+            buf += (size_t)chunk * BLOCK_SECTOR_SIZE;
+        }
+        block_unplug(dev);
+
+        for (int i = 0; i < n; i++) {
+            if (block_wait(&reqs[i]) != 0) {
+                status = -1;
+            }
+        }
+        if (status != 0) {
+            break;
+        }
+    }
+    return status;
+}
+
+int block_read(block_device_t* dev, uint64_t lba, uint32_t count, void* buffer) {
+    return block_transfer(dev, lba, count, buffer, 0);
+}
+
+int block_write(block_device_t* dev, uint64_t lba, uint32_t count, const void* buffer) {
+    return block_transfer(dev, lba, count, (void*)buffer, 1);
+}
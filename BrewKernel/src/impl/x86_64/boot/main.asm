@@ -17,6 +17,7 @@
 ;
 
 global start
+global multiboot_info_ptr
 extern long_mode_start
 
 section .text
@@ -25,6 +26,10 @@ start:
     ; Initialize stack pointer
     mov esp, stack_top
 
+    ; Save the multiboot2 info pointer: the checks and paging setup below
+    ; clobber EBX (cpuid, the MMIO mapping loop)
+    mov [multiboot_info_ptr], ebx
+
     ; Perform necessary system checks before transitioning to long mode
     call check_multiboot
     call check_cpuid
@@ -33,6 +38,7 @@ start:
     ; Set up memory paging and enable long mode
     call setup_page_tables
     call enable_paging
+    call enable_sse
 
     ; Load Global Descriptor Table for 64-bit mode and jump to long mode
     lgdt [gdt64.pointer]
@@ -197,6 +203,21 @@ enable_paging:
 
     ret
 
+; Function: enable_sse
+; Enables SSE/SSE2 so the kernel can use XMM registers (SIMD string search)
+; SSE2 is architecturally guaranteed on every x86_64 CPU, so no CPUID check is needed
+enable_sse:
+    mov eax, cr0
+    and ax, 0xFFFB         ; Clear EM (no x87 emulation)
+    or ax, 1 << 1          ; Set MP (monitor coprocessor)
+    mov cr0, eax
+
+    mov eax, cr4
+    or eax, 3 << 9         ; Set OSFXSR and OSXMMEXCPT
+    mov cr4, eax
+
+    ret
+
 ; Display error code on screen and halts
 ; Input: AL register contains error code character
 error:
@@ -221,6 +242,8 @@ page_table_l2_mmio:      ; L2 table for MMIO region (4th GB)
 stack_bottom:              ; Kernel stack (16KB)
     resb 4096 * 4
 stack_top:
+multiboot_info_ptr:        ; Physical address of the multiboot2 info block
+    resd 1
 
 ; Read-only data section
 section .rodata
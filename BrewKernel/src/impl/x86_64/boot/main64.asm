@@ -24,6 +24,7 @@
 
 global long_mode_start
 extern kernel_main
+extern multiboot_info_ptr
 
 section .text
 bits 64
@@ -37,9 +38,9 @@ long_mode_start:
     mov fs, ax      ; Extra Segment 2
     mov gs, ax      ; Extra Segment 3
 
-    ; Multiboot info pointer is in EBX (32-bit register)
-    ; Move it to RDI for the first argument of kernel_main (64-bit register)
-    mov edi, ebx
+    ; Pass the multiboot info pointer saved by start (EBX no longer holds
+    ; it) in RDI, the first argument of kernel_main
+    mov edi, [multiboot_info_ptr]
 
     ; Call the C kernel main function
     call kernel_main
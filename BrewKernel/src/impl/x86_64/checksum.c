@@ -0,0 +1,148 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "checksum.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Buffers at least this long go through the SSE2 loop
+#define CSUM_SSE2_MIN 256
+
+typedef char v16qi __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+typedef long long v2di __attribute__((vector_size(16)));
+
+// Unaligned 64-bit load that may alias any type
+typedef uint64_t __attribute__((may_alias, aligned(1))) csum_u64_t;
+typedef uint32_t __attribute__((may_alias, aligned(1))) csum_u32_t;
+typedef uint16_t __attribute__((may_alias, aligned(1))) csum_u16_t;
+
+static inline uint64_t csum_add64(uint64_t acc, uint64_t value) {
+    __asm__("addq %1, %0\n\t"
+            "adcq $0, %0"
+            : "+r"(acc) : "r"(value) : "cc");
+    return acc;
+}
+
+// One's complement addition is byte order independent, so whole 64-bit
+// words are added with the carry wrapped back in; end-around carry makes
+// the result congruent to the 16-bit sum.
+static const uint8_t* csum_adc_blocks(const uint8_t* p, size_t* len, uint64_t* acc) {
+    uint64_t a = *acc;
+    while (*len >= 32) {
+        __asm__("addq 0(%[p]), %[a]\n\t"
+                "adcq 8(%[p]), %[a]\n\t"
+                "adcq 16(%[p]), %[a]\n\t"
+                "adcq 24(%[p]), %[a]\n\t"
+                "adcq $0, %[a]"
+                : [a] "+r"(a) : [p] "r"(p), "m"(*(const uint8_t(*)[32])p) : "cc");
+        p += 32;
+        *len -= 32;
+    }
+    *acc = a;
+    return p;
+}
+
+// Widen each 32-bit word to 64 bits and add with paddq: the lanes cannot
+// overflow for any realistic length, so no carries need handling in the loop.
+static const uint8_t* csum_sse2_blocks(const uint8_t* p, size_t* len, uint64_t* acc) {
+    const v4si zero = {0, 0, 0, 0};
+    v2di sum0 = {0, 0};
+    v2di sum1 = {0, 0};
+    while (*len >= 32) {
+        v4si a = (v4si)__builtin_ia32_loaddqu((const char*)p);
+        v4si b = (v4si)__builtin_ia32_loaddqu((const char*)p + 16);
+        sum0 += (v2di)__builtin_ia32_punpckldq128(a, zero);
+        sum1 += (v2di)__builtin_ia32_punpckhdq128(a, zero);
+        sum0 += (v2di)__builtin_ia32_punpckldq128(b, zero);
+        sum1 += (v2di)__builtin_ia32_punpckhdq128(b, zero);
+        p += 32;
+        *len -= 32;
+    }
+    sum0 += sum1;
+    *acc = csum_add64(*acc, (uint64_t)sum0[0]);
+    *acc = csum_add64(*acc, (uint64_t)sum0[1]);
+    return p;
+}
+
+uint32_t csum_partial(const void* data, size_t len, uint32_t sum) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t acc = sum;
+
+    if (len >= CSUM_SSE2_MIN) {
+        p = csum_sse2_blocks(p, &len, &acc);
+    } else {
+        p = csum_adc_blocks(p, &len, &acc);
+    }
+
+    while (len >= 8) {
+        acc = csum_add64(acc, *(const csum_u64_t*)p);
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        acc = csum_add64(acc, *(const csum_u32_t*)p);
+        p += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        acc = csum_add64(acc, *(const csum_u16_t*)p);
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        acc = csum_add64(acc, p[0]);  // Odd byte is the first of a word
+    }
+
+    acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+    acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+    return (uint32_t)acc;
+}
+
+uint16_t csum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+uint32_t csum_pseudo_ipv4(const uint8_t src[4], const uint8_t dst[4], uint8_t protocol, uint16_t length) {
+    uint8_t pseudo[12];
+    for (int i = 0; i < 4; i++) {
+        pseudo[i] = src[i];
+        pseudo[4 + i] = dst[i];
+    }
+    pseudo[8] = 0;
+    pseudo[9] = protocol;
+    pseudo[10] = (uint8_t)(length >> 8);
+    pseudo[11] = (uint8_t)(length & 0xFF);
+    return csum_partial(pseudo, sizeof(pseudo), 0);
+}
+
+// RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m')
+uint16_t csum_replace16(uint16_t check, uint16_t old_word, uint16_t new_word) {
+    uint32_t sum = (uint32_t)(uint16_t)~check + (uint16_t)~old_word + new_word;
+    return (uint16_t)~csum_fold(sum);
+}
+
+uint16_t csum_replace32(uint16_t check, uint32_t old_value, uint32_t new_value) {
+    uint32_t sum = (uint32_t)(uint16_t)~check;
+    sum += (uint16_t)~old_value + (uint16_t)~(old_value >> 16);
+    sum += (new_value & 0xFFFF) + (new_value >> 16);
+    return (uint16_t)~csum_fold(sum);
+}
@@ -22,6 +22,11 @@
 #include "pic.h"
 #include "io.h"
 #include "network.h"
+#include "memory.h"
+#include "cmdline.h"
+#include "pbuf.h"
+#include "checksum.h"
+#include "timer.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -38,12 +43,17 @@ static void* memcpy(void* dest, const void* src, size_t n) {
 // Static device instance
 static e1000_device_t e1000_dev;
 static int e1000_initialized = 0;
+uint32_t e1000_mmio_accesses = 0;
 
-// Static buffers for descriptors and packet data (physically contiguous)
-static e1000_tx_desc_t tx_descriptors[E1000_TX_RING_SIZE] __attribute__((aligned(16)));
-static e1000_rx_desc_t rx_descriptors[E1000_RX_RING_SIZE] __attribute__((aligned(16)));
-static uint8_t tx_buffers[E1000_TX_RING_SIZE][2048] __attribute__((aligned(16)));
-static uint8_t rx_buffers[E1000_RX_RING_SIZE][2048] __attribute__((aligned(16)));
+// Software TX queue used by E1000_TX_QUEUE while the ring is full. Slots
+// hold the largest frame; the queue is reallocated when the MTU grows.
+static uint8_t* swq_frames = NULL;
+static size_t swq_stride = 0;
+static uint16_t swq_lengths[E1000_TX_SWQ_SIZE];
+
+static inline uint8_t* e1000_swq_frame(uint16_t slot) {
+    return swq_frames + (size_t)slot * swq_stride;
+}
 
 // Read MAC address from EEPROM
 static int e1000_read_eeprom(volatile uint32_t* mmio_base, uint16_t offset, uint16_t* data) {
@@ -110,7 +120,8 @@ static int e1000_get_mac_address(volatile uint32_t* mmio_base, mac_address_t* ma
     return 0;
 }
 
-// Network card interrupt handler
+// Network card interrupt handler. Reading ICR acknowledges the causes; the
+// device is then masked and the rings are serviced later by the poll loop.
 static void e1000_irq_handler(void) {
     // Safety check - don't access device if not initialized
     if (!e1000_initialized || !e1000_dev.initialized || !e1000_dev.mmio_base) {
@@ -119,18 +130,322 @@ static void e1000_irq_handler(void) {
     
     volatile uint32_t* mmio = e1000_dev.mmio_base;
     uint32_t icr = e1000_read_reg(mmio, E1000_REG_ICR);
+    if (icr == 0) {
+        return;  // Shared line, not ours
+    }
+    e1000_dev.stat_irqs++;
     
-    // Handle transmit interrupt
-    if (icr & E1000_ICR_TXDW) {
-        // Transmit descriptor written back - can free buffers
-        // For now, we'll handle this in the transmit function
+    if (icr & E1000_ICR_LSC) {
+        e1000_dev.link_up = (e1000_read_reg(mmio, E1000_REG_STATUS) & E1000_STATUS_LU) != 0;
     }
     
-    // Handle receive interrupt
-    if (icr & E1000_ICR_RXT0) {
-        // Receive timer interrupt - check for received packets
-        // This will be handled in the receive function
+    if (icr & (E1000_ICR_RXT0 | E1000_ICR_RXO | E1000_ICR_TXDW)) {
+        e1000_write_reg(mmio, E1000_REG_IMC, 0xFFFFFFFF);
+        e1000_dev.poll_pending = 1;
+    }
+}
+
+// ITR holds the minimum interval between interrupts in 256ns units
+static void e1000_write_itr(uint32_t rate) {
+    uint32_t interval = rate ? 3906250 / rate : 0;  // 10^9 / 256 / rate
+    if (interval > 0xFFFF) interval = 0xFFFF;
+    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_ITR, interval);
+    e1000_dev.itr_current = rate;
+}
+
+// Microseconds to the 1.024us units of the delay timers
+static uint32_t e1000_delay_units(uint16_t usecs) {
+    return ((uint32_t)usecs * 1000 + 1023) / 1024;
+}
+
+static void e1000_apply_moderation(void) {
+    volatile uint32_t* mmio = e1000_dev.mmio_base;
+    const e1000_moderation_t* mod = &e1000_dev.moderation;
+    e1000_write_reg(mmio, E1000_REG_RDTR, e1000_delay_units(mod->rdtr));
+    e1000_write_reg(mmio, E1000_REG_RADV, e1000_delay_units(mod->radv));
+    e1000_write_reg(mmio, E1000_REG_TIDV, e1000_delay_units(mod->tidv));
+    e1000_write_reg(mmio, E1000_REG_TADV, e1000_delay_units(mod->tadv));
+    // TX delays only apply to descriptors that ask for them
+    e1000_dev.txd_ide = (mod->tidv || mod->tadv) ? E1000_TXD_CMD_IDE : 0;
+    e1000_write_itr(mod->adaptive ? E1000_ITR_DEFAULT : mod->itr);
+    e1000_dev.itr_sample_tick = timer_get_ticks();
+    e1000_dev.itr_sample_frames = e1000_dev.stat_rx_frames + e1000_dev.stat_tx_frames;
+}
+
+// Adaptive mode: sample the frame rate and move ITR between the low
+// latency, default and bulk rates. ITR is only written on a change.
+static void e1000_itr_adapt(void) {
+    uint64_t now = timer_get_ticks();
+    uint64_t elapsed = now - e1000_dev.itr_sample_tick;
+    if (elapsed < E1000_ITR_SAMPLE_TICKS) {
+        return;
+    }
+    uint32_t frames = e1000_dev.stat_rx_frames + e1000_dev.stat_tx_frames;
+    uint64_t pps = (uint64_t)(frames - e1000_dev.itr_sample_frames) * TIMER_FREQUENCY / elapsed;
+    e1000_dev.itr_sample_tick = now;
+    e1000_dev.itr_sample_frames = frames;
+    
+    uint32_t rate = E1000_ITR_DEFAULT;
+    if (pps < E1000_ITR_LOW_PPS) {
+        rate = E1000_ITR_LOW_LATENCY;
+    } else if (pps > E1000_ITR_BULK_PPS) {
+        rate = E1000_ITR_BULK;
+    }
+    if (rate != e1000_dev.itr_current) {
+        e1000_write_itr(rate);
+        e1000_dev.stat_itr_changes++;
+    }
+}
+
+void e1000_set_moderation(const e1000_moderation_t* mod) {
+    if (!e1000_initialized || !mod) {
+        return;
+    }
+    e1000_dev.moderation = *mod;
+    e1000_dev.moderation.adaptive = mod->adaptive ? 1 : 0;
+    e1000_apply_moderation();
+}
+
+void e1000_get_moderation(e1000_moderation_t* mod) {
+    if (mod) {
+        *mod = e1000_dev.moderation;
+    }
+}
+
+// Hand consumed RX descriptors back to the hardware in batches. Holding
+// a few back costs nothing while the ring is busy; force at the end of a poll.
+static void e1000_rx_doorbell(int force) {
+    uint16_t size = e1000_dev.rx_ring_size;
+    uint16_t pending = (uint16_t)((e1000_dev.rx_tail + size - e1000_dev.rx_tail_hw) % size);
+    uint16_t batch = size / 4 < E1000_RDT_BATCH ? size / 4 : E1000_RDT_BATCH;
+    if (pending == 0 || (!force && pending < batch)) {
+        return;
+    }
+    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RDT, e1000_dev.rx_tail);
+    e1000_dev.rx_tail_hw = e1000_dev.rx_tail;
+    e1000_dev.stat_rx_doorbells++;
+}
+
+// Announce filled TX descriptors. Deferred while a hold is active, unless
+// forced or a quarter of the ring is waiting.
+static void e1000_tx_doorbell(int force) {
+    uint16_t size = e1000_dev.tx_ring_size;
+    uint16_t pending = (uint16_t)((e1000_dev.tx_tail + size - e1000_dev.tx_tail_hw) % size);
+    if (pending == 0 || (!force && e1000_dev.tx_hold > 0 && pending < size / 4)) {
+        return;
+    }
+    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_TDT, e1000_dev.tx_tail);
+    e1000_dev.tx_tail_hw = e1000_dev.tx_tail;
+    e1000_dev.stat_tx_doorbells++;
+}
+
+void e1000_tx_hold(int hold) {
+    if (!e1000_initialized) {
+        return;
+    }
+    if (hold) {
+        e1000_dev.tx_hold++;
+    } else if (e1000_dev.tx_hold > 0 && --e1000_dev.tx_hold == 0) {
+        e1000_tx_doorbell(1);
+    }
+}
+
+int e1000_poll_pending(void) {
+    return e1000_initialized && e1000_dev.poll_pending;
+}
+
+void e1000_poll_complete(int drained) {
+    if (!e1000_initialized) {
+        return;
+    }
+    e1000_dev.stat_polls++;
+    if (e1000_dev.moderation.adaptive) {
+        e1000_itr_adapt();
+    }
+    e1000_rx_doorbell(drained);
+    if (!drained) {
+        e1000_dev.stat_budget_exhausted++;
+        return;  // Stay in polling mode
+    }
+    if (e1000_dev.irq_enabled) {
+        // Causes latched while masked raise the interrupt again right away
+        e1000_dev.poll_pending = 0;
+        e1000_write_reg(e1000_dev.mmio_base, E1000_REG_IMS, E1000_IMS_ENABLE);
+    }
+}
+
+// Round a requested ring size to what the hardware accepts
+static uint16_t e1000_ring_size(uint32_t n) {
+    if (n < E1000_RING_MIN) n = E1000_RING_MIN;
+    if (n > E1000_RING_MAX) n = E1000_RING_MAX;
+    return (uint16_t)((n + E1000_RING_ALIGN - 1) & ~(uint32_t)(E1000_RING_ALIGN - 1));
+}
+
+static inline uint8_t* e1000_tx_buf(uint16_t i) {
+    return e1000_dev.tx_buffers + (size_t)i * E1000_BUFFER_SIZE;
+}
+
+// Allocate rings of the given sizes and point the hardware at them. The
+// old rings are only released once all new allocations succeeded. The
+// transmitter and receiver must be disabled (or not yet enabled).
+static int e1000_setup_rings(uint16_t tx_size, uint16_t rx_size) {
+    // RX descriptors are backed by pbufs. Keep a second ring's worth free
+    // for the buffers the stack holds, plus room for TX.
+    if (pbuf_pool_reserve((uint32_t)rx_size * 2 + E1000_PBUF_TX_RESERVE) != 0) {
+        return -1;
+    }
+    
+    e1000_tx_desc_t* tx_desc = (e1000_tx_desc_t*)fs_allocate_aligned(tx_size * sizeof(e1000_tx_desc_t), 128);
+    e1000_rx_desc_t* rx_desc = (e1000_rx_desc_t*)fs_allocate_aligned(rx_size * sizeof(e1000_rx_desc_t), 128);
+    uint8_t* tx_bufs = (uint8_t*)fs_allocate_aligned((size_t)tx_size * E1000_BUFFER_SIZE, 4096);
+    pbuf_t** tx_pbufs = (pbuf_t**)fs_allocate(tx_size * sizeof(pbuf_t*));
+    pbuf_t** rx_pbufs = (pbuf_t**)fs_allocate(rx_size * sizeof(pbuf_t*));
+    int ok = tx_desc && rx_desc && tx_bufs && tx_pbufs && rx_pbufs;
+    for (uint16_t i = 0; ok && i < rx_size; i++) {
+        rx_pbufs[i] = pbuf_alloc_rx();
+        if (!rx_pbufs[i]) {
+            while (i > 0) {
+                pbuf_free(rx_pbufs[--i]);
+            }
+            ok = 0;
+        }
+    }
+    if (!ok) {
+        if (tx_desc) fs_free_aligned(tx_desc);
+        if (rx_desc) fs_free_aligned(rx_desc);
+        if (tx_bufs) fs_free_aligned(tx_bufs);
+        if (tx_pbufs) fs_free(tx_pbufs);
+        if (rx_pbufs) fs_free(rx_pbufs);
+        return -1;
+    }
+    
+    // Release the old rings and any pbufs still attached to them
+    if (e1000_dev.rx_pbufs) {
+        for (uint16_t i = 0; i < e1000_dev.rx_ring_size; i++) {
+            pbuf_free(e1000_dev.rx_pbufs[i]);
+        }
+        fs_free(e1000_dev.rx_pbufs);
+    }
+    if (e1000_dev.tx_pbufs) {
+        for (uint16_t i = 0; i < e1000_dev.tx_ring_size; i++) {
+            if (e1000_dev.tx_pbufs[i]) pbuf_free(e1000_dev.tx_pbufs[i]);
+        }
+        fs_free(e1000_dev.tx_pbufs);
+    }
+    if (e1000_dev.tx_descriptors) fs_free_aligned(e1000_dev.tx_descriptors);
+    if (e1000_dev.rx_descriptors) fs_free_aligned(e1000_dev.rx_descriptors);
+    if (e1000_dev.tx_buffers) fs_free_aligned(e1000_dev.tx_buffers);
+    
+    e1000_dev.tx_descriptors = tx_desc;
+    e1000_dev.rx_descriptors = rx_desc;
+    e1000_dev.tx_buffers = tx_bufs;
+    e1000_dev.tx_pbufs = tx_pbufs;
+    e1000_dev.rx_pbufs = rx_pbufs;
+    e1000_dev.tx_ring_size = tx_size;
+    e1000_dev.rx_ring_size = rx_size;
+    
+    // Initialize transmit descriptors
+    e1000_dev.tx_head = 0;
+    e1000_dev.tx_tail = 0;
+    e1000_dev.tx_tail_hw = 0;
+    e1000_dev.tx_ctx_loaded = 0;
+    for (uint16_t i = 0; i < tx_size; i++) {
+        tx_pbufs[i] = NULL;
+        tx_desc[i].buffer_addr = (uint64_t)(uintptr_t)e1000_tx_buf(i);
+        tx_desc[i].length = 0;
+        tx_desc[i].cso = 0;
+        tx_desc[i].cmd = 0;
+        tx_desc[i].status = 0;
+        tx_desc[i].css = 0;
+        tx_desc[i].special = 0;
+    }
+    
+    // Set up transmit descriptor ring
+    volatile uint32_t* mmio = e1000_dev.mmio_base;
+    uint64_t tx_desc_phys = (uint64_t)(uintptr_t)tx_desc;
+    e1000_write_reg(mmio, E1000_REG_TDBAL, (uint32_t)(tx_desc_phys & 0xFFFFFFFF));
+    e1000_write_reg(mmio, E1000_REG_TDBAH, (uint32_t)(tx_desc_phys >> 32));
+    e1000_write_reg(mmio, E1000_REG_TDLEN, (uint32_t)tx_size * sizeof(e1000_tx_desc_t));
+    e1000_write_reg(mmio, E1000_REG_TDH, 0);
+    e1000_write_reg(mmio, E1000_REG_TDT, 0);
+    
+    // Initialize receive descriptors
+    e1000_dev.rx_head = 0;
+    e1000_dev.rx_tail = rx_size - 1;  // Start with tail at last position
+    e1000_dev.rx_tail_hw = rx_size - 1;
+    for (uint16_t i = 0; i < rx_size; i++) {
+        rx_desc[i].buffer_addr = (uint64_t)(uintptr_t)rx_pbufs[i]->buf;
+        rx_desc[i].length = 0;
+        rx_desc[i].checksum = 0;
+        rx_desc[i].status = 0;
+        rx_desc[i].errors = 0;
+        rx_desc[i].special = 0;
+    }
+    
+    // Set up receive descriptor ring
+    uint64_t rx_desc_phys = (uint64_t)(uintptr_t)rx_desc;
+    e1000_write_reg(mmio, E1000_REG_RDBAL, (uint32_t)(rx_desc_phys & 0xFFFFFFFF));
+    e1000_write_reg(mmio, E1000_REG_RDBAH, (uint32_t)(rx_desc_phys >> 32));
+    e1000_write_reg(mmio, E1000_REG_RDLEN, (uint32_t)rx_size * sizeof(e1000_rx_desc_t));
+    e1000_write_reg(mmio, E1000_REG_RDH, 0);
+    e1000_write_reg(mmio, E1000_REG_RDT, rx_size - 1);
+    return 0;
+}
+
+// Program our address into the first receive address entry and clear the
+// rest, which may still hold values from firmware
+static void e1000_write_ra(void) {
+    volatile uint32_t* mmio = e1000_dev.mmio_base;
+    const uint8_t* mac = e1000_dev.mac_address.bytes;
+    uint32_t ral = (uint32_t)mac[0] | ((uint32_t)mac[1] << 8) |
+                   ((uint32_t)mac[2] << 16) | ((uint32_t)mac[3] << 24);
+    uint32_t rah = (uint32_t)mac[4] | ((uint32_t)mac[5] << 8) | E1000_RAH_AV;
+    e1000_write_reg(mmio, E1000_REG_RAL, ral);
+    e1000_write_reg(mmio, E1000_REG_RAH, rah);
+    for (int i = 1; i < E1000_RA_ENTRIES; i++) {
+        e1000_write_reg(mmio, (uint16_t)(E1000_REG_RAH + i * 8), 0);
+        e1000_write_reg(mmio, (uint16_t)(E1000_REG_RAL + i * 8), 0);
+    }
+}
+
+// MTA hash for RCTL.MO = 0: bits 47:36 of the address
+static uint32_t e1000_mta_hash(const mac_address_t* mac) {
+    return (((uint32_t)mac->bytes[4] >> 4) | ((uint32_t)mac->bytes[5] << 4)) & 0xFFF;
+}
+
+// Rebuild the multicast table from the joined groups
+static void e1000_write_mta(void) {
+    uint32_t table[E1000_MTA_ENTRIES];
+    for (int i = 0; i < E1000_MTA_ENTRIES; i++) {
+        table[i] = 0;
+    }
+    for (int i = 0; i < E1000_MCAST_MAX; i++) {
+        if (e1000_dev.mcast_refs[i]) {
+            uint32_t hash = e1000_mta_hash(&e1000_dev.mcast_addrs[i]);
+            table[hash >> 5] |= 1u << (hash & 0x1F);
+        }
+    }
+    for (int i = 0; i < E1000_MTA_ENTRIES; i++) {
+        e1000_write_reg(e1000_dev.mmio_base, (uint16_t)(E1000_REG_MTA + i * 4), table[i]);
+    }
+}
+
+static int e1000_mac_equal(const mac_address_t* a, const mac_address_t* b) {
+    for (int i = 0; i < 6; i++) {
+        if (a->bytes[i] != b->bytes[i]) {
+            return 0;
+        }
     }
+    return 1;
+}
+
+static int e1000_mcast_find(const mac_address_t* mac) {
+    for (int i = 0; i < E1000_MCAST_MAX; i++) {
+        if (e1000_dev.mcast_refs[i] && e1000_mac_equal(&e1000_dev.mcast_addrs[i], mac)) {
+            return i;
+        }
+    }
+    return -1;
 }
 
 // Initialize e1000 device
@@ -258,29 +573,54 @@ int e1000_init(pci_device_t* pci_dev) {
         e1000_dev.mac_address.bytes[5] = (uint8_t)((rah >> 8) & 0xFF);
     }
     
-    // Initialize transmit descriptors
-    e1000_dev.tx_descriptors = tx_descriptors;
-    e1000_dev.tx_head = 0;
-    e1000_dev.tx_tail = 0;
+    // Full ring handling and statistics
+    e1000_dev.tx_policy = E1000_TX_SPIN;
+    e1000_dev.tx_spin_budget = E1000_TX_SPIN_DEFAULT;
+    e1000_dev.swq_head = 0;
+    e1000_dev.swq_count = 0;
+    e1000_dev.stat_tx_ring_full = 0;
+    e1000_dev.stat_tx_reclaimed = 0;
+    e1000_dev.stat_tx_queued = 0;
+    e1000_dev.stat_tx_dropped = 0;
+    e1000_dev.stat_tx_doorbells = 0;
+    e1000_dev.stat_tx_frames = 0;
+    e1000_dev.stat_rx_doorbells = 0;
+    e1000_dev.stat_rx_frames = 0;
     
-    for (int i = 0; i < E1000_TX_RING_SIZE; i++) {
-        e1000_dev.tx_buffers[i] = tx_buffers[i];
-        e1000_dev.tx_descriptors[i].buffer_addr = (uint64_t)(uintptr_t)tx_buffers[i];
-        e1000_dev.tx_descriptors[i].length = 0;
-        e1000_dev.tx_descriptors[i].cso = 0;
-        e1000_dev.tx_descriptors[i].cmd = 0;
-        e1000_dev.tx_descriptors[i].status = 0;
-        e1000_dev.tx_descriptors[i].css = 0;
-        e1000_dev.tx_descriptors[i].special = 0;
-    }
+    // Allocate and program both descriptor rings
+    uint32_t tx_size = E1000_TX_RING_DEFAULT;
+    uint32_t rx_size = E1000_RX_RING_DEFAULT;
+    cmdline_get_uint("e1000.txring", &tx_size);
+    cmdline_get_uint("e1000.rxring", &rx_size);
+    e1000_dev.tx_descriptors = NULL;
+    e1000_dev.rx_descriptors = NULL;
+    e1000_dev.tx_buffers = NULL;
+    e1000_dev.tx_pbufs = NULL;
+    e1000_dev.rx_pbufs = NULL;
+    e1000_dev.stat_rx_loaned = 0;
+    e1000_dev.stat_tx_sg_refs = 0;
+    e1000_dev.stat_tx_csum_hw = 0;
+    e1000_dev.stat_tx_csum_sw = 0;
+    e1000_dev.stat_rx_csum_ok = 0;
+    e1000_dev.stat_rx_csum_bad = 0;
+    e1000_dev.stat_rx_csum_none = 0;
+    e1000_dev.stat_rx_loan_starved = 0;
+    e1000_dev.stat_rx_jumbo = 0;
+    e1000_dev.stat_rx_oversize = 0;
     
-    // Set up transmit descriptor ring
-    uint64_t tx_desc_phys = (uint64_t)(uintptr_t)tx_descriptors;
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_TDBAL, (uint32_t)(tx_desc_phys & 0xFFFFFFFF));
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_TDBAH, (uint32_t)(tx_desc_phys >> 32));
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_TDLEN, E1000_TX_RING_SIZE * sizeof(e1000_tx_desc_t));
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_TDH, 0);
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_TDT, 0);
+    // Standard frames until e1000_set_mtu() says otherwise
+    e1000_dev.mtu = ETH_MTU_DEFAULT;
+    e1000_dev.frame_max = ETH_FRAME_SIZE(ETH_MTU_DEFAULT);
+    if (!swq_frames) {
+        swq_frames = (uint8_t*)fs_allocate((size_t)E1000_TX_SWQ_SIZE * e1000_dev.frame_max);
+        if (!swq_frames) {
+            return -1;
+        }
+        swq_stride = e1000_dev.frame_max;
+    }
+    if (e1000_setup_rings(e1000_ring_size(tx_size), e1000_ring_size(rx_size)) != 0) {
+        return -1;
+    }
     
     // Configure transmit control
     uint32_t tctl = E1000_TCTL_EN | E1000_TCTL_PSP | (E1000_TCTL_CT & (0x10 << 4)) | (E1000_TCTL_COLD & (0x40 << 12));
@@ -289,55 +629,96 @@ int e1000_init(pci_device_t* pci_dev) {
     // Set inter-packet gap
     e1000_write_reg(e1000_dev.mmio_base, E1000_REG_TIPG, 0x0060200A);
     
-    // Initialize receive descriptors
-    e1000_dev.rx_descriptors = rx_descriptors;
-    e1000_dev.rx_head = 0;
-    e1000_dev.rx_tail = E1000_RX_RING_SIZE - 1;  // Start with tail at last position
-    
-    for (int i = 0; i < E1000_RX_RING_SIZE; i++) {
-        e1000_dev.rx_buffers[i] = rx_buffers[i];
-        e1000_dev.rx_descriptors[i].buffer_addr = (uint64_t)(uintptr_t)rx_buffers[i];
-        e1000_dev.rx_descriptors[i].length = 0;
-        e1000_dev.rx_descriptors[i].checksum = 0;
-        e1000_dev.rx_descriptors[i].status = 0;
-        e1000_dev.rx_descriptors[i].errors = 0;
-        e1000_dev.rx_descriptors[i].special = 0;
+    // Receive filters: exact match on our address, nothing joined yet
+    e1000_dev.mcast_count = 0;
+    for (int i = 0; i < E1000_MCAST_MAX; i++) {
+        e1000_dev.mcast_refs[i] = 0;
     }
-    
-    // Set up receive descriptor ring
-    uint64_t rx_desc_phys = (uint64_t)(uintptr_t)rx_descriptors;
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RDBAL, (uint32_t)(rx_desc_phys & 0xFFFFFFFF));
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RDBAH, (uint32_t)(rx_desc_phys >> 32));
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RDLEN, E1000_RX_RING_SIZE * sizeof(e1000_rx_desc_t));
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RDH, 0);
-    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RDT, E1000_RX_RING_SIZE - 1);
+    e1000_write_ra();
+    e1000_write_mta();
+    uint32_t promisc = 0;
+    cmdline_get_uint("e1000.promisc", &promisc);
+    e1000_dev.promisc = promisc ? 1 : 0;
     
     // Configure receive control
-    uint32_t rctl = E1000_RCTL_EN | E1000_RCTL_SBP | E1000_RCTL_UPE | E1000_RCTL_MPE |
-                    E1000_RCTL_LPE | E1000_RCTL_LBM_NONE | E1000_RCTL_RDMTS_HALF |
+    uint32_t rctl = E1000_RCTL_EN | E1000_RCTL_LBM_NONE | E1000_RCTL_RDMTS_HALF |
                     E1000_RCTL_MO_36 | E1000_RCTL_BAM | E1000_RCTL_BSIZE_2048 | E1000_RCTL_SECRC;
+    if (e1000_dev.promisc) {
+        rctl |= E1000_RCTL_UPE | E1000_RCTL_MPE;
+    }
     e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RCTL, rctl);
     
+    // Checksum offload, unless disabled with e1000.csum=0
+    uint32_t csum_offload = 1;
+    cmdline_get_uint("e1000.csum", &csum_offload);
+    e1000_dev.csum_offload = csum_offload ? 1 : 0;
+    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RXCSUM,
+                    e1000_dev.csum_offload ? (E1000_RXCSUM_IPOFL | E1000_RXCSUM_TUOFL) : 0);
+    
     // Enable link
     ctrl = e1000_read_reg(e1000_dev.mmio_base, E1000_REG_CTRL);
     e1000_write_reg(e1000_dev.mmio_base, E1000_REG_CTRL, ctrl | E1000_CTRL_SLU);
     
-    // Enable interrupts (IRQ line from PCI config)
-    // Note: We'll set up interrupts but don't enable them yet to avoid crashes
-    // Interrupts can be enabled later once everything is stable
+    e1000_dev.link_up = (e1000_read_reg(e1000_dev.mmio_base, E1000_REG_STATUS) & E1000_STATUS_LU) != 0;
+    e1000_dev.stat_irqs = 0;
+    e1000_dev.stat_polls = 0;
+    e1000_dev.stat_budget_exhausted = 0;
+    
+    // Interrupt moderation: adaptive ITR unless e1000.itr=<rate> fixes it.
+    // Delay timers are off unless set with e1000.rdtr= and friends.
+    e1000_moderation_t* mod = &e1000_dev.moderation;
+    uint32_t value = 1;
+    cmdline_get_uint("e1000.adaptive", &value);
+    mod->adaptive = value ? 1 : 0;
+    mod->itr = E1000_ITR_DEFAULT;
+    if (cmdline_get_uint("e1000.itr", &value) == 0) {
+        mod->itr = value;
+        mod->adaptive = 0;
+    }
+    value = 0;
+    cmdline_get_uint("e1000.rdtr", &value);
+    mod->rdtr = (uint16_t)(value > E1000_DELAY_MAX ? E1000_DELAY_MAX : value);
+    value = 0;
+    cmdline_get_uint("e1000.radv", &value);
+    mod->radv = (uint16_t)(value > E1000_DELAY_MAX ? E1000_DELAY_MAX : value);
+    value = 0;
+    cmdline_get_uint("e1000.tidv", &value);
+    mod->tidv = (uint16_t)(value > E1000_DELAY_MAX ? E1000_DELAY_MAX : value);
+    value = 0;
+    cmdline_get_uint("e1000.tadv", &value);
+    mod->tadv = (uint16_t)(value > E1000_DELAY_MAX ? E1000_DELAY_MAX : value);
+    e1000_dev.stat_itr_changes = 0;
+    e1000_apply_moderation();
+    
+    // Enable interrupts: an MSI vector if the device offers one, else the
+    // IRQ line from PCI config. Without either the driver stays in polled mode.
+    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_IMC, 0xFFFFFFFF);
+    (void)e1000_read_reg(e1000_dev.mmio_base, E1000_REG_ICR);
+    e1000_dev.poll_pending = 1;
+    e1000_dev.irq_enabled = 0;
+    e1000_dev.msi_vector = pci_msi_enable(pci_dev, e1000_irq_handler);
     uint8_t irq_line = (uint8_t)(pci_read_config(pci_dev->bus, pci_dev->device, pci_dev->function, 0x3C) & 0xFF);
-    if (irq_line < 16 && irq_line > 0) {
+    if (e1000_dev.msi_vector >= 0) {
+        e1000_dev.irq_enabled = 1;
+    } else if (irq_line < 16 && irq_line > 0) {
+        e1000_dev.irq = irq_line;
+        e1000_dev.irq_enabled = 1;
         irq_register_handler(irq_line, e1000_irq_handler);
-        // Don't enable PIC interrupt yet - enable it after testing
-        // pic_irq_enable(irq_line);
-        
-        // Don't enable interrupt mask yet
-        // e1000_write_reg(e1000_dev.mmio_base, E1000_REG_IMS, E1000_ICR_TXDW | E1000_ICR_RXT0);
+        pic_irq_enable(irq_line);
+    }
+    if (e1000_dev.irq_enabled) {
+        e1000_write_reg(e1000_dev.mmio_base, E1000_REG_IMS, E1000_IMS_ENABLE);
     }
     
     e1000_dev.initialized = 1;
     e1000_initialized = 1;
     
+    // Jumbo frames with e1000.mtu=<n>
+    uint32_t mtu = 0;
+    if (cmdline_get_uint("e1000.mtu", &mtu) == 0 && mtu != ETH_MTU_DEFAULT) {
+        e1000_set_mtu(mtu);
+    }
+    
     return 0;
 }
 
@@ -349,86 +730,887 @@ e1000_device_t* e1000_get_device(void) {
     return &e1000_dev;
 }
 
-// Send a packet
-int e1000_send_packet(const void* data, size_t length) {
+// Free descriptors (one slot stays empty to tell a full ring from an empty one)
+static uint16_t e1000_tx_free(void) {
+    return (uint16_t)((e1000_dev.tx_head + e1000_dev.tx_ring_size - e1000_dev.tx_tail - 1) % e1000_dev.tx_ring_size);
+}
+
+// Descriptors a copied frame takes, one per slot buffer
+static inline uint16_t e1000_tx_descs(size_t length) {
+    return (uint16_t)((length + E1000_BUFFER_SIZE - 1) / E1000_BUFFER_SIZE);
+}
+
+// Copy a frame into the slot buffers from tx_tail on (more than one for
+// jumbo frames); the caller checked e1000_tx_descs() are free and writes TDT
+static void e1000_tx_fill(const void* data, size_t length) {
+    const uint8_t* src = (const uint8_t*)data;
+    while (length > 0) {
+        uint16_t tail = e1000_dev.tx_tail;
+        size_t chunk = length > E1000_BUFFER_SIZE ? E1000_BUFFER_SIZE : length;
+        memcpy(e1000_tx_buf(tail), src, chunk);
+        src += chunk;
+        length -= chunk;
+        
+        e1000_dev.tx_descriptors[tail].buffer_addr = (uint64_t)(uintptr_t)e1000_tx_buf(tail);
+        e1000_dev.tx_descriptors[tail].length = (uint16_t)chunk;
+        e1000_dev.tx_descriptors[tail].cso = 0;
+        e1000_dev.tx_descriptors[tail].cmd = E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS | e1000_dev.txd_ide |
+                                             (length == 0 ? E1000_TXD_CMD_EOP : 0);
+        e1000_dev.tx_descriptors[tail].status = 0;
+        e1000_dev.tx_descriptors[tail].css = 0;
+        e1000_dev.tx_tail = (tail + 1) % e1000_dev.tx_ring_size;
+    }
+}
+
+// Offsets of the one context the driver uses: Ethernet, 20 byte IPv4
+// header, UDP
+#define E1000_CSUM_IP_START   ETH_HEADER_SIZE
+#define E1000_CSUM_IP_FIELD   (ETH_HEADER_SIZE + 10)
+#define E1000_CSUM_L4_START   (ETH_HEADER_SIZE + 20)
+#define E1000_CSUM_UDP_FIELD  (ETH_HEADER_SIZE + 20 + 6)
+
+int e1000_csum_offload(void) {
+    return e1000_initialized && e1000_dev.csum_offload;
+}
+
+// The context only fits IPv4 without options
+static int e1000_csum_fits(const uint8_t* frame, size_t length) {
+    return length > E1000_CSUM_L4_START && frame[12] == 0x08 && frame[13] == 0x00 && frame[14] == 0x45;
+}
+
+// Do what the hardware would: fill the IPv4 header checksum and finish the
+// UDP checksum, whose field already holds the pseudo header sum
+static void e1000_csum_software(uint8_t* frame, size_t length, uint8_t csum) {
+    if (length <= E1000_CSUM_IP_START + 20) {
+        return;
+    }
+    size_t ihl = (size_t)(frame[E1000_CSUM_IP_START] & 0x0F) * 4;
+    if (csum & PBUF_CSUM_TX_IP) {
+        uint8_t* ip = frame + E1000_CSUM_IP_START;
+        ip[10] = 0;
+        ip[11] = 0;
+        uint16_t sum = (uint16_t)~csum_fold(csum_partial(ip, ihl, 0));
+        ip[10] = (uint8_t)(sum & 0xFF);
+        ip[11] = (uint8_t)(sum >> 8);
+    }
+    size_t l4 = E1000_CSUM_IP_START + ihl;
+    if ((csum & PBUF_CSUM_TX_UDP) && length >= l4 + 8) {
+        uint16_t sum = (uint16_t)~csum_fold(csum_partial(frame + l4, length - l4, 0));
+        if (sum == 0) {
+            sum = 0xFFFF;  // 0 means "no checksum" for UDP
+        }
+        frame[l4 + 6] = (uint8_t)(sum & 0xFF);
+        frame[l4 + 7] = (uint8_t)(sum >> 8);
+    }
+    e1000_dev.stat_tx_csum_sw++;
+}
+
+// e1000_csum_software() for a frame packed into the slot buffers from
+// 'first' on. Every slot but the last is full and the headers sit in the
+// first one; slot boundaries fall on even offsets, so the per-slot sums
+// of the UDP checksum simply add up.
+static void e1000_csum_software_slots(uint16_t first, size_t length, uint8_t csum) {
+    uint8_t* frame = e1000_tx_buf(first);
+    if (length <= E1000_BUFFER_SIZE) {
+        e1000_csum_software(frame, length, csum);
+        return;
+    }
+    e1000_csum_software(frame, E1000_BUFFER_SIZE, csum & PBUF_CSUM_TX_IP);
+    if (!(csum & PBUF_CSUM_TX_UDP)) {
+        return;
+    }
+    size_t l4 = E1000_CSUM_IP_START + (size_t)(frame[E1000_CSUM_IP_START] & 0x0F) * 4;
+    uint32_t sum = csum_partial(frame + l4, E1000_BUFFER_SIZE - l4, 0);
+    size_t left = length - E1000_BUFFER_SIZE;
+    for (uint16_t i = (first + 1) % e1000_dev.tx_ring_size; left > 0; i = (i + 1) % e1000_dev.tx_ring_size) {
+        size_t chunk = left > E1000_BUFFER_SIZE ? E1000_BUFFER_SIZE : left;
+        sum = csum_partial(e1000_tx_buf(i), chunk, sum);
+        left -= chunk;
+    }
+    uint16_t check = (uint16_t)~csum_fold(sum);
+    if (check == 0) {
+        check = 0xFFFF;  // 0 means "no checksum" for UDP
+    }
+    frame[l4 + 6] = (uint8_t)(check & 0xFF);
+    frame[l4 + 7] = (uint8_t)(check >> 8);
+}
+
+// e1000_csum_fits() on the first bytes of a gathered frame
+static int e1000_sg_csum_fits(const e1000_sg_t* segs, int nsegs, size_t total) {
+    uint8_t head[E1000_CSUM_IP_START + 1];
+    size_t have = 0;
+    for (int i = 0; i < nsegs && have < sizeof(head); i++) {
+        size_t n = segs[i].length;
+        if (n > sizeof(head) - have) {
+            n = sizeof(head) - have;
+        }
+        memcpy(head + have, segs[i].data, n);
+        have += n;
+    }
+    return have == sizeof(head) && e1000_csum_fits(head, total);
+}
+
+// Load the IPv4/UDP offload context at the tail unless the hardware
+// already has it. Returns the number of descriptors used.
+static int e1000_tx_context(void) {
+    if (e1000_dev.tx_ctx_loaded) {
+        return 0;
+    }
+    uint16_t tail = e1000_dev.tx_tail;
+    volatile e1000_tx_context_desc_t* ctx = (volatile e1000_tx_context_desc_t*)&e1000_dev.tx_descriptors[tail];
+    ctx->ipcss = E1000_CSUM_IP_START;
+    ctx->ipcso = E1000_CSUM_IP_FIELD;
+    ctx->ipcse = E1000_CSUM_L4_START - 1;
+    ctx->tucss = E1000_CSUM_L4_START;
+    ctx->tucso = E1000_CSUM_UDP_FIELD;
+    ctx->tucse = 0;
+    ctx->cmd_and_length = (uint32_t)(E1000_TXC_TUCMD_DEXT | E1000_TXC_TUCMD_IP | E1000_TXC_TUCMD_RS) << 24;
+    ctx->status = 0;
+    ctx->hdr_len = 0;
+    ctx->mss = 0;
+    e1000_dev.tx_pbufs[tail] = NULL;
+    e1000_dev.tx_tail = (tail + 1) % e1000_dev.tx_ring_size;
+    e1000_dev.tx_ctx_loaded = 1;
+    return 1;
+}
+
+// Point a descriptor at a buffer. Non-zero popts selects the extended
+// data format with checksum insertion.
+static void e1000_tx_desc_set(uint16_t idx, const void* buf, uint16_t length, uint8_t cmd, uint8_t popts) {
+    volatile e1000_tx_desc_t* desc = &e1000_dev.tx_descriptors[idx];
+    desc->buffer_addr = (uint64_t)(uintptr_t)buf;
+    desc->length = length;
+    cmd |= e1000_dev.txd_ide;
+    desc->cso = popts ? E1000_TXD_DTYP_DATA : 0;
+    desc->cmd = popts ? (uint8_t)(cmd | E1000_TXD_CMD_DEXT) : cmd;
+    desc->status = 0;
+    desc->css = popts;
+}
+
+static uint8_t e1000_csum_popts(uint8_t csum) {
+    uint8_t popts = 0;
+    if (csum & PBUF_CSUM_TX_IP) popts |= E1000_TXD_POPTS_IXSM;
+    if (csum & PBUF_CSUM_TX_UDP) popts |= E1000_TXD_POPTS_TXSM;
+    return popts;
+}
+
+void e1000_set_csum_offload(int enable) {
+    if (!e1000_initialized) {
+        return;
+    }
+    e1000_dev.csum_offload = enable ? 1 : 0;
+    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RXCSUM,
+                    enable ? (E1000_RXCSUM_IPOFL | E1000_RXCSUM_TUOFL) : 0);
+}
+
+void e1000_set_promisc(int enable) {
+    if (!e1000_initialized) {
+        return;
+    }
+    unsigned long flags = irq_save();
+    e1000_dev.promisc = enable ? 1 : 0;
+    uint32_t rctl = e1000_read_reg(e1000_dev.mmio_base, E1000_REG_RCTL);
+    if (enable) {
+        rctl |= E1000_RCTL_UPE | E1000_RCTL_MPE;
+    } else {
+        rctl &= ~(uint32_t)(E1000_RCTL_UPE | E1000_RCTL_MPE);
+    }
+    e1000_write_reg(e1000_dev.mmio_base, E1000_REG_RCTL, rctl);
+    irq_restore(flags);
+}
+
+int e1000_mcast_join(const mac_address_t* mac) {
+    if (!e1000_initialized || !mac || !(mac->bytes[0] & 0x01)) {
+        return -1;
+    }
+    int slot = e1000_mcast_find(mac);
+    if (slot >= 0) {
+        if (e1000_dev.mcast_refs[slot] == 0xFF) {
+            return -1;
+        }
+        e1000_dev.mcast_refs[slot]++;
+        return 0;
+    }
+    for (int i = 0; i < E1000_MCAST_MAX; i++) {
+        if (!e1000_dev.mcast_refs[i]) {
+            e1000_dev.mcast_addrs[i] = *mac;
+            e1000_dev.mcast_refs[i] = 1;
+            e1000_dev.mcast_count++;
+            e1000_write_mta();
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int e1000_mcast_leave(const mac_address_t* mac) {
+    if (!e1000_initialized || !mac) {
+        return -1;
+    }
+    int slot = e1000_mcast_find(mac);
+    if (slot < 0) {
+        return -1;
+    }
+    if (--e1000_dev.mcast_refs[slot] == 0) {
+        e1000_dev.mcast_count--;
+        e1000_write_mta();  // Other groups may share the hash bit
+    }
+    return 0;
+}
+
+int e1000_mcast_member(const mac_address_t* mac) {
+    return e1000_initialized && e1000_mcast_find(mac) >= 0;
+}
+
+// Collect finished descriptors between tx_head and tx_tail. Only descriptor
+// memory is read; the hardware sets DD in order, so the scan stops at the
+// first one still owned by the device.
+static int e1000_tx_clean(void) {
+    int reclaimed = 0;
+    uint16_t head = e1000_dev.tx_head;
+    while (head != e1000_dev.tx_tail) {
+        volatile e1000_tx_desc_t* desc = &e1000_dev.tx_descriptors[head];
+        if (!(desc->status & E1000_TXD_STAT_DD)) {
+            break;
+        }
+        desc->status = 0;
+        if (e1000_dev.tx_pbufs[head]) {
+            pbuf_free(e1000_dev.tx_pbufs[head]);
+            e1000_dev.tx_pbufs[head] = NULL;
+        }
+        head = (head + 1) % e1000_dev.tx_ring_size;
+        reclaimed++;
+    }
+    e1000_dev.tx_head = head;
+    e1000_dev.stat_tx_reclaimed += reclaimed;
+    return reclaimed;
+}
+
+int e1000_tx_reclaim(void) {
+    if (!e1000_initialized || !e1000_dev.initialized) {
+        return 0;
+    }
+    
+    unsigned long flags = irq_save();
+    int reclaimed = e1000_tx_clean();
+    
+    // Move queued frames into the freed slots, oldest first
+    int moved = 0;
+    while (e1000_dev.swq_count > 0 &&
+           e1000_tx_free() >= e1000_tx_descs(swq_lengths[e1000_dev.swq_head])) {
+        uint16_t slot = e1000_dev.swq_head;
+        e1000_tx_fill(e1000_swq_frame(slot), swq_lengths[slot]);
+        e1000_dev.swq_head = (slot + 1) % E1000_TX_SWQ_SIZE;
+        e1000_dev.swq_count--;
+        moved++;
+    }
+    if (moved) {
+        e1000_tx_doorbell(1);
+        e1000_dev.stat_tx_frames += moved;
+    }
+    irq_restore(flags);
+    return reclaimed;
+}
+
+void e1000_set_tx_policy(e1000_tx_policy_t policy, uint32_t spin_budget) {
+    e1000_dev.tx_policy = policy;
+    e1000_dev.tx_spin_budget = spin_budget ? spin_budget : E1000_TX_SPIN_DEFAULT;
+}
+
+int e1000_set_ring_sizes(uint32_t tx_size, uint32_t rx_size) {
     if (!e1000_initialized || !e1000_dev.initialized) {
         return -1;
     }
     
-    if (length > 2048) {
-        return -1;  // Packet too large
+    volatile uint32_t* mmio = e1000_dev.mmio_base;
+    
+    // Quiesce: mask interrupts, stop the receiver and let queued frames go out
+    e1000_write_reg(mmio, E1000_REG_IMC, 0xFFFFFFFF);
+    uint32_t rctl = e1000_read_reg(mmio, E1000_REG_RCTL);
+    e1000_write_reg(mmio, E1000_REG_RCTL, rctl & ~E1000_RCTL_EN);
+    e1000_tx_doorbell(1);
+    for (uint32_t spins = 0; e1000_dev.tx_head != e1000_dev.tx_tail && spins < E1000_QUIESCE_SPINS; spins++) {
+        __asm__ __volatile__("pause");
+        e1000_tx_clean();
+    }
+    
+    // The receiver finishes a frame in progress after RCTL.EN clears; RX
+    // DMA is idle once RDH stops moving
+    uint32_t rdh = e1000_read_reg(mmio, E1000_REG_RDH);
+    uint32_t stable = 0;
+    for (uint32_t spins = 0; stable < E1000_RX_IDLE_READS && spins < E1000_QUIESCE_SPINS; spins++) {
+        __asm__ __volatile__("pause");
+        uint32_t now = e1000_read_reg(mmio, E1000_REG_RDH);
+        stable = (now == rdh) ? stable + 1 : 0;
+        rdh = now;
+    }
+    
+    // The rings and their buffers may still be read by DMA: keep them
+    if (e1000_dev.tx_head != e1000_dev.tx_tail || stable < E1000_RX_IDLE_READS) {
+        e1000_write_reg(mmio, E1000_REG_RCTL, rctl);
+        e1000_dev.poll_pending = 1;
+        if (e1000_dev.irq_enabled) {
+            e1000_write_reg(mmio, E1000_REG_IMS, E1000_IMS_ENABLE);
+        }
+        return -1;
     }
+    uint32_t tctl = e1000_read_reg(mmio, E1000_REG_TCTL);
+    e1000_write_reg(mmio, E1000_REG_TCTL, tctl & ~E1000_TCTL_EN);
     
+    int result = e1000_setup_rings(e1000_ring_size(tx_size), e1000_ring_size(rx_size));
+    
+    // Restart; a poll moves anything left in the software queue to the new ring
+    e1000_write_reg(mmio, E1000_REG_TCTL, tctl | E1000_TCTL_EN);
+    e1000_write_reg(mmio, E1000_REG_RCTL, rctl | E1000_RCTL_EN);
+    e1000_dev.poll_pending = 1;
+    if (e1000_dev.irq_enabled) {
+        e1000_write_reg(mmio, E1000_REG_IMS, E1000_IMS_ENABLE);
+    }
+    return result;
+}
+
+int e1000_set_mtu(uint32_t mtu) {
+    if (!e1000_initialized || !e1000_dev.initialized || mtu < ETH_MTU_MIN || mtu > ETH_MTU_MAX) {
+        return -1;
+    }
+    if (mtu > ETH_MTU_DEFAULT && pbuf_jumbo_reserve(E1000_PBUF_JUMBO_RESERVE) != 0) {
+        return -1;
+    }
+    uint16_t frame_max = (uint16_t)ETH_FRAME_SIZE(mtu);
+    
+    // A larger frame limit needs a larger software queue; swap it while empty
+    if (frame_max > swq_stride) {
+        uint8_t* frames = (uint8_t*)fs_allocate((size_t)E1000_TX_SWQ_SIZE * frame_max);
+        if (!frames) {
+            return -1;
+        }
+        e1000_tx_flush();
+        unsigned long flags = irq_save();
+        if (e1000_dev.swq_count > 0) {
+            irq_restore(flags);
+            fs_free(frames);
+            return -1;
+        }
+        uint8_t* old = swq_frames;
+        swq_frames = frames;
+        swq_stride = frame_max;
+        e1000_dev.frame_max = frame_max;
+        irq_restore(flags);
+        fs_free(old);
+    } else {
+        e1000_dev.frame_max = frame_max;
+    }
+    e1000_dev.mtu = (uint16_t)mtu;
+    
+    // Long Packet Enable lets frames over 1522 bytes through; they fill
+    // several 2KB buffers
     volatile uint32_t* mmio = e1000_dev.mmio_base;
+    uint32_t rctl = e1000_read_reg(mmio, E1000_REG_RCTL);
+    if (mtu > ETH_MTU_DEFAULT) {
+        rctl |= E1000_RCTL_LPE;
+    } else {
+        rctl &= ~(uint32_t)E1000_RCTL_LPE;
+    }
+    e1000_write_reg(mmio, E1000_REG_RCTL, rctl);
+    return 0;
+}
+
+// Queue up to n frames with a single TDT write for everything placed in the
+// ring. Frames that do not fit are handled by the full ring policy. Returns
+// the number of frames accepted (sent or queued in software).
+int e1000_send_burst(const e1000_frame_t* frames, int n) {
+    if (!e1000_initialized || !e1000_dev.initialized || !frames) {
+        return 0;
+    }
+    
+    int accepted = 0;
+    
+    // Reclaim in batches rather than on every send
+    if (e1000_tx_free() < E1000_TX_RECLAIM_THRESH || e1000_tx_free() < n) {
+        e1000_tx_reclaim();
+    }
+    
+    while (accepted < n) {
+        const e1000_frame_t* f = &frames[accepted];
+        if (f->length == 0 || f->length > e1000_dev.frame_max) {
+            break;  // Packet too large
+        }
+        uint16_t needed = e1000_tx_descs(f->length);
+        
+        // Queued frames go first to keep the order
+        if (e1000_tx_free() < needed || e1000_dev.swq_count > 0) {
+            e1000_dev.stat_tx_ring_full++;
+            
+            // Let the hardware start on what is already filled in
+            e1000_tx_doorbell(1);
+            
+            if (e1000_dev.tx_policy == E1000_TX_SPIN) {
+                uint32_t spins = 0;
+                while ((e1000_tx_free() < needed || e1000_dev.swq_count > 0) &&
+                       spins++ < e1000_dev.tx_spin_budget) {
+                    __asm__ __volatile__("pause");
+                    e1000_tx_reclaim();
+                }
+            } else if (e1000_dev.tx_policy == E1000_TX_QUEUE) {
+                unsigned long flags = irq_save();
+                while (accepted < n && e1000_dev.swq_count < E1000_TX_SWQ_SIZE &&
+                       frames[accepted].length <= e1000_dev.frame_max) {
+                    uint16_t slot = (e1000_dev.swq_head + e1000_dev.swq_count) % E1000_TX_SWQ_SIZE;
+                    memcpy(e1000_swq_frame(slot), frames[accepted].data, frames[accepted].length);
+                    swq_lengths[slot] = (uint16_t)frames[accepted].length;
+                    e1000_dev.swq_count++;
+                    e1000_dev.stat_tx_queued++;
+                    accepted++;
+                }
+                irq_restore(flags);
+                // TXDW from the frames in flight schedules the poll that sends them
+                e1000_dev.stat_tx_dropped += n - accepted;
+                return accepted;
+            }
+            
+            if (e1000_tx_free() < needed || e1000_dev.swq_count > 0) {
+                e1000_dev.stat_tx_dropped += n - accepted;
+                return accepted;
+            }
+        }
+        
+        // Copy packet data to buffer and set up the descriptor
+        e1000_tx_fill(f->data, f->length);
+        accepted++;
+    }
+    
+    // One tail update tells the hardware about the whole burst
+    e1000_tx_doorbell(0);
+    e1000_dev.stat_tx_frames += accepted;
+    
+    return accepted;
+}
+
+// Send a packet
+int e1000_send_packet(const void* data, size_t length) {
+    e1000_frame_t frame;
+    frame.data = (void*)data;
+    frame.length = length;
+    frame.size = length;
+    return e1000_send_burst(&frame, 1) == 1 ? 0 : -1;
+}
+
+// Send one frame described by a gather list. Copied segments (and
+// referenced ones below the copybreak) are packed into the slot buffer of
+// the current descriptor, spilling into the next slot once it is full;
+// referenced segments get a descriptor of their own pointing straight at
+// the caller's memory. EOP goes on the last descriptor only.
+int e1000_send_sg(const e1000_sg_t* segs, int nsegs, uint8_t csum) {
+    if (!e1000_initialized || !e1000_dev.initialized || !segs || nsegs <= 0 || nsegs > E1000_SG_MAX) {
+        return -1;
+    }
+    
+    size_t total = 0;
+    for (int i = 0; i < nsegs; i++) {
+        total += segs[i].length;
+    }
+    
+    // Offload only what the context describes; otherwise every segment is
+    // copied so the checksums can be finished on the slot buffers
+    int sw_csum = csum && (!e1000_dev.csum_offload || !e1000_sg_csum_fits(segs, nsegs, total));
     
-    // Check if there's space in the transmit ring
-    uint16_t next_tail = (e1000_dev.tx_tail + 1) % E1000_TX_RING_SIZE;
-    if (next_tail == e1000_dev.tx_head) {
-        // Ring is full - wait for a descriptor to be freed
-        // For now, just return error
+    // Work out how many descriptors the frame takes
+    uint16_t needed = 0;
+    size_t run = 0;  // Bytes copied since the last referenced segment
+    for (int i = 0; i < nsegs; i++) {
+        if (!sw_csum && segs[i].by_ref && segs[i].length >= E1000_TX_COPYBREAK) {
+            needed += e1000_tx_descs(run) + 1;
+            run = 0;
+        } else {
+            run += segs[i].length;
+        }
+    }
+    needed += e1000_tx_descs(run);
+    if (total == 0 || total > e1000_dev.frame_max) {
         return -1;
     }
+    if (csum && !sw_csum && !e1000_dev.tx_ctx_loaded) {
+        needed++;
+    }
     
-    // Copy packet data to buffer
-    memcpy(e1000_dev.tx_buffers[e1000_dev.tx_tail], data, length);
+    if (e1000_tx_free() < needed || e1000_dev.swq_count > 0) {
+        e1000_tx_reclaim();
+    }
+    if (e1000_tx_free() < needed || e1000_dev.swq_count > 0) {
+        e1000_dev.stat_tx_ring_full++;
+        e1000_tx_doorbell(1);  // Held descriptors must complete to make room
+        if (e1000_dev.tx_policy == E1000_TX_SPIN) {
+            uint32_t spins = 0;
+            while ((e1000_tx_free() < needed || e1000_dev.swq_count > 0) &&
+                   spins++ < e1000_dev.tx_spin_budget) {
+                __asm__ __volatile__("pause");
+                e1000_tx_reclaim();
+            }
+        } else if (e1000_dev.tx_policy == E1000_TX_QUEUE) {
+            // The software queue holds flat frames, so gather into one
+            unsigned long flags = irq_save();
+            int result = -1;
+            if (e1000_dev.swq_count < E1000_TX_SWQ_SIZE) {
+                uint16_t slot = (e1000_dev.swq_head + e1000_dev.swq_count) % E1000_TX_SWQ_SIZE;
+                size_t off = 0;
+                for (int i = 0; i < nsegs; i++) {
+                    memcpy(e1000_swq_frame(slot) + off, segs[i].data, segs[i].length);
+                    off += segs[i].length;
+                }
+                if (csum) {
+                    e1000_csum_software(e1000_swq_frame(slot), total, csum);
+                }
+                swq_lengths[slot] = (uint16_t)total;
+                e1000_dev.swq_count++;
+                e1000_dev.stat_tx_queued++;
+                result = 0;
+            } else {
+                e1000_dev.stat_tx_dropped++;
+            }
+            irq_restore(flags);
+            return result;
+        }
+        if (e1000_tx_free() < needed || e1000_dev.swq_count > 0) {
+            e1000_dev.stat_tx_dropped++;
+            return -1;
+        }
+    }
     
-    // Set up descriptor
-    e1000_dev.tx_descriptors[e1000_dev.tx_tail].length = (uint16_t)length;
-    e1000_dev.tx_descriptors[e1000_dev.tx_tail].cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS;
-    e1000_dev.tx_descriptors[e1000_dev.tx_tail].status = 0;
+    uint8_t popts = sw_csum ? 0 : e1000_csum_popts(csum);
+    if (popts) {
+        e1000_tx_context();
+        e1000_dev.stat_tx_csum_hw++;
+    }
     
-    // Update tail pointer (this tells the hardware to start transmitting)
-    e1000_dev.tx_tail = next_tail;
-    e1000_write_reg(mmio, E1000_REG_TDT, e1000_dev.tx_tail);
+    uint16_t first = e1000_dev.tx_tail;
+    volatile e1000_tx_desc_t* desc = NULL;
+    size_t packed = 0;
+    int packing = 0;  // Current descriptor is a slot buffer being filled
+    for (int i = 0; i < nsegs; i++) {
+        if (segs[i].length == 0) {
+            continue;
+        }
+        uint16_t tail = e1000_dev.tx_tail;
+        if (!sw_csum && segs[i].by_ref && segs[i].length >= E1000_TX_COPYBREAK) {
+            // DMA straight from the caller's memory
+            e1000_tx_desc_set(tail, segs[i].data, (uint16_t)segs[i].length,
+                              E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS, popts);
+            desc = &e1000_dev.tx_descriptors[tail];
+            e1000_dev.tx_tail = (tail + 1) % e1000_dev.tx_ring_size;
+            e1000_dev.stat_tx_sg_refs++;
+            packing = 0;
+            continue;
+        }
+        const uint8_t* src = (const uint8_t*)segs[i].data;
+        size_t left = segs[i].length;
+        while (left > 0) {
+            if (!packing || packed == E1000_BUFFER_SIZE) {
+                tail = e1000_dev.tx_tail;
+                e1000_tx_desc_set(tail, e1000_tx_buf(tail), 0,
+                                  E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS, popts);
+                desc = &e1000_dev.tx_descriptors[tail];
+                e1000_dev.tx_tail = (tail + 1) % e1000_dev.tx_ring_size;
+                packed = 0;
+                packing = 1;
+            }
+            size_t chunk = E1000_BUFFER_SIZE - packed;
+            if (chunk > left) chunk = left;
+            memcpy((uint8_t*)(uintptr_t)desc->buffer_addr + packed, src, chunk);
+            packed += chunk;
+            src += chunk;
+            left -= chunk;
+            desc->length = (uint16_t)packed;
+        }
+    }
+    desc->cmd |= E1000_TXD_CMD_EOP;
+    if (sw_csum) {
+        e1000_csum_software_slots(first, total, csum);
+    }
     
+    e1000_tx_doorbell(0);
+    e1000_dev.stat_tx_frames++;
     return 0;
 }
 
-// Receive a packet
-int e1000_receive_packet(void* buffer, size_t buffer_size) {
+int e1000_tx_flush(void) {
     if (!e1000_initialized || !e1000_dev.initialized) {
+        return -1;
+    }
+    e1000_tx_doorbell(1);
+    for (uint32_t spins = 0; e1000_dev.tx_head != e1000_dev.tx_tail; spins++) {
+        if (spins >= E1000_QUIESCE_SPINS) {
+            return -1;
+        }
+        __asm__ __volatile__("pause");
+        e1000_tx_reclaim();
+    }
+    return 0;
+}
+
+// Find the frame that starts after 'tail'. Frames larger than one buffer
+// span descriptors up to the one with EOP. Returns the number of
+// descriptors it uses and its length, or 0 while it is still incomplete.
+static uint16_t e1000_rx_frame(uint16_t tail, size_t* length) {
+    uint16_t count = 0;
+    size_t total = 0;
+    uint16_t idx = tail;
+    for (;;) {
+        idx = (idx + 1) % e1000_dev.rx_ring_size;
+        volatile e1000_rx_desc_t* desc = &e1000_dev.rx_descriptors[idx];
+        if (!(desc->status & E1000_RXD_STAT_DD) || idx == tail) {
+            return 0;
+        }
+        total += desc->length;
+        count++;
+        if (desc->status & E1000_RXD_STAT_EOP) {
+            break;
+        }
+    }
+    *length = total;
+    return count;
+}
+
+// Copy a frame that spans several descriptors into dst (at most 'size'
+// bytes, NULL to discard it) and clear those descriptors for reuse
+static void e1000_rx_gather(uint16_t tail, uint16_t ndesc, uint8_t* dst, size_t size) {
+    size_t off = 0;
+    for (uint16_t i = 0; i < ndesc; i++) {
+        tail = (tail + 1) % e1000_dev.rx_ring_size;
+        volatile e1000_rx_desc_t* desc = &e1000_dev.rx_descriptors[tail];
+        size_t chunk = desc->length;
+        if (chunk > size - off) chunk = size - off;
+        if (dst) {
+            memcpy(dst + off, e1000_dev.rx_pbufs[tail]->buf, chunk);
+        }
+        off += chunk;
+        desc->status = 0;
+        desc->length = 0;
+    }
+}
+
+// Copy up to n received frames into the caller's buffers and hand all
+// their descriptors back with a single RDT write. The ring position is
+// tracked in software from the DD bits, so nothing is read over MMIO.
+// Returns the number of frames received.
+int e1000_receive_burst(e1000_frame_t* bufs, int n) {
+    if (!e1000_initialized || !e1000_dev.initialized || !bufs) {
         return 0;
     }
     
-    volatile uint32_t* mmio = e1000_dev.mmio_base;
-    
-    // Read current hardware head position
-    uint16_t hw_head = e1000_read_reg(mmio, E1000_REG_RDH);
-    uint16_t tail = e1000_read_reg(mmio, E1000_REG_RDT);
+    uint16_t tail = e1000_dev.rx_tail;
+    int count = 0;
     
-    // Check if ring is empty (head == tail means no packets)
-    // Note: In e1000, when head == tail, the ring is empty
-    // But we need to check if head has wrapped around
-    uint16_t next_idx = (tail + 1) % E1000_RX_RING_SIZE;
+    while (count < n) {
+        // The next frame starts after the last descriptor handed back.
+        // RCTL.SECRC already stripped the CRC.
+        size_t length;
+        uint16_t ndesc = e1000_rx_frame(tail, &length);
+        if (ndesc == 0) {
+            break;  // No more packets
+        }
+        if (length > bufs[count].size) {
+            length = bufs[count].size;
+        }
+        e1000_rx_gather(tail, ndesc, (uint8_t*)bufs[count].data, length);
+        bufs[count].length = length;
+        if (ndesc > 1) {
+            e1000_dev.stat_rx_jumbo++;
+        }
+        tail = (tail + ndesc) % e1000_dev.rx_ring_size;
+        count++;
+    }
     
-    // If head equals next_idx, ring is empty
-    if (hw_head == next_idx) {
-        return 0;  // No packets available
+    if (count > 0) {
+        // Give consumed descriptors back to hardware in batches
+        e1000_dev.rx_tail = tail;
+        e1000_rx_doorbell(0);
+        e1000_dev.stat_rx_frames += count;
+    }
+    return count;
+}
+
+// Receive a packet
+int e1000_receive_packet(void* buffer, size_t buffer_size) {
+    e1000_frame_t frame;
+    frame.data = buffer;
+    frame.size = buffer_size;
+    frame.length = 0;
+    return e1000_receive_burst(&frame, 1) == 1 ? (int)frame.length : 0;
+}
+
+// Translate the RX checksum status bits into PBUF_CSUM_RX_* flags
+static uint8_t e1000_rx_csum(uint8_t status, uint8_t errors) {
+    if (!e1000_dev.csum_offload || (status & E1000_RXD_STAT_IXSM)) {
+        e1000_dev.stat_rx_csum_none++;
+        return 0;
+    }
+    uint8_t csum = 0;
+    if (status & E1000_RXD_STAT_IPCS) {
+        csum |= (errors & E1000_RXD_ERR_IPE) ? PBUF_CSUM_RX_IP_BAD : PBUF_CSUM_RX_IP_OK;
+    }
+    if (status & E1000_RXD_STAT_TCPCS) {
+        csum |= (errors & E1000_RXD_ERR_TCPE) ? PBUF_CSUM_RX_L4_BAD : PBUF_CSUM_RX_L4_OK;
+    }
+    if (csum & (PBUF_CSUM_RX_IP_BAD | PBUF_CSUM_RX_L4_BAD)) {
+        e1000_dev.stat_rx_csum_bad++;
+    } else if (csum) {
+        e1000_dev.stat_rx_csum_ok++;
+    } else {
+        e1000_dev.stat_rx_csum_none++;  // Not IPv4, or a protocol the NIC does not check
+    }
+    return csum;
+}
+
+// Hand received frames up without copying. Each frame's pbuf leaves the
+// ring and a fresh one from the pool takes its descriptor. Jumbo frames
+// that span descriptors are copied into one jumbo pbuf instead, and their
+// ring buffers stay in place. Returns the number of pbufs stored in pkts;
+// the caller frees them.
+int e1000_receive_loan(pbuf_t** pkts, int n) {
+    if (!e1000_initialized || !e1000_dev.initialized || !pkts) {
+        return 0;
     }
     
-    // Check if this descriptor has a packet (status bit DD set)
-    if (!(e1000_dev.rx_descriptors[next_idx].status & E1000_RXD_STAT_DD)) {
-        return 0;  // Packet not ready yet
+    uint16_t tail = e1000_dev.rx_tail;
+    int count = 0;
+    int loaned = 0;
+    
+    while (count < n) {
+        size_t length;
+        uint16_t ndesc = e1000_rx_frame(tail, &length);
+        if (ndesc == 0) {
+            break;  // No more packets
+        }
+        
+        if (ndesc > 1) {
+            uint16_t last = (tail + ndesc) % e1000_dev.rx_ring_size;
+            volatile e1000_rx_desc_t* eop = &e1000_dev.rx_descriptors[last];
+            if (length > e1000_dev.frame_max) {
+                // LPE admits up to 16KB; drop what exceeds our MTU
+                e1000_rx_gather(tail, ndesc, NULL, 0);
+                e1000_dev.stat_rx_oversize++;
+                tail = last;
+                continue;
+            }
+            pbuf_t* p = pbuf_alloc_rx_size(length);
+            if (!p) {
+                e1000_dev.stat_rx_loan_starved++;
+                break;
+            }
+            p->length = (uint16_t)length;
+            p->csum = e1000_rx_csum(eop->status, eop->errors);
+            e1000_rx_gather(tail, ndesc, p->data, length);
+            pkts[count++] = p;
+            e1000_dev.stat_rx_jumbo++;
+            tail = last;
+            continue;
+        }
+        
+        uint16_t next_idx = (tail + 1) % e1000_dev.rx_ring_size;
+        volatile e1000_rx_desc_t* desc = &e1000_dev.rx_descriptors[next_idx];
+        pbuf_t* fresh = pbuf_alloc_rx();
+        if (!fresh) {
+            // Pool exhausted; leave the frame in the ring until buffers come back
+            e1000_dev.stat_rx_loan_starved++;
+            break;
+        }
+        
+        pbuf_t* p = e1000_dev.rx_pbufs[next_idx];
+        p->length = desc->length;
+        p->csum = e1000_rx_csum(desc->status, desc->errors);
+        pkts[count++] = p;
+        loaned++;
+        e1000_dev.rx_pbufs[next_idx] = fresh;
+        desc->buffer_addr = (uint64_t)(uintptr_t)fresh->buf;
+        
+        // Clear descriptor status for next use
+        desc->status = 0;
+        desc->length = 0;
+        tail = next_idx;
     }
     
-    // Get packet length (subtract CRC)
-    uint16_t length = e1000_dev.rx_descriptors[next_idx].length - 4;
-    if (length > buffer_size) {
-        length = (uint16_t)buffer_size;
+    if (tail != e1000_dev.rx_tail) {
+        // Also covers descriptors of dropped frames
+        e1000_dev.rx_tail = tail;
+        e1000_rx_doorbell(0);
+        e1000_dev.stat_rx_frames += count;
+        e1000_dev.stat_rx_loaned += loaned;
+    }
+    return count;
+}
+
+// Transmit a pbuf in place. The descriptor keeps the reference and the
+// buffer goes back to the pool once the hardware is done with it.
+int e1000_send_pbuf(pbuf_t* p) {
+    if (!p) {
+        return -1;
+    }
+    if (!e1000_initialized || !e1000_dev.initialized || p->length == 0 || p->length > e1000_dev.frame_max) {
+        pbuf_free(p);
+        return -1;
     }
     
-    // Copy packet data
-    memcpy(buffer, e1000_dev.rx_buffers[next_idx], length);
+    uint8_t csum = p->csum & (PBUF_CSUM_TX_IP | PBUF_CSUM_TX_UDP);
+    if (csum && (!e1000_dev.csum_offload || !e1000_csum_fits(p->data, p->length))) {
+        e1000_csum_software(p->data, p->length, csum);
+        csum = 0;
+    }
+    uint16_t needed = (csum && !e1000_dev.tx_ctx_loaded) ? 2 : 1;
     
-    // Clear descriptor status for next use
-    e1000_dev.rx_descriptors[next_idx].status = 0;
-    e1000_dev.rx_descriptors[next_idx].length = 0;
+    if (e1000_tx_free() < E1000_TX_RECLAIM_THRESH || e1000_dev.swq_count > 0) {
+        e1000_tx_reclaim();
+    }
+    if (e1000_tx_free() < needed || e1000_dev.swq_count > 0) {
+        // Full ring: the flat frame paths already implement the policy
+        e1000_sg_t seg = { p->data, p->length, 0 };
+        int result = e1000_send_sg(&seg, 1, csum);
+        pbuf_free(p);
+        return result;
+    }
     
-    // Update tail to give descriptor back to hardware
-    tail = next_idx;
-    e1000_write_reg(mmio, E1000_REG_RDT, tail);
-    e1000_dev.rx_tail = tail;
+    uint8_t popts = e1000_csum_popts(csum);
+    if (popts) {
+        e1000_tx_context();
+        e1000_dev.stat_tx_csum_hw++;
+    }
+    uint16_t tail = e1000_dev.tx_tail;
+    e1000_dev.tx_pbufs[tail] = p;
+    e1000_tx_desc_set(tail, p->data, p->length,
+                      E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS, popts);
+    e1000_dev.tx_tail = (tail + 1) % e1000_dev.tx_ring_size;
     
-    return (int)length;
+    e1000_tx_doorbell(0);
+    e1000_dev.stat_tx_frames++;
+    return 0;
+}
+
+static int e1000_netdev_get_mac(mac_address_t* mac) {
+    if (!e1000_initialized) {
+        return -1;
+    }
+    *mac = e1000_dev.mac_address;
+    return 0;
+}
+
+static uint16_t e1000_netdev_get_mtu(void) {
+    return e1000_initialized ? e1000_dev.mtu : ETH_MTU_DEFAULT;
 }
 
+const netdev_ops_t e1000_netdev_ops = {
+    .name = "e1000",
+    .get_mac = e1000_netdev_get_mac,
+    .get_mtu = e1000_netdev_get_mtu,
+    .set_mtu = e1000_set_mtu,
+    .send_packet = e1000_send_packet,
+    .receive_packet = e1000_receive_packet,
+    .receive_loan = e1000_receive_loan,
+    .send_pbuf = e1000_send_pbuf,
+    .send_sg = e1000_send_sg,
+    .csum_offload = e1000_csum_offload,
+    .mcast_member = e1000_mcast_member,
+    .tx_flush = e1000_tx_flush,
+    .tx_hold = e1000_tx_hold,
+    .tx_reclaim = e1000_tx_reclaim,
+    .poll_pending = e1000_poll_pending,
+    .poll_complete = e1000_poll_complete,
+};
@@ -0,0 +1,885 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "e1000e.h"
+#include "e1000.h"
+#include "netdev.h"
+#include "network.h"
+#include "pci.h"
+#include "apic.h"
+#include "irq.h"
+#include "pic.h"
+#include "memory.h"
+#include "cmdline.h"
+#include "pbuf.h"
+#include "checksum.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Simple memcpy implementation for freestanding environment
+static void* memcpy(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    for (size_t i = 0; i < n; i++) {
+        d[i] = s[i];
+    }
+    return dest;
+}
+
+static void* memset(void* dest, int value, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    for (size_t i = 0; i < n; i++) {
+        d[i] = (uint8_t)value;
+    }
+    return dest;
+}
+
+static e1000e_device_t e1000e_dev;
+static int e1000e_initialized = 0;
+
+// Default Toeplitz key, the one most drivers ship with
+static const uint8_t e1000e_rss_key[40] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+    0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+    0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+    0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+// MSI-X handlers. EIAC cleared the cause and IAM (with EIAME) masked it,
+// so there is no register to touch: flag the queue and leave the work to
+// the poll loop, which unmasks just this cause once the queue is drained.
+static void e1000e_rxq0_handler(void) {
+    e1000e_dev.rxq[0].pending = 1;
+}
+
+static void e1000e_rxq1_handler(void) {
+    e1000e_dev.rxq[1].pending = 1;
+}
+
+static void e1000e_txq0_handler(void) {
+    e1000e_dev.tx_pending = 1;
+}
+
+// Everything that is not a queue cause, in practice link changes
+static void e1000e_other_handler(void) {
+    volatile uint32_t* mmio = e1000e_dev.mmio_base;
+    uint32_t icr = e1000_read_reg(mmio, E1000_REG_ICR);
+    e1000_write_reg(mmio, E1000_REG_ICR, icr & (E1000_ICR_LSC | E1000E_ICR_OTHER));
+    e1000e_dev.stat_irqs++;
+    if (icr & E1000_ICR_LSC) {
+        e1000e_dev.link_up = (e1000_read_reg(mmio, E1000_REG_STATUS) & E1000_STATUS_LU) != 0;
+    }
+}
+
+// Without MSI-X all causes arrive on the (possibly shared) INTx line, as
+// with the 82540EM: reading ICR acknowledges them, then everything is
+// masked and serviced by the poll loop.
+static void e1000e_intx_handler(void) {
+    if (!e1000e_initialized) {
+        return;
+    }
+    volatile uint32_t* mmio = e1000e_dev.mmio_base;
+    uint32_t icr = e1000_read_reg(mmio, E1000_REG_ICR);
+    if (icr == 0) {
+        return;  // Shared line, not ours
+    }
+    e1000e_dev.stat_irqs++;
+    if (icr & E1000_ICR_LSC) {
+        e1000e_dev.link_up = (e1000_read_reg(mmio, E1000_REG_STATUS) & E1000_STATUS_LU) != 0;
+    }
+    if (icr & (E1000_ICR_RXT0 | E1000_ICR_RXO | E1000_ICR_TXDW)) {
+        e1000_write_reg(mmio, E1000_REG_IMC, 0xFFFFFFFF);
+        for (int i = 0; i < E1000E_RX_QUEUES; i++) {
+            e1000e_dev.rxq[i].pending = 1;
+        }
+        e1000e_dev.tx_pending = 1;
+    }
+}
+
+// Round a requested ring size to what the hardware accepts
+static uint16_t e1000e_ring_size(uint32_t n) {
+    if (n < E1000_RING_MIN) n = E1000_RING_MIN;
+    if (n > E1000_RING_MAX) n = E1000_RING_MAX;
+    return (uint16_t)((n + E1000_RING_ALIGN - 1) & ~(uint32_t)(E1000_RING_ALIGN - 1));
+}
+
+static inline uint8_t* e1000e_tx_buf(uint16_t i) {
+    return e1000e_dev.tx_buffers + (size_t)i * E1000_BUFFER_SIZE;
+}
+
+static int e1000e_setup_tx(uint16_t size) {
+    e1000_tx_desc_t* desc = (e1000_tx_desc_t*)fs_allocate_aligned(size * sizeof(e1000_tx_desc_t), 128);
+    uint8_t* bufs = (uint8_t*)fs_allocate_aligned((size_t)size * E1000_BUFFER_SIZE, 4096);
+    pbuf_t** pbufs = (pbuf_t**)fs_allocate(size * sizeof(pbuf_t*));
+    if (!desc || !bufs || !pbufs) {
+        if (desc) fs_free_aligned(desc);
+        if (bufs) fs_free_aligned(bufs);
+        if (pbufs) fs_free(pbufs);
+        return -1;
+    }
+    e1000e_dev.tx_descriptors = desc;
+    e1000e_dev.tx_buffers = bufs;
+    e1000e_dev.tx_pbufs = pbufs;
+    e1000e_dev.tx_ring_size = size;
+    for (uint16_t i = 0; i < size; i++) {
+        pbufs[i] = NULL;
+        memset(&desc[i], 0, sizeof(e1000_tx_desc_t));
+        desc[i].buffer_addr = (uint64_t)(uintptr_t)e1000e_tx_buf(i);
+    }
+    
+    volatile uint32_t* mmio = e1000e_dev.mmio_base;
+    uint64_t phys = (uint64_t)(uintptr_t)desc;
+    e1000_write_reg(mmio, E1000_REG_TDBAL, (uint32_t)(phys & 0xFFFFFFFF));
+    e1000_write_reg(mmio, E1000_REG_TDBAH, (uint32_t)(phys >> 32));
+    e1000_write_reg(mmio, E1000_REG_TDLEN, (uint32_t)size * sizeof(e1000_tx_desc_t));
+    e1000_write_reg(mmio, E1000_REG_TDH, 0);
+    e1000_write_reg(mmio, E1000_REG_TDT, 0);
+    return 0;
+}
+
+// Fill RX queue n with pbufs. Descriptors start in the read format: the
+// buffer address and a zero upper half, where the NIC later reports DD.
+static int e1000e_setup_rxq(int n, uint16_t size) {
+    e1000e_rx_queue_t* q = &e1000e_dev.rxq[n];
+    e1000e_rx_desc_t* desc = (e1000e_rx_desc_t*)fs_allocate_aligned(size * sizeof(e1000e_rx_desc_t), 128);
+    pbuf_t** pbufs = (pbuf_t**)fs_allocate(size * sizeof(pbuf_t*));
+    int ok = desc && pbufs;
+    for (uint16_t i = 0; ok && i < size; i++) {
+        pbufs[i] = pbuf_alloc_rx();
+        if (!pbufs[i]) {
+            while (i > 0) {
+                pbuf_free(pbufs[--i]);
+            }
+            ok = 0;
+        }
+    }
+    if (!ok) {
+        if (desc) fs_free_aligned(desc);
+        if (pbufs) fs_free(pbufs);
+        return -1;
+    }
+    q->descriptors = desc;
+    q->pbufs = pbufs;
+    q->size = size;
+    q->tail = size - 1;
+    q->tail_hw = size - 1;
+    q->vector = -1;
+    for (uint16_t i = 0; i < size; i++) {
+        desc[i].read.buffer_addr = (uint64_t)(uintptr_t)pbufs[i]->buf;
+        desc[i].read.reserved = 0;
+    }
+    
+    volatile uint32_t* mmio = e1000e_dev.mmio_base;
+    uint64_t phys = (uint64_t)(uintptr_t)desc;
+    e1000_write_reg(mmio, E1000E_RXQ_REG(E1000_REG_RDBAL, n), (uint32_t)(phys & 0xFFFFFFFF));
+    e1000_write_reg(mmio, E1000E_RXQ_REG(E1000_REG_RDBAH, n), (uint32_t)(phys >> 32));
+    e1000_write_reg(mmio, E1000E_RXQ_REG(E1000_REG_RDLEN, n), (uint32_t)size * sizeof(e1000e_rx_desc_t));
+    e1000_write_reg(mmio, E1000E_RXQ_REG(E1000_REG_RDH, n), 0);
+    e1000_write_reg(mmio, E1000E_RXQ_REG(E1000_REG_RDT, n), size - 1);
+    return 0;
+}
+
+// Spread IPv4 flows over both RX queues: the hash of addresses (and ports
+// for TCP) indexes the redirection table, whose entries alternate queues.
+// RSS needs extended descriptors, and PCSD since the hash takes the place
+// of the packet checksum in the write-back.
+static void e1000e_setup_rss(void) {
+    volatile uint32_t* mmio = e1000e_dev.mmio_base;
+    e1000_write_reg(mmio, E1000E_REG_RFCTL, E1000E_RFCTL_EXTEN);
+    uint32_t rxcsum = E1000E_RXCSUM_PCSD;
+    if (e1000e_dev.csum_offload) {
+        rxcsum |= E1000_RXCSUM_IPOFL | E1000_RXCSUM_TUOFL;
+    }
+    e1000_write_reg(mmio, E1000_REG_RXCSUM, rxcsum);
+    if (!e1000e_dev.rss) {
+        e1000_write_reg(mmio, E1000E_REG_MRQC, 0);
+        return;
+    }
+    for (int i = 0; i < 10; i++) {
+        const uint8_t* k = &e1000e_rss_key[i * 4];
+        e1000_write_reg(mmio, (uint16_t)(E1000E_REG_RSSRK + i * 4),
+                        (uint32_t)k[0] | ((uint32_t)k[1] << 8) | ((uint32_t)k[2] << 16) | ((uint32_t)k[3] << 24));
+    }
+    // Four entries per register, the odd ones pointing at queue 1
+    uint32_t reta = (uint32_t)E1000E_RETA_QUEUE1 << 8 | (uint32_t)E1000E_RETA_QUEUE1 << 24;
+    for (int i = 0; i < E1000E_RETA_ENTRIES / 4; i++) {
+        e1000_write_reg(mmio, (uint16_t)(E1000E_REG_RETA + i * 4), reta);
+    }
+    e1000_write_reg(mmio, E1000E_REG_MRQC, E1000E_MRQC_RSS | E1000E_MRQC_TCPIPV4 | E1000E_MRQC_IPV4);
+}
+
+// One MSI-X vector per queue plus one for link events. Returns -1 if the
+// device, the local APIC or the vector pool cannot provide them.
+static int e1000e_setup_msix(void) {
+    static const irq_handler_t handlers[E1000E_MSIX_VECTORS] = {
+        e1000e_rxq0_handler, e1000e_rxq1_handler, e1000e_txq0_handler, e1000e_other_handler,
+    };
+    pci_msix_t* table = &e1000e_dev.msix_table;
+    if (!lapic_available() || pci_msix_init(&e1000e_dev.pci_dev, table) != 0 ||
+        table->table_size < E1000E_MSIX_VECTORS) {
+        return -1;
+    }
+    int vectors[E1000E_MSIX_VECTORS];
+    for (int i = 0; i < E1000E_MSIX_VECTORS; i++) {
+        vectors[i] = irq_alloc_vector(handlers[i]);
+        if (vectors[i] < 0) {
+            while (i > 0) {
+                irq_free_vector(vectors[--i]);
+            }
+            return -1;
+        }
+        pci_msix_set_vector(table, (uint16_t)i, (uint8_t)vectors[i]);
+    }
+    e1000e_dev.rxq[0].vector = vectors[E1000E_MSIX_RXQ0];
+    e1000e_dev.rxq[1].vector = vectors[E1000E_MSIX_RXQ1];
+    e1000e_dev.tx_vector = vectors[E1000E_MSIX_TXQ0];
+    e1000e_dev.other_vector = vectors[E1000E_MSIX_OTHER];
+    
+    volatile uint32_t* mmio = e1000e_dev.mmio_base;
+    e1000_write_reg(mmio, E1000E_REG_IVAR,
+                    E1000E_IVAR_RXQ0(E1000E_MSIX_RXQ0) | E1000E_IVAR_RXQ1(E1000E_MSIX_RXQ1) |
+                    E1000E_IVAR_TXQ0(E1000E_MSIX_TXQ0) | E1000E_IVAR_OTHER(E1000E_MSIX_OTHER));
+    // Queue causes are cleared (EIAC) and masked (IAM) as their vector
+    // fires; they stay masked until poll_complete() finds the queue drained
+    uint32_t queue_causes = E1000E_ICR_RXQ0 | E1000E_ICR_RXQ1 | E1000E_ICR_TXQ0;
+    e1000_write_reg(mmio, E1000E_REG_EIAC, queue_causes);
+    e1000_write_reg(mmio, E1000E_REG_IAM, queue_causes);
+    uint32_t ctrl_ext = e1000_read_reg(mmio, E1000_REG_CTRL_EXT);
+    e1000_write_reg(mmio, E1000_REG_CTRL_EXT, ctrl_ext | E1000E_CTRL_EXT_EIAME | E1000E_CTRL_EXT_PBA_CLR);
+    
+    // Each vector is throttled on its own, in 256ns units like ITR
+    uint32_t interval = e1000e_dev.itr ? 3906250 / e1000e_dev.itr : 0;
+    if (interval > 0xFFFF) interval = 0xFFFF;
+    for (int i = 0; i < E1000E_MSIX_VECTORS; i++) {
+        e1000_write_reg(mmio, (uint16_t)E1000E_REG_EITR(i), interval);
+    }
+    pci_msix_enable(&e1000e_dev.pci_dev, table, 1);
+    e1000e_dev.msix = 1;
+    return 0;
+}
+
+// Causes unmasked while every queue is armed
+static uint32_t e1000e_ims_all(void) {
+    if (e1000e_dev.msix) {
+        // The OTHER vector is only signalled while OTHER is enabled
+        return E1000E_ICR_RXQ0 | E1000E_ICR_RXQ1 | E1000E_ICR_TXQ0 | E1000E_ICR_OTHER | E1000_ICR_LSC;
+    }
+    return E1000_IMS_ENABLE;
+}
+
+int e1000e_init(void) {
+    if (e1000e_initialized) {
+        return 0;
+    }
+    
+    pci_device_t pci_dev;
+    if (!pci_find_device(E1000_VENDOR_ID, E1000E_DEVICE_ID_82574L, &pci_dev)) {
+        return -1;
+    }
+    uint32_t mmio_phys = pci_bar_address(&pci_dev, 0);
+    if (!pci_mmio_mapped(mmio_phys)) {
+        return -1;  // Not mapped in the boot page tables
+    }
+    uint32_t command = pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x04);
+    command |= (1 << 2);  // Bus master enable
+    command |= (1 << 1);  // Memory space enable
+    pci_write_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x04, command);
+    
+    memset(&e1000e_dev, 0, sizeof(e1000e_dev));
+    e1000e_dev.pci_dev = pci_dev;
+    e1000e_dev.mmio_base = (volatile uint32_t*)(uintptr_t)mmio_phys;
+    e1000e_dev.tx_vector = -1;
+    e1000e_dev.other_vector = -1;
+    volatile uint32_t* mmio = e1000e_dev.mmio_base;
+    
+    // Reset, then keep interrupts off while the rings are built
+    uint32_t ctrl = e1000_read_reg(mmio, E1000_REG_CTRL);
+    e1000_write_reg(mmio, E1000_REG_CTRL, ctrl | E1000_CTRL_RST);
+    int reset_done = 0;
+    for (int i = 0; i < 100000; i++) {
+        if (!(e1000_read_reg(mmio, E1000_REG_CTRL) & E1000_CTRL_RST)) {
+            reset_done = 1;
+            break;
+        }
+    }
+    if (!reset_done) {
+        return -1;
+    }
+    e1000_write_reg(mmio, E1000_REG_IMC, 0xFFFFFFFF);
+    (void)e1000_read_reg(mmio, E1000_REG_ICR);
+    
+    // The reset loads the address from the EEPROM into RAL/RAH[0]
+    uint32_t ral = e1000_read_reg(mmio, E1000_REG_RAL);
+    uint32_t rah = e1000_read_reg(mmio, E1000_REG_RAH);
+    if ((ral == 0 && (rah & 0xFFFF) == 0) || !(rah & E1000_RAH_AV)) {
+        return -1;
+    }
+    for (int i = 0; i < 4; i++) {
+        e1000e_dev.mac_address.bytes[i] = (uint8_t)(ral >> (i * 8));
+    }
+    e1000e_dev.mac_address.bytes[4] = (uint8_t)(rah & 0xFF);
+    e1000e_dev.mac_address.bytes[5] = (uint8_t)((rah >> 8) & 0xFF);
+    for (int i = 0; i < E1000_MTA_ENTRIES; i++) {
+        e1000_write_reg(mmio, (uint16_t)(E1000_REG_MTA + i * 4), 0);
+    }
+    
+    // Rings: e1000e.txring= and e1000e.rxring= (per RX queue)
+    uint32_t tx_size = E1000E_RING_DEFAULT;
+    uint32_t rx_size = E1000E_RING_DEFAULT;
+    cmdline_get_uint("e1000e.txring", &tx_size);
+    cmdline_get_uint("e1000e.rxring", &rx_size);
+    uint16_t rx_ring = e1000e_ring_size(rx_size);
+    if (pbuf_pool_reserve((uint32_t)rx_ring * 2 * E1000E_RX_QUEUES + E1000E_PBUF_TX_RESERVE) != 0 ||
+        e1000e_setup_tx(e1000e_ring_size(tx_size)) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < E1000E_RX_QUEUES; i++) {
+        if (e1000e_setup_rxq(i, rx_ring) != 0) {
+            return -1;
+        }
+    }
+    
+    uint32_t tctl = E1000_TCTL_EN | E1000_TCTL_PSP | (E1000_TCTL_CT & (0x10 << 4)) | (E1000_TCTL_COLD & (0x40 << 12));
+    e1000_write_reg(mmio, E1000_REG_TCTL, tctl);
+    e1000_write_reg(mmio, E1000_REG_TIPG, 0x0060200A);
+    
+    // Receive side scaling and checksum offload, unless turned off with
+    // e1000e.rss=0 or e1000e.csum=0
+    uint32_t value = 1;
+    cmdline_get_uint("e1000e.rss", &value);
+    e1000e_dev.rss = value ? 1 : 0;
+    value = 1;
+    cmdline_get_uint("e1000e.csum", &value);
+    e1000e_dev.csum_offload = value ? 1 : 0;
+    e1000e_setup_rss();
+    
+    // Standard frames only: without LPE every frame fits one 2KB buffer
+    e1000_write_reg(mmio, E1000_REG_RCTL, E1000_RCTL_EN | E1000_RCTL_BAM | E1000E_RCTL_BSIZE_2048 | E1000_RCTL_SECRC);
+    
+    ctrl = e1000_read_reg(mmio, E1000_REG_CTRL);
+    e1000_write_reg(mmio, E1000_REG_CTRL, ctrl | E1000_CTRL_SLU);
+    e1000e_dev.link_up = (e1000_read_reg(mmio, E1000_REG_STATUS) & E1000_STATUS_LU) != 0;
+    
+    // Interrupts: MSI-X unless e1000e.msix=0, else the INTx line, else polled
+    e1000e_dev.itr = E1000E_ITR_DEFAULT;
+    cmdline_get_uint("e1000e.itr", &e1000e_dev.itr);
+    value = 1;
+    cmdline_get_uint("e1000e.msix", &value);
+    if (value && e1000e_setup_msix() == 0) {
+        e1000e_dev.irq_enabled = 1;
+    } else {
+        uint32_t interval = e1000e_dev.itr ? 3906250 / e1000e_dev.itr : 0;
+        e1000_write_reg(mmio, E1000_REG_ITR, interval > 0xFFFF ? 0xFFFF : interval);
+        uint8_t irq_line = (uint8_t)(pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x3C) & 0xFF);
+        if (irq_line > 0 && irq_line < 16 && irq_register_shared_handler(irq_line, e1000e_intx_handler) == 0) {
+            e1000e_dev.irq = irq_line;
+            e1000e_dev.irq_enabled = 1;
+            pic_irq_enable(irq_line);
+        }
+    }
+    
+    // The first poll drains whatever arrived during setup and arms the causes
+    for (int i = 0; i < E1000E_RX_QUEUES; i++) {
+        e1000e_dev.rxq[i].pending = 1;
+    }
+    e1000e_dev.tx_pending = 1;
+    e1000e_initialized = 1;
+    if (e1000e_dev.irq_enabled) {
+        e1000_write_reg(mmio, E1000_REG_IMS, e1000e_ims_all());
+    }
+    return 0;
+}
+
+e1000e_device_t* e1000e_get_device(void) {
+    return e1000e_initialized ? &e1000e_dev : NULL;
+}
+
+// Hand consumed descriptors of one queue back in batches, like the e1000
+static void e1000e_rx_doorbell(int n, int force) {
+    e1000e_rx_queue_t* q = &e1000e_dev.rxq[n];
+    uint16_t pending = (uint16_t)((q->tail + q->size - q->tail_hw) % q->size);
+    uint16_t batch = q->size / 4 < E1000_RDT_BATCH ? q->size / 4 : E1000_RDT_BATCH;
+    if (pending == 0 || (!force && pending < batch)) {
+        return;
+    }
+    e1000_write_reg(e1000e_dev.mmio_base, E1000E_RXQ_REG(E1000_REG_RDT, n), q->tail);
+    q->tail_hw = q->tail;
+    q->stat_doorbells++;
+}
+
+// Translate the extended status/error word into PBUF_CSUM_RX_* flags
+static uint8_t e1000e_rx_csum(uint32_t status_error) {
+    uint8_t status = (uint8_t)status_error;
+    uint8_t errors = E1000E_RXD_ERRORS(status_error);
+    if (!e1000e_dev.csum_offload || (status & E1000_RXD_STAT_IXSM)) {
+        return 0;
+    }
+    uint8_t csum = 0;
+    if (status & E1000_RXD_STAT_IPCS) {
+        csum |= (errors & E1000_RXD_ERR_IPE) ? PBUF_CSUM_RX_IP_BAD : PBUF_CSUM_RX_IP_OK;
+    }
+    if (status & E1000_RXD_STAT_TCPCS) {
+        csum |= (errors & E1000_RXD_ERR_TCPE) ? PBUF_CSUM_RX_L4_BAD : PBUF_CSUM_RX_L4_OK;
+    }
+    if (csum & (PBUF_CSUM_RX_IP_BAD | PBUF_CSUM_RX_L4_BAD)) {
+        e1000e_dev.stat_rx_csum_bad++;
+    } else if (csum) {
+        e1000e_dev.stat_rx_csum_ok++;
+    }
+    return csum;
+}
+
+// Loan up to n frames out of one queue, swapping fresh pbufs into the ring
+static int e1000e_rxq_loan(int n_queue, pbuf_t** pkts, int n) {
+    e1000e_rx_queue_t* q = &e1000e_dev.rxq[n_queue];
+    uint16_t tail = q->tail;
+    int count = 0;
+    while (count < n) {
+        uint16_t idx = (tail + 1) % q->size;
+        volatile e1000e_rx_desc_t* desc = &q->descriptors[idx];
+        uint32_t status_error = desc->wb.status_error;
+        if (!(status_error & E1000E_RXD_STAT_DD)) {
+            break;
+        }
+        pbuf_t* p = q->pbufs[idx];
+        if (!(status_error & E1000E_RXD_STAT_EOP)) {
+            // Cannot happen without LPE; recycle the buffer
+            e1000e_dev.stat_rx_dropped++;
+        } else {
+            pbuf_t* fresh = pbuf_alloc_rx();
+            if (!fresh) {
+                q->stat_starved++;
+                break;
+            }
+            p->length = desc->wb.length;
+            p->csum = e1000e_rx_csum(status_error);
+            pkts[count++] = p;
+            q->pbufs[idx] = p = fresh;
+        }
+        desc->read.buffer_addr = (uint64_t)(uintptr_t)p->buf;
+        desc->read.reserved = 0;
+        tail = idx;
+    }
+    if (tail != q->tail) {
+        q->tail = tail;
+        e1000e_rx_doorbell(n_queue, 0);
+        q->stat_frames += count;
+    }
+    return count;
+}
+
+// Serve the queues in turn, starting with a different one on every call
+// so a busy flow cannot starve the other queue
+static int e1000e_receive_loan(pbuf_t** pkts, int n) {
+    if (!e1000e_initialized || !pkts) {
+        return 0;
+    }
+    int count = 0;
+    int first = e1000e_dev.rx_next;
+    for (int i = 0; i < E1000E_RX_QUEUES && count < n; i++) {
+        count += e1000e_rxq_loan((first + i) % E1000E_RX_QUEUES, pkts + count, n - count);
+    }
+    e1000e_dev.rx_next = (first + 1) % E1000E_RX_QUEUES;
+    return count;
+}
+
+static int e1000e_receive_packet(void* buffer, size_t buffer_size) {
+    pbuf_t* p;
+    if (e1000e_receive_loan(&p, 1) != 1) {
+        return 0;
+    }
+    size_t length = p->length < buffer_size ? p->length : buffer_size;
+    memcpy(buffer, p->data, length);
+    pbuf_free(p);
+    return (int)length;
+}
+
+// Free descriptors (one slot stays empty to tell a full ring from an empty one)
+static uint16_t e1000e_tx_free(void) {
+    return (uint16_t)((e1000e_dev.tx_head + e1000e_dev.tx_ring_size - e1000e_dev.tx_tail - 1) % e1000e_dev.tx_ring_size);
+}
+
+static void e1000e_tx_doorbell(int force) {
+    uint16_t size = e1000e_dev.tx_ring_size;
+    uint16_t pending = (uint16_t)((e1000e_dev.tx_tail + size - e1000e_dev.tx_tail_hw) % size);
+    if (pending == 0 || (!force && e1000e_dev.tx_hold > 0 && pending < size / 4)) {
+        return;
+    }
+    e1000_write_reg(e1000e_dev.mmio_base, E1000_REG_TDT, e1000e_dev.tx_tail);
+    e1000e_dev.tx_tail_hw = e1000e_dev.tx_tail;
+    e1000e_dev.stat_tx_doorbells++;
+}
+
+static void e1000e_tx_hold(int hold) {
+    if (!e1000e_initialized) {
+        return;
+    }
+    if (hold) {
+        e1000e_dev.tx_hold++;
+    } else if (e1000e_dev.tx_hold > 0 && --e1000e_dev.tx_hold == 0) {
+        e1000e_tx_doorbell(1);
+    }
+}
+
+// Collect finished descriptors from descriptor memory, in ring order
+static int e1000e_tx_reclaim(void) {
+    if (!e1000e_initialized) {
+        return 0;
+    }
+    unsigned long flags = irq_save();
+    int reclaimed = 0;
+    uint16_t head = e1000e_dev.tx_head;
+    while (head != e1000e_dev.tx_tail) {
+        volatile e1000_tx_desc_t* desc = &e1000e_dev.tx_descriptors[head];
+        if (!(desc->status & E1000_TXD_STAT_DD)) {
+            break;
+        }
+        desc->status = 0;
+        if (e1000e_dev.tx_pbufs[head]) {
+            pbuf_free(e1000e_dev.tx_pbufs[head]);
+            e1000e_dev.tx_pbufs[head] = NULL;
+        }
+        head = (head + 1) % e1000e_dev.tx_ring_size;
+        reclaimed++;
+    }
+    e1000e_dev.tx_head = head;
+    e1000e_dev.stat_tx_reclaimed += reclaimed;
+    irq_restore(flags);
+    return reclaimed;
+}
+
+// Make room for 'needed' descriptors, waiting a bounded time for the NIC
+// to finish older ones. Returns -1 (frame dropped) if the ring stays full.
+static int e1000e_tx_room(uint16_t needed) {
+    if (e1000e_tx_free() < needed) {
+        e1000e_tx_reclaim();
+    }
+    if (e1000e_tx_free() >= needed) {
+        return 0;
+    }
+    e1000e_dev.stat_tx_ring_full++;
+    e1000e_tx_doorbell(1);  // Held descriptors must complete to make room
+    for (uint32_t spins = 0; e1000e_tx_free() < needed && spins < E1000_TX_SPIN_DEFAULT; spins++) {
+        __asm__ __volatile__("pause");
+        e1000e_tx_reclaim();
+    }
+    if (e1000e_tx_free() < needed) {
+        e1000e_dev.stat_tx_dropped++;
+        return -1;
+    }
+    return 0;
+}
+
+static int e1000e_tx_flush(void) {
+    if (!e1000e_initialized) {
+        return -1;
+    }
+    e1000e_tx_doorbell(1);
+    for (uint32_t spins = 0; e1000e_dev.tx_head != e1000e_dev.tx_tail; spins++) {
+        if (spins >= E1000_QUIESCE_SPINS) {
+            return -1;
+        }
+        __asm__ __volatile__("pause");
+        e1000e_tx_reclaim();
+    }
+    return 0;
+}
+
+// Offsets of the one checksum context the driver uses: Ethernet, 20 byte
+// IPv4 header, UDP (as in the e1000 driver)
+#define E1000E_CSUM_IP_START   ETH_HEADER_SIZE
+#define E1000E_CSUM_IP_FIELD   (ETH_HEADER_SIZE + 10)
+#define E1000E_CSUM_L4_START   (ETH_HEADER_SIZE + 20)
+#define E1000E_CSUM_UDP_FIELD  (ETH_HEADER_SIZE + 20 + 6)
+
+static int e1000e_csum_offload(void) {
+    return e1000e_initialized && e1000e_dev.csum_offload;
+}
+
+static int e1000e_csum_fits(const uint8_t* frame, size_t length) {
+    return length > E1000E_CSUM_L4_START && frame[12] == 0x08 && frame[13] == 0x00 && frame[14] == 0x45;
+}
+
+// Fill the IPv4 header checksum and finish the UDP checksum, whose field
+// already holds the pseudo header sum
+static void e1000e_csum_software(uint8_t* frame, size_t length, uint8_t csum) {
+    if (length <= E1000E_CSUM_IP_START + 20) {
+        return;
+    }
+    size_t ihl = (size_t)(frame[E1000E_CSUM_IP_START] & 0x0F) * 4;
+    if (csum & PBUF_CSUM_TX_IP) {
+        uint8_t* ip = frame + E1000E_CSUM_IP_START;
+        ip[10] = 0;
+        ip[11] = 0;
+        uint16_t sum = (uint16_t)~csum_fold(csum_partial(ip, ihl, 0));
+        ip[10] = (uint8_t)(sum & 0xFF);
+        ip[11] = (uint8_t)(sum >> 8);
+    }
+    size_t l4 = E1000E_CSUM_IP_START + ihl;
+    if ((csum & PBUF_CSUM_TX_UDP) && length >= l4 + 8) {
+        uint16_t sum = (uint16_t)~csum_fold(csum_partial(frame + l4, length - l4, 0));
+        if (sum == 0) {
+            sum = 0xFFFF;  // 0 means "no checksum" for UDP
+        }
+        frame[l4 + 6] = (uint8_t)(sum & 0xFF);
+        frame[l4 + 7] = (uint8_t)(sum >> 8);
+    }
+}
+
+// Load the IPv4/UDP offload context at the tail unless the NIC has it
+static void e1000e_tx_context(void) {
+    if (e1000e_dev.tx_ctx_loaded) {
+        return;
+    }
+    uint16_t tail = e1000e_dev.tx_tail;
+    volatile e1000_tx_context_desc_t* ctx = (volatile e1000_tx_context_desc_t*)&e1000e_dev.tx_descriptors[tail];
+    ctx->ipcss = E1000E_CSUM_IP_START;
+    ctx->ipcso = E1000E_CSUM_IP_FIELD;
+    ctx->ipcse = E1000E_CSUM_L4_START - 1;
+    ctx->tucss = E1000E_CSUM_L4_START;
+    ctx->tucso = E1000E_CSUM_UDP_FIELD;
+    ctx->tucse = 0;
+    ctx->cmd_and_length = (uint32_t)(E1000_TXC_TUCMD_DEXT | E1000_TXC_TUCMD_IP | E1000_TXC_TUCMD_RS) << 24;
+    ctx->status = 0;
+    ctx->hdr_len = 0;
+    ctx->mss = 0;
+    e1000e_dev.tx_pbufs[tail] = NULL;
+    e1000e_dev.tx_tail = (tail + 1) % e1000e_dev.tx_ring_size;
+    e1000e_dev.tx_ctx_loaded = 1;
+}
+
+static void e1000e_tx_desc_set(uint16_t idx, const void* buf, uint16_t length, uint8_t cmd, uint8_t popts) {
+    volatile e1000_tx_desc_t* desc = &e1000e_dev.tx_descriptors[idx];
+    desc->buffer_addr = (uint64_t)(uintptr_t)buf;
+    desc->length = length;
+    desc->cso = popts ? E1000_TXD_DTYP_DATA : 0;
+    desc->cmd = popts ? (uint8_t)(cmd | E1000_TXD_CMD_DEXT) : cmd;
+    desc->status = 0;
+    desc->css = popts;
+    e1000e_dev.tx_pbufs[idx] = NULL;
+}
+
+static uint8_t e1000e_csum_popts(uint8_t csum) {
+    uint8_t popts = 0;
+    if (csum & PBUF_CSUM_TX_IP) popts |= E1000_TXD_POPTS_IXSM;
+    if (csum & PBUF_CSUM_TX_UDP) popts |= E1000_TXD_POPTS_TXSM;
+    return popts;
+}
+
+// Copied segments are packed into the slot buffer of one descriptor,
+// referenced ones at or above the copybreak get a descriptor of their own.
+// A standard frame always fits one slot buffer, so at most one copy
+// descriptor sits between two referenced segments.
+static int e1000e_send_sg(const netdev_sg_t* segs, int nsegs, uint8_t csum) {
+    if (!e1000e_initialized || !segs || nsegs <= 0 || nsegs > NETDEV_SG_MAX) {
+        return -1;
+    }
+    size_t total = 0;
+    uint16_t needed = 0;
+    int run = 0;  // Copied bytes since the last referenced segment
+    for (int i = 0; i < nsegs; i++) {
+        total += segs[i].length;
+        if (segs[i].by_ref && segs[i].length >= E1000_TX_COPYBREAK) {
+            needed += (uint16_t)(run + 1);
+            run = 0;
+        } else if (segs[i].length) {
+            run = 1;
+        }
+    }
+    needed += (uint16_t)run;
+    if (total == 0 || total > ETH_FRAME_SIZE(ETH_MTU_DEFAULT)) {
+        return -1;
+    }
+    if (csum && !e1000e_dev.tx_ctx_loaded) {
+        needed++;
+    }
+    if (e1000e_tx_room(needed) != 0) {
+        return -1;
+    }
+    
+    uint8_t popts = e1000e_csum_popts(csum);
+    if (popts) {
+        e1000e_tx_context();
+        e1000e_dev.stat_tx_csum_hw++;
+    }
+    volatile e1000_tx_desc_t* desc = NULL;
+    int packing = 0;  // Current descriptor is a slot buffer being filled
+    for (int i = 0; i < nsegs; i++) {
+        if (segs[i].length == 0) {
+            continue;
+        }
+        uint16_t tail = e1000e_dev.tx_tail;
+        if (segs[i].by_ref && segs[i].length >= E1000_TX_COPYBREAK) {
+            e1000e_tx_desc_set(tail, segs[i].data, (uint16_t)segs[i].length,
+                               E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS, popts);
+            e1000e_dev.stat_tx_sg_refs++;
+            packing = 0;
+        } else if (!packing) {
+            e1000e_tx_desc_set(tail, e1000e_tx_buf(tail), 0, E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS, popts);
+            packing = 1;
+        } else {
+            memcpy((uint8_t*)(uintptr_t)desc->buffer_addr + desc->length, segs[i].data, segs[i].length);
+            desc->length = (uint16_t)(desc->length + segs[i].length);
+            continue;
+        }
+        desc = &e1000e_dev.tx_descriptors[tail];
+        e1000e_dev.tx_tail = (tail + 1) % e1000e_dev.tx_ring_size;
+        if (packing) {
+            memcpy(e1000e_tx_buf(tail), segs[i].data, segs[i].length);
+            desc->length = (uint16_t)segs[i].length;
+        }
+    }
+    desc->cmd |= E1000_TXD_CMD_EOP;
+    
+    e1000e_tx_doorbell(0);
+    e1000e_dev.stat_tx_frames++;
+    return 0;
+}
+
+static int e1000e_send_packet(const void* data, size_t length) {
+    netdev_sg_t seg = { data, length, 0 };
+    return e1000e_send_sg(&seg, 1, 0);
+}
+
+// Transmit a pbuf in place; the descriptor keeps the reference until the
+// NIC is done with it
+static int e1000e_send_pbuf(pbuf_t* p) {
+    if (!p) {
+        return -1;
+    }
+    if (!e1000e_initialized || p->length == 0 || p->length > ETH_FRAME_SIZE(ETH_MTU_DEFAULT)) {
+        pbuf_free(p);
+        return -1;
+    }
+    uint8_t csum = p->csum & (PBUF_CSUM_TX_IP | PBUF_CSUM_TX_UDP);
+    if (csum && (!e1000e_dev.csum_offload || !e1000e_csum_fits(p->data, p->length))) {
+        e1000e_csum_software(p->data, p->length, csum);
+        csum = 0;
+    }
+    if (e1000e_tx_room((csum && !e1000e_dev.tx_ctx_loaded) ? 2 : 1) != 0) {
+        pbuf_free(p);
+        return -1;
+    }
+    uint8_t popts = e1000e_csum_popts(csum);
+    if (popts) {
+        e1000e_tx_context();
+        e1000e_dev.stat_tx_csum_hw++;
+    }
+    uint16_t tail = e1000e_dev.tx_tail;
+    e1000e_tx_desc_set(tail, p->data, p->length,
+                       E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS, popts);
+    e1000e_dev.tx_pbufs[tail] = p;
+    e1000e_dev.tx_tail = (tail + 1) % e1000e_dev.tx_ring_size;
+    
+    e1000e_tx_doorbell(0);
+    e1000e_dev.stat_tx_frames++;
+    return 0;
+}
+
+static int e1000e_poll_pending(void) {
+    if (!e1000e_initialized) {
+        return 0;
+    }
+    for (int i = 0; i < E1000E_RX_QUEUES; i++) {
+        if (e1000e_dev.rxq[i].pending) {
+            return 1;
+        }
+    }
+    return e1000e_dev.tx_pending;
+}
+
+// With MSI-X only the causes whose vectors fired are masked, so only those
+// are unmasked again: TX right away (network_poll() reclaimed it before
+// calling here), RX once the queues are drained. Causes latched while
+// masked fire as soon as IMS is written.
+static void e1000e_poll_complete(int drained) {
+    if (!e1000e_initialized) {
+        return;
+    }
+    e1000e_dev.stat_polls++;
+    for (int i = 0; i < E1000E_RX_QUEUES; i++) {
+        e1000e_rx_doorbell(i, drained);
+    }
+    if (!e1000e_dev.irq_enabled) {
+        return;  // Polled mode
+    }
+    uint32_t ims = 0;
+    if (e1000e_dev.msix) {
+        if (e1000e_dev.tx_pending) {
+            e1000e_dev.tx_pending = 0;
+            ims |= E1000E_ICR_TXQ0;
+        }
+        for (int i = 0; drained && i < E1000E_RX_QUEUES; i++) {
+            if (e1000e_dev.rxq[i].pending) {
+                e1000e_dev.rxq[i].pending = 0;
+                ims |= E1000E_ICR_RXQ0 << i;
+            }
+        }
+    } else if (drained) {
+        for (int i = 0; i < E1000E_RX_QUEUES; i++) {
+            e1000e_dev.rxq[i].pending = 0;
+        }
+        e1000e_dev.tx_pending = 0;
+        ims = E1000_IMS_ENABLE;
+    }
+    if (ims) {
+        e1000_write_reg(e1000e_dev.mmio_base, E1000_REG_IMS, ims);
+    }
+}
+
+static int e1000e_get_mac(mac_address_t* mac) {
+    if (!e1000e_initialized) {
+        return -1;
+    }
+    *mac = e1000e_dev.mac_address;
+    return 0;
+}
+
+static uint16_t e1000e_get_mtu(void) {
+    return ETH_MTU_DEFAULT;
+}
+
+// Jumbo frames are not supported on this NIC yet
+static int e1000e_set_mtu(uint32_t mtu) {
+    return mtu == ETH_MTU_DEFAULT ? 0 : -1;
+}
+
+// No multicast groups are joined, so the MTA passes none
+static int e1000e_mcast_member(const mac_address_t* mac) {
+    (void)mac;
+    return 0;
+}
+
+const netdev_ops_t e1000e_netdev_ops = {
+    .name = "e1000e",
+    .get_mac = e1000e_get_mac,
+    .get_mtu = e1000e_get_mtu,
+    .set_mtu = e1000e_set_mtu,
+    .send_packet = e1000e_send_packet,
+    .receive_packet = e1000e_receive_packet,
+    .receive_loan = e1000e_receive_loan,
+    .send_pbuf = e1000e_send_pbuf,
+    .send_sg = e1000e_send_sg,
+    .csum_offload = e1000e_csum_offload,
+    .mcast_member = e1000e_mcast_member,
+    .tx_flush = e1000e_tx_flush,
+    .tx_hold = e1000e_tx_hold,
+    .tx_reclaim = e1000e_tx_reclaim,
+    .poll_pending = e1000e_poll_pending,
+    .poll_complete = e1000e_poll_complete,
+};
@@ -0,0 +1,377 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Bus master IDE (ATA DMA) driver.
+// Transfers are described by a PRD table and completion is signalled by the
+// channel interrupt, so the CPU never copies sector data by PIO.
+
+#include "ide.h"
+#include "pci.h"
+#include "irq.h"
+#include "pic.h"
+#include "io.h"
+#include "block.h"
+#include <stdint.h>
+#include <stddef.h>
+
+static ide_channel_t ide_channels[2];
+static ide_drive_t ide_drives[4];
+static int ide_initialized = 0;
+
+// One PRD table per channel (aligned so it never crosses a 64KB boundary)
+static ide_prd_t ide_prd_tables[2][IDE_PRD_ENTRIES] __attribute__((aligned(512)));
+
+// Wait ~400ns for the drive to update its status
+static void ide_delay(ide_channel_t* ch) {
+    for (int i = 0; i < 4; i++) {
+        inb(ch->ctrl_base);
+    }
+}
+
+static int ide_wait_not_busy(ide_channel_t* ch, int timeout) {
+    for (int i = 0; i < timeout; i++) {
+        uint8_t status = inb(ch->io_base + ATA_REG_STATUS);
+        if (status == 0xFF) {
+            return -1;  // Floating bus, nothing attached
+        }
+        if (!(status & ATA_SR_BSY)) {
+            return status;
+        }
+    }
+    return -1;
+}
+
+// Run IDENTIFY DEVICE by PIO (only used while probing)
+static int ide_identify(ide_channel_t* ch, uint8_t slave, uint16_t* id) {
+    outb(ch->io_base + ATA_REG_HDDEVSEL, 0xA0 | (slave << 4));
+    ide_delay(ch);
+
+    outb(ch->io_base + ATA_REG_SECCOUNT, 0);
+    outb(ch->io_base + ATA_REG_LBA0, 0);
+    outb(ch->io_base + ATA_REG_LBA1, 0);
+    outb(ch->io_base + ATA_REG_LBA2, 0);
+    outb(ch->io_base + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    ide_delay(ch);
+
+    uint8_t status = inb(ch->io_base + ATA_REG_STATUS);
+    if (status == 0 || status == 0xFF) {
+        return -1;  // No drive
+    }
+    if (ide_wait_not_busy(ch, 100000) < 0) {
+        return -1;
+    }
+
+    // ATAPI and SATA bridges report a signature here, we only drive ATA disks
+    if (inb(ch->io_base + ATA_REG_LBA1) != 0 || inb(ch->io_base + ATA_REG_LBA2) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < 100000; i++) {
+        status = inb(ch->io_base + ATA_REG_STATUS);
+        if (status & ATA_SR_ERR) {
+            return -1;
+        }
+        if (status & ATA_SR_DRQ) {
+            for (int w = 0; w < 256; w++) {
+                id[w] = inw(ch->io_base + ATA_REG_DATA);
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Fill the channel's PRD table from a (possibly merged) request
+static int ide_build_prd(ide_channel_t* ch, block_request_t* req) {
+    int n = 0;
+    for (block_request_t* seg = req; seg; seg = seg->merge_next) {
+        uint32_t addr = (uint32_t)(uintptr_t)seg->buffer;
+        uint32_t bytes = seg->count * BLOCK_SECTOR_SIZE;
+
+        while (bytes > 0) {
+            if (n >= IDE_PRD_ENTRIES) {
+                return -1;
+            }
+            // A PRD region may not cross a 64KB boundary
+            uint32_t chunk = 0x10000 - (addr & 0xFFFF);
+            if (chunk > bytes) chunk = bytes;
+
+            ch->prd_table[n].phys_addr = addr;
+            ch->prd_table[n].byte_count = (uint16_t)(chunk & 0xFFFF);
+            ch->prd_table[n].flags = 0;
+            n++;
+
+            addr += chunk;
+            bytes -= chunk;
+        }
+    }
+    if (n == 0) {
+        return -1;
+    }
+    ch->prd_table[n - 1].flags = IDE_PRD_EOT;
+    return 0;
+}
+
+static int ide_submit(block_device_t* dev, block_request_t* req) {
+    ide_drive_t* drive = (ide_drive_t*)dev->driver_data;
+    ide_channel_t* ch = drive->channel;
+
+    if (ch->active) {
+        return -1;  // Channel busy (the other drive may own it)
+    }
+
+    if (ide_build_prd(ch, req) != 0) {
+        block_complete(dev, req, -1);
+        return 0;
+    }
+
+    uint64_t lba = req->lba;
+    uint32_t count = req->total_count;
+    uint8_t dir = req->write ? 0 : BM_CMD_READ;
+    uint8_t cmd;
+
+    // Program the bus master: stop, load the PRD table, clear status
+    outb(ch->bm_base + BM_REG_COMMAND, dir);
+    outl(ch->bm_base + BM_REG_PRDT, (uint32_t)(uintptr_t)ch->prd_table);
+    outb(ch->bm_base + BM_REG_STATUS, inb(ch->bm_base + BM_REG_STATUS) | BM_STATUS_ERROR | BM_STATUS_IRQ);
+
+    if (drive->lba48) {
+        outb(ch->io_base + ATA_REG_HDDEVSEL, 0x40 | (drive->slave << 4));
+        ide_delay(ch);
+        outb(ch->io_base + ATA_REG_SECCOUNT, (uint8_t)(count >> 8));
+        outb(ch->io_base + ATA_REG_LBA0, (uint8_t)(lba >> 24));
+        outb(ch->io_base + ATA_REG_LBA1, (uint8_t)(lba >> 32));
+        outb(ch->io_base + ATA_REG_LBA2, (uint8_t)(lba >> 40));
+        outb(ch->io_base + ATA_REG_SECCOUNT, (uint8_t)count);
+        outb(ch->io_base + ATA_REG_LBA0, (uint8_t)lba);
+        outb(ch->io_base + ATA_REG_LBA1, (uint8_t)(lba >> 8));
+        outb(ch->io_base + ATA_REG_LBA2, (uint8_t)(lba >> 16));
+        cmd = req->write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+    } else {
+        outb(ch->io_base + ATA_REG_HDDEVSEL, 0xE0 | (drive->slave << 4) | (uint8_t)((lba >> 24) & 0x0F));
+        ide_delay(ch);
+        outb(ch->io_base + ATA_REG_SECCOUNT, (uint8_t)count);  // 0 means 256
+        outb(ch->io_base + ATA_REG_LBA0, (uint8_t)lba);
+        outb(ch->io_base + ATA_REG_LBA1, (uint8_t)(lba >> 8));
+        outb(ch->io_base + ATA_REG_LBA2, (uint8_t)(lba >> 16));
+        cmd = req->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+    }
+
+    ch->active = req;
+    ch->active_drive = drive;
+    ch->polls = 0;
+
+    outb(ch->io_base + ATA_REG_COMMAND, cmd);
+    outb(ch->bm_base + BM_REG_COMMAND, dir | BM_CMD_START);
+    return 0;
+}
+
+// Finish the active transfer if the channel raised its interrupt.
+// from_poll counts towards the timeout of a transfer that never completes.
+static void ide_channel_service(ide_channel_t* ch, int from_poll) {
+    unsigned long flags = irq_save();
+
+    if (!ch->active) {
+        irq_restore(flags);
+        return;
+    }
+
+    uint8_t bm_status = inb(ch->bm_base + BM_REG_STATUS);
+    int timed_out = from_poll && ++ch->polls > IDE_TIMEOUT_POLLS;
+
+    if (!(bm_status & BM_STATUS_IRQ) && !timed_out) {
+        irq_restore(flags);
+        return;  // Not ours (shared line) or still running
+    }
+
+    outb(ch->bm_base + BM_REG_COMMAND, 0);                     // Stop the engine
+    uint8_t ata_status = inb(ch->io_base + ATA_REG_STATUS);    // Acknowledges the device IRQ
+    outb(ch->bm_base + BM_REG_STATUS, bm_status | BM_STATUS_ERROR | BM_STATUS_IRQ);
+
+    int status = 0;
+    if (timed_out || (bm_status & BM_STATUS_ERROR) || (ata_status & (ATA_SR_ERR | ATA_SR_DF))) {
+        status = -1;
+    }
+    if (timed_out) {
+        // Reset the channel so the next command starts from a clean state
+        outb(ch->ctrl_base, ATA_CTRL_SRST);
+        ide_delay(ch);
+        outb(ch->ctrl_base, 0);
+        ide_wait_not_busy(ch, 100000);
+    }
+
+    block_request_t* req = ch->active;
+    ide_drive_t* drive = ch->active_drive;
+    ch->active = NULL;
+    ch->active_drive = NULL;
+
+    block_complete(&drive->blk, req, status);
+
+    // The other drive on this channel may have been waiting for the bus
+    for (int i = 0; i < 4; i++) {
+        if (ide_drives[i].present && ide_drives[i].channel == ch && &ide_drives[i] != drive) {
+            block_dispatch(&ide_drives[i].blk);
+        }
+    }
+
+    irq_restore(flags);
+}
+
+static void ide_poll(block_device_t* dev) {
+    ide_drive_t* drive = (ide_drive_t*)dev->driver_data;
+    ide_channel_service(drive->channel, 1);
+}
+
+static void ide_irq_primary(void) {
+    ide_channel_service(&ide_channels[0], 0);
+    if (ide_channels[1].irq == ide_channels[0].irq) {
+        ide_channel_service(&ide_channels[1], 0);  // Native mode shares one line
+    }
+}
+
+static void ide_irq_secondary(void) {
+    ide_channel_service(&ide_channels[1], 0);
+}
+
+static void ide_probe_drive(ide_channel_t* ch, uint8_t slave, int index) {
+    ide_drive_t* drive = &ide_drives[index];
+    uint16_t id[256];
+
+    drive->present = 0;
+    if (ide_identify(ch, slave, id) != 0) {
+        return;
+    }
+    if (!(id[49] & (1 << 8))) {
+        return;  // No DMA support
+    }
+
+    drive->channel = ch;
+    drive->slave = slave;
+    drive->lba48 = (id[83] & (1 << 10)) != 0;
+    if (drive->lba48) {
+        drive->sectors = (uint64_t)id[100] | ((uint64_t)id[101] << 16) |
+                         ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48);
+    } else {
+        drive->sectors = (uint64_t)id[60] | ((uint64_t)id[61] << 16);
+    }
+    if (drive->sectors == 0) {
+        return;
+    }
+
+    // Model string is stored as byte-swapped words
+    for (int i = 0; i < 20; i++) {
+        drive->model[i * 2] = (char)(id[27 + i] >> 8);
+        drive->model[i * 2 + 1] = (char)(id[27 + i] & 0xFF);
+    }
+    drive->model[40] = '\0';
+    for (int i = 39; i >= 0 && drive->model[i] == ' '; i--) {
+        drive->model[i] = '\0';
+    }
+
+    block_device_t* blk = &drive->blk;
+    blk->name[0] = 'h';
+    blk->name[1] = 'd';
+    blk->name[2] = (char)('a' + index);
+    blk->name[3] = '\0';
+    blk->driver = "ide-dma";
+    blk->sector_count = drive->sectors;
+    blk->max_sectors = IDE_MAX_SECTORS;
+    blk->max_segments = IDE_MAX_SEGMENTS;
+    blk->queue_depth = 1;
+    blk->submit = ide_submit;
+    blk->poll = ide_poll;
+    blk->driver_data = drive;
+
+    if (block_register_device(blk) == 0) {
+        drive->present = 1;
+    }
+}
+
+int ide_init(void) {
+    if (ide_initialized) {
+        return 0;
+    }
+
+    pci_device_t pci_dev;
+    if (!pci_find_device_by_class(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_IDE, &pci_dev)) {
+        return -1;
+    }
+    if (!(pci_dev.prog_if & 0x80)) {
+        return -1;  // Controller is not bus master capable
+    }
+
+    uint32_t bar4 = pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x20);
+    if (!(bar4 & 1)) {
+        return -1;  // Bus master registers must be in I/O space
+    }
+    uint16_t bm_base = (uint16_t)(bar4 & ~0x3);
+
+    // Enable I/O decoding and bus mastering
+    uint32_t command = pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x04);
+    command |= (1 << 0) | (1 << 2);
+    pci_write_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x04, command);
+
+    uint8_t pci_irq = (uint8_t)(pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x3C) & 0xFF);
+
+    for (int c = 0; c < 2; c++) {
+        ide_channel_t* ch = &ide_channels[c];
+        int native = (pci_dev.prog_if >> (c * 2)) & 1;
+
+        if (native) {
+            uint32_t bar_io = pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x10 + c * 8);
+            uint32_t bar_ctrl = pci_read_config(pci_dev.bus, pci_dev.device, pci_dev.function, 0x14 + c * 8);
+            ch->io_base = (uint16_t)(bar_io & ~0x3);
+            ch->ctrl_base = (uint16_t)((bar_ctrl & ~0x3) + 2);
+            ch->irq = pci_irq;
+        } else {
+            ch->io_base = c ? IDE_SECONDARY_IO : IDE_PRIMARY_IO;
+            ch->ctrl_base = c ? IDE_SECONDARY_CTRL : IDE_PRIMARY_CTRL;
+            ch->irq = c ? IDE_SECONDARY_IRQ : IDE_PRIMARY_IRQ;
+        }
+        ch->bm_base = bm_base + c * 8;
+        ch->prd_table = ide_prd_tables[c];
+        ch->active = NULL;
+        ch->active_drive = NULL;
+
+        // Probe with device interrupts off, then let the drives interrupt us
+        outb(ch->ctrl_base, ATA_CTRL_NIEN);
+        ide_probe_drive(ch, 0, c * 2);
+        ide_probe_drive(ch, 1, c * 2 + 1);
+        outb(ch->ctrl_base, 0);
+        inb(ch->io_base + ATA_REG_STATUS);
+    }
+
+    int found = 0;
+    for (int c = 0; c < 2; c++) {
+        if (!ide_drives[c * 2].present && !ide_drives[c * 2 + 1].present) {
+            continue;
+        }
+        found = 1;
+        ide_channel_t* ch = &ide_channels[c];
+        if (ch->irq > 0 && ch->irq < 16) {
+            if (c == 1 && ch->irq == ide_channels[0].irq) {
+                continue;  // Shared native line, already handled by the primary handler
+            }
+            irq_register_handler(ch->irq, c ? ide_irq_secondary : ide_irq_primary);
+            pic_irq_enable(ch->irq);
+        }
+    }
+
+    ide_initialized = 1;
+    return found ? 0 : -1;
+}
@@ -104,12 +104,13 @@ isr_page_fault:
 
 ; External C function for IRQ dispatching
 extern irq_dispatcher
+extern irq_vector_dispatcher
 extern timer_tick
 
-; Generic IRQ handler stub
-; This is called for each IRQ and dispatches to the C handler
-%macro IRQ_ISR 1
-irq%1:
+; Generic interrupt stub: saves state and calls a C dispatcher
+; %1 = label, %2 = argument, %3 = C function
+%macro ISR_DISPATCH 3
+%1:
     push rax
     push rcx
     push rdx
@@ -126,8 +127,17 @@ irq%1:
     push r14
     push r15
     
-    mov rdi, %1                            ; Pass IRQ number as first argument
-    call irq_dispatcher                    ; Call C dispatcher
+    ; Preserve SSE state, the interrupted code may be using XMM registers
+    mov rbp, rsp
+    and rsp, -16                           ; FXSAVE needs a 16-byte aligned area
+    sub rsp, 512
+    fxsave [rsp]
+    
+    mov rdi, %2                            ; Pass IRQ/vector number as first argument
+    call %3                                ; Call C dispatcher
+    
+    fxrstor [rsp]
+    mov rsp, rbp
     
     pop r15
     pop r14
@@ -147,6 +157,16 @@ irq%1:
     iretq
 %endmacro
 
+; PIC lines 0-15 (vectors 0x20-0x2F)
+%macro IRQ_ISR 1
+ISR_DISPATCH irq%1, %1, irq_dispatcher
+%endmacro
+
+; Message signalled vectors 0x30-0x3F, acknowledged at the local APIC
+%macro VECTOR_ISR 1
+ISR_DISPATCH vec%1, %1, irq_vector_dispatcher
+%endmacro
+
 ; Create IRQ handlers for IRQ 0-15
 IRQ_ISR 0
 IRQ_ISR 1
@@ -165,6 +185,35 @@ IRQ_ISR 13
 IRQ_ISR 14
 IRQ_ISR 15
 
+; Create handlers for the vectors handed out by irq_alloc_vector()
+VECTOR_ISR 0x30
+VECTOR_ISR 0x31
+VECTOR_ISR 0x32
+VECTOR_ISR 0x33
+VECTOR_ISR 0x34
+VECTOR_ISR 0x35
+VECTOR_ISR 0x36
+VECTOR_ISR 0x37
+VECTOR_ISR 0x38
+VECTOR_ISR 0x39
+VECTOR_ISR 0x3A
+VECTOR_ISR 0x3B
+VECTOR_ISR 0x3C
+VECTOR_ISR 0x3D
+VECTOR_ISR 0x3E
+VECTOR_ISR 0x3F
+
+; Spurious local APIC interrupt (vector 0xFF): no EOI
+isr_spurious:
+    iretq
+
+%macro SET_VECTOR 1
+    mov rax, vec%1
+    mov rbx, %1
+    mov rcx, 0
+    call set_idt_entry
+%endmacro
+
 ; Function: init_idt
 ; Initializes the IDT with basic exception handlers and IRQ handlers
 init_idt:
@@ -270,6 +319,29 @@ init_idt:
     mov rcx, 0
     call set_idt_entry
 
+    ; Set up MSI/MSI-X vectors (0x30-0x3F)
+    SET_VECTOR 0x30
+    SET_VECTOR 0x31
+    SET_VECTOR 0x32
+    SET_VECTOR 0x33
+    SET_VECTOR 0x34
+    SET_VECTOR 0x35
+    SET_VECTOR 0x36
+    SET_VECTOR 0x37
+    SET_VECTOR 0x38
+    SET_VECTOR 0x39
+    SET_VECTOR 0x3A
+    SET_VECTOR 0x3B
+    SET_VECTOR 0x3C
+    SET_VECTOR 0x3D
+    SET_VECTOR 0x3E
+    SET_VECTOR 0x3F
+
+    mov rax, isr_spurious
+    mov rbx, 0xFF                          ; Local APIC spurious vector
+    mov rcx, 0
+    call set_idt_entry
+
     call load_idt                          ; Load the IDT
     
     pop rcx
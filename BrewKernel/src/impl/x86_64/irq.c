@@ -19,16 +19,31 @@
 #include "irq.h"
 #include "pic.h"
 #include "timer.h"
+#include "apic.h"
 #include <stddef.h>
 
 // Array of IRQ handlers (16 IRQs)
 static irq_handler_t irq_handlers[16] = {NULL};
 
+// Additional handlers for shared PCI interrupt lines
+static irq_handler_t irq_shared_handlers[16][IRQ_MAX_SHARED];
+
+// Handlers for message signalled vectors, indexed from IRQ_VECTOR_BASE
+static irq_handler_t irq_vector_handlers[IRQ_VECTOR_COUNT];
+static uint32_t irq_vector_counts[IRQ_VECTOR_COUNT];
+
 // Initialize IRQ handling
 void irq_init(void) {
     // Clear all handlers
     for (int i = 0; i < 16; i++) {
         irq_handlers[i] = NULL;
+        for (int j = 0; j < IRQ_MAX_SHARED; j++) {
+            irq_shared_handlers[i][j] = NULL;
+        }
+    }
+    for (int i = 0; i < IRQ_VECTOR_COUNT; i++) {
+        irq_vector_handlers[i] = NULL;
+        irq_vector_counts[i] = 0;
     }
     
     // Register default timer handler
@@ -49,6 +64,22 @@ void irq_unregister_handler(unsigned char irq) {
     }
 }
 
+int irq_register_shared_handler(unsigned char irq, irq_handler_t handler) {
+    if (irq >= 16 || !handler) {
+        return -1;
+    }
+    for (int j = 0; j < IRQ_MAX_SHARED; j++) {
+        if (irq_shared_handlers[irq][j] == handler) {
+            return 0;
+        }
+        if (irq_shared_handlers[irq][j] == NULL) {
+            irq_shared_handlers[irq][j] = handler;
+            return 0;
+        }
+    }
+    return -1;
+}
+
 // IRQ dispatcher (called from assembly ISRs)
 // This must be visible to assembly code
 void irq_dispatcher(unsigned char irq) {
@@ -56,8 +87,53 @@ void irq_dispatcher(unsigned char irq) {
     if (irq < 16 && irq_handlers[irq] != NULL) {
         irq_handlers[irq]();
     }
+    if (irq < 16) {
+        for (int j = 0; j < IRQ_MAX_SHARED && irq_shared_handlers[irq][j]; j++) {
+            irq_shared_handlers[irq][j]();
+        }
+    }
     
     // Send EOI to PIC
     pic_send_eoi(irq);
 }
 
+int irq_alloc_vector(irq_handler_t handler) {
+    if (!handler) {
+        return -1;
+    }
+    unsigned long flags = irq_save();
+    for (int i = 0; i < IRQ_VECTOR_COUNT; i++) {
+        if (irq_vector_handlers[i] == NULL) {
+            irq_vector_handlers[i] = handler;
+            irq_vector_counts[i] = 0;
+            irq_restore(flags);
+            return IRQ_VECTOR_BASE + i;
+        }
+    }
+    irq_restore(flags);
+    return -1;
+}
+
+void irq_free_vector(int vector) {
+    if (vector >= IRQ_VECTOR_BASE && vector < IRQ_VECTOR_BASE + IRQ_VECTOR_COUNT) {
+        irq_vector_handlers[vector - IRQ_VECTOR_BASE] = NULL;
+    }
+}
+
+uint32_t irq_vector_count(int vector) {
+    if (vector < IRQ_VECTOR_BASE || vector >= IRQ_VECTOR_BASE + IRQ_VECTOR_COUNT) {
+        return 0;
+    }
+    return irq_vector_counts[vector - IRQ_VECTOR_BASE];
+}
+
+// Vector dispatcher (called from assembly ISRs). Messages are edge
+// triggered, so there is nothing to poll: one handler, then the APIC EOI.
+void irq_vector_dispatcher(unsigned char vector) {
+    int i = vector - IRQ_VECTOR_BASE;
+    if (i >= 0 && i < IRQ_VECTOR_COUNT && irq_vector_handlers[i] != NULL) {
+        irq_vector_counts[i]++;
+        irq_vector_handlers[i]();
+    }
+    lapic_eoi();
+}
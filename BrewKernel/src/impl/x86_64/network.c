@@ -18,7 +18,14 @@
 
 #include "network.h"
 #include "e1000.h"
+#include "e1000e.h"
+#include "virtio_net.h"
+#include "netdev.h"
 #include "pci.h"
+#include "pbuf.h"
+#include "checksum.h"
+#include "route.h"
+#include "timer.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -51,12 +58,16 @@ static int memcmp(const void* s1, const void* s2, size_t n) {
 }
 
 static int network_initialized = 0;
+static const netdev_ops_t* netdev = NULL;  // Driver of the NIC in use
 static mac_address_t our_mac;
 static ipv4_address_t our_ip = {{0, 0, 0, 0}};
 static uint16_t ipv4_id_counter = 0;
 
-static arp_cache_entry_t arp_cache[ARP_CACHE_SIZE];
-static int arp_cache_initialized = 0;
+static arp_entry_t arp_table[ARP_TABLE_SIZE];
+static int16_t arp_buckets[ARP_HASH_BUCKETS];  // First entry of each chain
+static arp_stats_t arp_stats;
+static uint64_t arp_last_tick = 0;  // Last arp_timer() pass
+static uint32_t neigh_generation = 0;  // Bumped when a cached MAC may be stale
 
 #define UDP_MAX_CALLBACKS 8
 typedef struct {
@@ -67,6 +78,9 @@ typedef struct {
 
 static udp_callback_entry_t udp_callbacks[UDP_MAX_CALLBACKS];
 
+static uint32_t tx_csum_sw_count = 0;  // Checksums computed here, offload off
+static uint32_t rx_csum_sw_count = 0;  // Checksums the NIC did not verify
+static uint32_t rx_csum_drop_count = 0;
 static int frames_received_count = 0;
 static int udp_packets_received_count = 0;
 static int udp_callbacks_called_count = 0;
@@ -76,18 +90,7 @@ static int e1000_receive_no_dd = 0;
 static int network_process_calls = 0;
 
 static uint16_t ipv4_checksum(const ipv4_header_t* header) {
-    uint32_t sum = 0;
-    const uint16_t* words = (const uint16_t*)header;
-    
-    for (int i = 0; i < 10; i++) {  
-        sum += words[i];
-    }
-    
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-    
-    return ~((uint16_t)sum);
+    return (uint16_t)~csum_fold(csum_partial(header, sizeof(ipv4_header_t), 0));
 }
 
 static uint16_t htons(uint16_t hostshort) {
@@ -105,45 +108,137 @@ static uint32_t htonl(uint32_t hostlong) {
            ((hostlong >> 24) & 0xFF);
 }
 
-static void arp_cache_init(void) {
-    if (arp_cache_initialized) {
-        return;
+static void arp_table_init(void) {
+    memset(arp_table, 0, sizeof(arp_table));
+    memset(&arp_stats, 0, sizeof(arp_stats));
+    for (int i = 0; i < ARP_HASH_BUCKETS; i++) {
+        arp_buckets[i] = -1;
     }
-    memset(arp_cache, 0, sizeof(arp_cache));
-    arp_cache_initialized = 1;
 }
 
-static arp_cache_entry_t* arp_cache_find(const ipv4_address_t* ip) {
-    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
-        if (arp_cache[i].valid && memcmp(&arp_cache[i].ip, ip, sizeof(ipv4_address_t)) == 0) {
-            return &arp_cache[i];
+static uint32_t arp_hash(const ipv4_address_t* ip) {
+    uint32_t key = ((uint32_t)ip->bytes[0] << 24) | ((uint32_t)ip->bytes[1] << 16) |
+                   ((uint32_t)ip->bytes[2] << 8) | ip->bytes[3];
+    return ((key * 2654435761U) >> 24) & (ARP_HASH_BUCKETS - 1);
+}
+
+static arp_entry_t* arp_table_find(const ipv4_address_t* ip) {
+    for (int i = arp_buckets[arp_hash(ip)]; i >= 0; i = arp_table[i].next) {
+        if (memcmp(&arp_table[i].ip, ip, sizeof(ipv4_address_t)) == 0) {
+            return &arp_table[i];
         }
     }
     return NULL;
 }
 
-static void arp_cache_add(const ipv4_address_t* ip, const mac_address_t* mac) {
-    arp_cache_entry_t* entry = arp_cache_find(ip);
-    if (entry) {
-        memcpy(&entry->mac, mac, sizeof(mac_address_t));
-        entry->timestamp = 0; 
-        return;
+// Drop the packets waiting on an entry
+static void arp_queue_drop(arp_entry_t* entry) {
+    for (int i = 0; i < entry->queue_len; i++) {
+        pbuf_free(entry->queue[i]);
+        arp_stats.dropped++;
     }
-    
-    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
-        if (!arp_cache[i].valid) {
-            memcpy(&arp_cache[i].ip, ip, sizeof(ipv4_address_t));
-            memcpy(&arp_cache[i].mac, mac, sizeof(mac_address_t));
-            arp_cache[i].timestamp = 0;
-            arp_cache[i].valid = 1;
-            return;
+    entry->queue_len = 0;
+}
+
+// Unhash an entry and mark it free
+static void arp_table_remove(arp_entry_t* entry) {
+    int index = (int)(entry - arp_table);
+    int16_t* link = &arp_buckets[arp_hash(&entry->ip)];
+    while (*link >= 0 && *link != index) {
+        link = &arp_table[*link].next;
+    }
+    if (*link == index) {
+        *link = entry->next;
+    }
+    arp_queue_drop(entry);
+    if (entry->state == ARP_STATE_REACHABLE) {
+        neigh_generation++;
+    }
+    entry->state = ARP_STATE_FREE;
+}
+
+// Take a free entry for ip, evicting the least recently used one (failed
+// entries first) when the table is full
+static arp_entry_t* arp_table_add(const ipv4_address_t* ip, uint64_t now) {
+    arp_entry_t* victim = NULL;
+    for (int i = 0; i < ARP_TABLE_SIZE; i++) {
+        arp_entry_t* entry = &arp_table[i];
+        if (entry->state == ARP_STATE_FREE) {
+            victim = entry;
+            break;
+        }
+        if (!victim ||
+            (entry->state == ARP_STATE_FAILED) > (victim->state == ARP_STATE_FAILED) ||
+            ((entry->state == ARP_STATE_FAILED) == (victim->state == ARP_STATE_FAILED) &&
+             entry->used < victim->used)) {
+            victim = entry;
         }
     }
+    if (victim->state != ARP_STATE_FREE) {
+        arp_stats.evicted++;
+        arp_table_remove(victim);
+    }
     
-    memcpy(&arp_cache[0].ip, ip, sizeof(ipv4_address_t));
-    memcpy(&arp_cache[0].mac, mac, sizeof(mac_address_t));
-    arp_cache[0].timestamp = 0;
-    arp_cache[0].valid = 1;
+    memset(victim, 0, sizeof(*victim));
+    victim->ip = *ip;
+    victim->state = ARP_STATE_INCOMPLETE;
+    victim->updated = now;
+    victim->used = now;
+    uint32_t bucket = arp_hash(ip);
+    victim->next = arp_buckets[bucket];
+    arp_buckets[bucket] = (int16_t)(victim - arp_table);
+    return victim;
+}
+
+// Send the next request for an unresolved entry
+static void arp_entry_request(arp_entry_t* entry, uint64_t now) {
+    entry->requests++;
+    entry->requested = now;
+    arp_stats.requests++;
+    arp_send_request(&entry->ip);
+}
+
+// Record a MAC for an entry and send the packets that waited on it
+static void arp_entry_resolve(arp_entry_t* entry, const mac_address_t* mac, uint64_t now) {
+    if (entry->state == ARP_STATE_REACHABLE && memcmp(&entry->mac, mac, sizeof(mac_address_t)) != 0) {
+        neigh_generation++;  // Host moved
+    }
+    entry->mac = *mac;
+    entry->state = ARP_STATE_REACHABLE;
+    entry->requests = 0;
+    entry->updated = now;
+    arp_stats.replies++;
+    
+    for (int i = 0; i < entry->queue_len; i++) {
+        pbuf_t* p = entry->queue[i];
+        memcpy(((eth_header_t*)p->data)->dest_mac, mac->bytes, 6);
+        netdev->send_pbuf(p);
+        arp_stats.released++;
+    }
+    entry->queue_len = 0;
+}
+
+// Park a complete frame until its destination resolves. arp_lookup() has
+// already created the entry and sent the request. Consumes the pbuf.
+static int arp_queue_frame(const ipv4_address_t* ip, pbuf_t* p) {
+    arp_entry_t* entry = arp_table_find(ip);
+    if (!entry || entry->state != ARP_STATE_INCOMPLETE) {
+        pbuf_free(p);
+        arp_stats.dropped++;
+        return -1;  // Resolution failed
+    }
+    if (entry->queue_len == ARP_QUEUE_LEN) {
+        // Keep the newest packets
+        pbuf_free(entry->queue[0]);
+        arp_stats.dropped++;
+        for (int i = 1; i < ARP_QUEUE_LEN; i++) {
+            entry->queue[i - 1] = entry->queue[i];
+        }
+        entry->queue_len--;
+    }
+    entry->queue[entry->queue_len++] = p;
+    arp_stats.queued++;
+    return 0;
 }
 
 int network_init(void) {
@@ -151,14 +246,22 @@ int network_init(void) {
         return 0;
     }
     
-    pci_device_t device;
-    if (!pci_find_device(E1000_VENDOR_ID, E1000_DEVICE_ID_82540EM, &device)) {
-        return -1;  // Network card not found
-    }
-    
-    // Initialize the e1000 device
-    if (e1000_init(&device) != 0) {
-        return -1;
+    // Prefer virtio-net: the emulated e1000 traps on every register access
+    if (virtio_net_init() == 0) {
+        netdev = &virtio_net_netdev_ops;
+    } else if (e1000e_init() == 0) {
+        netdev = &e1000e_netdev_ops;
+    } else {
+        pci_device_t device;
+        if (!pci_find_device(E1000_VENDOR_ID, E1000_DEVICE_ID_82540EM, &device)) {
+            return -1;  // Network card not found
+        }
+        
+        // Initialize the e1000 device
+        if (e1000_init(&device) != 0) {
+            return -1;
+        }
+        netdev = &e1000_netdev_ops;
     }
     
     // Get MAC address
@@ -166,8 +269,13 @@ int network_init(void) {
         return -1;
     }
     
-    // Initialize ARP cache
-    arp_cache_init();
+    // Initialize the ARP table
+    arp_table_init();
+    
+    // A broken longest-prefix match would send traffic to the wrong hop
+    if (route_self_check() != 0) {
+        return -1;
+    }
     
     // Initialize UDP callbacks
     memset(udp_callbacks, 0, sizeof(udp_callbacks));
@@ -179,13 +287,15 @@ int network_init(void) {
 
 // Get MAC address
 int network_get_mac_address(mac_address_t* mac) {
-    e1000_device_t* dev = e1000_get_device();
-    if (!dev) {
+    if (!netdev) {
         return -1;
     }
-    
-    *mac = dev->mac_address;
-    return 0;
+    return netdev->get_mac(mac);
+}
+
+// Name of the NIC driver in use
+const char* network_get_driver(void) {
+    return netdev ? netdev->name : "none";
 }
 
 // Get IPv4 address
@@ -203,20 +313,34 @@ int network_set_ipv4_address(const ipv4_address_t* ip) {
         return -1;
     }
     our_ip = *ip;
+    neigh_generation++;  // Header templates carry our address
     return 0;
 }
 
+// Get the MTU (largest IPv4 packet)
+uint16_t network_get_mtu(void) {
+    return netdev ? netdev->get_mtu() : ETH_MTU_DEFAULT;
+}
+
+// Set the MTU; above 1500 the NIC takes jumbo frames
+int network_set_mtu(uint16_t mtu) {
+    if (!network_initialized) {
+        return -1;
+    }
+    return netdev->set_mtu(mtu);
+}
+
 // Send an Ethernet frame
 int network_send_frame(const void* data, size_t length) {
     if (!network_initialized) {
         return -1;
     }
     
-    if (length > ETH_FRAME_MAX_SIZE) {
+    if (length > ETH_FRAME_SIZE(network_get_mtu())) {
         return -1;
     }
     
-    return e1000_send_packet(data, length);
+    return netdev->send_packet(data, length);
 }
 
 // Receive an Ethernet frame (non-blocking)
@@ -226,88 +350,171 @@ int network_receive_frame(void* buffer, size_t buffer_size) {
     }
     
     e1000_receive_calls++;
-    int result = e1000_receive_packet(buffer, buffer_size);
+    int result = netdev->receive_packet(buffer, buffer_size);
     if (result == 0) {
         e1000_receive_empty++;
     }
     return result;
 }
 
-// Process received Ethernet frames
+// Process received Ethernet frames. Runs the ARP timer, then does nothing
+// until the NIC interrupt (or polled mode) flags work; then handles at most
+// NET_POLL_BUDGET frames and re-arms the interrupt once the ring is empty.
 void network_process_frames(void) {
     network_process_calls++;  // Debug counter
     
     if (!network_initialized) {
         return;
     }
+    arp_timer();
+    if (!netdev->poll_pending()) {
+        return;
+    }
     
-    uint8_t frame_buffer[ETH_FRAME_MAX_SIZE];
-    int frame_length;
+    netdev->tx_reclaim();  // Free sent descriptors, send queued frames
+    int processed = network_poll(NET_POLL_BUDGET);
+    netdev->poll_complete(processed < NET_POLL_BUDGET);
+}
+
+int network_poll_pending(void) {
+    return network_initialized && netdev->poll_pending();
+}
+
+// Check the UDP checksum of a received datagram in software
+static int udp_checksum_valid(const ipv4_header_t* ip, size_t length) {
+    size_t ihl = (size_t)(ip->version_ihl & 0x0F) * 4;
+    size_t total_length = ntohs(ip->total_length);
+    if (ihl < 20 || total_length > length || total_length < ihl + sizeof(udp_header_t)) {
+        return 0;
+    }
+    const udp_header_t* udp = (const udp_header_t*)((const uint8_t*)ip + ihl);
+    if (udp->checksum == 0) {
+        return 1;  // Sender did not compute one
+    }
+    size_t udp_length = ntohs(udp->length);
+    if (udp_length < sizeof(udp_header_t) || udp_length > total_length - ihl) {
+        return 0;
+    }
+    rx_csum_sw_count++;
+    uint32_t sum = csum_pseudo_ipv4(ip->src_ip, ip->dest_ip, IP_PROTO_UDP, (uint16_t)udp_length);
+    sum = csum_partial(udp, udp_length, sum);
+    return csum_fold(sum) == 0xFFFF;
+}
+
+// Route one received frame to ARP or IPv4. csum holds the PBUF_CSUM_RX_*
+// flags: checks the NIC already did are not repeated in software.
+static void network_handle_frame(uint8_t* frame_buffer, int frame_length, uint8_t csum) {
+    if (frame_length < (int)sizeof(eth_header_t)) {
+        return;  // Frame too small
+    }
     
-    // Process all available frames
-    while ((frame_length = network_receive_frame(frame_buffer, sizeof(frame_buffer))) > 0) {
-        frames_received_count++;  // Debug counter
-        
-        if (frame_length < (int)sizeof(eth_header_t)) {
-            continue;  // Frame too small
-        }
-        
-        eth_header_t* eth = (eth_header_t*)frame_buffer;
-        uint16_t ethertype = ntohs(eth->ethertype);
-        
-        // Check if frame is for us (or broadcast)
+    eth_header_t* eth = (eth_header_t*)frame_buffer;
+    uint16_t ethertype = ntohs(eth->ethertype);
+    
+    // The NIC filters on our address and the multicast hash already; this
+    // catches hash collisions and everything let through in promiscuous mode
+    if (eth->dest_mac[0] & 0x01) {
         int is_broadcast = 1;
-        int is_for_us = 1;
         for (int i = 0; i < 6; i++) {
             if (eth->dest_mac[i] != 0xFF) {
                 is_broadcast = 0;
-            }
-            if (eth->dest_mac[i] != our_mac.bytes[i]) {
-                is_for_us = 0;
+                break;
             }
         }
-        
-        if (!is_broadcast && !is_for_us) {
-            continue;  // Not for us
+        if (!is_broadcast && !netdev->mcast_member((const mac_address_t*)eth->dest_mac)) {
+            return;  // Group we did not join
         }
-        
-        // Route based on ethertype
-        void* payload = frame_buffer + sizeof(eth_header_t);
-        size_t payload_length = frame_length - sizeof(eth_header_t);
-        
-        if (ethertype == ETH_ETHERTYPE_ARP) {
-            if (payload_length >= sizeof(arp_header_t)) {
-                arp_process_packet((arp_header_t*)payload, payload_length);
-            }
-        } else if (ethertype == ETH_ETHERTYPE_IPV4) {
-            if (payload_length >= sizeof(ipv4_header_t)) {
-                ipv4_header_t* ip = (ipv4_header_t*)payload;
-                // Verify checksum
+    } else if (memcmp(eth->dest_mac, our_mac.bytes, 6) != 0) {
+        return;  // Not for us
+    }
+    
+    // Route based on ethertype
+    void* payload = frame_buffer + sizeof(eth_header_t);
+    size_t payload_length = frame_length - sizeof(eth_header_t);
+    
+    if (ethertype == ETH_ETHERTYPE_ARP) {
+        if (payload_length >= sizeof(arp_header_t)) {
+            arp_process_packet((arp_header_t*)payload, payload_length);
+        }
+    } else if (ethertype == ETH_ETHERTYPE_IPV4) {
+        if (payload_length >= sizeof(ipv4_header_t)) {
+            ipv4_header_t* ip = (ipv4_header_t*)payload;
+            // Verify checksums unless the NIC did
+            int valid = !(csum & (PBUF_CSUM_RX_IP_BAD | PBUF_CSUM_RX_L4_BAD));
+            if (valid && !(csum & PBUF_CSUM_RX_IP_OK)) {
                 uint16_t checksum = ip->checksum;
                 ip->checksum = 0;
                 uint16_t calculated = ipv4_checksum(ip);
                 ip->checksum = checksum;
-                
-                if (checksum == calculated) {
-                    int is_for_our_ip = 1;
-                    for (int i = 0; i < 4; i++) {
-                        if (ip->dest_ip[i] != our_ip.bytes[i]) {
-                            is_for_our_ip = 0;
-                            break;
-                        }
-                    }
-                    
-                    if (is_for_our_ip || ip->dest_ip[0] == 255) {  // Broadcast
-                        mac_address_t src_mac;
-                        memcpy(src_mac.bytes, eth->src_mac, 6);
-                        ipv4_process_packet(ip, &src_mac, payload_length);
+                valid = (checksum == calculated);
+                rx_csum_sw_count++;
+            }
+            if (valid && ip->protocol == IP_PROTO_UDP && !(csum & PBUF_CSUM_RX_L4_OK)) {
+                valid = udp_checksum_valid(ip, payload_length);
+            }
+            if (!valid) {
+                rx_csum_drop_count++;
+            }
+            
+            if (valid) {
+                int is_for_our_ip = 1;
+                for (int i = 0; i < 4; i++) {
+                    if (ip->dest_ip[i] != our_ip.bytes[i]) {
+                        is_for_our_ip = 0;
+                        break;
                     }
                 }
+                
+                if (is_for_our_ip || ip->dest_ip[0] == 255) {  // Broadcast
+                    mac_address_t src_mac;
+                    memcpy(src_mac.bytes, eth->src_mac, 6);
+                    ipv4_process_packet(ip, &src_mac, payload_length);
+                }
             }
         }
     }
 }
 
+// Frames taken from the ring per receive burst
+#define NET_RX_BURST 16
+
+int network_poll(int budget) {
+    if (!network_initialized) {
+        return 0;
+    }
+    
+    pbuf_t* pkts[NET_RX_BURST];
+    int processed = 0;
+    
+    // Drain the ring in bursts (one RDT write each) up to the budget. The
+    // frames are parsed in their DMA buffers; consumers that keep data
+    // past their callback copy it.
+    while (processed < budget) {
+        int want = budget - processed;
+        if (want > NET_RX_BURST) {
+            want = NET_RX_BURST;
+        }
+        
+        e1000_receive_calls++;
+        int count = netdev->receive_loan(pkts, want);
+        if (count == 0) {
+            e1000_receive_empty++;
+            break;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            frames_received_count++;  // Debug counter
+            network_handle_frame(pkts[i]->data, pkts[i]->length, pkts[i]->csum);
+            pbuf_free(pkts[i]);
+        }
+        processed += count;
+        if (count < want) {
+            break;  // Ring is empty
+        }
+    }
+    return processed;
+}
+
 // ARP: Send request
 int arp_send_request(const ipv4_address_t* target_ip) {
     if (!network_initialized) {
@@ -344,15 +551,102 @@ int arp_lookup(const ipv4_address_t* ip, mac_address_t* mac) {
         return -1;
     }
     
-    arp_cache_entry_t* entry = arp_cache_find(ip);
-    if (entry && entry->valid) {
-        *mac = entry->mac;
-        return 0;
+    uint64_t now = timer_get_ticks();
+    arp_entry_t* entry = arp_table_find(ip);
+    if (!entry) {
+        entry = arp_table_add(ip, now);
+        arp_entry_request(entry, now);
+        return -1;
+    }
+    entry->used = now;
+    
+    switch (entry->state) {
+    case ARP_STATE_REACHABLE:
+        if (now - entry->updated < ARP_REACHABLE_TICKS) {
+            *mac = entry->mac;
+            return 0;
+        }
+        // Aged out between timer passes: resolve it again
+        arp_stats.expired++;
+        neigh_generation++;
+        entry->state = ARP_STATE_INCOMPLETE;
+        entry->updated = now;
+        arp_entry_request(entry, now);
+        return -1;
+    case ARP_STATE_FAILED:
+        arp_stats.rate_limited++;
+        return -1;  // Negative entry; arp_timer() frees it later
+    default:
+        // Request in flight; arp_timer() resends it
+        arp_stats.rate_limited++;
+        return -1;
+    }
+}
+
+// ARP: Resend requests for unresolved entries and age out old ones. Runs
+// at most once per timer tick.
+void arp_timer(void) {
+    if (!network_initialized) {
+        return;
     }
+    uint64_t now = timer_get_ticks();
+    if (now == arp_last_tick) {
+        return;
+    }
+    arp_last_tick = now;
     
-    // Not in cache - send ARP request
-    arp_send_request(ip);
-    return -1;  // Not found (would need to wait for reply in real implementation)
+    for (int i = 0; i < ARP_TABLE_SIZE; i++) {
+        arp_entry_t* entry = &arp_table[i];
+        switch (entry->state) {
+        case ARP_STATE_INCOMPLETE:
+            if (now - entry->requested < ARP_RETRY_TICKS) {
+                break;
+            }
+            if (entry->requests < ARP_MAX_REQUESTS) {
+                arp_entry_request(entry, now);
+            } else {
+                // No reply: fail lookups for a while instead of flooding
+                arp_queue_drop(entry);
+                entry->state = ARP_STATE_FAILED;
+                entry->updated = now;
+                arp_stats.failed++;
+            }
+            break;
+        case ARP_STATE_REACHABLE:
+            if (now - entry->updated >= ARP_REACHABLE_TICKS) {
+                arp_stats.expired++;
+                arp_table_remove(entry);
+            }
+            break;
+        case ARP_STATE_FAILED:
+            if (now - entry->updated >= ARP_FAILED_TICKS) {
+                arp_table_remove(entry);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+int arp_get_entry(int index, arp_entry_t* entry) {
+    if (index < 0 || index >= ARP_TABLE_SIZE || arp_table[index].state == ARP_STATE_FREE) {
+        return -1;
+    }
+    *entry = arp_table[index];
+    return 0;
+}
+
+void arp_get_stats(arp_stats_t* stats) {
+    *stats = arp_stats;
+}
+
+void arp_flush(void) {
+    for (int i = 0; i < ARP_TABLE_SIZE; i++) {
+        if (arp_table[i].state != ARP_STATE_FREE) {
+            arp_table_remove(&arp_table[i]);
+        }
+    }
 }
 
 // ARP: Process received packet
@@ -372,19 +666,27 @@ void arp_process_packet(const arp_header_t* arp, size_t length) {
     memcpy(sender_ip.bytes, arp->sender_ip, 4);
     memcpy(sender_mac.bytes, arp->sender_mac, 6);
     
-    // Add to ARP cache
-    arp_cache_add(&sender_ip, &sender_mac);
+    // Check if the packet is addressed to us
+    int is_for_us = 1;
+    for (int i = 0; i < 4; i++) {
+        if (arp->target_ip[i] != our_ip.bytes[i]) {
+            is_for_us = 0;
+            break;
+        }
+    }
+    
+    // Refresh a known sender; only learn new ones that talk to us, so
+    // other hosts' broadcasts do not churn the table
+    uint64_t now = timer_get_ticks();
+    arp_entry_t* entry = arp_table_find(&sender_ip);
+    if (!entry && is_for_us) {
+        entry = arp_table_add(&sender_ip, now);
+    }
+    if (entry) {
+        arp_entry_resolve(entry, &sender_mac, now);
+    }
     
     if (opcode == ARP_OP_REQUEST) {
-        // Check if request is for us
-        int is_for_us = 1;
-        for (int i = 0; i < 4; i++) {
-            if (arp->target_ip[i] != our_ip.bytes[i]) {
-                is_for_us = 0;
-                break;
-            }
-        }
-        
         if (is_for_us) {
             // Send ARP reply
             uint8_t frame[ETH_FRAME_MAX_SIZE];
@@ -413,39 +715,64 @@ void arp_process_packet(const arp_header_t* arp, size_t length) {
     }
 }
 
-// IPv4: Send packet
-int ipv4_send_packet(const ipv4_address_t* dest_ip, uint8_t protocol,
-                     const void* data, size_t data_length) {
-    if (!network_initialized) {
-        return -1;
+// Pick the neighbour an IPv4 packet is handed to: the gateway of the
+// longest matching route, or the destination itself when it is on-link.
+// With no matching route the destination is assumed on-link. Returns 1 if
+// dest_ip is a broadcast address (limited or of a connected subnet).
+static int ipv4_next_hop(const ipv4_address_t* dest_ip, ipv4_address_t* next_hop) {
+    if (dest_ip->bytes[0] == 255 && dest_ip->bytes[1] == 255 &&
+        dest_ip->bytes[2] == 255 && dest_ip->bytes[3] == 255) {
+        return 1;
     }
     
-    mac_address_t dest_mac;
-    
-    // Check if destination is broadcast (255.255.255.255)
-    int is_broadcast = (dest_ip->bytes[0] == 255 && dest_ip->bytes[1] == 255 &&
-                        dest_ip->bytes[2] == 255 && dest_ip->bytes[3] == 255);
-    
-    if (is_broadcast) {
-        // Use broadcast MAC for broadcast packets
-        memset(dest_mac.bytes, 0xFF, 6);
-    } else {
-        // Look up MAC address for unicast
-        int arp_ok = arp_lookup(dest_ip, &dest_mac);
-        
-        // If ARP lookup fails, use broadcast MAC (will be received by QEMU)
-        if (arp_ok != 0) {
-            memset(dest_mac.bytes, 0xFF, 6);
+    const route_entry_t* route = route_lookup(dest_ip);
+    if (route && (route->flags & ROUTE_FLAG_GATEWAY)) {
+        *next_hop = route->gateway;
+        return 0;
+    }
+    if (route && route->prefix_len < 31) {
+        // All host bits set: the subnet's broadcast address
+        int is_broadcast = 1;
+        for (int i = 0; i < 4; i++) {
+            int bits = route->prefix_len - i * 8;
+            uint8_t host_mask = bits >= 8 ? 0 : bits <= 0 ? 0xFF : (uint8_t)(0xFF >> bits);
+            if ((dest_ip->bytes[i] & host_mask) != host_mask) {
+                is_broadcast = 0;
+                break;
+            }
+        }
+        if (is_broadcast) {
+            return 1;
         }
     }
-    
-    uint8_t frame[ETH_FRAME_MAX_SIZE];
-    eth_header_t* eth = (eth_header_t*)frame;
-    ipv4_header_t* ip = (ipv4_header_t*)(frame + sizeof(eth_header_t));
-    void* ip_payload = frame + sizeof(eth_header_t) + sizeof(ipv4_header_t);
+    *next_hop = *dest_ip;
+    return 0;
+}
+
+// Resolve the destination MAC of an outgoing IPv4 packet. Returns -1 while
+// ARP resolves the next hop; the packet then waits on its neighbour entry.
+static int ipv4_resolve_mac(const ipv4_address_t* dest_ip, mac_address_t* dest_mac) {
+    ipv4_address_t next_hop;
+    if (ipv4_next_hop(dest_ip, &next_hop)) {
+        // Use broadcast MAC for broadcast packets
+        memset(dest_mac->bytes, 0xFF, 6);
+        return 0;
+    }
+    return arp_lookup(&next_hop, dest_mac);
+}
+
+// Fill in the Ethernet and IPv4 headers (ETH + IP = 34 bytes) for a
+// packet carrying data_length bytes of IPv4 payload
+#define IPV4_FRAME_HEADER_SIZE (sizeof(eth_header_t) + sizeof(ipv4_header_t))
+
+static void ipv4_fill_headers(uint8_t* header, const ipv4_address_t* dest_ip,
+                              const mac_address_t* dest_mac, uint8_t protocol,
+                              size_t data_length, int offload) {
+    eth_header_t* eth = (eth_header_t*)header;
+    ipv4_header_t* ip = (ipv4_header_t*)(header + sizeof(eth_header_t));
     
     // Ethernet header
-    memcpy(eth->dest_mac, dest_mac.bytes, 6);
+    memcpy(eth->dest_mac, dest_mac->bytes, 6);
     memcpy(eth->src_mac, our_mac.bytes, 6);
     eth->ethertype = htons(ETH_ETHERTYPE_IPV4);
     
@@ -461,14 +788,104 @@ int ipv4_send_packet(const ipv4_address_t* dest_ip, uint8_t protocol,
     memcpy(ip->src_ip, our_ip.bytes, 4);
     memcpy(ip->dest_ip, dest_ip->bytes, 4);
     
-    // Calculate checksum
-    ip->checksum = ipv4_checksum(ip);
+    // Calculate checksum, unless the NIC inserts it
+    if (!offload) {
+        ip->checksum = ipv4_checksum(ip);
+        tx_csum_sw_count++;
+    }
+}
+
+// Build the Ethernet and IPv4 headers in a small buffer and send them in
+// front of the payload segments, which the NIC gathers without flattening
+static int ipv4_send_sg(const ipv4_address_t* dest_ip, const mac_address_t* dest_mac,
+                        uint8_t protocol, const netdev_sg_t* payload, int nsegs, uint8_t csum) {
+    if (nsegs + 1 > NETDEV_SG_MAX) {
+        return -1;
+    }
     
-    // Copy payload
-    memcpy(ip_payload, data, data_length);
+    size_t data_length = 0;
+    for (int i = 0; i < nsegs; i++) {
+        data_length += payload[i].length;
+    }
+    if (sizeof(ipv4_header_t) + data_length > network_get_mtu()) {
+        return -1;
+    }
     
-    size_t frame_length = sizeof(eth_header_t) + sizeof(ipv4_header_t) + data_length;
-    return network_send_frame(frame, frame_length);
+    int offload = netdev->csum_offload();
+    if (offload) {
+        csum |= PBUF_CSUM_TX_IP;
+    }
+    uint8_t header[IPV4_FRAME_HEADER_SIZE];
+    ipv4_fill_headers(header, dest_ip, dest_mac, protocol, data_length, offload);
+    
+    netdev_sg_t segs[NETDEV_SG_MAX];
+    segs[0].data = header;
+    segs[0].length = sizeof(header);
+    segs[0].by_ref = 0;
+    for (int i = 0; i < nsegs; i++) {
+        segs[i + 1] = payload[i];
+    }
+    return netdev->send_sg(segs, nsegs + 1, csum);
+}
+
+// Prepend the Ethernet and IPv4 headers in the pbuf's headroom and hand
+// it to the NIC, or to the ARP queue if dest_mac is NULL (unresolved).
+// Consumes the pbuf.
+static int ipv4_send_pbuf(const ipv4_address_t* dest_ip, const mac_address_t* dest_mac,
+                          uint8_t protocol, pbuf_t* p) {
+    size_t data_length = p->length;
+    uint8_t* header = pbuf_push(p, IPV4_FRAME_HEADER_SIZE);
+    if (!header || p->length > ETH_HEADER_SIZE + network_get_mtu()) {
+        pbuf_free(p);
+        return -1;
+    }
+    int offload = netdev->csum_offload();
+    if (offload) {
+        p->csum |= PBUF_CSUM_TX_IP;
+    }
+    if (!dest_mac) {
+        static const mac_address_t unresolved = {{0, 0, 0, 0, 0, 0}};
+        ipv4_address_t next_hop;
+        ipv4_fill_headers(header, dest_ip, &unresolved, protocol, data_length, offload);
+        ipv4_next_hop(dest_ip, &next_hop);
+        return arp_queue_frame(&next_hop, p);
+    }
+    ipv4_fill_headers(header, dest_ip, dest_mac, protocol, data_length, offload);
+    return netdev->send_pbuf(p);
+}
+
+// Copy an IPv4 payload into a pbuf (a jumbo one above the standard MTU)
+// and send it. Falls back to a gather send if the pool is empty, which
+// needs a resolved dest_mac.
+static int ipv4_send_copy(const ipv4_address_t* dest_ip, const mac_address_t* dest_mac,
+                          uint8_t protocol, const void* data, size_t data_length) {
+    pbuf_t* p = pbuf_alloc_size(data_length);
+    if (!p) {
+        if (!dest_mac) {
+            return -1;
+        }
+        netdev_sg_t seg = { data, data_length, 0 };
+        return ipv4_send_sg(dest_ip, dest_mac, protocol, &seg, 1, 0);
+    }
+    uint8_t* payload = pbuf_put(p, data_length);
+    if (!payload) {
+        pbuf_free(p);
+        return -1;
+    }
+    memcpy(payload, data, data_length);
+    return ipv4_send_pbuf(dest_ip, dest_mac, protocol, p);
+}
+
+// IPv4: Send packet
+int ipv4_send_packet(const ipv4_address_t* dest_ip, uint8_t protocol,
+                     const void* data, size_t data_length) {
+    if (!network_initialized) {
+        return -1;
+    }
+    
+    mac_address_t dest_mac;
+    int resolved = ipv4_resolve_mac(dest_ip, &dest_mac) == 0;
+    return ipv4_send_copy(dest_ip, resolved ? &dest_mac : NULL, protocol, data, data_length);
 }
 
 // IPv4: Process received packet
@@ -509,85 +926,246 @@ int ipv4_send_packet_to_mac(const ipv4_address_t* dest_ip, const mac_address_t*
         return -1;
     }
     
-    uint8_t frame[ETH_FRAME_MAX_SIZE];
-    eth_header_t* eth = (eth_header_t*)frame;
-    ipv4_header_t* ip = (ipv4_header_t*)(frame + sizeof(eth_header_t));
-    void* ip_payload = frame + sizeof(eth_header_t) + sizeof(ipv4_header_t);
+    return ipv4_send_copy(dest_ip, dest_mac, protocol, data, data_length);
+}
+
+// Fill the UDP checksum. With offload only the pseudo header sum goes in
+// and the NIC finishes it; otherwise it is computed here. Returns the
+// PBUF_CSUM_TX_* flag to pass down.
+static uint8_t udp_fill_checksum(udp_header_t* udp, const ipv4_address_t* dest_ip,
+                                 const void* data, size_t data_length) {
+    uint16_t udp_length = (uint16_t)(sizeof(udp_header_t) + data_length);
+    uint32_t sum = csum_pseudo_ipv4(our_ip.bytes, dest_ip->bytes, IP_PROTO_UDP, udp_length);
+    udp->checksum = 0;
+    if (netdev->csum_offload()) {
+        udp->checksum = csum_fold(sum);
+        return PBUF_CSUM_TX_UDP;
+    }
+    sum = csum_partial(udp, sizeof(udp_header_t), sum);
+    sum = csum_partial(data, data_length, sum);
+    uint16_t checksum = (uint16_t)~csum_fold(sum);
+    udp->checksum = checksum ? checksum : 0xFFFF;  // 0 means "no checksum"
+    tx_csum_sw_count++;
+    return 0;
+}
+
+// Send a UDP datagram. Copies go into a pbuf and each layer prepends its
+// header in the headroom; by_ref payloads are gathered from the caller's
+// memory instead.
+static int udp_send_sg(const ipv4_address_t* dest_ip, const mac_address_t* dest_mac,
+                       uint16_t dest_port, uint16_t src_port,
+                       const void* data, size_t data_length, int by_ref) {
+    if (!network_initialized) {
+        return -1;
+    }
     
-    // Ethernet header
-    memcpy(eth->dest_mac, dest_mac->bytes, 6);
-    memcpy(eth->src_mac, our_mac.bytes, 6);
-    eth->ethertype = htons(ETH_ETHERTYPE_IPV4);
+    // An unresolved datagram waits on its ARP entry, so it must be copied
+    mac_address_t resolved;
+    if (!dest_mac) {
+        if (ipv4_resolve_mac(dest_ip, &resolved) == 0) {
+            dest_mac = &resolved;
+        } else {
+            by_ref = 0;
+        }
+    }
     
-    // IPv4 header
-    ip->version_ihl = (4 << 4) | 5;  // Version 4, IHL 5 (20 bytes)
-    ip->tos = 0;
-    ip->total_length = htons(sizeof(ipv4_header_t) + data_length);
-    ip->id = htons(ipv4_id_counter++);
-    ip->flags_frag = 0;  // No fragmentation
-    ip->ttl = 64;
-    ip->protocol = protocol;
-    ip->checksum = 0;
-    memcpy(ip->src_ip, our_ip.bytes, 4);
-    memcpy(ip->dest_ip, dest_ip->bytes, 4);
+    if (sizeof(ipv4_header_t) + sizeof(udp_header_t) + data_length > network_get_mtu()) {
+        return -1;  // No fragmentation
+    }
     
-    // Calculate checksum
-    ip->checksum = ipv4_checksum(ip);
+    pbuf_t* p = by_ref ? NULL : pbuf_alloc_size(sizeof(udp_header_t) + data_length);
+    if (p) {
+        uint8_t* payload = pbuf_put(p, data_length);
+        udp_header_t* udp = (udp_header_t*)pbuf_push(p, sizeof(udp_header_t));
+        if (!payload || !udp) {
+            pbuf_free(p);
+            return -1;
+        }
+        memcpy(payload, data, data_length);
+        udp->src_port = htons(src_port);
+        udp->dest_port = htons(dest_port);
+        udp->length = htons(sizeof(udp_header_t) + data_length);
+        p->csum = udp_fill_checksum(udp, dest_ip, payload, data_length);
+        return ipv4_send_pbuf(dest_ip, dest_mac, IP_PROTO_UDP, p);
+    }
     
-    // Copy payload
-    memcpy(ip_payload, data, data_length);
+    if (!dest_mac) {
+        return -1;  // Pool empty and nowhere to send yet
+    }
     
-    size_t frame_length = sizeof(eth_header_t) + sizeof(ipv4_header_t) + data_length;
-    return network_send_frame(frame, frame_length);
+    udp_header_t udp;
+    udp.src_port = htons(src_port);
+    udp.dest_port = htons(dest_port);
+    udp.length = htons(sizeof(udp_header_t) + data_length);
+    uint8_t csum = udp_fill_checksum(&udp, dest_ip, data, data_length);
+    
+    netdev_sg_t segs[2];
+    segs[0].data = &udp;
+    segs[0].length = sizeof(udp_header_t);
+    segs[0].by_ref = 0;
+    segs[1].data = data;
+    segs[1].length = data_length;
+    segs[1].by_ref = by_ref;
+    return ipv4_send_sg(dest_ip, dest_mac, IP_PROTO_UDP, segs, 2, csum);
 }
 
-// UDP: Send packet
-int udp_send_packet(const ipv4_address_t* dest_ip, uint16_t dest_port,
-                    uint16_t src_port, const void* data, size_t data_length) {
+// Build a connected socket's header template. Fails while the next hop
+// is unresolved; the ARP request has been sent by then.
+static int udp_socket_build(udp_socket_t* sock) {
+    sock->valid = 0;
+    sock->neigh_gen = neigh_generation;
+    sock->route_gen = route_generation();
+    
+    mac_address_t dest_mac;
+    if (ipv4_resolve_mac(&sock->dest_ip, &dest_mac) != 0) {
+        return -1;
+    }
+    sock->offload = netdev->csum_offload() ? 1 : 0;
+    ipv4_fill_headers(sock->header, &sock->dest_ip, &dest_mac, IP_PROTO_UDP,
+                      sizeof(udp_header_t), sock->offload);
+    
+    udp_header_t* udp = (udp_header_t*)(sock->header + IPV4_FRAME_HEADER_SIZE);
+    udp->src_port = htons(sock->src_port);
+    udp->dest_port = htons(sock->dest_port);
+    udp->length = htons(sizeof(udp_header_t));
+    udp->checksum = 0;
+    sock->pseudo_sum = csum_pseudo_ipv4(our_ip.bytes, sock->dest_ip.bytes, IP_PROTO_UDP, 0);
+    sock->ports_sum = csum_partial(udp, 2 * sizeof(uint16_t), 0);
+    sock->valid = 1;
+    return 0;
+}
+
+int udp_socket_connect(udp_socket_t* sock, const ipv4_address_t* dest_ip,
+                       uint16_t dest_port, uint16_t src_port) {
+    if (!network_initialized) {
+        return -1;
+    }
+    memset(sock, 0, sizeof(*sock));
+    sock->dest_ip = *dest_ip;
+    sock->dest_port = dest_port;
+    sock->src_port = src_port;
+    udp_socket_build(sock);
+    return 0;
+}
+
+// Send through a socket's template: copy the 42 header bytes, then patch
+// the two length fields, the IP ID and the checksums incrementally
+static int udp_socket_send_common(udp_socket_t* sock, const void* data,
+                                  size_t data_length, int by_ref) {
     if (!network_initialized) {
         return -1;
     }
+    if (!sock->valid || sock->neigh_gen != neigh_generation ||
+        sock->route_gen != route_generation() ||
+        sock->offload != (netdev->csum_offload() ? 1 : 0)) {
+        if (udp_socket_build(sock) != 0) {
+            // Not resolved yet: the slow path parks a copy on the ARP entry
+            return udp_send_sg(&sock->dest_ip, NULL, sock->dest_port, sock->src_port,
+                               data, data_length, by_ref);
+        }
+    }
+    if (sizeof(ipv4_header_t) + sizeof(udp_header_t) + data_length > network_get_mtu()) {
+        return -1;  // No fragmentation
+    }
     
-    uint8_t udp_packet[ETH_FRAME_MAX_SIZE];
-    udp_header_t* udp = (udp_header_t*)udp_packet;
-    void* udp_payload = udp_packet + sizeof(udp_header_t);
+    uint8_t stack_header[UDP_FRAME_HEADER_SIZE];
+    uint8_t* header = stack_header;
+    pbuf_t* p = by_ref ? NULL : pbuf_alloc_size(sizeof(udp_header_t) + data_length);
+    if (p) {
+        uint8_t* payload = pbuf_put(p, data_length);
+        header = pbuf_push(p, UDP_FRAME_HEADER_SIZE);
+        if (!payload || !header) {
+            pbuf_free(p);
+            return -1;
+        }
+        memcpy(payload, data, data_length);
+    }
+    memcpy(header, sock->header, UDP_FRAME_HEADER_SIZE);
     
-    // UDP header
-    udp->src_port = htons(src_port);
-    udp->dest_port = htons(dest_port);
+    ipv4_header_t* ip = (ipv4_header_t*)(header + sizeof(eth_header_t));
+    udp_header_t* udp = (udp_header_t*)(header + IPV4_FRAME_HEADER_SIZE);
+    uint16_t total_length = htons(sizeof(ipv4_header_t) + sizeof(udp_header_t) + data_length);
+    uint16_t id = htons(ipv4_id_counter++);
     udp->length = htons(sizeof(udp_header_t) + data_length);
-    udp->checksum = 0;  // Optional for IPv4, set to 0 for now
     
-    // Copy payload
-    memcpy(udp_payload, data, data_length);
+    uint8_t csum;
+    if (sock->offload) {
+        ip->total_length = total_length;
+        ip->id = id;
+        udp->checksum = csum_fold(sock->pseudo_sum + udp->length);
+        csum = PBUF_CSUM_TX_IP | PBUF_CSUM_TX_UDP;
+    } else {
+        ip->checksum = csum_replace16(ip->checksum, ip->total_length, total_length);
+        ip->checksum = csum_replace16(ip->checksum, ip->id, id);
+        ip->total_length = total_length;
+        ip->id = id;
+        // The UDP length is summed twice: pseudo header and UDP header
+        uint32_t sum = sock->pseudo_sum + sock->ports_sum + 2 * (uint32_t)udp->length;
+        uint16_t checksum = (uint16_t)~csum_fold(csum_partial(data, data_length, sum));
+        udp->checksum = checksum ? checksum : 0xFFFF;  // 0 means "no checksum"
+        tx_csum_sw_count++;
+        csum = 0;
+    }
     
-    size_t udp_packet_length = sizeof(udp_header_t) + data_length;
-    return ipv4_send_packet(dest_ip, IP_PROTO_UDP, udp_packet, udp_packet_length);
+    if (p) {
+        p->csum = csum;
+        return netdev->send_pbuf(p);
+    }
+    netdev_sg_t segs[2];
+    segs[0].data = header;
+    segs[0].length = UDP_FRAME_HEADER_SIZE;
+    segs[0].by_ref = 0;
+    segs[1].data = data;
+    segs[1].length = data_length;
+    segs[1].by_ref = by_ref;
+    return netdev->send_sg(segs, 2, csum);
+}
+
+int udp_socket_send(udp_socket_t* sock, const void* data, size_t data_length) {
+    return udp_socket_send_common(sock, data, data_length, 0);
+}
+
+int udp_socket_send_ref(udp_socket_t* sock, const void* data, size_t data_length) {
+    return udp_socket_send_common(sock, data, data_length, 1);
+}
+
+// UDP: Send packet
+int udp_send_packet(const ipv4_address_t* dest_ip, uint16_t dest_port,
+                    uint16_t src_port, const void* data, size_t data_length) {
+    return udp_send_sg(dest_ip, NULL, dest_port, src_port, data, data_length, 0);
+}
+
+// UDP: Send packet without copying the payload
+int udp_send_packet_ref(const ipv4_address_t* dest_ip, uint16_t dest_port,
+                        uint16_t src_port, const void* data, size_t data_length) {
+    return udp_send_sg(dest_ip, NULL, dest_port, src_port, data, data_length, 1);
 }
 
 // UDP: Send packet to specific MAC address
 int udp_send_packet_to_mac(const ipv4_address_t* dest_ip, const mac_address_t* dest_mac,
                            uint16_t dest_port, uint16_t src_port, 
                            const void* data, size_t data_length) {
+    return udp_send_sg(dest_ip, dest_mac, dest_port, src_port, data, data_length, 0);
+}
+
+// Wait until payloads passed by reference have left the NIC
+int network_tx_flush(void) {
     if (!network_initialized) {
         return -1;
     }
-    
-    uint8_t udp_packet[ETH_FRAME_MAX_SIZE];
-    udp_header_t* udp = (udp_header_t*)udp_packet;
-    void* udp_payload = udp_packet + sizeof(udp_header_t);
-    
-    // UDP header
-    udp->src_port = htons(src_port);
-    udp->dest_port = htons(dest_port);
-    udp->length = htons(sizeof(udp_header_t) + data_length);
-    udp->checksum = 0;  // Optional for IPv4, set to 0 for now
-    
-    // Copy payload
-    memcpy(udp_payload, data, data_length);
-    
-    size_t udp_packet_length = sizeof(udp_header_t) + data_length;
-    return ipv4_send_packet_to_mac(dest_ip, dest_mac, IP_PROTO_UDP, udp_packet, udp_packet_length);
+    return netdev->tx_flush();
+}
+
+void network_tx_batch_begin(void) {
+    if (network_initialized) {
+        netdev->tx_hold(1);
+    }
+}
+
+void network_tx_batch_end(void) {
+    if (network_initialized) {
+        netdev->tx_hold(0);
+    }
 }
 
 // UDP: Process received packet
@@ -689,6 +1267,9 @@ int network_get_process_calls(void) {
 #define DHCP_MSG_ACK      5
 #define DHCP_MSG_NAK      6
 
+#define DHCP_OPT_PAD              0
+#define DHCP_OPT_SUBNET_MASK      1
+#define DHCP_OPT_ROUTER           3
 #define DHCP_OPT_MSG_TYPE         53
 #define DHCP_OPT_SERVER_ID        54
 #define DHCP_OPT_REQ_IP           50
@@ -799,6 +1380,50 @@ static uint8_t dhcp_get_option(const uint8_t* opts, uint8_t code) {
     return 0;
 }
 
+// Find an option of at least min_len bytes in a reply's options field
+static const uint8_t* dhcp_find_option(const uint8_t* opts, size_t length,
+                                       uint8_t code, uint8_t min_len) {
+    size_t i = 0;
+    while (i < length && opts[i] != DHCP_OPT_END) {
+        if (opts[i] == DHCP_OPT_PAD) {
+            i++;
+            continue;
+        }
+        if (i + 2 > length || i + 2 + opts[i + 1] > length) {
+            break;  // Truncated
+        }
+        if (opts[i] == code && opts[i + 1] >= min_len) {
+            return &opts[i + 2];
+        }
+        i += 2 + opts[i + 1];
+    }
+    return NULL;
+}
+
+// Install the connected and default routes of a new lease, replacing the
+// previous lease's routes
+static void dhcp_set_routes(const uint8_t* opts, size_t length) {
+    route_flush(ROUTE_FLAG_DHCP);
+    
+    ipv4_address_t none = {{0, 0, 0, 0}};
+    const uint8_t* mask_opt = dhcp_find_option(opts, length, DHCP_OPT_SUBNET_MASK, 4);
+    if (mask_opt) {
+        ipv4_address_t mask;
+        memcpy(mask.bytes, mask_opt, 4);
+        int prefix_len = route_mask_to_prefix(&mask);
+        if (prefix_len > 0) {
+            route_add(&our_ip, (uint8_t)prefix_len, &none, ROUTE_FLAG_DHCP);
+        }
+    }
+    // The first router listed is the preferred one
+    const uint8_t* router_opt = dhcp_find_option(opts, length, DHCP_OPT_ROUTER, 4);
+    if (router_opt) {
+        ipv4_address_t router;
+        memcpy(router.bytes, router_opt, 4);
+        route_add(&none, 0, &router, ROUTE_FLAG_DHCP);
+    }
+}
+
 static void dhcp_udp_callback(const ipv4_address_t* src_ip, uint16_t src_port, 
                               const mac_address_t* src_mac, const void* payload, size_t payload_length) {
     (void)src_ip;
@@ -850,6 +1475,9 @@ static void dhcp_udp_callback(const ipv4_address_t* src_ip, uint16_t src_port,
         our_ip.bytes[1] = (uint8_t)((yi_host >> 16) & 0xFF);
         our_ip.bytes[2] = (uint8_t)((yi_host >> 8) & 0xFF);
         our_ip.bytes[3] = (uint8_t)(yi_host & 0xFF);
+        size_t opts_length = payload_length - (sizeof(dhcp_packet_t) - sizeof(pkt->options));
+        dhcp_set_routes(pkt->options, opts_length);
+        neigh_generation++;
         dhcp_state = 2; // acked
     } else if (mtype == DHCP_MSG_NAK) {
         dhcp_state = -1;
@@ -901,3 +1529,9 @@ int network_dhcp_acquire(void) {
     }
     return (dhcp_state == 2) ? 0 : -1;
 }
+
+void network_get_csum_stats(uint32_t* tx_sw, uint32_t* rx_sw, uint32_t* rx_dropped) {
+    if (tx_sw) *tx_sw = tx_csum_sw_count;
+    if (rx_sw) *rx_sw = rx_csum_sw_count;
+    if (rx_dropped) *rx_dropped = rx_csum_drop_count;
+}
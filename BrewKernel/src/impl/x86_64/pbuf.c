@@ -0,0 +1,218 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pbuf.h"
+#include "memory.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Free list head: a pbuf pointer in the low 48 bits and a generation tag
+// in the top 16, so a pop that raced with a pop/push pair fails its
+// compare-and-swap instead of installing a stale next pointer.
+#define PBUF_PTR_MASK  0x0000FFFFFFFFFFFFULL
+#define PBUF_TAG_ONE   0x0001000000000000ULL
+
+// One pool per buffer size
+typedef struct {
+    volatile uint64_t free_head;
+    volatile uint32_t total;
+    volatile uint32_t free_count;
+    volatile uint32_t high_water;
+    volatile uint32_t exhausted;
+    uint16_t buf_size;
+} pbuf_pool_t;
+
+static pbuf_pool_t pbuf_std_pool = { 0, 0, 0, 0, 0, PBUF_SIZE };
+static pbuf_pool_t pbuf_jumbo_pool = { 0, 0, 0, 0, 0, PBUF_JUMBO_SIZE };
+
+static inline pbuf_pool_t* pbuf_pool_of(const pbuf_t* p) {
+    return p->size == PBUF_JUMBO_SIZE ? &pbuf_jumbo_pool : &pbuf_std_pool;
+}
+
+static void pbuf_push_free(pbuf_pool_t* pool, pbuf_t* p) {
+    uint64_t old = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+    uint64_t new;
+    do {
+        p->next_free = (pbuf_t*)(uintptr_t)(old & PBUF_PTR_MASK);
+        new = ((old & ~PBUF_PTR_MASK) + PBUF_TAG_ONE) | ((uint64_t)(uintptr_t)p & PBUF_PTR_MASK);
+    } while (!__atomic_compare_exchange_n(&pool->free_head, &old, new, 0,
+                                          __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    __atomic_add_fetch(&pool->free_count, 1, __ATOMIC_RELAXED);
+}
+
+static pbuf_t* pbuf_pop_free(pbuf_pool_t* pool) {
+    uint64_t old = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+    uint64_t new;
+    pbuf_t* p;
+    do {
+        p = (pbuf_t*)(uintptr_t)(old & PBUF_PTR_MASK);
+        if (!p) {
+            return NULL;
+        }
+        new = ((old & ~PBUF_PTR_MASK) + PBUF_TAG_ONE) | ((uint64_t)(uintptr_t)p->next_free & PBUF_PTR_MASK);
+    } while (!__atomic_compare_exchange_n(&pool->free_head, &old, new, 0,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+    uint32_t free_now = __atomic_sub_fetch(&pool->free_count, 1, __ATOMIC_RELAXED);
+    uint32_t in_use = pool->total - free_now;
+    if (in_use > pool->high_water) {
+        pool->high_water = in_use;
+    }
+    return p;
+}
+
+// Pools only grow; the buffers live as long as the kernel
+static int pbuf_pool_grow(pbuf_pool_t* pool, uint32_t count) {
+    while (pool->total < count) {
+        uint32_t n = count - pool->total;
+        if (n > PBUF_GROW_MAX) n = PBUF_GROW_MAX;
+
+        pbuf_t* meta = (pbuf_t*)fs_allocate(n * sizeof(pbuf_t));
+        uint8_t* bufs = (uint8_t*)fs_allocate_aligned((size_t)n * pool->buf_size, 4096);
+        if (!meta || !bufs) {
+            if (meta) fs_free(meta);
+            if (bufs) fs_free_aligned(bufs);
+            return -1;
+        }
+
+        __atomic_add_fetch(&pool->total, n, __ATOMIC_RELAXED);
+        for (uint32_t i = 0; i < n; i++) {
+            meta[i].buf = bufs + (size_t)i * pool->buf_size;
+            meta[i].data = meta[i].buf;
+            meta[i].length = 0;
+            meta[i].size = pool->buf_size;
+            meta[i].refcount = 0;
+            pbuf_push_free(pool, &meta[i]);
+        }
+    }
+    return 0;
+}
+
+int pbuf_pool_reserve(uint32_t count) {
+    return pbuf_pool_grow(&pbuf_std_pool, count);
+}
+
+int pbuf_jumbo_reserve(uint32_t count) {
+    return pbuf_pool_grow(&pbuf_jumbo_pool, count);
+}
+
+static pbuf_t* pbuf_take(pbuf_pool_t* pool) {
+    pbuf_t* p = pbuf_pop_free(pool);
+    if (!p) {
+        __atomic_add_fetch(&pool->exhausted, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    p->data = p->buf;
+    p->length = 0;
+    p->csum = 0;
+    p->refcount = 1;
+    p->next_free = NULL;
+    return p;
+}
+
+pbuf_t* pbuf_alloc_rx(void) {
+    return pbuf_take(&pbuf_std_pool);
+}
+
+pbuf_t* pbuf_alloc(void) {
+    pbuf_t* p = pbuf_alloc_rx();
+    if (p) {
+        p->data = p->buf + PBUF_HEADROOM;
+    }
+    return p;
+}
+
+pbuf_t* pbuf_alloc_rx_size(size_t length) {
+    if (length <= PBUF_SIZE) {
+        return pbuf_take(&pbuf_std_pool);
+    }
+    if (length <= PBUF_JUMBO_SIZE) {
+        return pbuf_take(&pbuf_jumbo_pool);
+    }
+    return NULL;
+}
+
+pbuf_t* pbuf_alloc_size(size_t length) {
+    pbuf_t* p = pbuf_alloc_rx_size(length + PBUF_HEADROOM);
+    if (p) {
+        p->data = p->buf + PBUF_HEADROOM;
+    }
+    return p;
+}
+
+void pbuf_ref(pbuf_t* p) {
+    if (p) {
+        __atomic_add_fetch(&p->refcount, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void pbuf_free(pbuf_t* p) {
+    if (!p || p->refcount == 0) {
+        return;
+    }
+    if (__atomic_sub_fetch(&p->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        pbuf_push_free(pbuf_pool_of(p), p);
+    }
+}
+
+uint8_t* pbuf_push(pbuf_t* p, size_t n) {
+    if ((size_t)(p->data - p->buf) < n) {
+        return NULL;
+    }
+    p->data -= n;
+    p->length += (uint16_t)n;
+    return p->data;
+}
+
+uint8_t* pbuf_pull(pbuf_t* p, size_t n) {
+    if (p->length < n) {
+        return NULL;
+    }
+    p->data += n;
+    p->length -= (uint16_t)n;
+    return p->data;
+}
+
+uint8_t* pbuf_put(pbuf_t* p, size_t n) {
+    if (pbuf_tailroom(p) < n) {
+        return NULL;
+    }
+    uint8_t* tail = p->data + p->length;
+    p->length += (uint16_t)n;
+    return tail;
+}
+
+size_t pbuf_headroom(const pbuf_t* p) {
+    return (size_t)(p->data - p->buf);
+}
+
+size_t pbuf_tailroom(const pbuf_t* p) {
+    return p->size - pbuf_headroom(p) - p->length;
+}
+
+void pbuf_get_stats(pbuf_stats_t* stats) {
+    if (!stats) return;
+    stats->total = pbuf_std_pool.total;
+    stats->free = pbuf_std_pool.free_count;
+    stats->in_use = pbuf_std_pool.total - pbuf_std_pool.free_count;
+    stats->high_water = pbuf_std_pool.high_water;
+    stats->exhausted = pbuf_std_pool.exhausted;
+    stats->jumbo_total = pbuf_jumbo_pool.total;
+    stats->jumbo_free = pbuf_jumbo_pool.free_count;
+    stats->jumbo_exhausted = pbuf_jumbo_pool.exhausted;
+}
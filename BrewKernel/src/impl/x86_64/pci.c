@@ -18,6 +18,7 @@
 
 #include "pci.h"
 #include "io.h"
+#include "apic.h"
 #include <stdint.h>
 
 uint32_t pci_read_config(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
@@ -90,7 +91,7 @@ uint8_t pci_get_prog_if(uint8_t bus, uint8_t device, uint8_t function) {
 // Enumerate all PCI devices
 int pci_enumerate_devices(pci_device_t* devices, int max_devices) {
     int count = 0;
-    uint8_t bus;
+    uint16_t bus;  // Wider than the bus number so the loop below terminates
     uint8_t device;
     uint8_t function;
     uint8_t num_functions;
@@ -156,3 +157,136 @@ int pci_find_device_by_class(uint8_t class_code, uint8_t subclass, pci_device_t*
     return 0;
 }
 
+
+// Walk the capability list (status bit 4 says there is one)
+uint8_t pci_find_capability(const pci_device_t* dev, uint8_t cap_id) {
+    uint32_t status = pci_read_config(dev->bus, dev->device, dev->function, 0x04) >> 16;
+    if (!(status & (1 << 4))) {
+        return 0;
+    }
+    uint8_t ptr = (uint8_t)(pci_read_config(dev->bus, dev->device, dev->function, 0x34) & 0xFC);
+    for (int guard = 0; ptr && guard < 48; guard++) {
+        uint32_t header = pci_read_config(dev->bus, dev->device, dev->function, ptr);
+        if ((header & 0xFF) == cap_id) {
+            return ptr;
+        }
+        ptr = (uint8_t)((header >> 8) & 0xFC);
+    }
+    return 0;
+}
+
+uint32_t pci_bar_address(const pci_device_t* dev, int bar) {
+    if (bar < 0 || bar > 5) {
+        return 0;
+    }
+    uint8_t offset = (uint8_t)(0x10 + bar * 4);
+    uint32_t value = pci_read_config(dev->bus, dev->device, dev->function, offset);
+    if (value & 1) {
+        return 0;  // I/O space
+    }
+    if ((value & 0x6) == 0x4 && bar < 5 &&
+        pci_read_config(dev->bus, dev->device, dev->function, (uint8_t)(offset + 4)) != 0) {
+        return 0;  // 64-bit BAR above 4GB
+    }
+    return value & ~0xFu;
+}
+
+// The boot page tables map the first 1GB and the PCI window below 4GB
+int pci_mmio_mapped(uint32_t addr) {
+    return addr != 0 && (addr < 0x40000000u || (addr >= 0xFE800000u && addr < 0xFF000000u));
+}
+
+int pci_msix_init(const pci_device_t* dev, pci_msix_t* msix) {
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_ID_MSIX);
+    if (!cap) {
+        return -1;
+    }
+    uint32_t control = pci_read_config(dev->bus, dev->device, dev->function, cap) >> 16;
+    uint32_t table = pci_read_config(dev->bus, dev->device, dev->function, (uint8_t)(cap + 4));
+    uint32_t base = pci_bar_address(dev, (int)(table & 0x7));
+    uint32_t addr = base + (table & ~0x7u);
+    if (!base || !pci_mmio_mapped(addr)) {
+        return -1;
+    }
+    msix->cap = cap;
+    msix->table_size = (uint16_t)((control & 0x7FF) + 1);
+    msix->table = (volatile uint32_t*)(uintptr_t)addr;
+    for (uint16_t i = 0; i < msix->table_size; i++) {
+        pci_msix_mask(msix, i);
+    }
+    return 0;
+}
+
+int pci_msix_set_vector(pci_msix_t* msix, uint16_t entry, uint8_t vector) {
+    if (entry >= msix->table_size || !lapic_available()) {
+        return -1;
+    }
+    volatile uint32_t* e = msix->table + entry * (PCI_MSIX_ENTRY_SIZE / 4);
+    e[0] = MSI_ADDRESS_BASE | MSI_ADDRESS_DEST(lapic_id());
+    e[1] = 0;
+    e[2] = vector;      // Fixed delivery, edge triggered
+    e[3] = 0;           // Unmask
+    return 0;
+}
+
+void pci_msix_mask(pci_msix_t* msix, uint16_t entry) {
+    if (entry < msix->table_size) {
+        msix->table[entry * (PCI_MSIX_ENTRY_SIZE / 4) + 3] = 1;
+    }
+}
+
+void pci_msix_enable(const pci_device_t* dev, pci_msix_t* msix, int enable) {
+    uint32_t command = pci_read_config(dev->bus, dev->device, dev->function, 0x04);
+    if (enable) {
+        command |= PCI_COMMAND_INTX_DISABLE;
+    } else {
+        command &= ~PCI_COMMAND_INTX_DISABLE;
+    }
+    pci_write_config(dev->bus, dev->device, dev->function, 0x04, command & 0xFFFF);
+
+    uint32_t header = pci_read_config(dev->bus, dev->device, dev->function, msix->cap);
+    header &= ~((PCI_MSIX_CTRL_ENABLE | PCI_MSIX_CTRL_MASKALL) << 16);
+    if (enable) {
+        header |= PCI_MSIX_CTRL_ENABLE << 16;
+    }
+    pci_write_config(dev->bus, dev->device, dev->function, msix->cap, header);
+}
+
+int pci_msi_enable(const pci_device_t* dev, irq_handler_t handler) {
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_ID_MSI);
+    if (!cap || !lapic_available()) {
+        return -1;
+    }
+    int vector = irq_alloc_vector(handler);
+    if (vector < 0) {
+        return -1;
+    }
+    uint32_t header = pci_read_config(dev->bus, dev->device, dev->function, cap);
+    uint8_t data_offset = (uint8_t)(cap + 8);
+    pci_write_config(dev->bus, dev->device, dev->function, (uint8_t)(cap + 4),
+                     MSI_ADDRESS_BASE | MSI_ADDRESS_DEST(lapic_id()));
+    if ((header >> 16) & PCI_MSI_CTRL_64BIT) {
+        pci_write_config(dev->bus, dev->device, dev->function, (uint8_t)(cap + 8), 0);
+        data_offset = (uint8_t)(cap + 12);
+    }
+    // The message data is the low 16 bits: fixed delivery, edge triggered
+    uint32_t data = pci_read_config(dev->bus, dev->device, dev->function, data_offset);
+    pci_write_config(dev->bus, dev->device, dev->function, data_offset, (data & 0xFFFF0000u) | (uint8_t)vector);
+
+    uint32_t command = pci_read_config(dev->bus, dev->device, dev->function, 0x04);
+    pci_write_config(dev->bus, dev->device, dev->function, 0x04, (command | PCI_COMMAND_INTX_DISABLE) & 0xFFFF);
+    header &= ~((PCI_MSI_CTRL_MME | PCI_MSI_CTRL_ENABLE) << 16);
+    pci_write_config(dev->bus, dev->device, dev->function, cap, header | (PCI_MSI_CTRL_ENABLE << 16));
+    return vector;
+}
+
+void pci_msi_disable(const pci_device_t* dev, int vector) {
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_ID_MSI);
+    if (cap) {
+        uint32_t header = pci_read_config(dev->bus, dev->device, dev->function, cap);
+        pci_write_config(dev->bus, dev->device, dev->function, cap, header & ~(PCI_MSI_CTRL_ENABLE << 16));
+        uint32_t command = pci_read_config(dev->bus, dev->device, dev->function, 0x04);
+        pci_write_config(dev->bus, dev->device, dev->function, 0x04, command & ~PCI_COMMAND_INTX_DISABLE & 0xFFFF);
+    }
+    irq_free_vector(vector);
+}
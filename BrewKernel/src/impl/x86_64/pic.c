@@ -63,6 +63,8 @@ void pic_irq_enable(unsigned char irq) {
     } else {
         port = PIC2_DATA;
         irq -= 8;
+        // Slave lines only reach the CPU through the cascade (IRQ2)
+        outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << 2));
     }
     
     value = inb(port) & ~(1 << irq);  // Clear the bit to enable
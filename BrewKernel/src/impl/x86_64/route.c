@@ -0,0 +1,241 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "route.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// One trie node per prefix bit. Child and route indices are stored plus
+// one so that the zeroed table is an empty trie; node 0 is the root.
+typedef struct {
+    uint16_t child[2];
+    uint8_t route;
+} route_node_t;
+
+static route_entry_t routes[ROUTE_MAX];
+static route_node_t route_trie[ROUTE_TRIE_NODES];
+static int route_trie_used = 1;
+static uint32_t route_gen = 0;
+
+static uint32_t route_key(const ipv4_address_t* ip) {
+    return ((uint32_t)ip->bytes[0] << 24) | ((uint32_t)ip->bytes[1] << 16) |
+           ((uint32_t)ip->bytes[2] << 8) | ip->bytes[3];
+}
+
+static uint32_t route_prefix_mask(uint8_t prefix_len) {
+    return prefix_len ? 0xFFFFFFFFU << (32 - prefix_len) : 0;
+}
+
+static void route_trie_insert(int index) {
+    uint32_t key = route_key(&routes[index].dest);
+    int node = 0;
+    for (int bit = 0; bit < routes[index].prefix_len; bit++) {
+        int dir = (key >> (31 - bit)) & 1;
+        if (!route_trie[node].child[dir]) {
+            route_trie[node].child[dir] = (uint16_t)(route_trie_used + 1);
+            route_trie_used++;
+        }
+        node = route_trie[node].child[dir] - 1;
+    }
+    route_trie[node].route = (uint8_t)(index + 1);
+}
+
+// Rebuild the trie from the table. Routes change rarely (DHCP, ROUTE
+// command), so removal needs no pruning logic.
+static void route_trie_rebuild(void) {
+    for (int i = 0; i < route_trie_used; i++) {
+        route_trie[i].child[0] = 0;
+        route_trie[i].child[1] = 0;
+        route_trie[i].route = 0;
+    }
+    route_trie_used = 1;
+    for (int i = 0; i < ROUTE_MAX; i++) {
+        if (routes[i].valid) {
+            route_trie_insert(i);
+        }
+    }
+    route_gen++;
+}
+
+static int route_find(uint32_t key, uint8_t prefix_len) {
+    for (int i = 0; i < ROUTE_MAX; i++) {
+        if (routes[i].valid && routes[i].prefix_len == prefix_len &&
+            route_key(&routes[i].dest) == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int route_add(const ipv4_address_t* dest, uint8_t prefix_len,
+              const ipv4_address_t* gateway, uint8_t flags) {
+    if (prefix_len > 32) {
+        return -1;
+    }
+    uint32_t key = route_key(dest) & route_prefix_mask(prefix_len);
+    int index = route_find(key, prefix_len);
+    for (int i = 0; index < 0 && i < ROUTE_MAX; i++) {
+        if (!routes[i].valid) {
+            index = i;
+        }
+    }
+    if (index < 0) {
+        return -1;  // Table full
+    }
+    
+    route_entry_t* route = &routes[index];
+    route->dest.bytes[0] = (uint8_t)(key >> 24);
+    route->dest.bytes[1] = (uint8_t)(key >> 16);
+    route->dest.bytes[2] = (uint8_t)(key >> 8);
+    route->dest.bytes[3] = (uint8_t)key;
+    route->prefix_len = prefix_len;
+    route->flags = flags & ~ROUTE_FLAG_GATEWAY;
+    route->gateway = *gateway;
+    if (route_key(gateway) != 0) {
+        route->flags |= ROUTE_FLAG_GATEWAY;
+    }
+    route->valid = 1;
+    route_trie_rebuild();
+    return 0;
+}
+
+int route_del(const ipv4_address_t* dest, uint8_t prefix_len) {
+    if (prefix_len > 32) {
+        return -1;
+    }
+    int index = route_find(route_key(dest) & route_prefix_mask(prefix_len), prefix_len);
+    if (index < 0) {
+        return -1;
+    }
+    routes[index].valid = 0;
+    route_trie_rebuild();
+    return 0;
+}
+
+void route_flush(uint8_t flags) {
+    for (int i = 0; i < ROUTE_MAX; i++) {
+        if (routes[i].valid && (flags == 0xFF || (routes[i].flags & flags))) {
+            routes[i].valid = 0;
+        }
+    }
+    route_trie_rebuild();
+}
+
+const route_entry_t* route_lookup(const ipv4_address_t* dest) {
+    uint32_t key = route_key(dest);
+    int node = 0;
+    int best = route_trie[0].route;  // Default route, if any
+    for (int bit = 0; bit < 32; bit++) {
+        int next = route_trie[node].child[(key >> (31 - bit)) & 1];
+        if (!next) {
+            break;
+        }
+        node = next - 1;
+        if (route_trie[node].route) {
+            best = route_trie[node].route;
+        }
+    }
+    return best ? &routes[best - 1] : NULL;
+}
+
+int route_get(int index, route_entry_t* route) {
+    if (index < 0 || index >= ROUTE_MAX || !routes[index].valid) {
+        return -1;
+    }
+    *route = routes[index];
+    return 0;
+}
+
+uint32_t route_generation(void) {
+    return route_gen;
+}
+
+int route_mask_to_prefix(const ipv4_address_t* mask) {
+    uint32_t value = route_key(mask);
+    int prefix_len = 0;
+    while (prefix_len < 32 && (value & (0x80000000U >> prefix_len))) {
+        prefix_len++;
+    }
+    if (value != route_prefix_mask((uint8_t)prefix_len)) {
+        return -1;
+    }
+    return prefix_len;
+}
+
+// Lookup cases for route_self_check(): destination and the prefix length
+// of the route it must match (-1: no route)
+static const struct {
+    uint8_t dest[4];
+    int8_t prefix_len;
+} route_checks[] = {
+    {{10, 0, 2, 15}, 24},
+    {{10, 0, 2, 255}, 24},
+    {{10, 0, 3, 1}, 16},
+    {{10, 200, 1, 1}, 8},
+    {{10, 0, 2, 2}, 32},
+    {{192, 168, 1, 7}, 0},
+    {{2, 160, 4, 7}, 0},
+    {{255, 10, 1, 1}, 0},
+    {{160, 0, 32, 1}, 0},
+};
+
+// Check longest-prefix matching against a fixed set of overlapping routes.
+// The live table is saved and restored around the test.
+int route_self_check(void) {
+    route_entry_t saved[ROUTE_MAX];
+    for (int i = 0; i < ROUTE_MAX; i++) {
+        saved[i] = routes[i];
+        routes[i].valid = 0;
+    }
+    
+    static const uint8_t prefixes[][5] = {
+        {10, 0, 0, 0, 8}, {10, 0, 0, 0, 16}, {10, 0, 2, 0, 24}, {10, 0, 2, 2, 32},
+    };
+    ipv4_address_t none = {{0, 0, 0, 0}};
+    int failed = 0;
+    
+    // Without a default route the 0.0.0.0/0 cases must miss
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+            ipv4_address_t net = {{prefixes[i][0], prefixes[i][1], prefixes[i][2], prefixes[i][3]}};
+            route_add(&net, prefixes[i][4], &none, 0);
+        }
+        if (pass == 1) {
+            ipv4_address_t gateway = {{10, 0, 2, 2}};
+            route_add(&none, 0, &gateway, 0);
+        }
+        for (size_t i = 0; i < sizeof(route_checks) / sizeof(route_checks[0]); i++) {
+            ipv4_address_t dest = {{route_checks[i].dest[0], route_checks[i].dest[1],
+                                    route_checks[i].dest[2], route_checks[i].dest[3]}};
+            const route_entry_t* route = route_lookup(&dest);
+            int expect = route_checks[i].prefix_len;
+            if (pass == 0 && expect == 0) {
+                expect = -1;
+            }
+            if ((route ? route->prefix_len : -1) != expect) {
+                failed = 1;
+            }
+        }
+    }
+    
+    for (int i = 0; i < ROUTE_MAX; i++) {
+        routes[i] = saved[i];
+    }
+    route_trie_rebuild();
+    return failed ? -1 : 0;
+}
@@ -19,12 +19,11 @@
 #include "timer.h"
 #include "pic.h"
 #include "io.h"
-#include "network.h"
 #include <stdint.h>
 
 // Global tick counter
 static volatile uint64_t timer_ticks = 0;
-static volatile uint32_t network_tick_counter = 0;
+static uint64_t tsc_khz = 0;
 
 // Initialize the PIT timer
 void timer_init(uint32_t frequency) {
@@ -43,15 +42,6 @@ void timer_init(uint32_t frequency) {
 // This is called from the IRQ dispatcher
 void timer_handler(void) {
     timer_ticks++;
-    
-    // Process network frames every 10 ticks (100ms at 100Hz)
-    network_tick_counter++;
-    if (network_tick_counter >= 10) {
-        network_tick_counter = 0;
-        if (network_is_initialized()) {
-            network_process_frames();
-        }
-    }
 }
 
 // Get current tick count
@@ -70,3 +60,31 @@ void timer_sleep_ms(uint32_t milliseconds) {
     }
 }
 
+
+// Measure the TSC rate over 10ms of PIT channel 2 (polled, no IRQ needed)
+uint64_t timer_get_tsc_khz(void) {
+    if (tsc_khz) {
+        return tsc_khz;
+    }
+
+    uint16_t count = PIT_FREQUENCY / 100;
+
+    // Gate channel 2 on, speaker off
+    outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+    // Channel 2, lo/hi, mode 0 (interrupt on terminal count)
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CHANNEL2, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL2, (uint8_t)(count >> 8));
+
+    uint64_t start = timer_read_tsc();
+    while (!(inb(0x61) & 0x20)) {
+        // Wait for OUT2 to go high
+    }
+    uint64_t end = timer_read_tsc();
+
+    tsc_khz = (end - start) / 10;
+    if (tsc_khz == 0) {
+        tsc_khz = 1;
+    }
+    return tsc_khz;
+}
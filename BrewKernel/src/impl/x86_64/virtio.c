@@ -0,0 +1,361 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Legacy virtio PCI transport and split virtqueue handling shared by the
+// virtio drivers.
+
+#include "virtio.h"
+#include "pci.h"
+#include "apic.h"
+#include "irq.h"
+#include "io.h"
+#include "memory.h"
+#include <stdint.h>
+#include <stddef.h>
+
+static void virtio_memset(void* dest, int val, size_t len) {
+    uint8_t* d = (uint8_t*)dest;
+    for (size_t i = 0; i < len; i++) {
+        d[i] = (uint8_t)val;
+    }
+}
+
+int virtio_pci_init(virtio_device_t* vdev, const pci_device_t* pci) {
+    if (!vdev || !pci) return -1;
+
+    vdev->pci = *pci;
+    vdev->features = 0;
+    vdev->config_base = VIRTIO_PCI_CONFIG;
+    vdev->vector = -1;
+
+    uint32_t bar0 = pci_read_config(pci->bus, pci->device, pci->function, 0x10);
+    if (!(bar0 & 1)) {
+        return -1;  // Legacy interface lives in I/O space
+    }
+    vdev->io_base = (uint16_t)(bar0 & ~0x3);
+    vdev->irq = (uint8_t)(pci_read_config(pci->bus, pci->device, pci->function, 0x3C) & 0xFF);
+
+    // Enable I/O decoding and bus mastering
+    uint32_t command = pci_read_config(pci->bus, pci->device, pci->function, 0x04);
+    command |= (1 << 0) | (1 << 2);
+    pci_write_config(pci->bus, pci->device, pci->function, 0x04, command);
+
+    // Reset, then tell the device we found it and know how to drive it
+    outb(vdev->io_base + VIRTIO_PCI_STATUS, 0);
+    virtio_add_status(vdev, VIRTIO_STATUS_ACKNOWLEDGE);
+    virtio_add_status(vdev, VIRTIO_STATUS_DRIVER);
+    return 0;
+}
+
+uint32_t virtio_negotiate_features(virtio_device_t* vdev, uint32_t supported) {
+    uint32_t host = inl(vdev->io_base + VIRTIO_PCI_HOST_FEATURES);
+    vdev->features = host & supported;
+    outl(vdev->io_base + VIRTIO_PCI_GUEST_FEATURES, vdev->features);
+    return vdev->features;
+}
+
+void virtio_add_status(virtio_device_t* vdev, uint8_t status) {
+    uint8_t current = inb(vdev->io_base + VIRTIO_PCI_STATUS);
+    outb(vdev->io_base + VIRTIO_PCI_STATUS, current | status);
+}
+
+// Route all queues to one MSI-X vector running handler. Returns -1 (and
+// leaves the device on INTx) without a local APIC, an MSI-X capability or
+// a free vector.
+int virtio_enable_msix(virtio_device_t* vdev, irq_handler_t handler) {
+    if (!lapic_available()) {
+        return -1;
+    }
+    // The table sits in a memory BAR next to the I/O registers; decoding
+    // must be on before pci_msix_init() masks its entries
+    const pci_device_t* pci = &vdev->pci;
+    uint32_t command = pci_read_config(pci->bus, pci->device, pci->function, 0x04);
+    pci_write_config(pci->bus, pci->device, pci->function, 0x04, (command | (1 << 1)) & 0xFFFF);
+    if (pci_msix_init(pci, &vdev->msix) != 0) {
+        return -1;
+    }
+    int vector = irq_alloc_vector(handler);
+    if (vector < 0) {
+        return -1;
+    }
+    pci_msix_set_vector(&vdev->msix, 0, (uint8_t)vector);
+    pci_msix_enable(pci, &vdev->msix, 1);
+
+    // Config changes are not used; queues are pointed at entry 0 in
+    // virtqueue_setup()
+    vdev->config_base = VIRTIO_PCI_CONFIG_MSIX;
+    outw(vdev->io_base + VIRTIO_MSI_CONFIG_VECTOR, VIRTIO_MSI_NO_VECTOR);
+    vdev->vector = vector;
+    return 0;
+}
+
+void virtio_disable_msix(virtio_device_t* vdev) {
+    if (vdev->vector < 0) {
+        return;
+    }
+    pci_msix_enable(&vdev->pci, &vdev->msix, 0);
+    irq_free_vector(vdev->vector);
+    vdev->vector = -1;
+    vdev->config_base = VIRTIO_PCI_CONFIG;
+}
+
+// Reading the ISR register also acknowledges the interrupt
+uint8_t virtio_read_isr(virtio_device_t* vdev) {
+    return inb(vdev->io_base + VIRTIO_PCI_ISR);
+}
+
+uint8_t virtio_config_read8(virtio_device_t* vdev, uint16_t offset) {
+    return inb(vdev->io_base + vdev->config_base + offset);
+}
+
+uint16_t virtio_config_read16(virtio_device_t* vdev, uint16_t offset) {
+    return inw(vdev->io_base + vdev->config_base + offset);
+}
+
+uint32_t virtio_config_read32(virtio_device_t* vdev, uint16_t offset) {
+    return inl(vdev->io_base + vdev->config_base + offset);
+}
+
+uint64_t virtio_config_read64(virtio_device_t* vdev, uint16_t offset) {
+    uint64_t lo = virtio_config_read32(vdev, offset);
+    uint64_t hi = virtio_config_read32(vdev, offset + 4);
+    return lo | (hi << 32);
+}
+
+// Size of a legacy ring: descriptors + avail ring, then used ring on the next page
+static size_t virtqueue_mem_size(uint16_t size) {
+    size_t part1 = sizeof(virtq_desc_t) * size + sizeof(uint16_t) * (3 + size);
+    part1 = (part1 + VIRTIO_PCI_VRING_ALIGN - 1) & ~(size_t)(VIRTIO_PCI_VRING_ALIGN - 1);
+    size_t part2 = sizeof(uint16_t) * 3 + sizeof(virtq_used_elem_t) * size;
+    return part1 + part2;
+}
+
+int virtqueue_setup(virtio_device_t* vdev, virtqueue_t* vq, uint16_t index) {
+    outw(vdev->io_base + VIRTIO_PCI_QUEUE_SEL, index);
+    uint16_t size = inw(vdev->io_base + VIRTIO_PCI_QUEUE_SIZE);
+    if (size == 0) {
+        return -1;  // Queue not available
+    }
+
+    size_t mem_size = virtqueue_mem_size(size);
+    uint8_t* mem = (uint8_t*)fs_allocate_aligned(mem_size, VIRTIO_PCI_VRING_ALIGN);
+    void** cookies = (void**)fs_allocate(sizeof(void*) * size);
+    if (!mem || !cookies) {
+        fs_free_aligned(mem);
+        fs_free(cookies);
+        return -1;
+    }
+    virtio_memset(mem, 0, mem_size);
+
+    vq->vdev = vdev;
+    vq->index = index;
+    vq->size = size;
+    vq->mem = mem;
+    vq->desc = (virtq_desc_t*)mem;
+    vq->avail = (virtq_avail_t*)(mem + sizeof(virtq_desc_t) * size);
+    size_t used_offset = sizeof(virtq_desc_t) * size + sizeof(uint16_t) * (3 + size);
+    used_offset = (used_offset + VIRTIO_PCI_VRING_ALIGN - 1) & ~(size_t)(VIRTIO_PCI_VRING_ALIGN - 1);
+    vq->used = (virtq_used_t*)(mem + used_offset);
+    vq->cookies = cookies;
+    vq->last_used_idx = 0;
+    vq->pending = 0;
+    vq->notifies = 0;
+    vq->suppressed = 0;
+
+    // Chain all descriptors into the free list
+    for (uint16_t i = 0; i < size; i++) {
+        vq->desc[i].next = (uint16_t)(i + 1);
+        cookies[i] = NULL;
+    }
+    vq->free_head = 0;
+    vq->num_free = size;
+
+    outl(vdev->io_base + VIRTIO_PCI_QUEUE_PFN, (uint32_t)((uintptr_t)mem / VIRTIO_PCI_VRING_ALIGN));
+    if (vdev->vector >= 0) {
+        // Reads back VIRTIO_MSI_NO_VECTOR if the device could not map it
+        outw(vdev->io_base + VIRTIO_MSI_QUEUE_VECTOR, 0);
+        if (inw(vdev->io_base + VIRTIO_MSI_QUEUE_VECTOR) != 0) {
+            outl(vdev->io_base + VIRTIO_PCI_QUEUE_PFN, 0);
+            fs_free_aligned(mem);
+            fs_free(cookies);
+            vq->mem = NULL;
+            vq->cookies = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void virtqueue_publish(virtqueue_t* vq, uint16_t head, void* cookie) {
+    vq->cookies[head] = cookie;
+    uint16_t slot = (uint16_t)(vq->avail->idx + vq->pending) % vq->size;
+    vq->avail->ring[slot] = head;
+    vq->pending++;
+}
+
+int virtqueue_add(virtqueue_t* vq, const virtio_sg_t* sg, int count, void* cookie) {
+    if (count <= 0 || vq->num_free < count) {
+        return -1;
+    }
+
+    uint16_t head = vq->free_head;
+    uint16_t idx = head;
+    uint16_t last = head;
+    for (int i = 0; i < count; i++) {
+        virtq_desc_t* d = &vq->desc[idx];
+        d->addr = (uint64_t)(uintptr_t)sg[i].addr;
+        d->len = sg[i].len;
+        d->flags = sg[i].write ? VIRTQ_DESC_F_WRITE : 0;
+        if (i + 1 < count) {
+            d->flags |= VIRTQ_DESC_F_NEXT;
+        }
+        last = idx;
+        idx = d->next;
+    }
+    vq->free_head = vq->desc[last].next;
+    vq->num_free -= (uint16_t)count;
+
+    virtqueue_publish(vq, head, cookie);
+    return head;
+}
+
+int virtqueue_add_indirect(virtqueue_t* vq, virtq_desc_t* table, int count, void* cookie) {
+    if (count <= 0 || vq->num_free < 1) {
+        return -1;
+    }
+
+    // Link the table entries; the device follows 'next' inside the table
+    for (int i = 0; i < count; i++) {
+        if (i + 1 < count) {
+            table[i].flags |= VIRTQ_DESC_F_NEXT;
+            table[i].next = (uint16_t)(i + 1);
+        } else {
+            table[i].flags &= (uint16_t)~VIRTQ_DESC_F_NEXT;
+            table[i].next = 0;
+        }
+    }
+
+    uint16_t head = vq->free_head;
+    virtq_desc_t* d = &vq->desc[head];
+    vq->free_head = d->next;
+    vq->num_free--;
+
+    d->addr = (uint64_t)(uintptr_t)table;
+    d->len = (uint32_t)(sizeof(virtq_desc_t) * count);
+    d->flags = VIRTQ_DESC_F_INDIRECT;
+
+    virtqueue_publish(vq, head, cookie);
+    return head;
+}
+
+// Event index fields trail the rings: used_event after the avail ring,
+// avail_event after the used ring. The ring structs are packed, so the
+// addresses come from offsetof rather than &ring[size].
+static inline volatile uint16_t* virtqueue_used_event(virtqueue_t* vq) {
+    return (volatile uint16_t*)((uint8_t*)vq->avail + offsetof(virtq_avail_t, ring) +
+                                vq->size * sizeof(uint16_t));
+}
+
+static inline volatile uint16_t* virtqueue_avail_event(virtqueue_t* vq) {
+    return (volatile uint16_t*)((uint8_t*)vq->used + offsetof(virtq_used_t, ring) +
+                                vq->size * sizeof(virtq_used_elem_t));
+}
+
+void virtqueue_kick(virtqueue_t* vq) {
+    if (vq->pending == 0) {
+        return;
+    }
+
+    // Descriptors and ring entries must be visible before the index moves
+    __asm__ __volatile__("" : : : "memory");
+    uint16_t old_idx = vq->avail->idx;
+    uint16_t new_idx = (uint16_t)(old_idx + vq->pending);
+    vq->avail->idx = new_idx;
+    vq->pending = 0;
+
+    // Then read back what the device asked for
+    __asm__ __volatile__("mfence" : : : "memory");
+    int notify;
+    if (vq->vdev->features & VIRTIO_RING_F_EVENT_IDX) {
+        // Notify only if this batch moved the index past avail_event
+        uint16_t event = *virtqueue_avail_event(vq);
+        notify = (uint16_t)(new_idx - event - 1) < (uint16_t)(new_idx - old_idx);
+    } else {
+        notify = !(vq->used->flags & VIRTQ_USED_F_NO_NOTIFY);
+    }
+    if (notify) {
+        outw(vq->vdev->io_base + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+        vq->notifies++;
+    } else {
+        vq->suppressed++;
+    }
+}
+
+int virtqueue_has_used(virtqueue_t* vq) {
+    return vq->last_used_idx != *(volatile uint16_t*)&vq->used->idx;
+}
+
+void* virtqueue_get_used(virtqueue_t* vq, uint32_t* len) {
+    if (!virtqueue_has_used(vq)) {
+        return NULL;
+    }
+    __asm__ __volatile__("" : : : "memory");
+
+    virtq_used_elem_t* elem = &vq->used->ring[vq->last_used_idx % vq->size];
+    uint16_t head = (uint16_t)elem->id;
+    if (len) {
+        *len = elem->len;
+    }
+    vq->last_used_idx++;
+
+    void* cookie = vq->cookies[head];
+    vq->cookies[head] = NULL;
+
+    // Return the chain to the free list
+    uint16_t idx = head;
+    uint16_t freed = 1;
+    while (vq->desc[idx].flags & VIRTQ_DESC_F_NEXT) {
+        idx = vq->desc[idx].next;
+        freed++;
+    }
+    vq->desc[idx].next = vq->free_head;
+    vq->free_head = head;
+    vq->num_free += freed;
+
+    return cookie;
+}
+
+void virtqueue_disable_intr(virtqueue_t* vq) {
+    if (vq->vdev->features & VIRTIO_RING_F_EVENT_IDX) {
+        // The device ignores the flag; park used_event a full lap behind
+        *virtqueue_used_event(vq) = (uint16_t)(vq->last_used_idx - 1);
+    } else {
+        vq->avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
+    }
+}
+
+int virtqueue_enable_intr(virtqueue_t* vq) {
+    if (vq->vdev->features & VIRTIO_RING_F_EVENT_IDX) {
+        // Interrupt on the next completion after what we consumed
+        *virtqueue_used_event(vq) = vq->last_used_idx;
+    } else {
+        vq->avail->flags &= (uint16_t)~VIRTQ_AVAIL_F_NO_INTERRUPT;
+    }
+    __asm__ __volatile__("mfence" : : : "memory");
+    return virtqueue_has_used(vq);
+}
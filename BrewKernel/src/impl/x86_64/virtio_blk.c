@@ -0,0 +1,261 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// virtio-blk driver. Every request occupies one ring descriptor (an indirect
+// table holding header, data segments and status), so the whole queue can be
+// kept busy and completions arrive by interrupt.
+
+#include "virtio_blk.h"
+#include "virtio.h"
+#include "block.h"
+#include "pci.h"
+#include "irq.h"
+#include "pic.h"
+#include "memory.h"
+#include <stdint.h>
+#include <stddef.h>
+
+static virtio_blk_t* virtio_blk_devs[VIRTIO_BLK_MAX_DEVICES];
+static int virtio_blk_count = 0;
+static int virtio_blk_initialized = 0;
+
+static void virtio_blk_memset(void* dest, int val, size_t len) {
+    uint8_t* d = (uint8_t*)dest;
+    for (size_t i = 0; i < len; i++) {
+        d[i] = (uint8_t)val;
+    }
+}
+
+static int virtio_blk_submit(block_device_t* dev, block_request_t* req) {
+    virtio_blk_t* vb = (virtio_blk_t*)dev->driver_data;
+
+    if (req->write && vb->read_only) {
+        block_complete(dev, req, -1);
+        return 0;
+    }
+    if (!vb->free_slots) {
+        return -1;  // All slots in flight, retried on the next completion
+    }
+
+    int s = __builtin_ctzll(vb->free_slots);
+    virtio_blk_slot_t* slot = &vb->slots[s];
+    slot->hdr.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    slot->hdr.reserved = 0;
+    slot->hdr.sector = req->lba;
+    slot->status = 0xFF;
+    slot->req = req;
+
+    int rc;
+    int n = 0;
+    if (vb->indirect) {
+        virtq_desc_t* t = slot->table;
+        t[n].addr = (uint64_t)(uintptr_t)&slot->hdr;
+        t[n].len = sizeof(virtio_blk_req_hdr_t);
+        t[n].flags = 0;
+        n++;
+        for (block_request_t* seg = req; seg; seg = seg->merge_next) {
+            t[n].addr = (uint64_t)(uintptr_t)seg->buffer;
+            t[n].len = seg->count * BLOCK_SECTOR_SIZE;
+            t[n].flags = req->write ? 0 : VIRTQ_DESC_F_WRITE;
+            n++;
+        }
+        t[n].addr = (uint64_t)(uintptr_t)&slot->status;
+        t[n].len = 1;
+        t[n].flags = VIRTQ_DESC_F_WRITE;
+        n++;
+        rc = virtqueue_add_indirect(&vb->vq, t, n, slot);
+    } else {
+        virtio_sg_t sg[VIRTIO_BLK_MAX_SEGMENTS + 2];
+        sg[n].addr = &slot->hdr;
+        sg[n].len = sizeof(virtio_blk_req_hdr_t);
+        sg[n].write = 0;
+        n++;
+        for (block_request_t* seg = req; seg; seg = seg->merge_next) {
+            sg[n].addr = seg->buffer;
+            sg[n].len = seg->count * BLOCK_SECTOR_SIZE;
+            sg[n].write = !req->write;
+            n++;
+        }
+        sg[n].addr = (void*)&slot->status;
+        sg[n].len = 1;
+        sg[n].write = 1;
+        n++;
+        rc = virtqueue_add(&vb->vq, sg, n, slot);
+    }
+
+    if (rc < 0) {
+        slot->req = NULL;
+        return -1;  // Ring full
+    }
+
+    vb->free_slots &= ~(1ull << s);
+    req->tag = (uint32_t)s;
+    return 0;
+}
+
+// Notify the device once per dispatched batch
+static void virtio_blk_commit(block_device_t* dev) {
+    virtio_blk_t* vb = (virtio_blk_t*)dev->driver_data;
+    virtqueue_kick(&vb->vq);
+}
+
+static void virtio_blk_drain(virtio_blk_t* vb) {
+    unsigned long flags = irq_save();
+
+    void* cookie;
+    while ((cookie = virtqueue_get_used(&vb->vq, NULL)) != NULL) {
+        virtio_blk_slot_t* slot = (virtio_blk_slot_t*)cookie;
+        block_request_t* req = slot->req;
+        int status = (slot->status == VIRTIO_BLK_S_OK) ? 0 : -1;
+
+        slot->req = NULL;
+        vb->free_slots |= 1ull << (slot - vb->slots);
+        if (req) {
+            block_complete(&vb->blk, req, status);
+        }
+    }
+
+    irq_restore(flags);
+}
+
+static void virtio_blk_poll(block_device_t* dev) {
+    virtio_blk_drain((virtio_blk_t*)dev->driver_data);
+}
+
+static void virtio_blk_irq_handler(void) {
+    for (int i = 0; i < virtio_blk_count; i++) {
+        virtio_blk_t* vb = virtio_blk_devs[i];
+        // Reading ISR deasserts the (possibly shared) line
+        if (vb->vdev.vector < 0 && (virtio_read_isr(&vb->vdev) & VIRTIO_ISR_QUEUE)) {
+            vb->interrupts++;
+            virtio_blk_drain(vb);
+        }
+    }
+}
+
+// Each device with MSI-X has a vector of its own; the handler only looks
+// at used rings in memory, which costs no port access
+static void virtio_blk_msix_handler(void) {
+    for (int i = 0; i < virtio_blk_count; i++) {
+        virtio_blk_t* vb = virtio_blk_devs[i];
+        if (vb->vdev.vector >= 0 && virtqueue_has_used(&vb->vq)) {
+            vb->interrupts++;
+            virtio_blk_drain(vb);
+        }
+    }
+}
+
+static int virtio_blk_probe(const pci_device_t* pci) {
+    virtio_blk_t* vb = (virtio_blk_t*)fs_allocate(sizeof(virtio_blk_t));
+    if (!vb) return -1;
+    virtio_blk_memset(vb, 0, sizeof(virtio_blk_t));
+
+    if (virtio_pci_init(&vb->vdev, pci) != 0) {
+        fs_free(vb);
+        return -1;
+    }
+    virtio_enable_msix(&vb->vdev, virtio_blk_msix_handler);
+
+    uint32_t features = virtio_negotiate_features(&vb->vdev,
+        VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO);
+    vb->indirect = (features & VIRTIO_RING_F_INDIRECT_DESC) != 0;
+    vb->read_only = (features & VIRTIO_BLK_F_RO) != 0;
+
+    if (virtqueue_setup(&vb->vdev, &vb->vq, 0) != 0) {
+        virtio_add_status(&vb->vdev, VIRTIO_STATUS_FAILED);
+        virtio_disable_msix(&vb->vdev);
+        fs_free(vb);
+        return -1;
+    }
+
+    int max_segments = VIRTIO_BLK_MAX_SEGMENTS;
+    uint32_t max_sectors = VIRTIO_BLK_MAX_SECTORS;
+    if (features & VIRTIO_BLK_F_SEG_MAX) {
+        uint32_t seg_max = virtio_config_read32(&vb->vdev, VIRTIO_BLK_CFG_SEG_MAX);
+        if (seg_max > 0 && seg_max < (uint32_t)max_segments) {
+            max_segments = (int)seg_max;
+        }
+    }
+    if (features & VIRTIO_BLK_F_SIZE_MAX) {
+        uint32_t size_max = virtio_config_read32(&vb->vdev, VIRTIO_BLK_CFG_SIZE_MAX) / BLOCK_SECTOR_SIZE;
+        if (size_max > 0 && size_max < max_sectors) {
+            max_sectors = size_max;  // A single segment may not exceed this
+        }
+    }
+
+    // With indirect tables each request needs one ring entry, otherwise a full chain
+    int depth = vb->indirect ? vb->vq.size : vb->vq.size / (max_segments + 2);
+    if (depth > VIRTIO_BLK_MAX_INFLIGHT) depth = VIRTIO_BLK_MAX_INFLIGHT;
+    if (depth < 1) depth = 1;
+
+    vb->slots = (virtio_blk_slot_t*)fs_allocate_aligned(sizeof(virtio_blk_slot_t) * depth, 16);
+    if (!vb->slots) {
+        virtio_add_status(&vb->vdev, VIRTIO_STATUS_FAILED);
+        virtio_disable_msix(&vb->vdev);
+        fs_free(vb);
+        return -1;
+    }
+    virtio_blk_memset(vb->slots, 0, sizeof(virtio_blk_slot_t) * depth);
+    vb->free_slots = (depth == 64) ? ~0ull : ((1ull << depth) - 1);
+
+    block_device_t* blk = &vb->blk;
+    blk->name[0] = 'v';
+    blk->name[1] = 'd';
+    blk->name[2] = (char)('a' + virtio_blk_count);
+    blk->name[3] = '\0';
+    blk->driver = "virtio-blk";
+    blk->sector_count = virtio_config_read64(&vb->vdev, VIRTIO_BLK_CFG_CAPACITY);
+    blk->max_sectors = max_sectors;
+    blk->max_segments = max_segments;
+    blk->queue_depth = depth;
+    blk->submit = virtio_blk_submit;
+    blk->poll = virtio_blk_poll;
+    blk->commit = virtio_blk_commit;
+    blk->driver_data = vb;
+
+    virtio_add_status(&vb->vdev, VIRTIO_STATUS_DRIVER_OK);
+
+    if (block_register_device(blk) != 0) {
+        return -1;
+    }
+    virtio_blk_devs[virtio_blk_count++] = vb;
+
+    if (vb->vdev.vector < 0 && vb->vdev.irq > 0 && vb->vdev.irq < 16) {
+        irq_register_shared_handler(vb->vdev.irq, virtio_blk_irq_handler);
+        pic_irq_enable(vb->vdev.irq);
+    }
+    return 0;
+}
+
+int virtio_blk_init(void) {
+    if (virtio_blk_initialized) {
+        return virtio_blk_count > 0 ? 0 : -1;
+    }
+    virtio_blk_initialized = 1;
+
+    pci_device_t devices[32];
+    int count = pci_enumerate_devices(devices, 32);
+
+    for (int i = 0; i < count && virtio_blk_count < VIRTIO_BLK_MAX_DEVICES; i++) {
+        if (devices[i].vendor_id == VIRTIO_VENDOR_ID &&
+            devices[i].device_id == VIRTIO_DEVICE_BLK_LEGACY) {
+            virtio_blk_probe(&devices[i]);
+        }
+    }
+    return virtio_blk_count > 0 ? 0 : -1;
+}
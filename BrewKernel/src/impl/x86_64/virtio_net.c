@@ -0,0 +1,740 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+// virtio-net driver. Frames travel as descriptor chains behind a small
+// virtio_net_hdr, so a send or a batch of receives costs at most one
+// doorbell instead of the register traffic of an emulated NIC. RX
+// buffers are pbufs lent to the device; with mergeable buffers a large
+// frame spans several of them and is copied into one jumbo pbuf.
+
+#include "virtio_net.h"
+#include "virtio.h"
+#include "netdev.h"
+#include "network.h"
+#include "pci.h"
+#include "irq.h"
+#include "pic.h"
+#include "memory.h"
+#include "cmdline.h"
+#include "pbuf.h"
+#include "checksum.h"
+#include <stdint.h>
+#include <stddef.h>
+
+static virtio_net_t* vnet = NULL;
+static int virtio_net_initialized = 0;
+static uint16_t rx_next_queue = 0;  // Round robin start for receive_loan
+
+static int virtio_net_set_mtu(uint32_t mtu);
+
+static void virtio_net_memset(void* dest, int val, size_t len) {
+    uint8_t* d = (uint8_t*)dest;
+    for (size_t i = 0; i < len; i++) {
+        d[i] = (uint8_t)val;
+    }
+}
+
+static void virtio_net_memcpy(void* dest, const void* src, size_t len) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    for (size_t i = 0; i < len; i++) {
+        d[i] = s[i];
+    }
+}
+
+// Queue numbering: RX and TX of pair i at 2i and 2i+1, control after
+// the last pair the device supports
+static uint16_t virtio_net_ctrl_index(void) {
+    return (vnet->vdev.features & VIRTIO_NET_F_MQ) ? (uint16_t)(vnet->max_pairs * 2) : 2;
+}
+
+// Post fresh pbufs until the ring is full or the pool runs dry
+static void virtio_net_rx_refill(virtio_net_rxq_t* rxq) {
+    while (rxq->vq.num_free > 0) {
+        pbuf_t* p = pbuf_alloc_rx_size(vnet->mrg_rxbuf ? PBUF_SIZE : vnet->hdr_size + vnet->frame_max);
+        if (!p) {
+            vnet->stat_rx_starved++;
+            break;
+        }
+        virtio_sg_t sg = { p->buf, p->size, 1 };
+        if (virtqueue_add(&rxq->vq, &sg, 1, p) < 0) {
+            pbuf_free(p);
+            break;
+        }
+    }
+    virtqueue_kick(&rxq->vq);
+}
+
+// Send a control queue command and wait for the device to answer
+static int virtio_net_ctrl(uint8_t class, uint8_t cmd, uint16_t data) {
+    if (!(vnet->vdev.features & VIRTIO_NET_F_CTRL_VQ)) {
+        return -1;
+    }
+    vnet->ctrl_hdr[0] = class;
+    vnet->ctrl_hdr[1] = cmd;
+    vnet->ctrl_data = data;
+    vnet->ctrl_ack = 0xFF;
+
+    virtio_sg_t sg[3] = {
+        { vnet->ctrl_hdr, 2, 0 },
+        { &vnet->ctrl_data, 2, 0 },
+        { (void*)&vnet->ctrl_ack, 1, 1 },
+    };
+    if (virtqueue_add(&vnet->ctrlq, sg, 3, vnet) < 0) {
+        return -1;
+    }
+    virtqueue_kick(&vnet->ctrlq);
+    for (uint32_t spins = 0; !virtqueue_get_used(&vnet->ctrlq, NULL); spins++) {
+        if (spins >= VIRTIO_NET_TX_SPINS) {
+            return -1;
+        }
+        __asm__ __volatile__("pause");
+    }
+    return vnet->ctrl_ack == VIRTIO_NET_OK ? 0 : -1;
+}
+
+// The RX queues stay quiet until the poll loop has drained them
+static void virtio_net_queue_intr(void) {
+    for (uint16_t i = 0; i < vnet->pairs; i++) {
+        virtqueue_disable_intr(&vnet->rxq[i].vq);
+    }
+    vnet->poll_pending = 1;
+}
+
+// Reading ISR acknowledges the (possibly shared) line
+static void virtio_net_irq_handler(void) {
+    if (!vnet) {
+        return;
+    }
+    uint8_t isr = virtio_read_isr(&vnet->vdev);
+    if (!(isr & (VIRTIO_ISR_QUEUE | VIRTIO_ISR_CONFIG))) {
+        return;  // Not ours
+    }
+    vnet->stat_irqs++;
+    if (isr & VIRTIO_ISR_QUEUE) {
+        virtio_net_queue_intr();
+    }
+}
+
+// The MSI-X vector is ours alone: no ISR read, no EOI at the 8259
+static void virtio_net_msix_handler(void) {
+    if (!vnet) {
+        return;
+    }
+    vnet->stat_irqs++;
+    virtio_net_queue_intr();
+}
+
+static void virtio_net_free_queues(virtio_net_t* vn) {
+    for (int i = 0; i < VIRTIO_NET_MAX_PAIRS; i++) {
+        fs_free_aligned(vn->rxq[i].vq.mem);
+        fs_free_aligned(vn->txq[i].vq.mem);
+        fs_free(vn->rxq[i].vq.cookies);
+        fs_free(vn->txq[i].vq.cookies);
+        fs_free(vn->txq[i].slots);
+        fs_free(vn->txq[i].free_slots);
+    }
+    fs_free_aligned(vn->ctrlq.mem);
+    fs_free(vn->ctrlq.cookies);
+}
+
+static int virtio_net_setup_txq(virtio_net_t* vn, virtio_net_txq_t* txq, uint16_t index) {
+    if (virtqueue_setup(&vn->vdev, &txq->vq, index) != 0) {
+        return -1;
+    }
+    // A frame takes at least two descriptors, so one slot per descriptor is plenty
+    uint16_t size = txq->vq.size;
+    txq->slots = (virtio_net_tx_slot_t*)fs_allocate(sizeof(virtio_net_tx_slot_t) * size);
+    txq->free_slots = (uint16_t*)fs_allocate(sizeof(uint16_t) * size);
+    if (!txq->slots || !txq->free_slots) {
+        return -1;
+    }
+    virtio_net_memset(txq->slots, 0, sizeof(virtio_net_tx_slot_t) * size);
+    for (uint16_t i = 0; i < size; i++) {
+        txq->free_slots[i] = (uint16_t)(size - 1 - i);
+    }
+    txq->free_count = size;
+    txq->by_ref_inflight = 0;
+    // Completions are collected on the send path, not by interrupt
+    virtqueue_disable_intr(&txq->vq);
+    return 0;
+}
+
+static int virtio_net_probe(const pci_device_t* pci) {
+    virtio_net_t* vn = (virtio_net_t*)fs_allocate(sizeof(virtio_net_t));
+    if (!vn) return -1;
+    virtio_net_memset(vn, 0, sizeof(virtio_net_t));
+
+    if (virtio_pci_init(&vn->vdev, pci) != 0) {
+        fs_free(vn);
+        return -1;
+    }
+    // Moves the device config, so before anything reads it
+    virtio_enable_msix(&vn->vdev, virtio_net_msix_handler);
+
+    uint32_t supported = VIRTIO_NET_F_MAC | VIRTIO_NET_F_STATUS | VIRTIO_NET_F_MRG_RXBUF |
+                         VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ | VIRTIO_F_ANY_LAYOUT |
+                         VIRTIO_RING_F_EVENT_IDX;
+    uint32_t csum_offload = 1;
+    cmdline_get_uint("virtio_net.csum", &csum_offload);
+    if (csum_offload) {
+        supported |= VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM;
+    }
+    uint32_t features = virtio_negotiate_features(&vn->vdev, supported);
+
+    // RX buffers carry the header in front of the frame, which legacy
+    // devices only accept with one of these
+    if (!(features & VIRTIO_NET_F_MAC) ||
+        !(features & (VIRTIO_NET_F_MRG_RXBUF | VIRTIO_F_ANY_LAYOUT))) {
+        virtio_add_status(&vn->vdev, VIRTIO_STATUS_FAILED);
+        virtio_disable_msix(&vn->vdev);
+        fs_free(vn);
+        return -1;
+    }
+    vn->mrg_rxbuf = (features & VIRTIO_NET_F_MRG_RXBUF) != 0;
+    vn->hdr_size = vn->mrg_rxbuf ? VIRTIO_NET_HDR_MRG_SIZE : VIRTIO_NET_HDR_SIZE;
+    vn->csum_offload = (features & VIRTIO_NET_F_CSUM) != 0;
+    vn->guest_csum = (features & VIRTIO_NET_F_GUEST_CSUM) != 0;
+    for (uint16_t i = 0; i < 6; i++) {
+        vn->mac_address.bytes[i] = virtio_config_read8(&vn->vdev, VIRTIO_NET_CFG_MAC + i);
+    }
+    vn->mtu = ETH_MTU_DEFAULT;
+    vn->frame_max = ETH_FRAME_SIZE(ETH_MTU_DEFAULT);
+
+    // Multiqueue needs the control queue to switch the extra pairs on
+    vn->max_pairs = 1;
+    if ((features & VIRTIO_NET_F_MQ) && (features & VIRTIO_NET_F_CTRL_VQ)) {
+        vn->max_pairs = virtio_config_read16(&vn->vdev, VIRTIO_NET_CFG_MAX_PAIRS);
+        if (vn->max_pairs == 0) vn->max_pairs = 1;
+    }
+    uint32_t pairs = vn->max_pairs;
+    cmdline_get_uint("virtio_net.queues", &pairs);
+    if (pairs > vn->max_pairs) pairs = vn->max_pairs;
+    if (pairs > VIRTIO_NET_MAX_PAIRS) pairs = VIRTIO_NET_MAX_PAIRS;
+    if (pairs == 0) pairs = 1;
+    vn->pairs = (uint16_t)pairs;
+
+    vnet = vn;
+    int failed = 0;
+    for (uint16_t i = 0; i < vn->pairs && !failed; i++) {
+        failed = virtqueue_setup(&vn->vdev, &vn->rxq[i].vq, (uint16_t)(i * 2)) != 0 ||
+                 virtio_net_setup_txq(vn, &vn->txq[i], (uint16_t)(i * 2 + 1)) != 0;
+    }
+    if (!failed && (features & VIRTIO_NET_F_CTRL_VQ)) {
+        failed = virtqueue_setup(&vn->vdev, &vn->ctrlq, virtio_net_ctrl_index()) != 0;
+    }
+    // RX rings are backed by pbufs; keep a second ring's worth for the
+    // stack and one per TX slot for copied frames
+    uint32_t reserve = 0;
+    for (uint16_t i = 0; i < vn->pairs && !failed; i++) {
+        reserve += (uint32_t)vn->rxq[i].vq.size * 2 + vn->txq[i].vq.size;
+    }
+    if (failed || pbuf_pool_reserve(reserve) != 0) {
+        virtio_add_status(&vn->vdev, VIRTIO_STATUS_FAILED);
+        virtio_net_free_queues(vn);
+        virtio_disable_msix(&vn->vdev);
+        fs_free(vn);
+        vnet = NULL;
+        return -1;
+    }
+
+    virtio_add_status(&vn->vdev, VIRTIO_STATUS_DRIVER_OK);
+
+    for (uint16_t i = 0; i < vn->pairs; i++) {
+        virtio_net_rx_refill(&vn->rxq[i]);
+    }
+    if (vn->pairs > 1 && virtio_net_ctrl(VIRTIO_NET_CTRL_MQ, VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET, vn->pairs) != 0) {
+        // The device keeps using the first pair only
+        vn->pairs = 1;
+    }
+
+    // MSI-X if it was set up, else INTx. Without a usable line the driver
+    // stays in polled mode.
+    vn->poll_pending = 1;
+    vn->irq_enabled = 0;
+    if (vn->vdev.vector >= 0) {
+        vn->irq_enabled = 1;
+    } else if (vn->vdev.irq > 0 && vn->vdev.irq < 16) {
+        vn->irq = vn->vdev.irq;
+        vn->irq_enabled = 1;
+        irq_register_shared_handler(vn->irq, virtio_net_irq_handler);
+        pic_irq_enable(vn->irq);
+    }
+
+    uint32_t mtu = 0;
+    if (cmdline_get_uint("virtio_net.mtu", &mtu) == 0 && mtu != ETH_MTU_DEFAULT) {
+        virtio_net_set_mtu(mtu);
+    }
+    return 0;
+}
+
+int virtio_net_init(void) {
+    if (virtio_net_initialized) {
+        return vnet ? 0 : -1;
+    }
+    virtio_net_initialized = 1;
+
+    pci_device_t devices[32];
+    int count = pci_enumerate_devices(devices, 32);
+
+    for (int i = 0; i < count; i++) {
+        if (devices[i].vendor_id == VIRTIO_VENDOR_ID &&
+            devices[i].device_id == VIRTIO_DEVICE_NET_LEGACY &&
+            virtio_net_probe(&devices[i]) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+virtio_net_t* virtio_net_get_device(void) {
+    return vnet;
+}
+
+void virtio_net_get_kick_stats(uint32_t* notifies, uint32_t* suppressed) {
+    uint32_t n = 0;
+    uint32_t s = 0;
+    for (uint16_t i = 0; vnet && i < vnet->pairs; i++) {
+        n += vnet->rxq[i].vq.notifies + vnet->txq[i].vq.notifies;
+        s += vnet->rxq[i].vq.suppressed + vnet->txq[i].vq.suppressed;
+    }
+    if (notifies) *notifies = n;
+    if (suppressed) *suppressed = s;
+}
+
+static int virtio_net_get_mac(mac_address_t* mac) {
+    if (!vnet) {
+        return -1;
+    }
+    *mac = vnet->mac_address;
+    return 0;
+}
+
+static uint16_t virtio_net_get_mtu(void) {
+    return vnet ? vnet->mtu : ETH_MTU_DEFAULT;
+}
+
+// Frames above one RX buffer need mergeable buffers to arrive at all
+static int virtio_net_set_mtu(uint32_t mtu) {
+    if (!vnet || mtu < ETH_MTU_MIN || mtu > ETH_MTU_MAX) {
+        return -1;
+    }
+    if (mtu > ETH_MTU_DEFAULT) {
+        if (!vnet->mrg_rxbuf || pbuf_jumbo_reserve(VIRTIO_NET_JUMBO_RESERVE) != 0) {
+            return -1;
+        }
+    }
+    vnet->mtu = (uint16_t)mtu;
+    vnet->frame_max = (uint16_t)ETH_FRAME_SIZE(mtu);
+    return 0;
+}
+
+static int virtio_net_csum_offload(void) {
+    return vnet && vnet->csum_offload;
+}
+
+// The device cannot filter multicast without the RX control class, and
+// no groups can be joined here; only broadcast passes the stack's check
+static int virtio_net_mcast_member(const mac_address_t* mac) {
+    (void)mac;
+    return 0;
+}
+
+// Translate the header flags into PBUF_CSUM_RX_* flags. NEEDS_CSUM
+// frames come from a peer on the same host and were never on a wire.
+static uint8_t virtio_net_rx_csum(const virtio_net_hdr_t* hdr) {
+    if (vnet->guest_csum && (hdr->flags & (VIRTIO_NET_HDR_F_DATA_VALID | VIRTIO_NET_HDR_F_NEEDS_CSUM))) {
+        vnet->stat_rx_csum_ok++;
+        return PBUF_CSUM_RX_L4_OK;
+    }
+    return 0;
+}
+
+// Pop the rest of a merged frame and copy it after the first buffer's
+// data. dst may be NULL to discard it. Returns the bytes copied, or -1 if
+// the frame did not fit or its buffers were missing.
+static int virtio_net_rx_merge(virtqueue_t* vq, uint16_t nbufs, uint8_t* dst, size_t offset, size_t size) {
+    int ok = 1;
+    for (uint16_t i = 1; i < nbufs; i++) {
+        uint32_t len;
+        pbuf_t* p = (pbuf_t*)virtqueue_get_used(vq, &len);
+        if (!p) {
+            return -1;
+        }
+        if (dst && offset + len <= size) {
+            virtio_net_memcpy(dst + offset, p->buf, len);
+        } else {
+            ok = 0;
+        }
+        offset += len;
+        pbuf_free(p);
+    }
+    return ok ? (int)offset : -1;
+}
+
+// Take up to n frames from one RX queue
+static int virtio_net_rx_queue(virtio_net_rxq_t* rxq, pbuf_t** pkts, int n) {
+    int count = 0;
+    while (count < n) {
+        uint32_t len;
+        pbuf_t* p = (pbuf_t*)virtqueue_get_used(&rxq->vq, &len);
+        if (!p) {
+            break;
+        }
+        const virtio_net_hdr_t* hdr = (const virtio_net_hdr_t*)p->buf;
+        uint16_t nbufs = vnet->mrg_rxbuf ? hdr->num_buffers : 1;
+        if (len < vnet->hdr_size || nbufs == 0) {
+            pbuf_free(p);
+            vnet->stat_rx_dropped++;
+            continue;
+        }
+        uint8_t csum = virtio_net_rx_csum(hdr);
+        p->length = (uint16_t)len;
+        pbuf_pull(p, vnet->hdr_size);
+
+        if (nbufs > 1) {
+            // Copy the pieces into one buffer big enough for our MTU
+            pbuf_t* frame = pbuf_alloc_rx_size(vnet->frame_max);
+            int total = -1;
+            if (frame && p->length <= vnet->frame_max) {
+                virtio_net_memcpy(frame->data, p->data, p->length);
+                total = virtio_net_rx_merge(&rxq->vq, nbufs, frame->data, p->length, vnet->frame_max);
+            } else {
+                virtio_net_rx_merge(&rxq->vq, nbufs, NULL, 0, 0);
+            }
+            pbuf_free(p);
+            if (total < 0) {
+                if (frame) pbuf_free(frame);
+                vnet->stat_rx_dropped++;
+                continue;
+            }
+            frame->length = (uint16_t)total;
+            p = frame;
+            vnet->stat_rx_merged++;
+        } else if (p->length > vnet->frame_max) {
+            pbuf_free(p);
+            vnet->stat_rx_dropped++;
+            continue;
+        }
+        p->csum = csum;
+        pkts[count++] = p;
+    }
+    return count;
+}
+
+// Hand received frames up without copying; the queues are served round
+// robin and refilled with fresh pbufs (one doorbell at most each)
+static int virtio_net_receive_loan(pbuf_t** pkts, int n) {
+    if (!vnet || !pkts) {
+        return 0;
+    }
+    int count = 0;
+    for (uint16_t i = 0; i < vnet->pairs && count < n; i++) {
+        virtio_net_rxq_t* rxq = &vnet->rxq[(rx_next_queue + i) % vnet->pairs];
+        int got = virtio_net_rx_queue(rxq, pkts + count, n - count);
+        // Also retry a ring the pool could not fill, which receives nothing
+        if (got > 0 || rxq->vq.num_free == rxq->vq.size) {
+            virtio_net_rx_refill(rxq);
+            count += got;
+        }
+    }
+    rx_next_queue = (uint16_t)((rx_next_queue + 1) % vnet->pairs);
+    vnet->stat_rx_frames += (uint32_t)count;
+    return count;
+}
+
+static int virtio_net_receive_packet(void* buffer, size_t buffer_size) {
+    pbuf_t* p;
+    if (virtio_net_receive_loan(&p, 1) != 1) {
+        return 0;
+    }
+    size_t length = p->length < buffer_size ? p->length : buffer_size;
+    virtio_net_memcpy(buffer, p->data, length);
+    pbuf_free(p);
+    return (int)length;
+}
+
+// Free the slots of chains the device has sent
+static int virtio_net_txq_reclaim(virtio_net_txq_t* txq) {
+    int count = 0;
+    virtio_net_tx_slot_t* slot;
+    while ((slot = (virtio_net_tx_slot_t*)virtqueue_get_used(&txq->vq, NULL)) != NULL) {
+        if (slot->p) {
+            pbuf_free(slot->p);
+            slot->p = NULL;
+        }
+        if (slot->by_ref) {
+            txq->by_ref_inflight--;
+        }
+        txq->free_slots[txq->free_count++] = (uint16_t)(slot - txq->slots);
+        count++;
+    }
+    // Keep the event index parked so completions stay silent
+    virtqueue_disable_intr(&txq->vq);
+    return count;
+}
+
+static int virtio_net_tx_reclaim(void) {
+    int count = 0;
+    for (uint16_t i = 0; vnet && i < vnet->pairs; i++) {
+        count += virtio_net_txq_reclaim(&vnet->txq[i]);
+    }
+    return count;
+}
+
+// Spread flows over the TX queues by IPv4 addresses and ports, so the
+// frames of one flow stay in order
+static virtio_net_txq_t* virtio_net_pick_txq(const uint8_t* frame, size_t length) {
+    if (vnet->pairs == 1 || length < ETH_HEADER_SIZE + 20 ||
+        frame[12] != 0x08 || frame[13] != 0x00) {
+        return &vnet->txq[0];
+    }
+    const uint8_t* ip = frame + ETH_HEADER_SIZE;
+    uint32_t hash = 0;
+    for (int i = 12; i < 20; i++) {
+        hash = hash * 31 + ip[i];
+    }
+    size_t ihl = (size_t)(ip[0] & 0x0F) * 4;
+    if ((ip[9] == 6 || ip[9] == 17) && length >= ETH_HEADER_SIZE + ihl + 4) {
+        for (size_t i = ihl; i < ihl + 4; i++) {
+            hash = hash * 31 + ip[i];
+        }
+    }
+    hash *= 0x9E3779B1u;
+    return &vnet->txq[(hash >> 16) % vnet->pairs];
+}
+
+// The device has no IPv4 header offload; finish it here. The UDP
+// checksum goes to the device as a partial checksum from csum_start.
+static void virtio_net_tx_csum(virtio_net_hdr_t* hdr, uint8_t* frame, size_t length, uint8_t csum) {
+    if (length < ETH_HEADER_SIZE + 20) {
+        return;
+    }
+    uint8_t* ip = frame + ETH_HEADER_SIZE;
+    size_t ihl = (size_t)(ip[0] & 0x0F) * 4;
+    if (csum & PBUF_CSUM_TX_IP) {
+        ip[10] = 0;
+        ip[11] = 0;
+        uint16_t sum = (uint16_t)~csum_fold(csum_partial(ip, ihl, 0));
+        ip[10] = (uint8_t)(sum & 0xFF);
+        ip[11] = (uint8_t)(sum >> 8);
+    }
+    if ((csum & PBUF_CSUM_TX_UDP) && vnet->csum_offload) {
+        hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr->csum_start = (uint16_t)(ETH_HEADER_SIZE + ihl);
+        hdr->csum_offset = 6;
+        vnet->stat_tx_csum_hw++;
+    }
+}
+
+// Queue one chain: sg[0] is left for the header. Takes ownership of p.
+static int virtio_net_xmit(virtio_sg_t* sg, int count, pbuf_t* p, int by_ref, uint8_t csum) {
+    virtio_net_txq_t* txq = virtio_net_pick_txq(p->data, p->length);
+    if (txq->free_count == 0 || txq->vq.num_free < count) {
+        virtio_net_txq_reclaim(txq);
+    }
+    if (txq->free_count == 0 || txq->vq.num_free < count) {
+        // Make sure the device sees what is queued, then wait for room
+        vnet->stat_tx_ring_full++;
+        virtqueue_kick(&txq->vq);
+        for (uint32_t spins = 0; txq->free_count == 0 || txq->vq.num_free < count; spins++) {
+            if (spins >= VIRTIO_NET_TX_SPINS) {
+                pbuf_free(p);
+                return -1;
+            }
+            __asm__ __volatile__("pause");
+            virtio_net_txq_reclaim(txq);
+        }
+    }
+
+    virtio_net_tx_slot_t* slot = &txq->slots[txq->free_slots[--txq->free_count]];
+    virtio_net_memset(&slot->hdr, 0, sizeof(slot->hdr));
+    if (csum) {
+        virtio_net_tx_csum(&slot->hdr, p->data, p->length, csum);
+    }
+    slot->p = p;
+    slot->by_ref = by_ref ? 1 : 0;
+    sg[0].addr = &slot->hdr;
+    sg[0].len = vnet->hdr_size;
+    sg[0].write = 0;
+    virtqueue_add(&txq->vq, sg, count, slot);
+    if (by_ref) {
+        txq->by_ref_inflight++;
+    }
+
+    // Held batches are announced at the end, or once a quarter ring waits
+    if (vnet->tx_hold == 0 || txq->vq.pending >= txq->vq.size / 4) {
+        virtqueue_kick(&txq->vq);
+    }
+    vnet->stat_tx_frames++;
+    return 0;
+}
+
+// Copy the segments into one pbuf, except by_ref ones of useful size
+// which the device reads in place. The first segment is always copied,
+// since it holds the headers the checksum code edits.
+static int virtio_net_send_sg(const netdev_sg_t* segs, int nsegs, uint8_t csum) {
+    if (!vnet || !segs || nsegs <= 0 || nsegs > NETDEV_SG_MAX) {
+        return -1;
+    }
+    size_t total = 0;
+    size_t copied = 0;
+    for (int i = 0; i < nsegs; i++) {
+        total += segs[i].length;
+        if (i == 0 || !segs[i].by_ref || segs[i].length < VIRTIO_NET_TX_COPYBREAK) {
+            copied += segs[i].length;
+        }
+    }
+    if (total == 0 || total > vnet->frame_max) {
+        return -1;
+    }
+    pbuf_t* p = pbuf_alloc_size(copied);
+    if (!p) {
+        return -1;
+    }
+
+    virtio_sg_t sg[NETDEV_SG_MAX + 1];
+    int count = 1;
+    int by_ref = 0;
+    uint8_t* run_end = NULL;  // End of the copied run sg[count - 1] covers
+    for (int i = 0; i < nsegs; i++) {
+        if (segs[i].length == 0) {
+            continue;
+        }
+        if (i > 0 && segs[i].by_ref && segs[i].length >= VIRTIO_NET_TX_COPYBREAK) {
+            sg[count].addr = (void*)segs[i].data;
+            sg[count].len = (uint32_t)segs[i].length;
+            sg[count].write = 0;
+            count++;
+            run_end = NULL;
+            by_ref = 1;
+            vnet->stat_tx_sg_refs++;
+            continue;
+        }
+        uint8_t* dst = pbuf_put(p, segs[i].length);
+        virtio_net_memcpy(dst, segs[i].data, segs[i].length);
+        if (run_end == dst) {
+            sg[count - 1].len += (uint32_t)segs[i].length;
+        } else {
+            sg[count].addr = dst;
+            sg[count].len = (uint32_t)segs[i].length;
+            sg[count].write = 0;
+            count++;
+        }
+        run_end = dst + segs[i].length;
+    }
+    return virtio_net_xmit(sg, count, p, by_ref, csum);
+}
+
+static int virtio_net_send_packet(const void* data, size_t length) {
+    netdev_sg_t seg = { data, length, 0 };
+    return virtio_net_send_sg(&seg, 1, 0);
+}
+
+// Transmit a pbuf in place; the slot keeps it until the device is done
+static int virtio_net_send_pbuf(pbuf_t* p) {
+    if (!p) {
+        return -1;
+    }
+    if (!vnet || p->length == 0 || p->length > vnet->frame_max) {
+        pbuf_free(p);
+        return -1;
+    }
+    virtio_sg_t sg[2];
+    sg[1].addr = p->data;
+    sg[1].len = p->length;
+    sg[1].write = 0;
+    return virtio_net_xmit(sg, 2, p, 0, p->csum & (PBUF_CSUM_TX_IP | PBUF_CSUM_TX_UDP));
+}
+
+// Wait until no chain references caller memory
+static int virtio_net_tx_flush(void) {
+    if (!vnet) {
+        return -1;
+    }
+    for (uint16_t i = 0; i < vnet->pairs; i++) {
+        virtio_net_txq_t* txq = &vnet->txq[i];
+        virtqueue_kick(&txq->vq);
+        for (uint32_t spins = 0; txq->by_ref_inflight > 0; spins++) {
+            if (spins >= VIRTIO_NET_TX_SPINS) {
+                return -1;
+            }
+            __asm__ __volatile__("pause");
+            virtio_net_txq_reclaim(txq);
+        }
+    }
+    return 0;
+}
+
+static void virtio_net_tx_hold(int hold) {
+    if (!vnet) {
+        return;
+    }
+    if (hold) {
+        vnet->tx_hold++;
+    } else if (vnet->tx_hold > 0 && --vnet->tx_hold == 0) {
+        for (uint16_t i = 0; i < vnet->pairs; i++) {
+            virtqueue_kick(&vnet->txq[i].vq);
+        }
+    }
+}
+
+static int virtio_net_poll_pending(void) {
+    return vnet && vnet->poll_pending;
+}
+
+// Once drained, top up the RX rings and re-arm their interrupts. Frames
+// that land in between are caught by the recheck in virtqueue_enable_intr.
+static void virtio_net_poll_complete(int drained) {
+    if (!vnet) {
+        return;
+    }
+    vnet->stat_polls++;
+    if (!drained || !vnet->irq_enabled) {
+        return;  // Stay in polling mode
+    }
+    unsigned long flags = irq_save();
+    vnet->poll_pending = 0;
+    for (uint16_t i = 0; i < vnet->pairs; i++) {
+        virtio_net_rxq_t* rxq = &vnet->rxq[i];
+        virtio_net_rx_refill(rxq);
+        // An empty ring raises nothing; keep polling until pbufs come back
+        if (virtqueue_enable_intr(&rxq->vq) || rxq->vq.num_free == rxq->vq.size) {
+            vnet->poll_pending = 1;
+        }
+    }
+    irq_restore(flags);
+}
+
+const netdev_ops_t virtio_net_netdev_ops = {
+    .name = "virtio-net",
+    .get_mac = virtio_net_get_mac,
+    .get_mtu = virtio_net_get_mtu,
+    .set_mtu = virtio_net_set_mtu,
+    .send_packet = virtio_net_send_packet,
+    .receive_packet = virtio_net_receive_packet,
+    .receive_loan = virtio_net_receive_loan,
+    .send_pbuf = virtio_net_send_pbuf,
+    .send_sg = virtio_net_send_sg,
+    .csum_offload = virtio_net_csum_offload,
+    .mcast_member = virtio_net_mcast_member,
+    .tx_flush = virtio_net_tx_flush,
+    .tx_hold = virtio_net_tx_hold,
+    .tx_reclaim = virtio_net_tx_reclaim,
+    .poll_pending = virtio_net_poll_pending,
+    .poll_complete = virtio_net_poll_complete,
+};
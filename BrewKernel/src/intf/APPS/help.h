@@ -43,10 +43,25 @@ static void display_help() {
     brew_str("  CAT     - Display file contents\n");
     brew_str("  TOUCH   - Create an empty file\n");
     brew_str("  ECHO    - Print text (can redirect to file with >)\n");
-    brew_str("  NETINIT - Initialize network card\n");
+    brew_str("  GREP    - Search files for a pattern (GREP <pattern> <path>)\n");
+    brew_str("  FIND    - Find files by name (FIND <root> -name <glob>)\n");
+    brew_str("  DISKINFO - Show block devices and buffer cache stats\n");
+    brew_str("  DISKBENCH - Measure disk IOPS and MB/s (DISKBENCH [device] [depth])\n");
+    brew_str("  MOUNT - Mount a FAT32 disk on /mnt or show its status (MOUNT [device])\n");
+    brew_str("  UMOUNT - Flush and unmount the FAT32 volume\n");
+    brew_str("  PERSIST - Save the filesystem to a disk or show log status (PERSIST [device] [FORCE])\n");
+    brew_str("  SYNC - Write filesystem changes to disk\n");
+    brew_str("  NETINIT - Initialize network card (virtio-net, e1000e or e1000)\n");
     brew_str("  NETINFO - Show network status (MAC, IP)\n");
     brew_str("  UDPTEST - Start UDP echo server on port 12345 (broken)\n");
     brew_str("  UDPSEND - Send UDP packet (UDPSEND <ip> <port> <msg>)\n");
+    brew_str("  TXPOLICY - Set what a send does on a full TX ring (FAIL, SPIN [budget], QUEUE)\n");
+    brew_str("  NETRING - Show or resize the e1000 descriptor rings (NETRING [<tx> <rx>])\n");
+    brew_str("  NETMTU - Show or set the MTU, up to 9000 for jumbo frames (NETMTU [<mtu>])\n");
+    brew_str("  NETMOD - Show or set interrupt moderation (NETMOD [ADAPTIVE | ITR <irqs/s> | RDTR|RADV|TIDV|TADV <usecs>])\n");
+    brew_str("  NETPROMISC - Receive every frame on the segment, for capture (NETPROMISC [ON|OFF])\n");
+    brew_str("  ARP - Show the neighbour table and ARP counters, or clear it (ARP [FLUSH])\n");
+    brew_str("  ROUTE - Show or edit the IPv4 routing table (ROUTE [ADD <net>/<len> [<gw>] | DEL <net>/<len> | FLUSH])\n");
     brew_str("\nPipe support:\n");
     brew_str("  CAT <file> | UDPSEND <ip> <port> - Send file contents via UDP\n");
 }
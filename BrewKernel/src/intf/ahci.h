@@ -0,0 +1,169 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+#include "pci.h"
+#include "block.h"
+
+// PCI AHCI controller (class 0x01, subclass 0x06)
+#define PCI_SUBCLASS_SATA 0x06
+
+// HBA generic registers (offsets from ABAR, PCI BAR5)
+#define AHCI_REG_CAP   0x00
+#define AHCI_REG_GHC   0x04
+#define AHCI_REG_IS    0x08
+#define AHCI_REG_PI    0x0C
+#define AHCI_REG_VS    0x10
+
+#define AHCI_CAP_NCS_SHIFT 8           // Command slots - 1 (bits 12:8)
+#define AHCI_CAP_SNCQ      (1u << 30)  // Native command queuing
+#define AHCI_CAP_S64A      (1u << 31)  // 64-bit addressing
+
+#define AHCI_GHC_HR  (1u << 0)   // HBA reset
+#define AHCI_GHC_IE  (1u << 1)   // Interrupt enable
+#define AHCI_GHC_AE  (1u << 31)  // AHCI enable
+
+// Port registers (offsets from ABAR + 0x100 + port * 0x80)
+#define AHCI_PORT_BASE   0x100
+#define AHCI_PORT_SIZE   0x80
+#define AHCI_PxCLB   0x00
+#define AHCI_PxCLBU  0x04
+#define AHCI_PxFB    0x08
+#define AHCI_PxFBU   0x0C
+#define AHCI_PxIS    0x10
+#define AHCI_PxIE    0x14
+#define AHCI_PxCMD   0x18
+#define AHCI_PxTFD   0x20
+#define AHCI_PxSIG   0x24
+#define AHCI_PxSSTS  0x28
+#define AHCI_PxSERR  0x30
+#define AHCI_PxSACT  0x34
+#define AHCI_PxCI    0x38
+
+#define AHCI_PxCMD_ST   (1u << 0)
+#define AHCI_PxCMD_FRE  (1u << 4)
+#define AHCI_PxCMD_FR   (1u << 14)
+#define AHCI_PxCMD_CR   (1u << 15)
+
+#define AHCI_PxIS_DHRS  (1u << 0)   // D2H register FIS
+#define AHCI_PxIS_PSS   (1u << 1)   // PIO setup FIS
+#define AHCI_PxIS_DSS   (1u << 2)   // DMA setup FIS
+#define AHCI_PxIS_SDBS  (1u << 3)   // Set device bits FIS (NCQ completion)
+#define AHCI_PxIS_IFS   (1u << 27)
+#define AHCI_PxIS_HBDS  (1u << 28)
+#define AHCI_PxIS_HBFS  (1u << 29)
+#define AHCI_PxIS_TFES  (1u << 30)  // Task file error
+#define AHCI_PxIS_ERROR (AHCI_PxIS_IFS | AHCI_PxIS_HBDS | AHCI_PxIS_HBFS | AHCI_PxIS_TFES)
+
+#define AHCI_SSTS_DET_PRESENT 0x3
+#define AHCI_SIG_ATA          0x00000101
+
+#define AHCI_TFD_BSY  0x80
+#define AHCI_TFD_DRQ  0x08
+#define AHCI_TFD_ERR  0x01
+
+// FIS types
+#define FIS_TYPE_REG_H2D 0x27
+
+// ATA commands used by the driver
+#define ATA_CMD_READ_DMA_EXT_AHCI   0x25
+#define ATA_CMD_WRITE_DMA_EXT_AHCI  0x35
+#define ATA_CMD_READ_FPDMA_QUEUED   0x60
+#define ATA_CMD_WRITE_FPDMA_QUEUED  0x61
+#define ATA_CMD_IDENTIFY_AHCI       0xEC
+
+// Command header (one per slot in the 1KB command list)
+typedef struct {
+    uint16_t flags;        // CFL (FIS length in dwords), A, W, P, R, B, C, PMP
+    uint16_t prdtl;        // Number of PRD entries
+    volatile uint32_t prdbc;  // Bytes transferred
+    uint32_t ctba;         // Command table base (128-byte aligned)
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed)) ahci_cmd_header_t;
+
+#define AHCI_CMD_FLAG_WRITE (1u << 6)
+
+// Physical region descriptor
+typedef struct {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;          // Byte count - 1 (bits 21:0), bit 31 = interrupt
+} __attribute__((packed)) ahci_prd_t;
+
+#define AHCI_PRD_ENTRIES 32
+
+// Command table: command FIS, ATAPI command, then the PRD table
+typedef struct {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    ahci_prd_t prdt[AHCI_PRD_ENTRIES];
+} __attribute__((packed)) ahci_cmd_table_t;
+
+// Host to device register FIS
+typedef struct {
+    uint8_t fis_type;
+    uint8_t pmport_c;      // Bit 7: command (not control) update
+    uint8_t command;
+    uint8_t featurel;
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t featureh;
+    uint8_t countl;
+    uint8_t counth;
+    uint8_t icc;
+    uint8_t control;
+    uint8_t reserved[4];
+} __attribute__((packed)) fis_reg_h2d_t;
+
+#define AHCI_MAX_PORTS    32
+#define AHCI_MAX_SLOTS    32
+#define AHCI_MAX_SECTORS  1024   // 512KB per command
+#define AHCI_TIMEOUT_POLLS 5000000
+
+typedef struct ahci_port {
+    volatile uint32_t* regs;         // Port register block
+    int index;
+    int ncq;                         // Drive and HBA support NCQ
+    uint32_t slot_mask;              // Usable command slots
+    uint32_t issued;                 // Slots handed to the HBA
+    uint32_t pending;                // Prepared, doorbell not rung yet
+    uint32_t polls;                  // Polls without progress
+    ahci_cmd_header_t* cmd_list;
+    void* fis_area;
+    ahci_cmd_table_t* cmd_tables;
+    block_request_t* slot_req[AHCI_MAX_SLOTS];
+    uint64_t sectors;
+    uint32_t max_inflight;           // Highest number of commands seen in flight
+    block_device_t blk;
+} ahci_port_t;
+
+// Probe the AHCI controller and register SATA disks as sda, sdb, ...
+int ahci_init(void);
+
+#endif // AHCI_H
@@ -0,0 +1,59 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+
+// Local APIC of the boot CPU. The 8259 keeps delivering the legacy lines
+// through LINT0 (virtual wire mode); the APIC only adds the message
+// signalled vectors PCI devices write to.
+
+#define LAPIC_MSR_BASE       0x1B
+#define LAPIC_MSR_ENABLE     (1u << 11)
+
+#define LAPIC_REG_ID         0x020
+#define LAPIC_REG_TPR        0x080
+#define LAPIC_REG_EOI        0x0B0
+#define LAPIC_REG_SVR        0x0F0
+#define LAPIC_REG_LVT_LINT0  0x350
+#define LAPIC_REG_LVT_LINT1  0x360
+
+#define LAPIC_SVR_ENABLE     0x100
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+#define LAPIC_LVT_EXTINT     0x700
+#define LAPIC_LVT_NMI        0x400
+
+// Only this window is identity mapped for MMIO at boot
+#define LAPIC_MMIO_MIN       0xFE800000u
+#define LAPIC_MMIO_MAX       0xFF000000u
+
+// Message address for MSI/MSI-X: fixed delivery to one APIC
+#define MSI_ADDRESS_BASE     0xFEE00000u
+#define MSI_ADDRESS_DEST(id) ((uint32_t)(id) << 12)
+
+// Enable the local APIC. Returns 0 on success, -1 without one.
+int lapic_init(void);
+
+int lapic_available(void);
+uint8_t lapic_id(void);
+
+// Acknowledge the interrupt being serviced
+void lapic_eoi(void);
+
+#endif // APIC_H
@@ -0,0 +1,79 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include "block.h"
+
+// Sector buffer cache: LRU replacement, write-back of dirty sectors and
+// sequential read-ahead (a stream prefetches the next window while the
+// current one is being consumed).
+
+#define BCACHE_ENTRIES 1024          // 512KB of cached sectors
+#define BCACHE_HASH_SIZE 512
+#define BCACHE_READAHEAD_SECTORS 32  // Read-ahead window (16KB)
+
+typedef struct bcache_buf {
+    uint8_t data[BLOCK_SECTOR_SIZE] __attribute__((aligned(16)));
+    block_device_t* dev;
+    uint64_t lba;
+    int valid;                 // data holds the sector contents
+    volatile int dirty;        // data must be written back
+    int refcount;
+    volatile int io_pending;   // a read or write is in flight
+    int ra_trigger;            // hitting this buffer starts the next read-ahead window
+    int write_error;           // last write-back failed; eviction skips it
+    block_request_t req;
+    struct bcache_buf* hash_next;
+    struct bcache_buf* lru_prev;
+    struct bcache_buf* lru_next;
+} bcache_buf_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t readahead;        // Sectors requested by read-ahead
+    uint32_t writebacks;       // Dirty sectors written to disk
+    uint32_t dirty;            // Currently dirty sectors
+    uint32_t write_errors;     // Failed write-backs
+} bcache_stats_t;
+
+// Get a referenced buffer holding the given sector (NULL on I/O error)
+bcache_buf_t* bcache_get(block_device_t* dev, uint64_t lba);
+
+// Drop a reference taken with bcache_get()
+void bcache_release(bcache_buf_t* buf);
+
+// Mark buffer contents as modified (written back on sync or eviction)
+void bcache_mark_dirty(bcache_buf_t* buf);
+
+// Write back all dirty sectors of a device (NULL = all devices)
+int bcache_sync(block_device_t* dev);
+
+// Write back and drop all cached sectors of a device
+void bcache_invalidate(block_device_t* dev);
+
+// Drop cached copies of a sector range without writing them back
+// (used when the range is about to be overwritten directly)
+void bcache_discard(block_device_t* dev, uint64_t lba, uint32_t count);
+
+void bcache_get_stats(bcache_stats_t* stats);
+
+#endif // BCACHE_H
@@ -0,0 +1,124 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Generic block device layer.
+// Drivers register a block_device_t, callers queue block_request_t's on it.
+// Queued requests are kept sorted by LBA and adjacent ones are merged into a
+// single hardware transfer (one request with several buffer segments).
+
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCK_MAX_DEVICES 8
+
+struct block_device;
+
+typedef struct block_request {
+    struct block_device* dev;
+    uint64_t lba;              // First sector of this segment
+    uint32_t count;            // Sectors in this segment
+    void* buffer;              // Data buffer for this segment
+    int write;                 // 1 = write to disk, 0 = read from disk
+
+    volatile int done;         // Set when the request completes
+    volatile int status;       // 0 = success, -1 = error
+
+    // Optional completion callback (runs in interrupt context)
+    void (*complete)(struct block_request* req);
+    void* private_data;
+
+    // Set on the head request of a merged chain
+    uint32_t total_count;      // Sectors across all merged segments
+    int segments;              // Number of merged segments
+
+    struct block_request* next;        // Next request in the device queue
+    struct block_request* merge_next;  // Next segment merged into this transfer
+    uint32_t tag;                      // Driver private (hardware slot/tag)
+} block_request_t;
+
+typedef struct block_device {
+    char name[8];
+    const char* driver;        // Driver name for DISKINFO
+    uint64_t sector_count;
+    uint32_t max_sectors;      // Largest transfer after merging
+    int max_segments;          // Largest number of merged segments
+    int queue_depth;           // Requests the hardware can have in flight
+
+    // Start a (possibly merged) request on the hardware.
+    // Returns 0 if started, -1 if the hardware is busy (request stays queued).
+    int (*submit)(struct block_device* dev, block_request_t* req);
+    // Optional: check for completions without waiting for an interrupt
+    void (*poll)(struct block_device* dev);
+    // Optional: called once after a batch of submits (ring the doorbell once)
+    void (*commit)(struct block_device* dev);
+    void* driver_data;
+
+    // Queue state (owned by block.c)
+    block_request_t* queue_head;
+    volatile int in_flight;
+    int plugged;
+    uint64_t last_read_lba;    // Used by the buffer cache to detect streams
+
+    // Statistics
+    uint32_t stat_requests;
+    uint32_t stat_merges;
+    uint32_t stat_dispatched;
+    uint32_t stat_errors;
+    uint64_t stat_sectors_read;
+    uint64_t stat_sectors_written;
+} block_device_t;
+
+// Probe all storage drivers and register their devices
+void block_init(void);
+
+// Register a device, returns 0 on success
+int block_register_device(block_device_t* dev);
+
+// Device lookup
+int block_get_device_count(void);
+block_device_t* block_get_device(int index);
+block_device_t* block_find_device(const char* name);
+
+// Queue a request (asynchronous). Completion is signalled through req->done
+// and req->complete. Returns 0 if queued, -1 on invalid arguments.
+int block_submit(block_request_t* req);
+
+// Hold back dispatching while a batch is queued so it can be merged
+void block_plug(block_device_t* dev);
+void block_unplug(block_device_t* dev);
+
+// Start as many queued requests as the hardware accepts
+void block_dispatch(block_device_t* dev);
+
+// Called by drivers when a (merged) request finishes
+void block_complete(block_device_t* dev, block_request_t* req, int status);
+
+// Wait for a submitted request to finish. Returns its status. There is no
+// timeout here: the device may still DMA into the buffer, so a request
+// cannot be abandoned; drivers fail requests that the hardware drops.
+int block_wait(block_request_t* req);
+
+// Synchronous helpers
+int block_read(block_device_t* dev, uint64_t lba, uint32_t count, void* buffer);
+int block_write(block_device_t* dev, uint64_t lba, uint32_t count, const void* buffer);
+
+#endif // BLOCK_H
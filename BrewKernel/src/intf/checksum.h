@@ -0,0 +1,44 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Internet checksum (RFC 1071). Sums are kept in memory byte order, so a
+// folded result can be stored straight into a header field.
+
+// Add len bytes at data to a running 32-bit sum. Sums 64 bits per step with
+// add-with-carry, long buffers use SSE2. data needs no particular alignment.
+uint32_t csum_partial(const void* data, size_t len, uint32_t sum);
+
+// Fold a running sum to 16 bits (not complemented)
+uint16_t csum_fold(uint32_t sum);
+
+// Sum of the IPv4 pseudo header for a TCP/UDP segment of 'length' bytes
+uint32_t csum_pseudo_ipv4(const uint8_t src[4], const uint8_t dst[4], uint8_t protocol, uint16_t length);
+
+// Patch a stored checksum after a 16-bit or 32-bit field changed from old
+// to new (RFC 1624), without summing the rest of the data again. Values are
+// in memory byte order, as read from the header.
+uint16_t csum_replace16(uint16_t check, uint16_t old_word, uint16_t new_word);
+uint16_t csum_replace32(uint16_t check, uint32_t old_value, uint32_t new_value);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,39 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CMDLINE_H
+#define CMDLINE_H
+
+#include <stdint.h>
+
+// Kernel command line, taken from the multiboot2 boot information.
+// Parameters are space separated "key=value" words, e.g.
+//   multiboot2 /boot/kernel.bin e1000.rxring=1024 e1000.txring=256
+
+#define CMDLINE_MAX 256
+
+// Copy the command line out of the boot information (NULL = empty)
+void cmdline_init(void* multiboot_info);
+
+// Whole command line ("" if none was given)
+const char* cmdline_get(void);
+
+// Parse key=<decimal>. Returns 0 and sets *value if the key is present.
+int cmdline_get_uint(const char* key, uint32_t* value);
+
+#endif // CMDLINE_H
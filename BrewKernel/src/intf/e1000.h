@@ -23,6 +23,8 @@
 #include <stddef.h>
 #include "pci.h"
 #include "network.h"
+#include "pbuf.h"
+#include "netdev.h"
 
 // Intel 82540EM device IDs
 #define E1000_VENDOR_ID 0x8086
@@ -35,6 +37,7 @@
 #define E1000_REG_EERD     0x0014  // EEPROM Read
 #define E1000_REG_CTRL_EXT 0x0018  // Extended Device Control
 #define E1000_REG_ICR      0x00C0  // Interrupt Cause Read
+#define E1000_REG_ITR      0x00C4  // Interrupt Throttling Rate
 #define E1000_REG_ICS      0x00C8  // Interrupt Cause Set
 #define E1000_REG_IMS      0x00D0  // Interrupt Mask Set/Read
 #define E1000_REG_IMC      0x00D8  // Interrupt Mask Clear
@@ -46,13 +49,19 @@
 #define E1000_REG_RDLEN    0x2808  // Receive Descriptor Length
 #define E1000_REG_RDH      0x2810  // Receive Descriptor Head
 #define E1000_REG_RDT      0x2818  // Receive Descriptor Tail
+#define E1000_REG_RDTR     0x2820  // Receive Delay Timer
+#define E1000_REG_RADV     0x282C  // Receive Interrupt Absolute Delay Timer
 #define E1000_REG_TDBAL    0x3800  // Transmit Descriptor Base Address Low
 #define E1000_REG_TDBAH    0x3804  // Transmit Descriptor Base Address High
 #define E1000_REG_TDLEN    0x3808  // Transmit Descriptor Length
 #define E1000_REG_TDH      0x3810  // Transmit Descriptor Head
 #define E1000_REG_TDT      0x3818  // Transmit Descriptor Tail
+#define E1000_REG_TIDV     0x3820  // Transmit Interrupt Delay Value
+#define E1000_REG_TADV     0x382C  // Transmit Absolute Interrupt Delay Value
+#define E1000_REG_MTA      0x5200  // Multicast Table Array (128 dwords)
 #define E1000_REG_RAL      0x5400  // Receive Address Low (MAC address)
 #define E1000_REG_RAH      0x5404  // Receive Address High
+#define E1000_REG_RXCSUM   0x5000  // Receive Checksum Control
 
 // Control register bits
 #define E1000_CTRL_RST     (1 << 26)  // Device Reset
@@ -74,6 +83,16 @@
 #define E1000_RCTL_BSIZE_2048 (1 << 16) // Buffer Size 2048
 #define E1000_RCTL_SECRC   (1 << 26)  // Strip Ethernet CRC
 
+// Receive address filters
+#define E1000_RAH_AV       (1u << 31) // Receive address entry valid
+#define E1000_RA_ENTRIES   16         // RAL/RAH pairs, 8 bytes apart
+#define E1000_MTA_ENTRIES  128        // 4096-bit multicast hash table
+#define E1000_MCAST_MAX    32         // Multicast groups joined at once
+
+// Receive Checksum Control bits
+#define E1000_RXCSUM_IPOFL (1 << 8)   // IP checksum offload
+#define E1000_RXCSUM_TUOFL (1 << 9)   // TCP/UDP checksum offload
+
 // Transmit Control register bits
 #define E1000_TCTL_EN      (1 << 1)   // Transmit Enable
 #define E1000_TCTL_PSP     (1 << 3)   // Pad Short Packets
@@ -94,18 +113,96 @@
 #define E1000_ICR_GPI      (1 << 18)  // General Purpose Interrupts
 #define E1000_ICR_TXD_LOW  (1 << 15)  // Transmit Descriptor Low Threshold
 
+// Causes serviced by the driver. RXO is included so an overrun still
+// schedules a poll that drains the ring.
+#define E1000_IMS_ENABLE   (E1000_ICR_RXT0 | E1000_ICR_RXO | E1000_ICR_TXDW | E1000_ICR_LSC)
+
+// Device status bits
+#define E1000_STATUS_LU    (1 << 1)   // Link Up
+
 // Descriptor flags
 #define E1000_TXD_CMD_EOP  (1 << 0)   // End of Packet
 #define E1000_TXD_CMD_IFCS (1 << 1)   // Insert FCS
 #define E1000_TXD_CMD_RS   (1 << 3)   // Report Status
+#define E1000_TXD_CMD_DEXT (1 << 5)   // Extended descriptor format
+#define E1000_TXD_CMD_IDE  (1 << 7)   // Interrupt Delay Enable (TIDV/TADV)
 #define E1000_TXD_STAT_DD  (1 << 0)   // Descriptor Done
 
+// Extended TX descriptors reuse the legacy layout: DTYP sits in the upper
+// nibble of the cso byte and POPTS in the css byte
+#define E1000_TXD_DTYP_DATA  0x10     // Data descriptor (DTYP = 0001)
+#define E1000_TXD_POPTS_IXSM 0x01     // Insert IP checksum
+#define E1000_TXD_POPTS_TXSM 0x02     // Insert TCP/UDP checksum
+
+// Context descriptor TUCMD bits (cmd_and_length bits 31:24)
+#define E1000_TXC_TUCMD_IP   (1 << 1) // IPv4 packet
+#define E1000_TXC_TUCMD_RS   (1 << 3) // Report Status
+#define E1000_TXC_TUCMD_DEXT (1 << 5) // Extended descriptor
+
 #define E1000_RXD_STAT_DD  (1 << 0)   // Descriptor Done
 #define E1000_RXD_STAT_EOP (1 << 1)   // End of Packet
+#define E1000_RXD_STAT_IXSM (1 << 2)  // Ignore checksum indication
+#define E1000_RXD_STAT_TCPCS (1 << 5) // TCP/UDP checksum calculated
+#define E1000_RXD_STAT_IPCS (1 << 6)  // IP checksum calculated
+#define E1000_RXD_ERR_TCPE (1 << 5)   // TCP/UDP checksum error
+#define E1000_RXD_ERR_IPE  (1 << 6)   // IP checksum error
+
+// Descriptor ring sizes. TDLEN/RDLEN must be a multiple of 128 bytes, so
+// sizes are rounded up to 8 descriptors. Chosen at boot with the
+// e1000.txring= and e1000.rxring= parameters or later with
+// e1000_set_ring_sizes().
+#define E1000_RING_MIN         32
+#define E1000_RING_MAX         4096
+#define E1000_RING_ALIGN       8
+#define E1000_TX_RING_DEFAULT  256
+#define E1000_RX_RING_DEFAULT  256
+#define E1000_BUFFER_SIZE      2048   // Matches RCTL.BSIZE (and PBUF_SIZE)
+#define E1000_PBUF_TX_RESERVE  256    // Pool buffers kept for the TX path
+#define E1000_PBUF_JUMBO_RESERVE 64   // Jumbo pool size once the MTU exceeds 1500
+
+// Reclaim attempts while waiting for the TX ring to drain before a resize
+#define E1000_QUIESCE_SPINS    1000000
+// Consecutive RDH reads without movement that count as RX DMA being idle
+#define E1000_RX_IDLE_READS    1000
+
+// Reclaim completed TX descriptors once fewer than this many are free
+#define E1000_TX_RECLAIM_THRESH 8
+
+// RDT is written once this many RX descriptors (or a quarter of the ring)
+// wait to be handed back, and whenever a poll drains the ring
+#define E1000_RDT_BATCH        32
+
+// Interrupt moderation. ITR caps the interrupt rate for all causes; the
+// delay timers hold back RX and TX interrupts to batch more descriptors.
+// Timer values are in microseconds here and in 1.024us units in hardware.
+typedef struct {
+    uint32_t itr;        // Interrupts per second at most, 0 = no throttling
+    uint16_t rdtr;       // RX: wait this long after a frame for another one
+    uint16_t radv;       // RX: but no longer than this after the first one
+    uint16_t tidv;       // TX: same for completions
+    uint16_t tadv;
+    int adaptive;        // Pick itr from the packet rate
+} e1000_moderation_t;
 
-// Descriptor ring sizes
-#define E1000_TX_RING_SIZE 32
-#define E1000_RX_RING_SIZE 32
+// Adaptive mode picks one of three rates once per sample period, by
+// frames per second in both directions
+#define E1000_ITR_LOW_LATENCY  70000
+#define E1000_ITR_DEFAULT      20000
+#define E1000_ITR_BULK         4000
+#define E1000_ITR_LOW_PPS      2000   // Below this: E1000_ITR_LOW_LATENCY
+#define E1000_ITR_BULK_PPS     20000  // Above this: E1000_ITR_BULK
+#define E1000_ITR_SAMPLE_TICKS 10     // Timer ticks per rate sample (100ms)
+#define E1000_DELAY_MAX        65535  // Largest timer value in microseconds
+
+// What e1000_send_packet() does when the TX ring is full
+typedef enum {
+    E1000_TX_FAIL = 0,   // Return -1 immediately
+    E1000_TX_SPIN,       // Reclaim and retry up to tx_spin_budget times
+    E1000_TX_QUEUE       // Copy to a software queue, sent on TX completion
+} e1000_tx_policy_t;
+
+#define E1000_TX_SPIN_DEFAULT 1000000
+#define E1000_TX_SWQ_SIZE     64     // Frames held by the software queue
 
 // Transmit descriptor
 typedef struct {
@@ -118,6 +215,20 @@ typedef struct {
     uint16_t special;
 } __attribute__((packed)) e1000_tx_desc_t;
 
+// Transmit context descriptor (checksum offload offsets)
+typedef struct {
+    uint8_t ipcss;            // IP checksum start
+    uint8_t ipcso;            // IP checksum offset
+    uint16_t ipcse;           // IP checksum end (inclusive)
+    uint8_t tucss;            // TCP/UDP checksum start
+    uint8_t tucso;            // TCP/UDP checksum offset
+    uint16_t tucse;           // TCP/UDP checksum end (0 = end of packet)
+    uint32_t cmd_and_length;
+    uint8_t status;
+    uint8_t hdr_len;
+    uint16_t mss;
+} __attribute__((packed)) e1000_tx_context_desc_t;
+
 // Receive descriptor
 typedef struct {
     uint64_t buffer_addr;
@@ -128,6 +239,19 @@ typedef struct {
     uint16_t special;
 } __attribute__((packed)) e1000_rx_desc_t;
 
+// One piece of a frame for e1000_send_sg()
+typedef netdev_sg_t e1000_sg_t;
+
+#define E1000_SG_MAX        NETDEV_SG_MAX
+#define E1000_TX_COPYBREAK  256   // Shorter by_ref segments are copied anyway
+
+// Frame descriptor for the burst calls
+typedef struct {
+    void* data;       // TX: frame to send, RX: destination buffer
+    size_t length;    // TX: frame length, RX: set to the received length
+    size_t size;      // RX: buffer capacity
+} e1000_frame_t;
+
 // E1000 device structure
 typedef struct {
     uint32_t io_base;        // I/O base address (if I/O mapped)
@@ -136,29 +260,100 @@ typedef struct {
     int initialized;
     mac_address_t mac_address;
     
-    // Transmit descriptors
+    // Transmit descriptors (rings and buffers come from fs_allocate_aligned)
     e1000_tx_desc_t* tx_descriptors;
-    void* tx_buffers[E1000_TX_RING_SIZE];
+    uint8_t* tx_buffers;          // tx_ring_size buffers of E1000_BUFFER_SIZE
+    pbuf_t** tx_pbufs;            // pbuf to free when the descriptor completes
+    uint16_t tx_ring_size;
     uint16_t tx_head;
     uint16_t tx_tail;
+    uint16_t tx_tail_hw;          // Last value written to TDT
+    int tx_hold;                  // e1000_tx_hold() depth, defers TDT writes
     
     // Receive descriptors
     e1000_rx_desc_t* rx_descriptors;
-    void* rx_buffers[E1000_RX_RING_SIZE];
+    pbuf_t** rx_pbufs;            // Buffer behind each RX descriptor
+    uint16_t rx_ring_size;
     uint16_t rx_head;
-    uint16_t rx_tail;
+    uint16_t rx_tail;             // Last descriptor consumed
+    uint16_t rx_tail_hw;          // Last value written to RDT
+
+    // Full ring handling
+    e1000_tx_policy_t tx_policy;
+    uint32_t tx_spin_budget;
+    uint16_t swq_head;            // Software queue (E1000_TX_QUEUE)
+    uint16_t swq_count;
+    uint32_t stat_tx_ring_full;   // Sends that found the ring full
+    uint32_t stat_tx_reclaimed;
+    uint32_t stat_tx_queued;
+    uint32_t stat_tx_dropped;
+    uint32_t stat_tx_doorbells;   // TDT writes
+    uint32_t stat_tx_frames;
+    uint32_t stat_tx_sg_refs;     // Segments sent without a copy
+
+    // Checksum offload
+    int csum_offload;             // RXCSUM on and TX context descriptors used
+    int tx_ctx_loaded;            // The IPv4/UDP context is in the hardware
+    uint32_t stat_tx_csum_hw;     // Frames the NIC checksummed
+    uint32_t stat_tx_csum_sw;     // Offload requests done in software instead
+    uint32_t stat_rx_csum_ok;     // Frames the NIC verified
+    uint32_t stat_rx_csum_bad;
+    uint32_t stat_rx_csum_none;   // Frames left for the stack to check
+    uint32_t stat_rx_doorbells;   // RDT writes
+    uint32_t stat_rx_frames;
+    uint32_t stat_rx_loaned;      // Frames handed up without a copy
+    uint32_t stat_rx_loan_starved; // Frames left in the ring, pbuf pool empty
+    uint32_t stat_rx_jumbo;       // Frames that spanned several RX descriptors
+    uint32_t stat_rx_oversize;    // Dropped, longer than frame_max
+
+    // Frame size. Above 1500 RCTL.LPE is set; received jumbo frames span
+    // several 2KB descriptors and are reassembled into a jumbo pbuf.
+    uint16_t mtu;
+    uint16_t frame_max;           // ETH_FRAME_SIZE(mtu)
+
+    // Receive filtering: our address in RAL/RAH[0], joined groups in the MTA
+    int promisc;                  // UPE/MPE set, every frame is delivered
+    mac_address_t mcast_addrs[E1000_MCAST_MAX];
+    uint8_t mcast_refs[E1000_MCAST_MAX]; // 0 = free slot
+    int mcast_count;
+
+    // Interrupt state: the ISR masks the device and leaves the work to
+    // e1000_poll_pending()/e1000_poll_complete() in the main loop
+    uint8_t irq;
+    int irq_enabled;              // 0 = no usable IRQ line, always polled
+    int msi_vector;               // Exclusive MSI vector, -1 on the INTx line
+    volatile int poll_pending;
+    volatile int link_up;
+    uint32_t stat_irqs;
+    uint32_t stat_polls;
+    uint32_t stat_budget_exhausted;
+
+    // Interrupt moderation
+    e1000_moderation_t moderation;
+    uint32_t itr_current;         // Rate in ITR now (differs from moderation.itr if adaptive)
+    uint8_t txd_ide;              // E1000_TXD_CMD_IDE when TX delays are set
+    uint64_t itr_sample_tick;
+    uint32_t itr_sample_frames;
+    uint32_t stat_itr_changes;    // Adaptive rate switches
 } e1000_device_t;
 
 // Initialize e1000 device
 int e1000_init(pci_device_t* pci_dev);
 
+// Register accesses so far. Under QEMU/KVM each one traps to the
+// hypervisor, so the datapath keeps them to doorbells and interrupt
+// handling and reads only descriptor memory otherwise.
+extern uint32_t e1000_mmio_accesses;
+
 // Read from e1000 register
 static inline uint32_t e1000_read_reg(volatile uint32_t* mmio_base, uint16_t offset) {
+    e1000_mmio_accesses++;
     return mmio_base[offset / 4];
 }
 
 // Write to e1000 register
 static inline void e1000_write_reg(volatile uint32_t* mmio_base, uint16_t offset, uint32_t value) {
+    e1000_mmio_accesses++;
     mmio_base[offset / 4] = value;
 }
 
@@ -171,5 +366,85 @@ int e1000_send_packet(const void* data, size_t length);
 // Receive a packet
 int e1000_receive_packet(void* buffer, size_t buffer_size);
 
+// Send up to n frames with one TDT write, returns frames accepted
+int e1000_send_burst(const e1000_frame_t* frames, int n);
+
+// Receive up to n frames with one RDT write, returns frames received
+int e1000_receive_burst(e1000_frame_t* bufs, int n);
+
+// Receive up to n frames without copying. The pbufs that held them are
+// swapped out of the ring and handed over; release them with pbuf_free().
+int e1000_receive_loan(pbuf_t** pkts, int n);
+
+// Send a frame straight from a pbuf, taking over the caller's reference.
+// PBUF_CSUM_TX_* flags are done in hardware, or in software if offload is off.
+int e1000_send_pbuf(pbuf_t* p);
+
+// True if the NIC inserts checksums for Ethernet/IPv4 (IHL 5)/UDP frames
+int e1000_csum_offload(void);
+
+// Turn RX and TX checksum offload on or off
+void e1000_set_csum_offload(int enable);
+
+// Deliver every unicast and multicast frame on the segment (for capture).
+// Off by default: only our address, broadcast and joined groups pass.
+void e1000_set_promisc(int enable);
+
+// Receive a multicast group. Joins are counted, each needs a matching leave.
+// Returns 0 on success, -1 if the address is not multicast or the table is full.
+int e1000_mcast_join(const mac_address_t* mac);
+int e1000_mcast_leave(const mac_address_t* mac);
+
+// True if mac is a group we joined. The MTA is a hash filter, so frames of
+// other groups can still get through and need this exact check.
+int e1000_mcast_member(const mac_address_t* mac);
+
+// Program interrupt moderation (values are clamped to what the hardware
+// can hold) and read back the current settings
+void e1000_set_moderation(const e1000_moderation_t* mod);
+void e1000_get_moderation(e1000_moderation_t* mod);
+
+// Change the MTU (ETH_MTU_MIN to ETH_MTU_MAX). Waits for queued frames to
+// go out first. Returns -1 if the size is out of range or the jumbo pool
+// cannot be filled.
+int e1000_set_mtu(uint32_t mtu);
+
+// Send one frame from a gather list, one descriptor per referenced segment.
+// Memory of by_ref segments must stay unchanged until the descriptors
+// complete (see e1000_tx_flush()). Returns 0 on success, -1 on error.
+// csum is a set of PBUF_CSUM_TX_* flags and requires e1000_csum_offload().
+int e1000_send_sg(const e1000_sg_t* segs, int nsegs, uint8_t csum);
+
+// Wait until the hardware finished every queued descriptor
+int e1000_tx_flush(void);
+
+// Hold TX doorbells while sending a run of frames: TDT is written when the
+// hold is released (or a quarter of the ring is waiting), so the run costs
+// one register write instead of one per frame. Holds nest.
+void e1000_tx_hold(int hold);
+
+// Return descriptors the hardware finished with (DD set) to the ring and
+// move queued frames into the freed slots. Returns descriptors reclaimed.
+int e1000_tx_reclaim(void);
+
+// Select the full ring policy. spin_budget applies to E1000_TX_SPIN (0 = default).
+void e1000_set_tx_policy(e1000_tx_policy_t policy, uint32_t spin_budget);
+
+// Quiesce the device and rebuild both rings with new sizes (rounded and
+// clamped to E1000_RING_MIN..E1000_RING_MAX). Frames still in the old RX
+// ring are dropped. Returns -1 if memory runs out or the NIC does not go
+// idle (TX ring not drained, RX DMA still moving); the old rings stay.
+int e1000_set_ring_sizes(uint32_t tx_size, uint32_t rx_size);
+
+// True if an interrupt (or polled mode) left work for the poll loop
+int e1000_poll_pending(void);
+
+// End a poll. 'drained' = the RX ring was emptied within the budget, in
+// which case interrupts are unmasked again; otherwise polling continues.
+void e1000_poll_complete(int drained);
+
+// The calls above as a network stack driver
+extern const netdev_ops_t e1000_netdev_ops;
+
 #endif // E1000_H
 
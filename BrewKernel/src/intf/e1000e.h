@@ -0,0 +1,178 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef E1000E_H
+#define E1000E_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pci.h"
+#include "network.h"
+#include "pbuf.h"
+#include "netdev.h"
+#include "e1000.h"
+
+// Intel 82574L (QEMU: -device e1000e). Registers and TX descriptors are
+// those of the 82540EM in e1000.h. On top it has two RX queues filled by
+// receive side scaling and MSI-X, which gives every queue a vector of its
+// own: RX queue 0, RX queue 1, TX queue 0 and link events are serviced
+// independently and never share a line.
+#define E1000E_DEVICE_ID_82574L 0x10D3
+
+// Registers beyond the 82540EM set
+#define E1000E_REG_EIAC     0x00DC  // Causes cleared in ICR when their vector fires
+#define E1000E_REG_IAM      0x00E0  // Causes masked when their vector fires (with EIAME)
+#define E1000E_REG_IVAR     0x00E4  // Cause to MSI-X entry mapping
+#define E1000E_REG_EITR(n)  (0x00E8 + (n) * 4)  // Per-vector throttling
+#define E1000E_REG_RFCTL    0x5008  // Receive filter control
+#define E1000E_REG_MRQC     0x5818  // Multiple receive queues command
+#define E1000E_REG_RETA     0x5C00  // Redirection table, 128 one-byte entries
+#define E1000E_REG_RSSRK    0x5C80  // RSS hash key, 10 dwords
+
+// RX queue n has the RDBAL..RDT block of queue 0 moved by n * stride
+#define E1000E_RXQ_REG(reg, n)  ((uint16_t)((reg) + (n) * 0x100))
+
+#define E1000E_CTRL_EXT_EIAME   (1u << 24)  // A vector firing masks its causes set in IAM
+#define E1000E_CTRL_EXT_PBA_CLR (1u << 31)  // Clear pending bits on MSI-X clear
+
+#define E1000E_RFCTL_EXTEN      (1u << 15)  // Extended RX descriptors
+#define E1000E_RXCSUM_PCSD      (1u << 13)  // RSS hash instead of packet checksum
+#define E1000E_RCTL_BSIZE_2048  0           // BSIZE 00, BSEX 0
+
+#define E1000E_MRQC_RSS         0x1         // Multiple receive queues by RSS
+#define E1000E_MRQC_TCPIPV4     (1u << 16)  // Hash addresses and ports of TCP/IPv4
+#define E1000E_MRQC_IPV4        (1u << 17)  // Hash addresses of other IPv4
+#define E1000E_RETA_ENTRIES     128
+#define E1000E_RETA_QUEUE1      0x80        // Entry bit 7 selects the queue
+
+// Interrupt causes reported per queue in MSI-X mode
+#define E1000E_ICR_RXQ0         (1u << 20)
+#define E1000E_ICR_RXQ1         (1u << 21)
+#define E1000E_ICR_TXQ0         (1u << 22)
+#define E1000E_ICR_TXQ1         (1u << 23)
+#define E1000E_ICR_OTHER        (1u << 24)
+
+// IVAR: a 4-bit field per cause, bit 3 valid, bits 2:0 the MSI-X entry
+#define E1000E_IVAR_VALID       0x8
+#define E1000E_IVAR_RXQ0(e)     ((uint32_t)(E1000E_IVAR_VALID | (e)) << 0)
+#define E1000E_IVAR_RXQ1(e)     ((uint32_t)(E1000E_IVAR_VALID | (e)) << 4)
+#define E1000E_IVAR_TXQ0(e)     ((uint32_t)(E1000E_IVAR_VALID | (e)) << 8)
+#define E1000E_IVAR_OTHER(e)    ((uint32_t)(E1000E_IVAR_VALID | (e)) << 16)
+
+// MSI-X table entries used by the driver
+#define E1000E_MSIX_RXQ0        0
+#define E1000E_MSIX_RXQ1        1
+#define E1000E_MSIX_TXQ0        2
+#define E1000E_MSIX_OTHER       3
+#define E1000E_MSIX_VECTORS     4
+
+// Extended RX descriptor status (low bits) and errors (high byte)
+#define E1000E_RXD_STAT_DD      (1u << 0)
+#define E1000E_RXD_STAT_EOP     (1u << 1)
+#define E1000E_RXD_ERRORS(se)   ((uint8_t)((se) >> 24))  // Same bits as legacy errors
+
+#define E1000E_RX_QUEUES        2
+#define E1000E_RING_DEFAULT     256
+#define E1000E_ITR_DEFAULT      20000   // Interrupts per second per vector
+#define E1000E_PBUF_TX_RESERVE  256
+
+// Extended RX descriptor. The driver writes the read format; the NIC
+// overwrites it with the write-back format once it stored a frame.
+typedef union {
+    struct {
+        uint64_t buffer_addr;
+        uint64_t reserved;        // Must be 0 (DD lives here after write-back)
+    } read;
+    struct {
+        uint32_t mrq;             // RSS type and queue
+        uint32_t rss;             // RSS hash
+        uint32_t status_error;
+        uint16_t length;
+        uint16_t vlan;
+    } wb;
+} __attribute__((packed)) e1000e_rx_desc_t;
+
+typedef struct {
+    e1000e_rx_desc_t* descriptors;
+    pbuf_t** pbufs;               // Buffer behind each descriptor
+    uint16_t size;
+    uint16_t tail;                // Last descriptor consumed
+    uint16_t tail_hw;             // Last value written to RDT
+    int vector;                   // CPU vector, -1 when sharing the INTx line
+    volatile int pending;         // Interrupt fired, poll loop has not drained it yet
+    uint32_t stat_frames;
+    uint32_t stat_doorbells;
+    uint32_t stat_starved;        // Frames left in the ring, pbuf pool empty
+} e1000e_rx_queue_t;
+
+typedef struct {
+    volatile uint32_t* mmio_base;
+    pci_device_t pci_dev;
+    mac_address_t mac_address;
+
+    // TX queue 0 (same descriptors and slot buffers as the e1000 driver)
+    e1000_tx_desc_t* tx_descriptors;
+    uint8_t* tx_buffers;          // tx_ring_size buffers of E1000_BUFFER_SIZE
+    pbuf_t** tx_pbufs;            // pbuf to free when the descriptor completes
+    uint16_t tx_ring_size;
+    uint16_t tx_head;
+    uint16_t tx_tail;
+    uint16_t tx_tail_hw;
+    int tx_hold;
+    int tx_ctx_loaded;            // The IPv4/UDP checksum context is loaded
+    int tx_vector;
+    volatile int tx_pending;
+
+    e1000e_rx_queue_t rxq[E1000E_RX_QUEUES];
+    int rx_next;                  // Queue served first by the next receive call
+    int rss;                      // Flows are spread over both RX queues
+    int csum_offload;
+
+    // Interrupts: MSI-X vectors, or the INTx line if MSI-X or the local
+    // APIC is missing (then everything is serviced together)
+    int msix;
+    pci_msix_t msix_table;
+    int other_vector;
+    uint8_t irq;
+    int irq_enabled;
+    uint32_t itr;
+    volatile int link_up;
+
+    uint32_t stat_irqs;           // INTx interrupts and link events
+    uint32_t stat_polls;
+    uint32_t stat_tx_frames;
+    uint32_t stat_tx_doorbells;
+    uint32_t stat_tx_reclaimed;
+    uint32_t stat_tx_ring_full;
+    uint32_t stat_tx_dropped;
+    uint32_t stat_tx_sg_refs;
+    uint32_t stat_tx_csum_hw;
+    uint32_t stat_rx_csum_ok;
+    uint32_t stat_rx_csum_bad;
+    uint32_t stat_rx_dropped;     // Frames that did not fit one buffer
+} e1000e_device_t;
+
+// Find an 82574L and bring it up. Returns 0 on success.
+int e1000e_init(void);
+
+// Device state, or NULL if no 82574L is running
+e1000e_device_t* e1000e_get_device(void);
+
+extern const netdev_ops_t e1000e_netdev_ops;
+
+#endif // E1000E_H
@@ -0,0 +1,1263 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fat32.h"
+#include "block.h"
+#include "bcache.h"
+#include "memory.h"
+#include "print.h"
+#include "rtc.h"
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+    block_device_t* dev;
+    uint64_t part_lba;           // Start of the volume on the device
+    uint32_t sectors_per_cluster;
+    uint32_t cluster_size;       // Bytes
+    uint64_t fat_lba;            // First FAT copy
+    uint32_t fat_sectors;        // Sectors per FAT copy
+    uint32_t num_fats;
+    uint64_t data_lba;           // Cluster 2
+    uint32_t root_cluster;
+    uint32_t cluster_count;      // Valid clusters are 2 .. cluster_count + 1
+    uint64_t fsinfo_lba;         // 0 if there is no FSInfo sector
+    uint32_t* fat;               // In-memory FAT
+    uint8_t* fat_dirty;          // One flag per FAT sector
+    uint32_t free_clusters;
+    uint32_t next_free;
+} fat32_volume_t;
+
+// Cached cluster chain as a list of contiguous runs
+typedef struct {
+    uint32_t file_cluster;       // Index of the first cluster of the run in the chain
+    uint32_t disk_cluster;
+    uint32_t length;
+} fat32_extent_t;
+
+typedef struct {
+    uint32_t first_cluster;      // 0 = slot unused
+    uint32_t count;
+    uint32_t total_clusters;     // Clusters covered by the runs
+    int complete;                // Runs cover the whole chain
+    uint32_t lru;
+    fat32_extent_t ext[FAT32_MAX_EXTENTS];
+} fat32_extent_map_t;
+
+// Directory entry as seen through the name index
+typedef struct {
+    char name[FAT32_NAME_MAX];
+    uint8_t sfn[11];
+    uint8_t attr;
+    uint32_t first_cluster;
+    uint32_t size;
+    uint32_t entry_index;
+    uint32_t lfn_count;
+    int hash_next;
+} fat32_index_entry_t;
+
+typedef struct {
+    uint32_t dir_cluster;        // 0 = slot unused
+    uint32_t lru;
+    int count;
+    int capacity;
+    fat32_index_entry_t* entries;
+    int buckets[FAT32_DIR_HASH];
+} fat32_dir_index_t;
+
+static fat32_volume_t vol;
+static int fat32_mounted = 0;
+static fat32_extent_map_t extent_cache[FAT32_EXTENT_CACHE];
+static fat32_dir_index_t dir_cache[FAT32_DIR_CACHE];
+static uint32_t fat32_lru_clock = 0;
+static fat32_stats_t fat32_stats;
+
+// Bounce buffer for transfers from unaligned caller memory
+#define FAT32_BOUNCE_SECTORS 128
+static uint8_t fat32_bounce[FAT32_BOUNCE_SECTORS * BLOCK_SECTOR_SIZE] __attribute__((aligned(16)));
+static uint8_t fat32_sector[BLOCK_SECTOR_SIZE] __attribute__((aligned(16)));
+
+static void fat_memcpy(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    while (n--) *d++ = *s++;
+}
+
+static void fat_memset(void* dest, int val, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    while (n--) *d++ = (uint8_t)val;
+}
+
+static int fat_memcmp(const void* a, const void* b, size_t n) {
+    const uint8_t* x = (const uint8_t*)a;
+    const uint8_t* y = (const uint8_t*)b;
+    for (size_t i = 0; i < n; i++) {
+        if (x[i] != y[i]) return x[i] - y[i];
+    }
+    return 0;
+}
+
+static size_t fat_strlen(const char* s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static char fat_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c + 32) : c;
+}
+
+static char fat_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - 32) : c;
+}
+
+static int fat_name_equal(const char* a, const char* b) {
+    while (*a && *b) {
+        if (fat_lower(*a) != fat_lower(*b)) return 0;
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static uint32_t fat_name_hash(const char* name) {
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (uint8_t)fat_lower(*name++);
+        h *= 16777619u;
+    }
+    return h % FAT32_DIR_HASH;
+}
+
+static uint64_t fat_cluster_lba(uint32_t cluster) {
+    return vol.data_lba + (uint64_t)(cluster - 2) * vol.sectors_per_cluster;
+}
+
+static int fat_valid_cluster(uint32_t cluster) {
+    return cluster >= 2 && cluster < vol.cluster_count + 2;
+}
+
+static uint32_t fat_get(uint32_t cluster) {
+    return vol.fat[cluster] & FAT32_CLUSTER_MASK;
+}
+
+static void fat_set(uint32_t cluster, uint32_t value) {
+    // The top four bits are reserved and must be preserved
+    vol.fat[cluster] = (vol.fat[cluster] & ~FAT32_CLUSTER_MASK) | (value & FAT32_CLUSTER_MASK);
+    vol.fat_dirty[(cluster * 4) / BLOCK_SECTOR_SIZE] = 1;
+}
+
+// Write sectors, bouncing through an aligned buffer when the source is not
+// suitably aligned for DMA
+static int fat_write_sectors(uint64_t lba, uint32_t count, const void* src) {
+    if (((uintptr_t)src & 3) == 0) {
+        return block_write(vol.dev, lba, count, src);
+    }
+    const uint8_t* p = (const uint8_t*)src;
+    while (count > 0) {
+        uint32_t n = count > FAT32_BOUNCE_SECTORS ? FAT32_BOUNCE_SECTORS : count;
+        fat_memcpy(fat32_bounce, p, (size_t)n * BLOCK_SECTOR_SIZE);
+        if (block_write(vol.dev, lba, n, fat32_bounce) != 0) return -1;
+        lba += n;
+        count -= n;
+        p += (size_t)n * BLOCK_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+// Set the write (and optionally creation) time of an entry to now
+static void fat_stamp(fat32_dirent_t* e, int created) {
+    int year, month, day, hour, minute, second;
+    get_datetime(&year, &month, &day, &hour, &minute, &second);
+    if (year < 1980) year = 1980;
+    uint16_t date = (uint16_t)(((year - 1980) << 9) | (month << 5) | day);
+    uint16_t time = (uint16_t)((hour << 11) | (minute << 5) | (second / 2));
+
+    e->wrt_date = date;
+    e->wrt_time = time;
+    e->lst_acc_date = date;
+    if (created) {
+        e->crt_date = date;
+        e->crt_time = time;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Cluster chain runs
+
+static void fat_extents_invalidate(uint32_t first_cluster) {
+    for (int i = 0; i < FAT32_EXTENT_CACHE; i++) {
+        if (extent_cache[i].first_cluster == first_cluster) {
+            extent_cache[i].first_cluster = 0;
+        }
+    }
+}
+
+static fat32_extent_map_t* fat_get_extents(uint32_t first_cluster) {
+    fat32_extent_map_t* victim = &extent_cache[0];
+    for (int i = 0; i < FAT32_EXTENT_CACHE; i++) {
+        fat32_extent_map_t* map = &extent_cache[i];
+        if (map->first_cluster == first_cluster) {
+            map->lru = ++fat32_lru_clock;
+            fat32_stats.extent_hits++;
+            return map;
+        }
+        if (map->first_cluster == 0 || map->lru < victim->lru) {
+            if (victim->first_cluster != 0) victim = map;
+        }
+    }
+    fat32_stats.extent_misses++;
+
+    // Walk the chain once, merging physically contiguous clusters
+    fat32_extent_map_t* map = victim;
+    map->first_cluster = first_cluster;
+    map->count = 0;
+    map->total_clusters = 0;
+    map->complete = 1;
+    map->lru = ++fat32_lru_clock;
+
+    uint32_t cluster = first_cluster;
+    uint32_t steps = 0;
+    while (fat_valid_cluster(cluster) && steps++ <= vol.cluster_count) {
+        fat32_extent_t* last = map->count ? &map->ext[map->count - 1] : NULL;
+        if (last && last->disk_cluster + last->length == cluster) {
+            last->length++;
+        } else {
+            if (map->count == FAT32_MAX_EXTENTS) {
+                map->complete = 0;  // Too fragmented, the rest is walked on demand
+                break;
+            }
+            map->ext[map->count].file_cluster = map->total_clusters;
+            map->ext[map->count].disk_cluster = cluster;
+            map->ext[map->count].length = 1;
+            map->count++;
+        }
+        map->total_clusters++;
+        uint32_t next = fat_get(cluster);
+        if (next >= FAT32_EOC) break;
+        cluster = next;
+    }
+    return map;
+}
+
+// Map cluster number 'index' of a chain to a disk cluster. *run receives the
+// number of physically contiguous clusters starting there. Returns 0 past the end.
+static uint32_t fat_map_cluster(uint32_t first_cluster, uint32_t index, uint32_t* run) {
+    if (!fat_valid_cluster(first_cluster)) return 0;
+
+    fat32_extent_map_t* map = fat_get_extents(first_cluster);
+    for (uint32_t i = 0; i < map->count; i++) {
+        fat32_extent_t* e = &map->ext[i];
+        if (index >= e->file_cluster && index < e->file_cluster + e->length) {
+            if (run) *run = e->length - (index - e->file_cluster);
+            return e->disk_cluster + (index - e->file_cluster);
+        }
+    }
+    if (map->complete || map->count == 0) return 0;
+
+    // Beyond the cached runs: continue walking from the last known cluster
+    fat32_extent_t* last = &map->ext[map->count - 1];
+    uint32_t cluster = last->disk_cluster + last->length - 1;
+    uint32_t pos = last->file_cluster + last->length - 1;
+    while (pos < index) {
+        uint32_t next = fat_get(cluster);
+        if (next >= FAT32_EOC || !fat_valid_cluster(next)) return 0;
+        cluster = next;
+        pos++;
+    }
+    if (run) *run = 1;
+    return cluster;
+}
+
+static void fat_free_chain(uint32_t first_cluster) {
+    fat_extents_invalidate(first_cluster);
+    uint32_t cluster = first_cluster;
+    uint32_t steps = 0;
+    while (fat_valid_cluster(cluster) && steps++ <= vol.cluster_count) {
+        uint32_t next = fat_get(cluster);
+        fat_set(cluster, 0);
+        vol.free_clusters++;
+        if (cluster < vol.next_free) vol.next_free = cluster;
+        if (next >= FAT32_EOC) break;
+        cluster = next;
+    }
+}
+
+// Allocate and link 'count' clusters, preferring a contiguous run
+static uint32_t fat_alloc_chain(uint32_t count) {
+    if (count == 0 || count > vol.free_clusters) return 0;
+
+    uint32_t first = 0;
+    uint32_t prev = 0;
+    uint32_t cluster = vol.next_free;
+    uint32_t scanned = 0;
+
+    while (count > 0 && scanned < vol.cluster_count) {
+        if (!fat_valid_cluster(cluster)) cluster = 2;
+        if (fat_get(cluster) == 0) {
+            fat_set(cluster, FAT32_EOC_MARK);
+            if (prev) {
+                fat_set(prev, cluster);
+            } else {
+                first = cluster;
+            }
+            prev = cluster;
+            vol.free_clusters--;
+            count--;
+        }
+        cluster++;
+        scanned++;
+    }
+    vol.next_free = cluster;
+
+    if (count > 0) {
+        if (first) fat_free_chain(first);
+        return 0;
+    }
+    return first;
+}
+
+// ---------------------------------------------------------------------------
+// Directories
+
+static int fat_dir_entry_loc(uint32_t dir_cluster, uint32_t index, uint64_t* lba, uint32_t* offset) {
+    uint32_t per_cluster = vol.cluster_size / sizeof(fat32_dirent_t);
+    uint32_t cluster = fat_map_cluster(dir_cluster, index / per_cluster, NULL);
+    if (!cluster) return -1;
+
+    uint32_t byte = (index % per_cluster) * sizeof(fat32_dirent_t);
+    *lba = fat_cluster_lba(cluster) + byte / BLOCK_SECTOR_SIZE;
+    *offset = byte % BLOCK_SECTOR_SIZE;
+    return 0;
+}
+
+static int fat_dir_write_entry(uint32_t dir_cluster, uint32_t index, const void* entry) {
+    uint64_t lba;
+    uint32_t offset;
+    if (fat_dir_entry_loc(dir_cluster, index, &lba, &offset) != 0) return -1;
+
+    bcache_buf_t* buf = bcache_get(vol.dev, lba);
+    if (!buf) return -1;
+    fat_memcpy(buf->data + offset, entry, sizeof(fat32_dirent_t));
+    bcache_mark_dirty(buf);
+    bcache_release(buf);
+    return 0;
+}
+
+static void fat_format_sfn(const fat32_dirent_t* e, char* out) {
+    int pos = 0;
+    for (int i = 0; i < 8 && e->name[i] != ' '; i++) {
+        char c = (char)e->name[i];
+        if (i == 0 && (uint8_t)c == 0x05) c = (char)0xE5;
+        out[pos++] = (e->ntres & 0x08) ? fat_lower(c) : c;
+    }
+    if (e->name[8] != ' ') {
+        out[pos++] = '.';
+        for (int i = 8; i < 11 && e->name[i] != ' '; i++) {
+            out[pos++] = (e->ntres & 0x10) ? fat_lower((char)e->name[i]) : (char)e->name[i];
+        }
+    }
+    out[pos] = '\0';
+}
+
+static uint8_t fat_lfn_checksum(const uint8_t* sfn) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + sfn[i]);
+    }
+    return sum;
+}
+
+static void fat_dir_index_drop(fat32_dir_index_t* idx) {
+    if (idx->entries) fs_free(idx->entries);
+    idx->entries = NULL;
+    idx->count = 0;
+    idx->capacity = 0;
+    idx->dir_cluster = 0;
+}
+
+static void fat_dir_invalidate(uint32_t dir_cluster) {
+    for (int i = 0; i < FAT32_DIR_CACHE; i++) {
+        if (dir_cache[i].dir_cluster == dir_cluster) {
+            fat_dir_index_drop(&dir_cache[i]);
+        }
+    }
+}
+
+static int fat_dir_index_add(fat32_dir_index_t* idx, const fat32_index_entry_t* entry) {
+    if (idx->count == idx->capacity) {
+        int capacity = idx->capacity ? idx->capacity * 2 : 32;
+        fat32_index_entry_t* grown = (fat32_index_entry_t*)fs_allocate(sizeof(fat32_index_entry_t) * capacity);
+        if (!grown) return -1;
+        if (idx->entries) {
+            fat_memcpy(grown, idx->entries, sizeof(fat32_index_entry_t) * idx->count);
+            fs_free(idx->entries);
+        }
+        idx->entries = grown;
+        idx->capacity = capacity;
+    }
+
+    fat32_index_entry_t* e = &idx->entries[idx->count];
+    *e = *entry;
+    uint32_t bucket = fat_name_hash(e->name);
+    e->hash_next = idx->buckets[bucket];
+    idx->buckets[bucket] = idx->count;
+    idx->count++;
+    return 0;
+}
+
+// Scan a directory once and build its hashed name index
+static fat32_dir_index_t* fat_dir_index(uint32_t dir_cluster) {
+    fat32_dir_index_t* victim = &dir_cache[0];
+    for (int i = 0; i < FAT32_DIR_CACHE; i++) {
+        fat32_dir_index_t* idx = &dir_cache[i];
+        if (idx->dir_cluster == dir_cluster) {
+            idx->lru = ++fat32_lru_clock;
+            fat32_stats.dir_index_hits++;
+            return idx;
+        }
+        if (idx->dir_cluster == 0 || idx->lru < victim->lru) {
+            if (victim->dir_cluster != 0) victim = idx;
+        }
+    }
+
+    fat32_dir_index_t* idx = victim;
+    fat_dir_index_drop(idx);
+    for (int i = 0; i < FAT32_DIR_HASH; i++) {
+        idx->buckets[i] = -1;
+    }
+    fat32_stats.dir_index_builds++;
+
+    char lfn[FAT32_NAME_MAX];
+    int lfn_valid = 0;
+    uint32_t lfn_count = 0;
+    uint8_t lfn_sum = 0;
+    bcache_buf_t* buf = NULL;
+    uint64_t buf_lba = 0;
+
+    for (uint32_t i = 0; ; i++) {
+        uint64_t lba;
+        uint32_t offset;
+        if (fat_dir_entry_loc(dir_cluster, i, &lba, &offset) != 0) break;
+
+        if (!buf || buf_lba != lba) {
+            if (buf) bcache_release(buf);
+            buf = bcache_get(vol.dev, lba);
+            buf_lba = lba;
+            if (!buf) break;
+        }
+
+        fat32_dirent_t* e = (fat32_dirent_t*)(buf->data + offset);
+        if (e->name[0] == 0x00) break;  // End of directory
+        if (e->name[0] == 0xE5) {
+            lfn_valid = 0;
+            continue;
+        }
+
+        if (e->attr == FAT32_ATTR_LFN) {
+            fat32_lfn_t* l = (fat32_lfn_t*)e;
+            int ord = l->ord & 0x3F;
+            if (l->ord & 0x40) {
+                fat_memset(lfn, 0, sizeof(lfn));
+                lfn_valid = 1;
+                lfn_count = 0;
+                lfn_sum = l->checksum;
+            }
+            if (!lfn_valid || ord < 1 || ord > 20 || l->checksum != lfn_sum) {
+                lfn_valid = 0;
+                continue;
+            }
+            uint16_t chars[13];
+            fat_memcpy(&chars[0], l->name1, sizeof(l->name1));
+            fat_memcpy(&chars[5], l->name2, sizeof(l->name2));
+            fat_memcpy(&chars[11], l->name3, sizeof(l->name3));
+            for (int c = 0; c < 13; c++) {
+                int pos = (ord - 1) * 13 + c;
+                if (chars[c] == 0x0000 || chars[c] == 0xFFFF || pos >= FAT32_NAME_MAX - 1) break;
+                lfn[pos] = (chars[c] < 0x80) ? (char)chars[c] : '?';
+            }
+            lfn_count++;
+            continue;
+        }
+
+        if (e->attr & FAT32_ATTR_VOLUME_ID) {
+            lfn_valid = 0;
+            continue;
+        }
+
+        fat32_index_entry_t entry;
+        if (lfn_valid && fat_lfn_checksum(e->name) == lfn_sum) {
+            fat_memcpy(entry.name, lfn, sizeof(lfn));
+            entry.lfn_count = lfn_count;
+        } else {
+            fat_format_sfn(e, entry.name);
+            entry.lfn_count = 0;
+        }
+        lfn_valid = 0;
+
+        if ((entry.name[0] == '.' && entry.name[1] == '\0') ||
+            (entry.name[0] == '.' && entry.name[1] == '.' && entry.name[2] == '\0')) {
+            continue;
+        }
+
+        fat_memcpy(entry.sfn, e->name, 11);
+        entry.attr = e->attr;
+        entry.first_cluster = ((uint32_t)e->fst_clus_hi << 16) | e->fst_clus_lo;
+        entry.size = e->file_size;
+        entry.entry_index = i;
+        if (fat_dir_index_add(idx, &entry) != 0) break;
+    }
+    if (buf) bcache_release(buf);
+
+    idx->dir_cluster = dir_cluster;
+    idx->lru = ++fat32_lru_clock;
+    return idx;
+}
+
+static fat32_index_entry_t* fat_dir_find(fat32_dir_index_t* idx, const char* name) {
+    int i = idx->buckets[fat_name_hash(name)];
+    while (i >= 0) {
+        if (fat_name_equal(idx->entries[i].name, name)) {
+            return &idx->entries[i];
+        }
+        i = idx->entries[i].hash_next;
+    }
+    return NULL;
+}
+
+// Resolve a path; the root directory is reported with dir_cluster 0
+int fat32_lookup(const char* path, fat32_node_t* node) {
+    if (!fat32_mounted || !path || !node) return -1;
+
+    node->first_cluster = vol.root_cluster;
+    node->size = 0;
+    node->attr = FAT32_ATTR_DIRECTORY;
+    node->dir_cluster = 0;
+    node->entry_index = 0;
+    node->lfn_count = 0;
+
+    char component[FAT32_NAME_MAX];
+    const char* p = path;
+    while (*p) {
+        while (*p == '/') p++;
+        if (!*p) break;
+
+        size_t len = 0;
+        while (*p && *p != '/') {
+            if (len < sizeof(component) - 1) component[len++] = *p;
+            p++;
+        }
+        component[len] = '\0';
+        if (len == 1 && component[0] == '.') continue;
+
+        if (!(node->attr & FAT32_ATTR_DIRECTORY)) return -1;
+
+        fat32_dir_index_t* idx = fat_dir_index(node->first_cluster);
+        fat32_index_entry_t* e = fat_dir_find(idx, component);
+        if (!e) return -1;
+
+        node->dir_cluster = node->first_cluster;
+        node->first_cluster = e->first_cluster;
+        node->size = e->size;
+        node->attr = e->attr;
+        node->entry_index = e->entry_index;
+        node->lfn_count = e->lfn_count;
+
+        // ".." entries point to cluster 0 for the root
+        if ((node->attr & FAT32_ATTR_DIRECTORY) && node->first_cluster == 0) {
+            node->first_cluster = vol.root_cluster;
+        }
+    }
+    return 0;
+}
+
+int fat32_is_directory(const char* path) {
+    fat32_node_t node;
+    return fat32_lookup(path, &node) == 0 && (node.attr & FAT32_ATTR_DIRECTORY);
+}
+
+// Split "a/b/name" into the parent directory node and "name"
+static int fat_lookup_parent(const char* path, fat32_node_t* parent, char* name) {
+    size_t len = fat_strlen(path);
+    while (len > 0 && path[len - 1] == '/') len--;
+    size_t start = len;
+    while (start > 0 && path[start - 1] != '/') start--;
+    if (start == len || len - start >= FAT32_NAME_MAX) return -1;
+
+    for (size_t i = start; i < len; i++) {
+        name[i - start] = path[i];
+    }
+    name[len - start] = '\0';
+
+    char parent_path[FAT32_NAME_MAX];
+    if (start >= sizeof(parent_path)) return -1;
+    for (size_t i = 0; i < start; i++) {
+        parent_path[i] = path[i];
+    }
+    parent_path[start] = '\0';
+
+    if (fat32_lookup(parent_path, parent) != 0 || !(parent->attr & FAT32_ATTR_DIRECTORY)) {
+        return -1;
+    }
+    return 0;
+}
+
+static int fat_sfn_char_ok(char c) {
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) return 1;
+    const char* extra = "$%'-_@~`!(){}^#&";
+    for (int i = 0; extra[i]; i++) {
+        if (c == extra[i]) return 1;
+    }
+    return 0;
+}
+
+// Case of the letters in s[0..len): 0 = none, 1 = lower, 2 = upper, 3 = mixed
+static int fat_letter_case(const char* s, size_t len) {
+    int result = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] >= 'a' && s[i] <= 'z') result |= 1;
+        if (s[i] >= 'A' && s[i] <= 'Z') result |= 2;
+    }
+    return result;
+}
+
+// Build the 8.3 name for 'name'. Returns 1 if the 8.3 name represents it
+// exactly (no long name entries needed).
+static int fat_make_sfn(const char* name, uint8_t* sfn, uint8_t* ntres) {
+    size_t len = fat_strlen(name);
+    size_t dot = len;
+    for (size_t i = len; i > 0; i--) {
+        if (name[i - 1] == '.') {
+            dot = i - 1;
+            break;
+        }
+    }
+    if (dot == 0) dot = len;  // Leading dot is part of the base name
+
+    size_t base_len = dot;
+    size_t ext_len = (dot < len) ? len - dot - 1 : 0;
+    const char* ext = name + dot + 1;
+
+    int exact = base_len >= 1 && base_len <= 8 && ext_len <= 3;
+    for (size_t i = 0; exact && i < base_len; i++) {
+        if (!fat_sfn_char_ok(name[i])) exact = 0;
+    }
+    for (size_t i = 0; exact && i < ext_len; i++) {
+        if (!fat_sfn_char_ok(ext[i])) exact = 0;
+    }
+    int base_case = fat_letter_case(name, base_len);
+    int ext_case = fat_letter_case(ext, ext_len);
+    if (base_case == 3 || ext_case == 3) exact = 0;
+
+    fat_memset(sfn, ' ', 11);
+    *ntres = 0;
+
+    int pos = 0;
+    for (size_t i = 0; i < base_len && pos < 8; i++) {
+        char c = name[i];
+        if (c == ' ' || c == '.') continue;
+        sfn[pos++] = (uint8_t)(fat_sfn_char_ok(c) ? fat_upper(c) : '_');
+    }
+    if (pos == 0) sfn[pos++] = '_';
+    pos = 8;
+    for (size_t i = 0; i < ext_len && pos < 11; i++) {
+        char c = ext[i];
+        if (c == ' ') continue;
+        sfn[pos++] = (uint8_t)(fat_sfn_char_ok(c) ? fat_upper(c) : '_');
+    }
+
+    if (exact) {
+        if (base_case == 1) *ntres |= 0x08;
+        if (ext_case == 1) *ntres |= 0x10;
+    }
+    return exact;
+}
+
+static int fat_sfn_in_use(fat32_dir_index_t* idx, const uint8_t* sfn) {
+    for (int i = 0; i < idx->count; i++) {
+        if (fat_memcmp(idx->entries[i].sfn, sfn, 11) == 0) return 1;
+    }
+    return 0;
+}
+
+// Give a lossy 8.3 name a unique "~N" tail
+static int fat_make_unique_sfn(fat32_dir_index_t* idx, uint8_t* sfn) {
+    uint8_t basis[8];
+    fat_memcpy(basis, sfn, 8);
+    int basis_len = 8;
+    while (basis_len > 0 && basis[basis_len - 1] == ' ') basis_len--;
+
+    for (uint32_t n = 1; n < 1000000; n++) {
+        char tail[8];
+        int tail_len = 0;
+        uint32_t v = n;
+        char digits[7];
+        int nd = 0;
+        while (v > 0) {
+            digits[nd++] = (char)('0' + v % 10);
+            v /= 10;
+        }
+        tail[tail_len++] = '~';
+        while (nd > 0) tail[tail_len++] = digits[--nd];
+
+        int keep = basis_len;
+        if (keep > 8 - tail_len) keep = 8 - tail_len;
+        fat_memset(sfn, ' ', 8);
+        fat_memcpy(sfn, basis, keep);
+        fat_memcpy(sfn + keep, tail, tail_len);
+
+        if (!fat_sfn_in_use(idx, sfn)) return 0;
+    }
+    return -1;
+}
+
+// Append a zeroed cluster to a directory chain
+static int fat_dir_extend(uint32_t dir_cluster) {
+    uint32_t cluster = fat_alloc_chain(1);
+    if (!cluster) return -1;
+
+    uint32_t last = dir_cluster;
+    uint32_t steps = 0;
+    while (steps++ <= vol.cluster_count) {
+        uint32_t next = fat_get(last);
+        if (next >= FAT32_EOC || !fat_valid_cluster(next)) break;
+        last = next;
+    }
+    fat_set(last, cluster);
+    fat_extents_invalidate(dir_cluster);
+
+    uint64_t lba = fat_cluster_lba(cluster);
+    for (uint32_t s = 0; s < vol.sectors_per_cluster; s++) {
+        bcache_buf_t* buf = bcache_get(vol.dev, lba + s);
+        if (!buf) return -1;
+        fat_memset(buf->data, 0, BLOCK_SECTOR_SIZE);
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+    }
+    return 0;
+}
+
+// Create a directory entry (with long name entries if needed)
+static int fat_dir_add(uint32_t dir_cluster, const char* name, uint8_t attr,
+                       uint32_t first_cluster, uint32_t size, fat32_node_t* out) {
+    fat32_dir_index_t* idx = fat_dir_index(dir_cluster);
+    if (fat_dir_find(idx, name)) return -1;
+
+    uint8_t sfn[11];
+    uint8_t ntres;
+    int exact = fat_make_sfn(name, sfn, &ntres);
+    if (exact && fat_sfn_in_use(idx, sfn)) exact = 0;
+    if (!exact && fat_make_unique_sfn(idx, sfn) != 0) return -1;
+
+    size_t name_len = fat_strlen(name);
+    uint32_t lfn_entries = exact ? 0 : (uint32_t)((name_len + 12) / 13);
+    uint32_t needed = lfn_entries + 1;
+
+    // Find 'needed' consecutive free entries, growing the directory if necessary
+    uint32_t run_start = 0;
+    uint32_t run_len = 0;
+    uint32_t i = 0;
+    for (;;) {
+        uint64_t lba;
+        uint32_t offset;
+        if (fat_dir_entry_loc(dir_cluster, i, &lba, &offset) != 0) {
+            if (fat_dir_extend(dir_cluster) != 0) return -1;
+            continue;
+        }
+        bcache_buf_t* buf = bcache_get(vol.dev, lba);
+        if (!buf) return -1;
+        uint8_t first = buf->data[offset];
+        bcache_release(buf);
+
+        if (first == 0x00 || first == 0xE5) {
+            if (run_len == 0) run_start = i;
+            run_len++;
+            if (run_len == needed) break;
+        } else {
+            run_len = 0;
+        }
+        i++;
+    }
+
+    uint8_t checksum = fat_lfn_checksum(sfn);
+    for (uint32_t n = 0; n < lfn_entries; n++) {
+        uint32_t ord = lfn_entries - n;  // Stored last part first
+        fat32_lfn_t l;
+        fat_memset(&l, 0, sizeof(l));
+        l.ord = (uint8_t)(ord | (n == 0 ? 0x40 : 0));
+        l.attr = FAT32_ATTR_LFN;
+        l.checksum = checksum;
+
+        uint16_t chars[13];
+        for (int c = 0; c < 13; c++) {
+            size_t pos = (ord - 1) * 13 + c;
+            if (pos < name_len) chars[c] = (uint8_t)name[pos];
+            else if (pos == name_len) chars[c] = 0x0000;
+            else chars[c] = 0xFFFF;
+        }
+        fat_memcpy(l.name1, &chars[0], sizeof(l.name1));
+        fat_memcpy(l.name2, &chars[5], sizeof(l.name2));
+        fat_memcpy(l.name3, &chars[11], sizeof(l.name3));
+
+        if (fat_dir_write_entry(dir_cluster, run_start + n, &l) != 0) return -1;
+    }
+
+    fat32_dirent_t e;
+    fat_memset(&e, 0, sizeof(e));
+    fat_memcpy(e.name, sfn, 11);
+    e.attr = attr;
+    e.ntres = ntres;
+    fat_stamp(&e, 1);
+    e.fst_clus_hi = (uint16_t)(first_cluster >> 16);
+    e.fst_clus_lo = (uint16_t)(first_cluster & 0xFFFF);
+    e.file_size = size;
+
+    uint32_t entry_index = run_start + lfn_entries;
+    if (fat_dir_write_entry(dir_cluster, entry_index, &e) != 0) return -1;
+
+    fat_dir_invalidate(dir_cluster);
+
+    if (out) {
+        out->first_cluster = first_cluster;
+        out->size = size;
+        out->attr = attr;
+        out->dir_cluster = dir_cluster;
+        out->entry_index = entry_index;
+        out->lfn_count = lfn_entries;
+    }
+    return 0;
+}
+
+// Rewrite the cluster and size fields of an existing entry
+static int fat_update_entry(const fat32_node_t* node) {
+    uint64_t lba;
+    uint32_t offset;
+    if (fat_dir_entry_loc(node->dir_cluster, node->entry_index, &lba, &offset) != 0) return -1;
+
+    bcache_buf_t* buf = bcache_get(vol.dev, lba);
+    if (!buf) return -1;
+    fat32_dirent_t* e = (fat32_dirent_t*)(buf->data + offset);
+    e->fst_clus_hi = (uint16_t)(node->first_cluster >> 16);
+    e->fst_clus_lo = (uint16_t)(node->first_cluster & 0xFFFF);
+    e->file_size = node->size;
+    fat_stamp(e, 0);
+    bcache_mark_dirty(buf);
+    bcache_release(buf);
+
+    fat_dir_invalidate(node->dir_cluster);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Public API
+
+int fat32_mount(block_device_t* dev) {
+    if (!dev) return -1;
+    if (fat32_mounted) fat32_unmount();
+
+    uint64_t part_lba = 0;
+    if (block_read(dev, 0, 1, fat32_sector) != 0) return -1;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint8_t* b = fat32_sector;
+        uint16_t bytes_per_sector = (uint16_t)(b[11] | (b[12] << 8));
+        uint8_t spc = b[13];
+        uint16_t fat_size_16 = (uint16_t)(b[22] | (b[23] << 8));
+        uint32_t fat_size_32 = b[36] | (b[37] << 8) | (b[38] << 16) | ((uint32_t)b[39] << 24);
+
+        if (b[510] == 0x55 && b[511] == 0xAA && bytes_per_sector == BLOCK_SECTOR_SIZE &&
+            spc != 0 && (spc & (spc - 1)) == 0 && b[16] != 0 && fat_size_16 == 0 && fat_size_32 != 0) {
+            break;  // FAT32 boot sector
+        }
+        if (attempt == 1 || b[510] != 0x55 || b[511] != 0xAA) return -1;
+
+        // Otherwise look for a FAT32 partition in the MBR
+        part_lba = 0;
+        for (int p = 0; p < 4; p++) {
+            uint8_t* entry = b + 0x1BE + p * 16;
+            if (entry[4] == 0x0B || entry[4] == 0x0C) {
+                part_lba = entry[8] | (entry[9] << 8) | (entry[10] << 16) | ((uint32_t)entry[11] << 24);
+                break;
+            }
+        }
+        if (part_lba == 0 || block_read(dev, part_lba, 1, fat32_sector) != 0) return -1;
+    }
+
+    uint8_t* b = fat32_sector;
+    uint16_t reserved = (uint16_t)(b[14] | (b[15] << 8));
+    uint32_t total_16 = (uint32_t)(b[19] | (b[20] << 8));
+    uint32_t total_32 = b[32] | (b[33] << 8) | (b[34] << 16) | ((uint32_t)b[35] << 24);
+    uint16_t fsinfo = (uint16_t)(b[48] | (b[49] << 8));
+
+    fat_memset(&vol, 0, sizeof(vol));
+    vol.dev = dev;
+    vol.part_lba = part_lba;
+    vol.sectors_per_cluster = b[13];
+    vol.cluster_size = vol.sectors_per_cluster * BLOCK_SECTOR_SIZE;
+    vol.num_fats = b[16];
+    vol.fat_sectors = b[36] | (b[37] << 8) | (b[38] << 16) | ((uint32_t)b[39] << 24);
+    vol.root_cluster = b[44] | (b[45] << 8) | (b[46] << 16) | ((uint32_t)b[47] << 24);
+    vol.fat_lba = part_lba + reserved;
+    vol.data_lba = vol.fat_lba + (uint64_t)vol.num_fats * vol.fat_sectors;
+    vol.fsinfo_lba = (fsinfo != 0 && fsinfo != 0xFFFF) ? part_lba + fsinfo : 0;
+
+    uint32_t total = total_16 ? total_16 : total_32;
+    if (part_lba + total > dev->sector_count || vol.data_lba >= part_lba + total) return -1;
+    vol.cluster_count = (uint32_t)((part_lba + total - vol.data_lba) / vol.sectors_per_cluster);
+    if (vol.cluster_count + 2 > vol.fat_sectors * (BLOCK_SECTOR_SIZE / 4)) {
+        vol.cluster_count = vol.fat_sectors * (BLOCK_SECTOR_SIZE / 4) - 2;
+    }
+    if ((uint64_t)vol.fat_sectors * BLOCK_SECTOR_SIZE > FAT32_MAX_FAT_BYTES) return -1;
+    if (!fat_valid_cluster(vol.root_cluster)) return -1;
+
+    // Load the first FAT copy in one large read
+    vol.fat = (uint32_t*)fs_allocate_aligned((size_t)vol.fat_sectors * BLOCK_SECTOR_SIZE, 16);
+    vol.fat_dirty = (uint8_t*)fs_allocate(vol.fat_sectors);
+    if (!vol.fat || !vol.fat_dirty) {
+        fs_free_aligned(vol.fat);
+        fs_free(vol.fat_dirty);
+        return -1;
+    }
+    if (block_read(dev, vol.fat_lba, vol.fat_sectors, vol.fat) != 0) {
+        fs_free_aligned(vol.fat);
+        fs_free(vol.fat_dirty);
+        return -1;
+    }
+    fat_memset(vol.fat_dirty, 0, vol.fat_sectors);
+
+    vol.free_clusters = 0;
+    vol.next_free = 0;
+    for (uint32_t c = 2; c < vol.cluster_count + 2; c++) {
+        if (fat_get(c) == 0) {
+            if (!vol.next_free) vol.next_free = c;
+            vol.free_clusters++;
+        }
+    }
+    if (!vol.next_free) vol.next_free = 2;
+
+    for (int i = 0; i < FAT32_EXTENT_CACHE; i++) {
+        extent_cache[i].first_cluster = 0;
+        extent_cache[i].lru = 0;
+    }
+    for (int i = 0; i < FAT32_DIR_CACHE; i++) {
+        dir_cache[i].entries = NULL;
+        dir_cache[i].dir_cluster = 0;
+        dir_cache[i].lru = 0;
+    }
+    fat_memset(&fat32_stats, 0, sizeof(fat32_stats));
+
+    fat32_mounted = 1;
+    return 0;
+}
+
+void fat32_unmount(void) {
+    if (!fat32_mounted) return;
+    fat32_sync();
+    for (int i = 0; i < FAT32_DIR_CACHE; i++) {
+        fat_dir_index_drop(&dir_cache[i]);
+    }
+    for (int i = 0; i < FAT32_EXTENT_CACHE; i++) {
+        extent_cache[i].first_cluster = 0;
+    }
+    bcache_invalidate(vol.dev);
+    fs_free_aligned(vol.fat);
+    fs_free(vol.fat_dirty);
+    vol.fat = NULL;
+    vol.fat_dirty = NULL;
+    fat32_mounted = 0;
+}
+
+int fat32_is_mounted(void) {
+    return fat32_mounted;
+}
+
+block_device_t* fat32_get_device(void) {
+    return fat32_mounted ? vol.dev : NULL;
+}
+
+uint64_t fat32_get_free_bytes(void) {
+    return fat32_mounted ? (uint64_t)vol.free_clusters * vol.cluster_size : 0;
+}
+
+void fat32_get_stats(fat32_stats_t* stats) {
+    if (stats) *stats = fat32_stats;
+}
+
+int fat32_list(const char* path) {
+    fat32_node_t node;
+    if (fat32_lookup(path, &node) != 0 || !(node.attr & FAT32_ATTR_DIRECTORY)) {
+        return -1;
+    }
+
+    fat32_dir_index_t* idx = fat_dir_index(node.first_cluster);
+    if (idx->count == 0) {
+        brew_str("Directory is empty\n");
+        return 0;
+    }
+    for (int i = 0; i < idx->count; i++) {
+        fat32_index_entry_t* e = &idx->entries[i];
+        if (e->attr & (FAT32_ATTR_HIDDEN | FAT32_ATTR_SYSTEM)) continue;
+        brew_str((e->attr & FAT32_ATTR_DIRECTORY) ? "[DIR]  " : "[FILE] ");
+        brew_str(e->name);
+        brew_str("\n");
+    }
+    return 0;
+}
+
+char* fat32_read_file(const char* path, size_t* size) {
+    fat32_node_t node;
+    if (!size || fat32_lookup(path, &node) != 0 || (node.attr & FAT32_ATTR_DIRECTORY)) {
+        return NULL;
+    }
+
+    // Round up to whole clusters so every run is read straight into the buffer
+    uint32_t clusters = (node.size + vol.cluster_size - 1) / vol.cluster_size;
+    size_t alloc = (size_t)clusters * vol.cluster_size;
+    char* data = (char*)fs_allocate(alloc ? alloc : 1);
+    if (!data) return NULL;
+
+    uint32_t index = 0;
+    while (index < clusters) {
+        uint32_t run = 0;
+        uint32_t cluster = fat_map_cluster(node.first_cluster, index, &run);
+        if (!cluster) {
+            fs_free(data);
+            return NULL;
+        }
+        if (run > clusters - index) run = clusters - index;
+
+        if (block_read(vol.dev, fat_cluster_lba(cluster), run * vol.sectors_per_cluster,
+                       data + (size_t)index * vol.cluster_size) != 0) {
+            fs_free(data);
+            return NULL;
+        }
+        index += run;
+    }
+
+    *size = node.size;
+    return data;
+}
+
+// Write 'size' bytes into a freshly allocated chain
+static int fat_write_chain(uint32_t first_cluster, const uint8_t* data, size_t size) {
+    uint32_t clusters = (uint32_t)((size + vol.cluster_size - 1) / vol.cluster_size);
+    uint32_t index = 0;
+    size_t pos = 0;
+
+    while (index < clusters) {
+        uint32_t run = 0;
+        uint32_t cluster = fat_map_cluster(first_cluster, index, &run);
+        if (!cluster) return -1;
+        if (run > clusters - index) run = clusters - index;
+
+        uint64_t lba = fat_cluster_lba(cluster);
+        uint32_t run_sectors = run * vol.sectors_per_cluster;
+        size_t bytes = (size_t)run * vol.cluster_size;
+        if (bytes > size - pos) bytes = size - pos;
+
+        // Cached copies of these sectors (e.g. from a deleted directory) are stale now
+        bcache_discard(vol.dev, lba, run_sectors);
+
+        uint32_t full = (uint32_t)(bytes / BLOCK_SECTOR_SIZE);
+        if (full > 0 && fat_write_sectors(lba, full, data + pos) != 0) return -1;
+
+        size_t tail = bytes % BLOCK_SECTOR_SIZE;
+        if (tail > 0) {
+            fat_memset(fat32_sector, 0, BLOCK_SECTOR_SIZE);
+            fat_memcpy(fat32_sector, data + pos + (size_t)full * BLOCK_SECTOR_SIZE, tail);
+            if (block_write(vol.dev, lba + full, 1, fat32_sector) != 0) return -1;
+        }
+
+        pos += bytes;
+        index += run;
+    }
+    return 0;
+}
+
+int fat32_write_file(const char* path, const void* data, size_t size) {
+    if (!fat32_mounted || (!data && size > 0) || size > 0xFFFFFFFFu) return -1;
+
+    fat32_node_t node;
+    if (fat32_lookup(path, &node) == 0) {
+        if (node.attr & FAT32_ATTR_DIRECTORY) return -1;
+        if (fat_valid_cluster(node.first_cluster)) {
+            fat_free_chain(node.first_cluster);
+        }
+        node.first_cluster = 0;
+        node.size = 0;
+    } else {
+        fat32_node_t parent;
+        char name[FAT32_NAME_MAX];
+        if (fat_lookup_parent(path, &parent, name) != 0) return -1;
+        if (fat_dir_add(parent.first_cluster, name, FAT32_ATTR_ARCHIVE, 0, 0, &node) != 0) return -1;
+    }
+
+    if (size > 0) {
+        uint32_t clusters = (uint32_t)((size + vol.cluster_size - 1) / vol.cluster_size);
+        uint32_t first = fat_alloc_chain(clusters);
+        if (!first) {
+            fat_update_entry(&node);
+            fat32_sync();
+            return -1;
+        }
+        if (fat_write_chain(first, (const uint8_t*)data, size) != 0) {
+            fat_free_chain(first);
+            fat_update_entry(&node);
+            fat32_sync();
+            return -1;
+        }
+        node.first_cluster = first;
+        node.size = (uint32_t)size;
+    }
+
+    int rc = fat_update_entry(&node);
+    if (fat32_sync() != 0) rc = -1;
+    return rc;
+}
+
+int fat32_create_file(const char* path) {
+    fat32_node_t node;
+    if (fat32_lookup(path, &node) == 0) {
+        return (node.attr & FAT32_ATTR_DIRECTORY) ? -1 : 0;
+    }
+    return fat32_write_file(path, NULL, 0);
+}
+
+int fat32_mkdir(const char* path) {
+    if (!fat32_mounted) return -1;
+
+    fat32_node_t parent;
+    char name[FAT32_NAME_MAX];
+    if (fat_lookup_parent(path, &parent, name) != 0) return -1;
+
+    uint32_t cluster = fat_alloc_chain(1);
+    if (!cluster) return -1;
+
+    // Zero the new directory and add "." and ".."
+    uint64_t lba = fat_cluster_lba(cluster);
+    for (uint32_t s = 0; s < vol.sectors_per_cluster; s++) {
+        bcache_buf_t* buf = bcache_get(vol.dev, lba + s);
+        if (!buf) {
+            fat_free_chain(cluster);
+            return -1;
+        }
+        fat_memset(buf->data, 0, BLOCK_SECTOR_SIZE);
+        if (s == 0) {
+            fat32_dirent_t* dot = (fat32_dirent_t*)buf->data;
+            uint32_t parent_cluster = (parent.first_cluster == vol.root_cluster) ? 0 : parent.first_cluster;
+
+            fat_memset(dot[0].name, ' ', 11);
+            dot[0].name[0] = '.';
+            dot[0].attr = FAT32_ATTR_DIRECTORY;
+            dot[0].fst_clus_hi = (uint16_t)(cluster >> 16);
+            dot[0].fst_clus_lo = (uint16_t)(cluster & 0xFFFF);
+            fat_stamp(&dot[0], 1);
+
+            fat_memset(dot[1].name, ' ', 11);
+            dot[1].name[0] = '.';
+            dot[1].name[1] = '.';
+            dot[1].attr = FAT32_ATTR_DIRECTORY;
+            dot[1].fst_clus_hi = (uint16_t)(parent_cluster >> 16);
+            dot[1].fst_clus_lo = (uint16_t)(parent_cluster & 0xFFFF);
+            fat_stamp(&dot[1], 1);
+        }
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+    }
+
+    if (fat_dir_add(parent.first_cluster, name, FAT32_ATTR_DIRECTORY, cluster, 0, NULL) != 0) {
+        fat_free_chain(cluster);
+        return -1;
+    }
+    return fat32_sync();
+}
+
+int fat32_remove(const char* path) {
+    fat32_node_t node;
+    if (fat32_lookup(path, &node) != 0 || node.dir_cluster == 0) return -1;
+
+    if (node.attr & FAT32_ATTR_DIRECTORY) {
+        fat32_dir_index_t* idx = fat_dir_index(node.first_cluster);
+        if (idx->count > 0) {
+            brew_str("Error: Cannot remove non-empty directory\n");
+            return -1;
+        }
+        fat_dir_invalidate(node.first_cluster);
+    }
+
+    // Mark the long name entries and the 8.3 entry deleted
+    uint32_t first = node.entry_index - node.lfn_count;
+    for (uint32_t i = first; i <= node.entry_index; i++) {
+        uint64_t lba;
+        uint32_t offset;
+        if (fat_dir_entry_loc(node.dir_cluster, i, &lba, &offset) != 0) return -1;
+        bcache_buf_t* buf = bcache_get(vol.dev, lba);
+        if (!buf) return -1;
+        buf->data[offset] = 0xE5;
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+    }
+    fat_dir_invalidate(node.dir_cluster);
+
+    if (fat_valid_cluster(node.first_cluster)) {
+        fat_free_chain(node.first_cluster);
+    }
+    return fat32_sync();
+}
+
+int fat32_sync(void) {
+    if (!fat32_mounted) return -1;
+    int status = 0;
+
+    // Write runs of dirty FAT sectors to every FAT copy
+    uint32_t s = 0;
+    while (s < vol.fat_sectors) {
+        if (!vol.fat_dirty[s]) {
+            s++;
+            continue;
+        }
+        uint32_t start = s;
+        while (s < vol.fat_sectors && vol.fat_dirty[s]) {
+            vol.fat_dirty[s] = 0;
+            s++;
+        }
+        uint32_t count = s - start;
+        const uint8_t* src = (const uint8_t*)vol.fat + (size_t)start * BLOCK_SECTOR_SIZE;
+        for (uint32_t f = 0; f < vol.num_fats; f++) {
+            uint64_t lba = vol.fat_lba + (uint64_t)f * vol.fat_sectors + start;
+            if (fat_write_sectors(lba, count, src) != 0) status = -1;
+        }
+        fat32_stats.fat_sectors_written += count * vol.num_fats;
+    }
+
+    if (vol.fsinfo_lba) {
+        bcache_buf_t* buf = bcache_get(vol.dev, vol.fsinfo_lba);
+        if (buf) {
+            uint8_t* d = buf->data;
+            if (d[0] == 0x52 && d[1] == 0x52 && d[2] == 0x61 && d[3] == 0x41) {
+                fat_memcpy(d + 488, &vol.free_clusters, 4);
+                fat_memcpy(d + 492, &vol.next_free, 4);
+                bcache_mark_dirty(buf);
+            }
+            bcache_release(buf);
+        }
+    }
+
+    if (bcache_sync(vol.dev) != 0) status = -1;
+    return status;
+}
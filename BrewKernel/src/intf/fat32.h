@@ -0,0 +1,127 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAT32_H
+#define FAT32_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "block.h"
+
+// FAT32 volume on a block device. Paths are relative to the volume root
+// ("" or "/" is the root directory, components separated by '/').
+//
+// The whole FAT is kept in memory (dirty sectors written back on sync),
+// each file's cluster chain is cached as a list of contiguous runs, and
+// every directory that is looked up gets a hashed name index.
+
+#define FAT32_MAX_FAT_BYTES   (16 * 1024 * 1024)  // Largest FAT kept in memory
+#define FAT32_MAX_EXTENTS     64                  // Runs cached per chain
+#define FAT32_EXTENT_CACHE    16                  // Chains with cached runs
+#define FAT32_DIR_CACHE       8                   // Directories with a name index
+#define FAT32_DIR_HASH        64
+#define FAT32_NAME_MAX        256
+
+#define FAT32_ATTR_READ_ONLY  0x01
+#define FAT32_ATTR_HIDDEN     0x02
+#define FAT32_ATTR_SYSTEM     0x04
+#define FAT32_ATTR_VOLUME_ID  0x08
+#define FAT32_ATTR_DIRECTORY  0x10
+#define FAT32_ATTR_ARCHIVE    0x20
+#define FAT32_ATTR_LFN        0x0F
+
+#define FAT32_EOC             0x0FFFFFF8  // Values >= this end a chain
+#define FAT32_EOC_MARK        0x0FFFFFFF
+#define FAT32_CLUSTER_MASK    0x0FFFFFFF
+
+// On-disk 8.3 directory entry
+typedef struct {
+    uint8_t name[11];
+    uint8_t attr;
+    uint8_t ntres;            // Bit 3: base lower case, bit 4: extension lower case
+    uint8_t crt_time_tenth;
+    uint16_t crt_time;
+    uint16_t crt_date;
+    uint16_t lst_acc_date;
+    uint16_t fst_clus_hi;
+    uint16_t wrt_time;
+    uint16_t wrt_date;
+    uint16_t fst_clus_lo;
+    uint32_t file_size;
+} __attribute__((packed)) fat32_dirent_t;
+
+// On-disk long file name entry (13 UCS-2 characters)
+typedef struct {
+    uint8_t ord;
+    uint16_t name1[5];
+    uint8_t attr;
+    uint8_t type;
+    uint8_t checksum;
+    uint16_t name2[6];
+    uint16_t fst_clus_lo;
+    uint16_t name3[2];
+} __attribute__((packed)) fat32_lfn_t;
+
+// A file or directory found by a lookup
+typedef struct {
+    uint32_t first_cluster;
+    uint32_t size;
+    uint8_t attr;
+    uint32_t dir_cluster;     // Directory holding the entry (0 for the root itself)
+    uint32_t entry_index;     // Index of the 8.3 entry in that directory
+    uint32_t lfn_count;       // Long name entries directly before it
+} fat32_node_t;
+
+typedef struct {
+    uint32_t extent_hits;
+    uint32_t extent_misses;
+    uint32_t dir_index_hits;
+    uint32_t dir_index_builds;
+    uint32_t fat_sectors_written;
+} fat32_stats_t;
+
+int fat32_mount(block_device_t* dev);
+void fat32_unmount(void);
+int fat32_is_mounted(void);
+block_device_t* fat32_get_device(void);
+
+// Free space in bytes
+uint64_t fat32_get_free_bytes(void);
+void fat32_get_stats(fat32_stats_t* stats);
+
+int fat32_lookup(const char* path, fat32_node_t* node);
+int fat32_is_directory(const char* path);
+
+// Print the entries of a directory. Returns 0 on success.
+int fat32_list(const char* path);
+
+// Read a whole file into a buffer from fs_allocate() (caller frees it)
+char* fat32_read_file(const char* path, size_t* size);
+
+// Create or replace a file with the given contents
+int fat32_write_file(const char* path, const void* data, size_t size);
+int fat32_create_file(const char* path);
+int fat32_mkdir(const char* path);
+
+// Remove a file or an empty directory
+int fat32_remove(const char* path);
+
+// Write back the FAT, FSInfo and dirty directory sectors
+int fat32_sync(void);
+
+#endif // FAT32_H
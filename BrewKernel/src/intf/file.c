@@ -49,6 +49,8 @@ File* create_file(const char* name, char type) {
     file->next_sibling = NULL;
     file->content = NULL;
     file->content_size = 0;
+    file->ino = (unsigned int)file_count;
+    file->log_flags = FILE_LOG_NEW;
     
     return file;
 }
@@ -58,6 +60,8 @@ bool file_write_content(File* file, const char* content, size_t size) {
         return false;
     }
 
+    file->log_flags |= FILE_LOG_DIRTY;
+
     if (file->content) {
         fs_free(file->content);
         file->content = NULL;
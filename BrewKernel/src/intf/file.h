@@ -25,6 +25,10 @@
 #define FS_MAX_FILES 100
 #define FS_MAX_FILE_SIZE 4096
 
+// log_flags: changes not yet written to the persistent log (see fslog.h)
+#define FILE_LOG_NEW   0x01     // Node has no create record on disk
+#define FILE_LOG_DIRTY 0x02     // Content changed since the last sync
+
 typedef struct File {
     char name[FS_MAX_FILENAME];
     char type;              // 'd' for directory, 'f' for file
@@ -34,6 +38,8 @@ typedef struct File {
     struct File* next_sibling; // Next sibling in parent's children list
     char* content;          // File content (NULL for directories)
     size_t content_size;    // Size of content (0 for directories)
+    unsigned int ino;       // Node number, unique for this boot
+    unsigned char log_flags;
 } File;
 
 File* create_file(const char* name, char type);
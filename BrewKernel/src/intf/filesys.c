@@ -18,6 +18,9 @@
 #include "filesys.h"
 #include "file.h"
 #include "print.h"
+#include "fat32.h"
+#include "memory.h"
+#include "fslog.h"
 #include <stdbool.h>
 #include <stddef.h>
 
@@ -52,9 +55,88 @@ static int fs_strcmp(const char* s1, const char* s2) {
 static char current_path[256] = "/";
 static File* root_dir = NULL;
 static File* current_dir = NULL;
+static File* mount_dir = NULL;   // Placeholder node for FS_MOUNT_POINT
 
 File* fs_internal_resolve_path(const char* path);
 
+// Join path with the working directory and fold "." and ".." components
+static void fs_make_absolute(const char* path, char* out, size_t size) {
+    char joined[512];
+    size_t len = 0;
+    if (path[0] != '/') {
+        for (size_t i = 0; current_path[i] && len < sizeof(joined) - 1; i++) {
+            joined[len++] = current_path[i];
+        }
+        if (len < sizeof(joined) - 1) joined[len++] = '/';
+    }
+    for (size_t i = 0; path[i] && len < sizeof(joined) - 1; i++) {
+        joined[len++] = path[i];
+    }
+    joined[len] = '\0';
+
+    size_t pos = 0;
+    size_t i = 0;
+    while (joined[i]) {
+        while (joined[i] == '/') i++;
+        if (!joined[i]) break;
+        size_t start = i;
+        while (joined[i] && joined[i] != '/') i++;
+        size_t clen = i - start;
+
+        if (clen == 1 && joined[start] == '.') continue;
+        if (clen == 2 && joined[start] == '.' && joined[start + 1] == '.') {
+            while (pos > 0 && out[pos - 1] != '/') pos--;
+            if (pos > 0) pos--;
+            continue;
+        }
+        if (pos + clen + 2 > size) break;
+        out[pos++] = '/';
+        for (size_t j = 0; j < clen; j++) {
+            out[pos++] = joined[start + j];
+        }
+    }
+    if (pos == 0) out[pos++] = '/';
+    out[pos] = '\0';
+}
+
+// Returns the volume relative part of an absolute path on the mounted
+// volume, or NULL if the path lies outside FS_MOUNT_POINT
+static const char* fs_mount_relative(const char* abs) {
+    const char* m = FS_MOUNT_POINT;
+    size_t i = 0;
+    while (m[i]) {
+        if (abs[i] != m[i]) return NULL;
+        i++;
+    }
+    if (abs[i] != '\0' && abs[i] != '/') return NULL;
+    return abs + i;
+}
+
+// Decide where a path lives. Returns true with the volume relative path in
+// buf if it is on the mounted FAT32 volume. Otherwise *path is left for the
+// ramfs, rewritten to an absolute path while the working directory is on the
+// volume (current_dir then only points at the mount placeholder).
+static bool fs_mount_route(const char** path, char* buf, size_t size) {
+    bool cwd_on_volume = fs_mount_relative(current_path) != NULL;
+    if (!fat32_is_mounted() && !cwd_on_volume) return false;
+
+    fs_make_absolute(*path, buf, size);
+    const char* rel = fs_mount_relative(buf);
+    if (rel && fat32_is_mounted()) {
+        size_t i = 0;
+        while (rel[i]) {
+            buf[i] = rel[i];
+            i++;
+        }
+        buf[i] = '\0';
+        return true;
+    }
+    if (cwd_on_volume) {
+        *path = buf;
+    }
+    return false;
+}
+
 void fs_init(void) {
     root_dir = create_file("/", 'd');
     current_dir = root_dir;
@@ -87,6 +169,12 @@ void fs_init(void) {
 }
 
 void fs_list_directory(void) {
+    const char* rel = fs_mount_relative(current_path);
+    if (rel && fat32_is_mounted()) {
+        fat32_list(rel);
+        return;
+    }
+
     if (!current_dir) {
         brew_str("Error: Current directory is NULL\n");
         return;
@@ -113,6 +201,14 @@ void fs_list_directory(void) {
 bool fs_change_directory(const char* path) {
     if (!path) return false;
 
+    char mount_path[256];
+    if (fs_mount_route(&path, mount_path, sizeof(mount_path))) {
+        if (!fat32_is_directory(mount_path)) return false;
+        fs_make_absolute(path, current_path, sizeof(current_path));
+        current_dir = mount_dir;
+        return true;
+    }
+
     File* target = fs_internal_resolve_path(path);
     if (!target) return false;
 
@@ -201,6 +297,21 @@ File* fs_internal_resolve_path(const char* path) {
 }
 
 bool fs_list_directory_at_path(const char* path) {
+    char mount_path[256];
+    if (path && path[0] != '\0' && fs_mount_route(&path, mount_path, sizeof(mount_path))) {
+        if (fat32_list(mount_path) != 0) {
+            brew_str("Error: Path not found\n");
+            return false;
+        }
+        return true;
+    }
+    if (!path || path[0] == '\0') {
+        const char* rel = fs_mount_relative(current_path);
+        if (rel && fat32_is_mounted()) {
+            return fat32_list(rel) == 0;
+        }
+    }
+
     File* dir = NULL;
     if (!path || path[0] == '\0') {
         dir = current_dir;
@@ -310,6 +421,11 @@ File* fs_find_file(const char* name) {
 bool fs_create_directory_at_path(const char* path) {
     if (!path) return false;
 
+    char mount_path[256];
+    if (fs_mount_route(&path, mount_path, sizeof(mount_path))) {
+        return fat32_mkdir(mount_path) == 0;
+    }
+
     File* original_dir = current_dir;
     const char* original_path = fs_get_working_directory();
     char original_path_copy[256];
@@ -369,6 +485,15 @@ bool fs_create_directory_at_path(const char* path) {
 bool fs_remove_file(const char* path) {
     if (!path) return false;
 
+    char mount_path[256];
+    if (fs_mount_route(&path, mount_path, sizeof(mount_path))) {
+        if (fat32_remove(mount_path) != 0) {
+            brew_str("Error: File or directory not found\n");
+            return false;
+        }
+        return true;
+    }
+
     char dir_path[256];
     const char* last_slash = fs_strrchr(path, '/');
     char name[256];
@@ -402,9 +527,7 @@ bool fs_remove_file(const char* path) {
 
     if (!target_dir) return false;
 
-    File* prev = NULL;
     File* current = target_dir->children;
-
     while (current) {
         if (fs_strcmp(current->name, name) == 0) {
             if (current->type == 'd' && current->child_count > 0) {
@@ -412,15 +535,10 @@ bool fs_remove_file(const char* path) {
                 return false;
             }
 
-            if (prev) {
-                prev->next_sibling = current->next_sibling;
-            } else {
-                target_dir->children = current->next_sibling;
-            }
-            target_dir->child_count--;
+            fs_unlink_node(current);
+            fslog_note_remove(current);
             return true;
         }
-        prev = current;
         current = current->next_sibling;
     }
 
@@ -444,6 +562,18 @@ bool fs_create_directories(const char** names, int count) {
 const char* fs_read_file_at_path(const char* path, size_t* out_size) {
     if (!path || !out_size) return NULL;
 
+    // Volume files are returned in a buffer that lives until the next read
+    static char* mount_file = NULL;
+    char mount_path[256];
+    if (fs_mount_route(&path, mount_path, sizeof(mount_path))) {
+        if (mount_file) {
+            fs_free(mount_file);
+            mount_file = NULL;
+        }
+        mount_file = fat32_read_file(mount_path, out_size);
+        return mount_file;
+    }
+
     char dir_path[256];
     const char* last_slash = fs_strrchr(path, '/');
     char name[256];
@@ -492,6 +622,11 @@ const char* fs_read_file_at_path(const char* path, size_t* out_size) {
 bool fs_write_file_at_path(const char* path, const char* content, size_t size) {
     if (!path || !content) return false;
 
+    char mount_path[256];
+    if (fs_mount_route(&path, mount_path, sizeof(mount_path))) {
+        return fat32_write_file(mount_path, content, size) == 0;
+    }
+
     char dir_path[256];
     const char* last_slash = fs_strrchr(path, '/');
     char name[256];
@@ -572,6 +707,11 @@ bool fs_write_file_at_path(const char* path, const char* content, size_t size) {
 bool fs_create_file_at_path(const char* path) {
     if (!path) return false;
 
+    char mount_path[256];
+    if (fs_mount_route(&path, mount_path, sizeof(mount_path))) {
+        return fat32_create_file(mount_path) == 0;
+    }
+
     char dir_path[256];
     const char* last_slash = fs_strrchr(path, '/');
     char name[256];
@@ -648,4 +788,161 @@ bool fs_create_file_at_path(const char* path) {
     current_path[i] = '\0';
 
     return success;
-}
\ No newline at end of file
+}
+
+File* fs_resolve_node(const char* path) {
+    if (!path || path[0] == '\0') return current_dir;
+
+    File* dir = fs_internal_resolve_path(path);
+    if (dir) return dir;
+
+    char dir_path[256];
+    const char* last_slash = fs_strrchr(path, '/');
+    const char* name = path;
+    File* target_dir = current_dir;
+
+    if (last_slash) {
+        size_t dir_len = last_slash - path;
+        size_t i;
+        for (i = 0; i < dir_len && i < sizeof(dir_path)-1; i++) {
+            dir_path[i] = path[i];
+        }
+        dir_path[i] = '\0';
+        name = last_slash + 1;
+        target_dir = (dir_len == 0) ? root_dir : fs_internal_resolve_path(dir_path);
+    }
+
+    if (!target_dir) return NULL;
+
+    File* child = target_dir->children;
+    while (child) {
+        if (fs_strcmp(child->name, name) == 0) {
+            return child;
+        }
+        child = child->next_sibling;
+    }
+    return NULL;
+}
+
+// Walks the tree through the parent/sibling links, so no stack is needed
+File* fs_walk_next(File* root, File* node) {
+    if (!root || !node) return NULL;
+
+    if (node->type == 'd' && node->children) {
+        return node->children;
+    }
+
+    while (node && node != root) {
+        if (node->next_sibling) {
+            return node->next_sibling;
+        }
+        node = node->parent;
+    }
+    return NULL;
+}
+
+void fs_get_node_path(const File* node, char* out, size_t out_size) {
+    if (!out || out_size == 0) return;
+    out[0] = '\0';
+    if (!node) return;
+
+    if (node == root_dir || !node->parent) {
+        if (out_size > 1) {
+            out[0] = '/';
+            out[1] = '\0';
+        }
+        return;
+    }
+
+    const char* parts[64];
+    int part_count = 0;
+    const File* it = node;
+    while (it && it != root_dir && part_count < (int)(sizeof(parts)/sizeof(parts[0]))) {
+        parts[part_count++] = it->name;
+        it = it->parent;
+    }
+
+    size_t idx = 0;
+    for (int p = part_count - 1; p >= 0 && idx < out_size - 1; p--) {
+        out[idx++] = '/';
+        const char* name = parts[p];
+        for (size_t j = 0; name[j] && idx < out_size - 1; j++) {
+            out[idx++] = name[j];
+        }
+    }
+    out[idx] = '\0';
+}
+
+File* fs_add_child(File* parent, const char* name, char type) {
+    if (!parent || parent->type != 'd' || !name) return NULL;
+
+    File* last = NULL;
+    File* child = parent->children;
+    while (child) {
+        if (fs_strcmp(child->name, name) == 0) {
+            return child->type == type ? child : NULL;
+        }
+        last = child;
+        child = child->next_sibling;
+    }
+
+    File* node = create_file(name, type);
+    if (!node) return NULL;
+
+    node->parent = parent;
+    if (last) {
+        last->next_sibling = node;
+    } else {
+        parent->children = node;
+    }
+    parent->child_count++;
+    return node;
+}
+
+bool fs_unlink_node(File* node) {
+    if (!node || !node->parent) return false;
+
+    File* parent = node->parent;
+    File* prev = NULL;
+    File* child = parent->children;
+    while (child) {
+        if (child == node) {
+            if (prev) {
+                prev->next_sibling = child->next_sibling;
+            } else {
+                parent->children = child->next_sibling;
+            }
+            parent->child_count--;
+            node->next_sibling = NULL;
+            return true;
+        }
+        prev = child;
+        child = child->next_sibling;
+    }
+    return false;
+}
+
+bool fs_mount(block_device_t* dev) {
+    if (!dev) {
+        // Use the first disk that carries a FAT32 volume
+        int count = block_get_device_count();
+        for (int i = 0; i < count; i++) {
+            if (fs_mount(block_get_device(i))) return true;
+        }
+        return false;
+    }
+
+    if (fat32_mount(dev) != 0) return false;
+
+    if (!mount_dir) {
+        mount_dir = fs_add_child(root_dir, FS_MOUNT_POINT + 1, 'd');
+    }
+    return true;
+}
+
+void fs_unmount(void) {
+    if (fs_mount_relative(current_path)) {
+        fs_change_directory("/");
+    }
+    fat32_unmount();
+}
@@ -20,6 +20,12 @@
 
 #include "file.h"
 #include <stdbool.h>
+
+// Where the FAT32 volume on a disk appears in the tree
+#define FS_MOUNT_POINT "/mnt"
+
+struct block_device;
+
 void fs_init(void);
 void fs_list_directory(void);
 bool fs_change_directory(const char* path);
@@ -36,4 +42,19 @@ const char* fs_read_file_at_path(const char* path, size_t* out_size);
 bool fs_write_file_at_path(const char* path, const char* content, size_t size);
 bool fs_create_file_at_path(const char* path);
 
+// Resolve a path to a file or directory node (NULL if it does not exist)
+File* fs_resolve_node(const char* path);
+// Iterative pre-order walk of the subtree under root, start with node = root
+File* fs_walk_next(File* root, File* node);
+// Build the absolute path of a node into out
+void fs_get_node_path(const File* node, char* out, size_t out_size);
+// Find a child by name, creating it if missing (NULL if it exists with another type)
+File* fs_add_child(File* parent, const char* name, char type);
+// Detach a node from its parent directory
+bool fs_unlink_node(File* node);
+
+// Mount the FAT32 volume of a disk at FS_MOUNT_POINT (NULL = first disk that has one)
+bool fs_mount(struct block_device* dev);
+void fs_unmount(void);
+
 #endif
\ No newline at end of file
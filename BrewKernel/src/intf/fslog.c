@@ -0,0 +1,460 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "fslog.h"
+#include "filesys.h"
+#include "file.h"
+#include "block.h"
+#include "memory.h"
+#include "print.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define FSLOG_ROOT_INO 1
+
+// Set on nodes found in a checkpoint while it is replayed
+#define FSLOG_SEEN 0x80
+
+static block_device_t* log_dev = NULL;
+static uint64_t region_end = 0;
+static uint64_t checkpoint_lba = FSLOG_REGION_START;
+static uint32_t checkpoint_sectors = 0;
+static uint64_t log_tail = FSLOG_REGION_START;   // Where the next segment goes
+static uint64_t next_seq = 1;
+static uint32_t log_sectors = 0;                 // Log written since the checkpoint
+
+// Nodes removed since the last sync that the log knows about
+static unsigned int removed[FS_MAX_FILES];
+static int removed_count = 0;
+
+static fslog_stats_t fslog_stats;
+static uint8_t fslog_sector[BLOCK_SECTOR_SIZE] __attribute__((aligned(16)));
+
+static void log_memcpy(void* dest, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    while (n--) *d++ = *s++;
+}
+
+static void log_memset(void* dest, int val, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+    while (n--) *d++ = (uint8_t)val;
+}
+
+static size_t log_strlen(const char* s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static uint32_t log_checksum(const void* data, size_t n) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint32_t h = 2166136261u;
+    while (n--) {
+        h ^= *p++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static File* log_root(void) {
+    return fs_resolve_node("/");
+}
+
+static unsigned int log_ino(File* node) {
+    return node == log_root() ? FSLOG_ROOT_INO : node->ino;
+}
+
+// ---------------------------------------------------------------------------
+// Building segments
+
+static size_t log_put_record(uint8_t* out, size_t pos, uint8_t type, File* node,
+                             const void* data, size_t len) {
+    if (out) {
+        fslog_record_t rec;
+        rec.type = type;
+        rec.ftype = (uint8_t)node->type;
+        rec.name_len = (type == FSLOG_REC_CREATE) ? (uint16_t)len : 0;
+        rec.ino = log_ino(node);
+        rec.parent = (type == FSLOG_REC_CREATE) ? log_ino(node->parent) : 0;
+        rec.size = (type == FSLOG_REC_WRITE) ? (uint32_t)len : 0;
+        log_memcpy(out + pos, &rec, sizeof(rec));
+        if (len) log_memcpy(out + pos + sizeof(rec), data, len);
+        fslog_stats.records++;
+    }
+    return pos + sizeof(fslog_record_t) + len;
+}
+
+// Lay out the records of a segment after the header. With out == NULL only
+// the size is computed. A checkpoint describes the whole tree, a log segment
+// only what changed since the last sync.
+static size_t log_build(uint8_t* out, int checkpoint) {
+    size_t pos = sizeof(fslog_segment_t);
+
+    if (!checkpoint) {
+        for (int i = 0; i < removed_count; i++) {
+            if (out) {
+                fslog_record_t rec;
+                log_memset(&rec, 0, sizeof(rec));
+                rec.type = FSLOG_REC_REMOVE;
+                rec.ino = removed[i];
+                log_memcpy(out + pos, &rec, sizeof(rec));
+                fslog_stats.records++;
+            }
+            pos += sizeof(fslog_record_t);
+        }
+    }
+
+    // Pre-order walk, so a directory is always created before its children
+    File* root = log_root();
+    File* node = fs_walk_next(root, root);
+    while (node) {
+        if (checkpoint || (node->log_flags & FILE_LOG_NEW)) {
+            pos = log_put_record(out, pos, FSLOG_REC_CREATE, node, node->name, log_strlen(node->name));
+        }
+        if (node->type == 'f') {
+            int write = checkpoint ? node->content_size > 0 : (node->log_flags & FILE_LOG_DIRTY) != 0;
+            if (write) {
+                pos = log_put_record(out, pos, FSLOG_REC_WRITE, node, node->content, node->content_size);
+            }
+        }
+        node = fs_walk_next(root, node);
+    }
+    return pos;
+}
+
+static void log_clear_flags(void) {
+    File* root = log_root();
+    root->log_flags = 0;
+    File* node = fs_walk_next(root, root);
+    while (node) {
+        node->log_flags = 0;
+        node = fs_walk_next(root, node);
+    }
+    removed_count = 0;
+}
+
+// Find room for a segment without overwriting the live checkpoint and log.
+// A new checkpoint supersedes the log, so if that leaves no room it may
+// overwrite the log and only has to spare the old checkpoint. A crash
+// before the superblock moves then loses the changes since the old
+// checkpoint, but never the checkpoint itself.
+static uint64_t log_place(uint32_t sectors, int checkpoint) {
+    if (log_tail >= checkpoint_lba) {
+        if (log_tail + sectors <= region_end) return log_tail;
+        if (FSLOG_REGION_START + sectors <= checkpoint_lba) return FSLOG_REGION_START;
+    } else if (log_tail + sectors <= checkpoint_lba) {
+        return log_tail;
+    }
+    if (checkpoint) {
+        uint64_t checkpoint_end = checkpoint_lba + checkpoint_sectors;
+        if (checkpoint_end + sectors <= region_end) return checkpoint_end;
+        if (FSLOG_REGION_START + sectors <= checkpoint_lba) return FSLOG_REGION_START;
+    }
+    return 0;
+}
+
+static int log_write_super(void) {
+    fslog_super_t* sb = (fslog_super_t*)fslog_sector;
+    log_memset(fslog_sector, 0, sizeof(fslog_sector));
+    log_memcpy(sb->magic, FSLOG_MAGIC, 8);
+    sb->version = FSLOG_VERSION;
+    sb->region_end = region_end;
+    sb->checkpoint_lba = checkpoint_lba;
+    sb->checkpoint_seq = next_seq - 1;
+    sb->checksum = log_checksum(sb, offsetof(fslog_super_t, checksum));
+    fslog_stats.sectors_written++;
+    return block_write(log_dev, 0, 1, fslog_sector);
+}
+
+// Build and append one segment. Returns its location, 0 on failure.
+static uint64_t log_write_segment(int kind, uint32_t* out_sectors) {
+    size_t bytes = log_build(NULL, kind == FSLOG_SEG_CHECKPOINT);
+    uint32_t sectors = (uint32_t)((bytes + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE);
+    uint64_t lba = log_place(sectors, kind == FSLOG_SEG_CHECKPOINT);
+    if (!lba) {
+        if (kind == FSLOG_SEG_CHECKPOINT) fslog_stats.no_space++;
+        return 0;
+    }
+
+    uint8_t* buf = (uint8_t*)fs_allocate_aligned((size_t)sectors * BLOCK_SECTOR_SIZE, 16);
+    if (!buf) return 0;
+    log_memset(buf, 0, (size_t)sectors * BLOCK_SECTOR_SIZE);
+    log_build(buf, kind == FSLOG_SEG_CHECKPOINT);
+
+    fslog_segment_t* hdr = (fslog_segment_t*)buf;
+    hdr->magic = FSLOG_SEGMENT_MAGIC;
+    hdr->kind = (uint32_t)kind;
+    hdr->seq = next_seq;
+    hdr->payload_bytes = (uint32_t)(bytes - sizeof(fslog_segment_t));
+    hdr->payload_sum = log_checksum(buf + sizeof(fslog_segment_t), hdr->payload_bytes);
+    hdr->header_sum = log_checksum(hdr, offsetof(fslog_segment_t, header_sum));
+
+    int rc = block_write(log_dev, lba, sectors, buf);
+    fs_free_aligned(buf);
+    if (rc != 0) return 0;
+
+    fslog_stats.sectors_written += sectors;
+    next_seq++;
+    log_tail = lba + sectors;
+    *out_sectors = sectors;
+    return lba;
+}
+
+static int log_checkpoint(void) {
+    uint32_t sectors = 0;
+    uint32_t no_space = fslog_stats.no_space;
+    uint64_t lba = log_write_segment(FSLOG_SEG_CHECKPOINT, &sectors);
+    if (!lba) return fslog_stats.no_space != no_space ? FSLOG_NO_SPACE : -1;
+
+    // The new checkpoint becomes live once the superblock points at it
+    uint64_t old_lba = checkpoint_lba;
+    checkpoint_lba = lba;
+    if (log_write_super() != 0) {
+        checkpoint_lba = old_lba;
+        return -1;
+    }
+    checkpoint_sectors = sectors;
+    log_sectors = 0;
+    fslog_stats.checkpoints++;
+    log_clear_flags();
+    return 0;
+}
+
+int fslog_sync(void) {
+    if (!log_dev) return -1;
+
+    size_t bytes = log_build(NULL, 0);
+    if (bytes == sizeof(fslog_segment_t)) {
+        return 0;  // Nothing dirty
+    }
+    fslog_stats.syncs++;
+
+    // Rewrite the tree once the log would make replay longer than the checkpoint
+    uint32_t sectors = (uint32_t)((bytes + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE);
+    uint32_t limit = checkpoint_sectors > FSLOG_CHECKPOINT_SECTORS ? checkpoint_sectors : FSLOG_CHECKPOINT_SECTORS;
+    if (log_sectors + sectors > limit) {
+        return log_checkpoint();
+    }
+
+    if (!log_write_segment(FSLOG_SEG_LOG, &sectors)) {
+        return log_checkpoint();  // No room behind the checkpoint, start over
+    }
+    log_sectors += sectors;
+    log_clear_flags();
+    return 0;
+}
+
+void fslog_note_remove(File* node) {
+    if (!node) return;
+    // A node that never reached the log needs no record
+    if (!(node->log_flags & FILE_LOG_NEW) && removed_count < FS_MAX_FILES) {
+        removed[removed_count++] = log_ino(node);
+    }
+    node->log_flags = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Replay
+
+static int log_apply(File** map, const uint8_t* payload, uint32_t bytes) {
+    uint32_t pos = 0;
+    while (pos + sizeof(fslog_record_t) <= bytes) {
+        fslog_record_t rec;
+        log_memcpy(&rec, payload + pos, sizeof(rec));
+        pos += sizeof(rec);
+
+        uint32_t len = (rec.type == FSLOG_REC_CREATE) ? rec.name_len : rec.size;
+        if (pos + len > bytes || rec.ino == 0 || rec.ino > FS_MAX_FILES) return -1;
+        const uint8_t* data = payload + pos;
+        pos += len;
+        fslog_stats.replayed_records++;
+
+        if (rec.type == FSLOG_REC_CREATE) {
+            if (rec.parent == 0 || rec.parent > FS_MAX_FILES || len >= FS_MAX_FILENAME) continue;
+            char name[FS_MAX_FILENAME];
+            log_memcpy(name, data, len);
+            name[len] = '\0';
+            File* node = fs_add_child(map[rec.parent], name, rec.ftype == 'd' ? 'd' : 'f');
+            if (node) node->log_flags |= FSLOG_SEEN;
+            map[rec.ino] = node;
+        } else if (rec.type == FSLOG_REC_WRITE) {
+            if (map[rec.ino]) {
+                file_write_content(map[rec.ino], (const char*)data, len);
+            }
+        } else if (rec.type == FSLOG_REC_REMOVE) {
+            File* node = map[rec.ino];
+            if (node && node->child_count == 0) {
+                fs_unlink_node(node);
+            }
+            map[rec.ino] = NULL;
+        }
+    }
+    return 0;
+}
+
+// Read and verify the segment at lba. Returns a buffer to free with
+// fs_free_aligned(), NULL if there is no valid segment with that sequence.
+static uint8_t* log_read_segment(uint64_t lba, uint64_t seq, uint32_t* sectors) {
+    if (lba < FSLOG_REGION_START || lba >= region_end) return NULL;
+    if (block_read(log_dev, lba, 1, fslog_sector) != 0) return NULL;
+
+    fslog_segment_t hdr;
+    log_memcpy(&hdr, fslog_sector, sizeof(hdr));
+    if (hdr.magic != FSLOG_SEGMENT_MAGIC || hdr.seq != seq ||
+        hdr.header_sum != log_checksum(&hdr, offsetof(fslog_segment_t, header_sum))) {
+        return NULL;
+    }
+
+    uint64_t bytes = sizeof(fslog_segment_t) + (uint64_t)hdr.payload_bytes;
+    uint32_t count = (uint32_t)((bytes + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE);
+    if (lba + count > region_end) return NULL;
+
+    uint8_t* buf = (uint8_t*)fs_allocate_aligned((size_t)count * BLOCK_SECTOR_SIZE, 16);
+    if (!buf) return NULL;
+    if (block_read(log_dev, lba, count, buf) != 0 ||
+        log_checksum(buf + sizeof(fslog_segment_t), hdr.payload_bytes) != hdr.payload_sum) {
+        fs_free_aligned(buf);
+        return NULL;
+    }
+    *sectors = count;
+    return buf;
+}
+
+// Drop nodes that the checkpoint does not contain (e.g. created at boot)
+static void log_prune_unseen(void) {
+    File* stale[FS_MAX_FILES];
+    int count = 0;
+    File* root = log_root();
+    File* node = fs_walk_next(root, root);
+    while (node) {
+        if (!(node->log_flags & FSLOG_SEEN) && (node->parent->log_flags & FSLOG_SEEN || node->parent == root)) {
+            if (count < FS_MAX_FILES) stale[count++] = node;
+        }
+        node = fs_walk_next(root, node);
+    }
+    for (int i = 0; i < count; i++) {
+        fs_unlink_node(stale[i]);
+    }
+}
+
+static int log_replay(const fslog_super_t* sb) {
+    static File* map[FS_MAX_FILES + 1];
+    for (int i = 0; i <= FS_MAX_FILES; i++) {
+        map[i] = NULL;
+    }
+    map[FSLOG_ROOT_INO] = log_root();
+
+    uint32_t sectors = 0;
+    uint8_t* seg = log_read_segment(sb->checkpoint_lba, sb->checkpoint_seq, &sectors);
+    if (!seg || ((fslog_segment_t*)seg)->kind != FSLOG_SEG_CHECKPOINT) {
+        if (seg) fs_free_aligned(seg);
+        return -1;
+    }
+
+    int rc = log_apply(map, seg + sizeof(fslog_segment_t), ((fslog_segment_t*)seg)->payload_bytes);
+    fs_free_aligned(seg);
+    log_prune_unseen();
+    fslog_stats.replayed_segments++;
+
+    checkpoint_lba = sb->checkpoint_lba;
+    checkpoint_sectors = sectors;
+    log_tail = checkpoint_lba + sectors;
+    next_seq = sb->checkpoint_seq + 1;
+    log_sectors = 0;
+
+    // Follow the log written after the checkpoint until the sequence breaks
+    while (rc == 0) {
+        uint64_t lba = log_tail;
+        seg = log_read_segment(lba, next_seq, &sectors);
+        if (!seg && lba != FSLOG_REGION_START) {
+            lba = FSLOG_REGION_START;
+            seg = log_read_segment(lba, next_seq, &sectors);
+        }
+        if (!seg) break;
+
+        rc = log_apply(map, seg + sizeof(fslog_segment_t), ((fslog_segment_t*)seg)->payload_bytes);
+        fs_free_aligned(seg);
+        fslog_stats.replayed_segments++;
+        log_tail = lba + sectors;
+        log_sectors += sectors;
+        next_seq++;
+    }
+    return rc;
+}
+
+void fslog_init(void) {
+    int count = block_get_device_count();
+    for (int i = 0; i < count && !log_dev; i++) {
+        block_device_t* dev = block_get_device(i);
+        if (block_read(dev, 0, 1, fslog_sector) != 0) continue;
+
+        fslog_super_t sb;
+        log_memcpy(&sb, fslog_sector, sizeof(sb));
+        int match = 1;
+        for (int j = 0; j < 8; j++) {
+            if (sb.magic[j] != FSLOG_MAGIC[j]) match = 0;
+        }
+        if (!match || sb.version != FSLOG_VERSION ||
+            sb.checksum != log_checksum(&sb, offsetof(fslog_super_t, checksum)) ||
+            sb.region_end > dev->sector_count) {
+            continue;
+        }
+
+        log_dev = dev;
+        region_end = sb.region_end;
+        if (log_replay(&sb) != 0) {
+            brew_str("fslog: log on ");
+            brew_str(dev->name);
+            brew_str(" is damaged, replayed up to the first bad segment\n");
+        }
+
+        // Node numbers are only valid for one boot: restate the tree in a
+        // fresh checkpoint so later records refer to this boot's numbering
+        if (log_checkpoint() != 0) {
+            brew_str("fslog: could not write checkpoint\n");
+        }
+    }
+}
+
+int fslog_format(block_device_t* dev) {
+    if (!dev || dev->sector_count < FSLOG_REGION_START + 64) return -1;
+
+    log_dev = dev;
+    region_end = dev->sector_count < FSLOG_MAX_REGION ? dev->sector_count : FSLOG_MAX_REGION;
+    checkpoint_lba = FSLOG_REGION_START;
+    checkpoint_sectors = 0;
+    log_tail = FSLOG_REGION_START;
+    next_seq = 1;
+    log_sectors = 0;
+    removed_count = 0;
+
+    if (log_checkpoint() != 0) {
+        log_dev = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+block_device_t* fslog_get_device(void) {
+    return log_dev;
+}
+
+void fslog_get_stats(fslog_stats_t* stats) {
+    if (stats) *stats = fslog_stats;
+}
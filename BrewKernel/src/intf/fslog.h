@@ -0,0 +1,116 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FSLOG_H
+#define FSLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "file.h"
+#include "block.h"
+
+// Persistence for the in-memory filesystem. Changes are appended to a disk
+// as a log of create/write/remove records. A checkpoint (a full image of the
+// tree) is written when the log since the last checkpoint grows too long, so
+// replay at boot reads one checkpoint plus a bounded tail of records.
+//
+// Disk layout:
+//   LBA 0      superblock, points at the current checkpoint
+//   LBA 1..    segments: a header followed by packed records, each segment
+//              starting on a sector boundary. Segments follow each other and
+//              wrap to LBA 1 when the end of the region is reached.
+
+#define FSLOG_MAGIC          "BREWLOG1"
+#define FSLOG_VERSION        1
+#define FSLOG_SEGMENT_MAGIC  0x4C474553  // "SEGL"
+#define FSLOG_REGION_START   1
+#define FSLOG_MAX_REGION     131072      // Use at most 64MB of the disk
+
+// Start a new checkpoint once this many sectors of log follow the last one
+// (or the log outgrows the checkpoint itself)
+#define FSLOG_CHECKPOINT_SECTORS 256
+
+#define FSLOG_SEG_CHECKPOINT 1
+#define FSLOG_SEG_LOG        2
+
+#define FSLOG_REC_CREATE 1
+#define FSLOG_REC_WRITE  2
+#define FSLOG_REC_REMOVE 3
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t region_end;          // First sector past the log region
+    uint64_t checkpoint_lba;
+    uint64_t checkpoint_seq;
+    uint32_t checksum;            // Over the preceding fields
+} __attribute__((packed)) fslog_super_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;                // FSLOG_SEG_*
+    uint64_t seq;                 // Increases by one per segment
+    uint32_t payload_bytes;
+    uint32_t payload_sum;
+    uint32_t header_sum;          // Over the preceding fields
+    uint32_t reserved;
+} __attribute__((packed)) fslog_segment_t;
+
+// Followed by name_len bytes of name (CREATE) or size bytes of content (WRITE)
+typedef struct {
+    uint8_t type;                 // FSLOG_REC_*
+    uint8_t ftype;                // 'd' or 'f' for CREATE
+    uint16_t name_len;
+    uint32_t ino;
+    uint32_t parent;              // CREATE: parent node, 1 = root
+    uint32_t size;                // WRITE: content bytes
+} __attribute__((packed)) fslog_record_t;
+
+typedef struct {
+    uint32_t syncs;
+    uint32_t records;
+    uint32_t checkpoints;
+    uint32_t sectors_written;
+    uint32_t replayed_segments;
+    uint32_t replayed_records;
+    uint32_t no_space;            // Checkpoints that did not fit next to the old one
+} fslog_stats_t;
+
+// Look for a log on the attached disks and replay it into the tree
+void fslog_init(void);
+
+// Format dev for the log and write a checkpoint of the current tree
+int fslog_format(block_device_t* dev);
+
+// fslog_sync() result when the tree has outgrown the log region: a new
+// checkpoint does not fit beside the old one. Nothing is written until
+// the tree shrinks.
+#define FSLOG_NO_SPACE (-2)
+
+// Append the changes since the last sync (dirty nodes and removals).
+// Returns 0, -1 on a write error or FSLOG_NO_SPACE.
+int fslog_sync(void);
+
+// Called when a node leaves the tree
+void fslog_note_remove(File* node);
+
+block_device_t* fslog_get_device(void);
+void fslog_get_stats(fslog_stats_t* stats);
+
+#endif // FSLOG_H
@@ -0,0 +1,121 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IDE_H
+#define IDE_H
+
+#include <stdint.h>
+#include "pci.h"
+#include "block.h"
+
+// PCI IDE controller (class 0x01, subclass 0x01)
+#define PCI_CLASS_MASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE       0x01
+
+// Legacy (compatibility mode) channel resources
+#define IDE_PRIMARY_IO        0x1F0
+#define IDE_PRIMARY_CTRL      0x3F6
+#define IDE_SECONDARY_IO      0x170
+#define IDE_SECONDARY_CTRL    0x376
+#define IDE_PRIMARY_IRQ       14
+#define IDE_SECONDARY_IRQ     15
+
+// ATA task file registers (offsets from the channel I/O base)
+#define ATA_REG_DATA      0x00
+#define ATA_REG_ERROR     0x01
+#define ATA_REG_FEATURES  0x01
+#define ATA_REG_SECCOUNT  0x02
+#define ATA_REG_LBA0      0x03
+#define ATA_REG_LBA1      0x04
+#define ATA_REG_LBA2      0x05
+#define ATA_REG_HDDEVSEL  0x06
+#define ATA_REG_COMMAND   0x07
+#define ATA_REG_STATUS    0x07
+
+// Device control register bits (control base)
+#define ATA_CTRL_NIEN     0x02  // Disable device interrupts
+#define ATA_CTRL_SRST     0x04  // Software reset
+
+// Status register bits
+#define ATA_SR_BSY   0x80  // Busy
+#define ATA_SR_DRDY  0x40  // Drive ready
+#define ATA_SR_DF    0x20  // Drive fault
+#define ATA_SR_DRQ   0x08  // Data request
+#define ATA_SR_ERR   0x01  // Error
+
+// ATA commands
+#define ATA_CMD_READ_DMA       0xC8
+#define ATA_CMD_READ_DMA_EXT   0x25
+#define ATA_CMD_WRITE_DMA      0xCA
+#define ATA_CMD_WRITE_DMA_EXT  0x35
+#define ATA_CMD_IDENTIFY       0xEC
+
+// Bus master IDE registers (offsets from BAR4, +8 for the secondary channel)
+#define BM_REG_COMMAND  0x00
+#define BM_REG_STATUS   0x02
+#define BM_REG_PRDT     0x04
+
+#define BM_CMD_START    0x01  // Start/stop bus master
+#define BM_CMD_READ     0x08  // Direction: device to memory
+
+#define BM_STATUS_ACTIVE 0x01
+#define BM_STATUS_ERROR  0x02
+#define BM_STATUS_IRQ    0x04
+
+// Physical Region Descriptor
+#define IDE_PRD_ENTRIES  64
+#define IDE_PRD_EOT      0x8000  // Last entry in the table
+
+typedef struct {
+    uint32_t phys_addr;   // Buffer address (must not cross a 64KB boundary)
+    uint16_t byte_count;  // 0 means 64KB
+    uint16_t flags;
+} __attribute__((packed)) ide_prd_t;
+
+// Largest DMA transfer issued (LBA28 commands take at most 256 sectors)
+#define IDE_MAX_SECTORS  256
+#define IDE_MAX_SEGMENTS 16
+
+// Polls of an unfinished transfer before the channel is reset
+#define IDE_TIMEOUT_POLLS 5000000
+
+typedef struct ide_channel {
+    uint16_t io_base;
+    uint16_t ctrl_base;
+    uint16_t bm_base;
+    uint8_t irq;
+    ide_prd_t* prd_table;
+    block_request_t* active;          // Request currently on the bus
+    struct ide_drive* active_drive;
+    uint32_t polls;                   // Polls since the command was issued
+} ide_channel_t;
+
+typedef struct ide_drive {
+    ide_channel_t* channel;
+    uint8_t slave;
+    int present;
+    int lba48;
+    uint64_t sectors;
+    char model[41];
+    block_device_t blk;
+} ide_drive_t;
+
+// Probe the PCI IDE controller and register all DMA capable ATA disks
+int ide_init(void);
+
+#endif // IDE_H
@@ -19,6 +19,8 @@
 #ifndef IRQ_H
 #define IRQ_H
 
+#include <stdint.h>
+
 // IRQ numbers (mapped to interrupt vectors 0x20-0x2F)
 #define IRQ0_TIMER     0
 #define IRQ1_KEYBOARD  1
@@ -46,8 +48,42 @@ void irq_register_handler(unsigned char irq, irq_handler_t handler);
 // Unregister an IRQ handler
 void irq_unregister_handler(unsigned char irq);
 
+// Add a handler to a line shared by several PCI devices (INTx).
+// Shared handlers run after the regular one and must check their device
+// actually raised the interrupt. Returns 0 on success, -1 if the line is full.
+#define IRQ_MAX_SHARED 4
+int irq_register_shared_handler(unsigned char irq, irq_handler_t handler);
+
+// Message signalled interrupts (MSI/MSI-X) get vectors of their own,
+// delivered through the local APIC instead of the 8259 and never shared
+#define IRQ_VECTOR_BASE  0x30
+#define IRQ_VECTOR_COUNT 16
+
+// Claim a free vector for handler. Returns the vector, or -1 if none is left.
+int irq_alloc_vector(irq_handler_t handler);
+
+// Release a vector from irq_alloc_vector()
+void irq_free_vector(int vector);
+
+// Times each allocated vector has fired (0 for free ones)
+uint32_t irq_vector_count(int vector);
+
 // Initialize IRQ handling
 void irq_init(void);
 
+// Disable interrupts and return the previous RFLAGS (for short critical sections)
+static inline unsigned long irq_save(void) {
+    unsigned long flags;
+    __asm__ __volatile__("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+// Re-enable interrupts if they were enabled when irq_save() was called
+static inline void irq_restore(unsigned long flags) {
+    if (flags & (1 << 9)) {
+        __asm__ __volatile__("sti" : : : "memory");
+    }
+}
+
 #endif // IRQ_H
 
@@ -27,6 +27,11 @@ size_t fs_get_total_memory(void);
 size_t fs_get_used_memory(void);
 size_t fs_get_free_memory(void);
 
+// Aligned allocations from the same pool (DMA rings, descriptor tables).
+// align must be a power of two. Free with fs_free_aligned().
+void* fs_allocate_aligned(size_t size, size_t align);
+void fs_free_aligned(void* ptr);
+
 // System memory functions
 void sys_memory_init(void* multiboot_info);
 size_t sys_get_total_ram(void);
@@ -0,0 +1,62 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef NETDEV_H
+#define NETDEV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "network.h"
+#include "pbuf.h"
+
+// Driver interface below the network stack. network_init() binds the
+// first NIC whose probe succeeds and network.c reaches the hardware only
+// through its ops table.
+
+// One piece of a frame for a gather send
+typedef struct {
+    const void* data;
+    size_t length;
+    int by_ref;       // 1 = DMA straight from data, 0 = copy into the ring
+} netdev_sg_t;
+
+#define NETDEV_SG_MAX 8     // Segments per frame
+
+typedef struct {
+    const char* name;
+    int (*get_mac)(mac_address_t* mac);
+    uint16_t (*get_mtu)(void);
+    int (*set_mtu)(uint32_t mtu);
+    int (*send_packet)(const void* data, size_t length);
+    int (*receive_packet)(void* buffer, size_t buffer_size);
+    // Zero-copy paths: received pbufs are freed by the caller, sent ones
+    // are consumed. csum carries PBUF_CSUM_TX_* requests.
+    int (*receive_loan)(pbuf_t** pkts, int n);
+    int (*send_pbuf)(pbuf_t* p);
+    int (*send_sg)(const netdev_sg_t* segs, int nsegs, uint8_t csum);
+    int (*csum_offload)(void);
+    int (*mcast_member)(const mac_address_t* mac);
+    int (*tx_flush)(void);
+    void (*tx_hold)(int hold);
+    int (*tx_reclaim)(void);
+    // Interrupt/poll handshake: pending says the rings need service,
+    // complete re-arms the interrupt once they are drained
+    int (*poll_pending)(void);
+    void (*poll_complete)(int drained);
+} netdev_ops_t;
+
+#endif // NETDEV_H
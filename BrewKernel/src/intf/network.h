@@ -21,12 +21,21 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "timer.h"
 
 // Maximum Ethernet frame size (including header)
 #define ETH_FRAME_MAX_SIZE 1518
 #define ETH_HEADER_SIZE 14
 #define ETH_DATA_MAX_SIZE (ETH_FRAME_MAX_SIZE - ETH_HEADER_SIZE)
 
+// MTU (largest IP packet) limits. A frame for a given MTU adds only the
+// Ethernet header: the NIC appends the FCS on transmit and strips it on
+// receive, so frame lengths never include it.
+#define ETH_MTU_DEFAULT 1500
+#define ETH_MTU_MIN 576
+#define ETH_MTU_MAX 9000
+#define ETH_FRAME_SIZE(mtu) ((size_t)(mtu) + ETH_HEADER_SIZE)
+
 // Ethernet ethertypes
 #define ETH_ETHERTYPE_ARP  0x0806
 #define ETH_ETHERTYPE_IPV4 0x0800
@@ -92,16 +101,50 @@ typedef struct {
     uint16_t checksum;     // UDP checksum
 } __attribute__((packed)) udp_header_t;
 
-// ARP cache entry
-#define ARP_CACHE_SIZE 16
-#define ARP_CACHE_TIMEOUT 300  // 5 minutes in seconds (simplified)
+// ARP neighbour table. Entries are hashed on the IPv4 address; when the
+// table is full the least recently used entry is evicted. Times are timer
+// ticks (TIMER_FREQUENCY per second).
+#define ARP_TABLE_SIZE       64
+#define ARP_HASH_BUCKETS     32                        // Power of two
+#define ARP_REACHABLE_TICKS  (300 * TIMER_FREQUENCY)   // A reply is trusted for 5 minutes
+#define ARP_RETRY_TICKS      TIMER_FREQUENCY           // At most one request per entry per second
+#define ARP_MAX_REQUESTS     3                         // Unanswered requests before giving up
+#define ARP_FAILED_TICKS     (10 * TIMER_FREQUENCY)    // Then fail lookups for 10 seconds
+#define ARP_QUEUE_LEN        4                         // Packets held per unresolved entry
+
+typedef enum {
+    ARP_STATE_FREE = 0,
+    ARP_STATE_INCOMPLETE,   // Request sent, packets wait in the queue
+    ARP_STATE_REACHABLE,    // MAC known
+    ARP_STATE_FAILED        // No reply; lookups fail without a request
+} arp_state_t;
+
+struct pbuf;
 
 typedef struct {
     ipv4_address_t ip;
     mac_address_t mac;
-    uint32_t timestamp;  // Simple timestamp (can be uptime-based)
-    int valid;
-} arp_cache_entry_t;
+    uint8_t state;
+    uint8_t requests;        // Requests sent in this resolution attempt
+    uint8_t queue_len;
+    int16_t next;            // Next entry in the hash chain, -1 at the end
+    uint64_t updated;        // Last reply (REACHABLE) or state change
+    uint64_t used;           // Last lookup, for LRU eviction
+    uint64_t requested;      // Last request sent
+    struct pbuf* queue[ARP_QUEUE_LEN];  // Complete frames, MAC filled on reply
+} arp_entry_t;
+
+typedef struct {
+    uint32_t requests;       // Requests sent
+    uint32_t rate_limited;   // Lookups that found a request already in flight
+    uint32_t replies;        // Entries resolved or refreshed
+    uint32_t queued;         // Packets parked until resolution
+    uint32_t released;       // Parked packets sent after the reply
+    uint32_t dropped;        // Parked packets dropped (queue full, no reply, eviction)
+    uint32_t failed;         // Resolutions that ran out of requests
+    uint32_t expired;        // Entries that aged out
+    uint32_t evicted;        // Entries reused while in use
+} arp_stats_t;
 
 // Initialize network subsystem
 int network_init(void);
@@ -109,6 +152,9 @@ int network_init(void);
 // Get MAC address
 int network_get_mac_address(mac_address_t* mac);
 
+// Name of the NIC driver in use ("virtio-net", "e1000e" or "e1000"; "none" before NETINIT)
+const char* network_get_driver(void);
+
 // Get/set IPv4 address
 int network_get_ipv4_address(ipv4_address_t* ip);
 int network_set_ipv4_address(const ipv4_address_t* ip);
@@ -116,18 +162,55 @@ int network_set_ipv4_address(const ipv4_address_t* ip);
 // Send an Ethernet frame
 int network_send_frame(const void* data, size_t length);
 
+// Wait until every queued frame has been sent (releases by-reference payloads)
+int network_tx_flush(void);
+
+// Bracket a run of sends so the NIC is told about them with one register
+// write at network_tx_batch_end() instead of one per frame
+void network_tx_batch_begin(void);
+void network_tx_batch_end(void);
+
+// MTU: largest IPv4 packet sent or received (ETH_MTU_MIN to ETH_MTU_MAX).
+// UDP payloads are limited to the MTU minus 28 bytes of headers.
+uint16_t network_get_mtu(void);
+int network_set_mtu(uint16_t mtu);
+
 // Receive an Ethernet frame (non-blocking)
 // Returns number of bytes received, 0 if no frame available
 int network_receive_frame(void* buffer, size_t buffer_size);
 
-// Process received Ethernet frames (call this periodically)
+// Frames handled per poll before returning to the caller
+#define NET_POLL_BUDGET 64
+
+// Process received Ethernet frames (call this from the main loop). Cheap
+// when the NIC has not raised an interrupt since the last poll.
 void network_process_frames(void);
 
+// Handle up to 'budget' received frames, returns how many were handled
+int network_poll(int budget);
+
+// True if received frames may be waiting for network_process_frames()
+int network_poll_pending(void);
+
 // ARP functions
 int arp_send_request(const ipv4_address_t* target_ip);
+
+// Look up a neighbour. Returns 0 with the MAC if it is known; otherwise
+// starts (or continues) resolution, rate limited, and returns -1.
 int arp_lookup(const ipv4_address_t* ip, mac_address_t* mac);
 void arp_process_packet(const arp_header_t* arp, size_t length);
 
+// Resend requests and expire entries; called from network_process_frames()
+void arp_timer(void);
+
+// Copy table entry 'index' (0 to ARP_TABLE_SIZE - 1). Returns -1 if it is
+// free. The queue pointers of the copy must not be used.
+int arp_get_entry(int index, arp_entry_t* entry);
+void arp_get_stats(arp_stats_t* stats);
+
+// Drop every entry and the packets waiting on them
+void arp_flush(void);
+
 // DHCP (best-effort) - acquire an IP from router
 int network_dhcp_acquire(void);
 
@@ -141,13 +224,48 @@ void ipv4_process_packet(const ipv4_header_t* ip, const mac_address_t* src_mac,
 // UDP functions
 int udp_send_packet(const ipv4_address_t* dest_ip, uint16_t dest_port,
                     uint16_t src_port, const void* data, size_t data_length);
+// Like udp_send_packet(), but the NIC reads the payload straight from
+// 'data'. It must stay unchanged until network_tx_flush() returns.
+int udp_send_packet_ref(const ipv4_address_t* dest_ip, uint16_t dest_port,
+                        uint16_t src_port, const void* data, size_t data_length);
 int udp_send_packet_to_mac(const ipv4_address_t* dest_ip, const mac_address_t* dest_mac,
                            uint16_t dest_port, uint16_t src_port, 
                            const void* data, size_t data_length);
 void udp_process_packet(const udp_header_t* udp, const ipv4_address_t* src_ip,
                         const mac_address_t* src_mac, size_t length);
 
-// UDP socket callback type
+// Connected UDP socket. udp_socket_connect() resolves the route and the
+// next hop's MAC once and keeps the Ethernet, IPv4 and UDP headers as a
+// template; each send copies it and patches the lengths, the IP ID and
+// the checksums. The template is rebuilt when the ARP table, the routes,
+// our address or the checksum offload change.
+#define UDP_FRAME_HEADER_SIZE 42  // Ethernet + IPv4 + UDP
+
+typedef struct {
+    ipv4_address_t dest_ip;
+    uint16_t dest_port;
+    uint16_t src_port;
+    uint8_t valid;               // header matches the generations below
+    uint8_t offload;             // Template built for checksum offload
+    uint32_t neigh_gen;
+    uint32_t route_gen;
+    uint32_t pseudo_sum;         // Pseudo header sum without the length
+    uint32_t ports_sum;          // Sum of the two UDP port fields
+    uint8_t header[UDP_FRAME_HEADER_SIZE];
+} udp_socket_t;
+
+// Fill in the socket and try to build its template. Returns 0 even if the
+// next hop is still being resolved; sends then take the slow path until
+// ARP answers.
+int udp_socket_connect(udp_socket_t* sock, const ipv4_address_t* dest_ip,
+                       uint16_t dest_port, uint16_t src_port);
+int udp_socket_send(udp_socket_t* sock, const void* data, size_t data_length);
+// Like udp_send_packet_ref(): data must stay unchanged until
+// network_tx_flush() returns
+int udp_socket_send_ref(udp_socket_t* sock, const void* data, size_t data_length);
+
+// UDP socket callback type. data points into the receive buffer and is
+// only valid during the call; copy it to keep it.
 typedef void (*udp_callback_t)(const ipv4_address_t* src_ip, uint16_t src_port,
                                 const mac_address_t* src_mac, const void* data, size_t length);
 
@@ -165,5 +283,8 @@ int network_get_e1000_receive_calls(void);
 int network_get_e1000_receive_empty(void);
 int network_get_process_calls(void);
 
+// Checksums computed in software on TX and RX, and frames dropped for a bad checksum
+void network_get_csum_stats(uint32_t* tx_sw, uint32_t* rx_sw, uint32_t* rx_dropped);
+
 #endif // NETWORK_H
 
@@ -0,0 +1,100 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PBUF_H
+#define PBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Packet buffers shared by the RX and TX paths. Each pbuf owns a 2KB
+// buffer, or a 9KB one from the separate jumbo pool for frames above the
+// standard MTU. TX buffers start with PBUF_HEADROOM bytes free in front of the
+// data so every layer can prepend its header by moving the data pointer;
+// RX buffers start at offset 0 because the NIC writes the whole frame.
+
+#define PBUF_SIZE        2048
+#define PBUF_HEADROOM    64     // Ethernet + IPv4 with options + UDP
+#define PBUF_GROW_MAX    4096   // Buffers added per pbuf_pool_reserve() step
+#define PBUF_JUMBO_SIZE  9216   // Headroom + 9000 byte MTU frame
+
+// Checksum state (csum field)
+#define PBUF_CSUM_TX_IP     0x01  // TX: NIC fills in the IPv4 header checksum
+#define PBUF_CSUM_TX_UDP    0x02  // TX: NIC fills in the UDP checksum (field holds the pseudo header sum)
+#define PBUF_CSUM_RX_IP_OK  0x10  // RX: NIC verified the IPv4 header checksum
+#define PBUF_CSUM_RX_IP_BAD 0x20
+#define PBUF_CSUM_RX_L4_OK  0x40  // RX: NIC verified the TCP/UDP checksum
+#define PBUF_CSUM_RX_L4_BAD 0x80
+
+typedef struct pbuf {
+    uint8_t* buf;               // 'size' bytes, DMA capable
+    uint8_t* data;              // Start of the packet within buf
+    uint16_t length;            // Bytes of packet at data
+    uint16_t size;              // PBUF_SIZE or PBUF_JUMBO_SIZE
+    uint8_t csum;               // PBUF_CSUM_* flags
+    volatile uint16_t refcount;
+    struct pbuf* next_free;
+} pbuf_t;
+
+typedef struct {
+    uint32_t total;             // Buffers in the pool
+    uint32_t free;
+    uint32_t in_use;
+    uint32_t high_water;        // Most buffers ever in use at once
+    uint32_t exhausted;         // Allocations that found the pool empty
+    uint32_t jumbo_total;       // Jumbo pool
+    uint32_t jumbo_free;
+    uint32_t jumbo_exhausted;
+} pbuf_stats_t;
+
+// Make sure the pool holds at least 'count' buffers. Returns -1 if memory runs out.
+int pbuf_pool_reserve(uint32_t count);
+
+// Same for the jumbo pool, which is only filled once a large MTU is set
+int pbuf_jumbo_reserve(uint32_t count);
+
+// Take a buffer with PBUF_HEADROOM reserved (NULL if the pool is empty)
+pbuf_t* pbuf_alloc(void);
+
+// Take a buffer with the data pointer at the start (for the NIC to fill)
+pbuf_t* pbuf_alloc_rx(void);
+
+// As above, with room for at least 'length' bytes of data. Lengths that
+// do not fit a standard buffer come from the jumbo pool.
+pbuf_t* pbuf_alloc_size(size_t length);
+pbuf_t* pbuf_alloc_rx_size(size_t length);
+
+// Reference counting; the last pbuf_free() returns the buffer to the pool
+void pbuf_ref(pbuf_t* p);
+void pbuf_free(pbuf_t* p);
+
+// Prepend n bytes of header, returns the new start (NULL if no headroom)
+uint8_t* pbuf_push(pbuf_t* p, size_t n);
+
+// Strip n bytes from the front, returns the new start (NULL if too short)
+uint8_t* pbuf_pull(pbuf_t* p, size_t n);
+
+// Append n bytes, returns where they go (NULL if no tailroom)
+uint8_t* pbuf_put(pbuf_t* p, size_t n);
+
+size_t pbuf_headroom(const pbuf_t* p);
+size_t pbuf_tailroom(const pbuf_t* p);
+
+void pbuf_get_stats(pbuf_stats_t* stats);
+
+#endif // PBUF_H
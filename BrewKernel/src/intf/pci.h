@@ -20,6 +20,7 @@
 #define PCI_H
 
 #include <stdint.h>
+#include "irq.h"
 
 // PCI configuration space ports
 #define PCI_CONFIG_ADDRESS  0xCF8
@@ -75,5 +76,56 @@ int pci_find_device(uint16_t vendor_id, uint16_t device_id, pci_device_t* device
 // Find PCI device by class code
 int pci_find_device_by_class(uint8_t class_code, uint8_t subclass, pci_device_t* device);
 
+// Capability IDs
+#define PCI_CAP_ID_MSI   0x05
+#define PCI_CAP_ID_MSIX  0x11
+
+// Offset of the first capability with this ID, or 0 if the device has none
+uint8_t pci_find_capability(const pci_device_t* dev, uint8_t cap_id);
+
+// Memory address of a BAR (0 for I/O BARs and 64-bit BARs above 4GB)
+uint32_t pci_bar_address(const pci_device_t* dev, int bar);
+
+// Nonzero if an MMIO address is identity mapped at boot
+int pci_mmio_mapped(uint32_t addr);
+
+// MSI-X: each table entry holds the message (address and data) one
+// interrupt source writes, which selects the CPU vector
+#define PCI_MSIX_CTRL_ENABLE  (1u << 15)
+#define PCI_MSIX_CTRL_MASKALL (1u << 14)
+#define PCI_MSIX_ENTRY_SIZE   16
+#define PCI_COMMAND_INTX_DISABLE (1u << 10)
+
+typedef struct {
+    uint8_t cap;                // Capability offset in config space
+    uint16_t table_size;        // Entries in the table
+    volatile uint32_t* table;   // Mapped vector table
+} pci_msix_t;
+
+// Locate and map the MSI-X table, all entries masked. Returns 0 on
+// success, -1 if the device has none or the table is not mapped.
+int pci_msix_init(const pci_device_t* dev, pci_msix_t* msix);
+
+// Point an entry at a vector of this CPU and unmask it
+int pci_msix_set_vector(pci_msix_t* msix, uint16_t entry, uint8_t vector);
+void pci_msix_mask(pci_msix_t* msix, uint16_t entry);
+
+// Switch the function to MSI-X (INTx off) or back
+void pci_msix_enable(const pci_device_t* dev, pci_msix_t* msix, int enable);
+
+// MSI: a single message for the whole function, written to the local APIC
+#define PCI_MSI_CTRL_ENABLE   (1u << 0)
+#define PCI_MSI_CTRL_MME      (7u << 4)   // Messages enabled (log2)
+#define PCI_MSI_CTRL_64BIT    (1u << 7)
+
+// Give the function an exclusive, edge-triggered vector for handler through
+// MSI and turn INTx off. Returns the vector, or -1 if the device has no MSI
+// capability, there is no local APIC or no vector is left; the driver then
+// keeps its INTx line.
+int pci_msi_enable(const pci_device_t* dev, irq_handler_t handler);
+
+// Back to INTx, releasing the vector
+void pci_msi_disable(const pci_device_t* dev, int vector);
+
 #endif // PCI_H
 
@@ -0,0 +1,69 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <stdint.h>
+#include "network.h"
+
+// IPv4 routing table. Lookups take the longest matching prefix, walking a
+// binary trie with one node per prefix bit that is rebuilt whenever a
+// route changes.
+#define ROUTE_MAX        16
+#define ROUTE_TRIE_NODES (ROUTE_MAX * 32 + 1)
+
+#define ROUTE_FLAG_GATEWAY 0x01  // Next hop is 'gateway', not the destination
+#define ROUTE_FLAG_DHCP    0x02  // Learned from a DHCP lease
+
+typedef struct {
+    ipv4_address_t dest;     // Network address, host bits zero
+    ipv4_address_t gateway;  // 0.0.0.0 for a connected (on-link) route
+    uint8_t prefix_len;      // 0 (default route) to 32
+    uint8_t flags;
+    uint8_t valid;
+} route_entry_t;
+
+// Add or replace the route for dest/prefix_len. Host bits of dest are
+// cleared. Returns -1 if the prefix is invalid or the table is full.
+int route_add(const ipv4_address_t* dest, uint8_t prefix_len,
+              const ipv4_address_t* gateway, uint8_t flags);
+
+// Remove the route for dest/prefix_len. Returns -1 if there is none.
+int route_del(const ipv4_address_t* dest, uint8_t prefix_len);
+
+// Remove every route that has any of 'flags' set (0xFF: all routes)
+void route_flush(uint8_t flags);
+
+// Longest-prefix match; NULL if no route covers dest
+const route_entry_t* route_lookup(const ipv4_address_t* dest);
+
+// Copy route 'index' (0 to ROUTE_MAX - 1). Returns -1 if the slot is free.
+int route_get(int index, route_entry_t* route);
+
+// Bumped on every table change, so cached lookups can be revalidated
+uint32_t route_generation(void);
+
+// Prefix length of a contiguous netmask, or -1 if it is not contiguous
+int route_mask_to_prefix(const ipv4_address_t* mask);
+
+// Check longest-prefix matching on a fixed set of routes; -1 on a mismatch.
+// Leaves the table as it was.
+int route_self_check(void);
+
+#endif // ROUTE_H
@@ -0,0 +1,62 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+
+// Text search helpers used by GREP and FIND.
+
+// Find the first occurrence of needle in haystack (SSE2 first/last byte filter).
+// Returns a pointer into haystack, or NULL if not found.
+const char* search_literal(const char* haystack, size_t haystack_len,
+                           const char* needle, size_t needle_len);
+
+// Small regular expression engine
+// Supports: literals, '.', '*', '+', '?', '^', '$', [set], [^set] and '\' escapes
+#define REGEX_MAX_TOKENS 64
+
+typedef struct {
+    unsigned char type;      // Token type (literal, any, class)
+    unsigned char quant;     // Quantifier (none, '*', '+', '?')
+    unsigned char ch;        // Literal character
+    unsigned char negate;    // Negated character class
+    unsigned char set[32];   // Character class bitmap
+} regex_token_t;
+
+typedef struct {
+    regex_token_t tokens[REGEX_MAX_TOKENS];
+    int token_count;
+    int anchored_start;
+    int anchored_end;
+    int is_literal;          // Pattern contains no metacharacters
+    char required[64];       // Literal run every match must contain (prefilter)
+    size_t required_len;
+} regex_t;
+
+// Compile a pattern. Returns 0 on success, -1 if the pattern is invalid.
+int regex_compile(regex_t* re, const char* pattern);
+
+// Returns 1 if the regex matches somewhere in the line, 0 otherwise
+int regex_match_line(const regex_t* re, const char* line, size_t len);
+
+// Shell-style glob match ('*', '?', [set]). Returns 1 on match.
+int glob_match(const char* pattern, const char* name);
+
+#endif // SEARCH_H
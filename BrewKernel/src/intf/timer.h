@@ -51,5 +51,15 @@ void timer_sleep_ms(uint32_t milliseconds);
 // Timer interrupt handler (called from IRQ dispatcher)
 void timer_handler(void);
 
+// Read the CPU time stamp counter
+static inline uint64_t timer_read_tsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// TSC frequency in kHz, calibrated once against PIT channel 2
+uint64_t timer_get_tsc_khz(void);
+
 #endif // TIMER_H
 
@@ -0,0 +1,182 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+#include "pci.h"
+#include "irq.h"
+
+// Virtio over legacy (or transitional) PCI: registers in I/O BAR0,
+// split virtqueues placed in guest memory by page frame number.
+
+#define VIRTIO_VENDOR_ID         0x1AF4
+#define VIRTIO_DEVICE_NET_LEGACY 0x1000
+#define VIRTIO_DEVICE_BLK_LEGACY 0x1001
+
+// Legacy PCI register offsets (from BAR0)
+#define VIRTIO_PCI_HOST_FEATURES   0x00
+#define VIRTIO_PCI_GUEST_FEATURES  0x04
+#define VIRTIO_PCI_QUEUE_PFN       0x08
+#define VIRTIO_PCI_QUEUE_SIZE      0x0C
+#define VIRTIO_PCI_QUEUE_SEL       0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY    0x10
+#define VIRTIO_PCI_STATUS          0x12
+#define VIRTIO_PCI_ISR             0x13
+#define VIRTIO_PCI_CONFIG          0x14  // Device specific config (MSI-X disabled)
+#define VIRTIO_MSI_CONFIG_VECTOR   0x14  // MSI-X entry for config changes
+#define VIRTIO_MSI_QUEUE_VECTOR    0x16  // MSI-X entry of the selected queue
+#define VIRTIO_PCI_CONFIG_MSIX     0x18  // Device specific config (MSI-X enabled)
+#define VIRTIO_MSI_NO_VECTOR       0xFFFF
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE  0x01
+#define VIRTIO_STATUS_DRIVER       0x02
+#define VIRTIO_STATUS_DRIVER_OK    0x04
+#define VIRTIO_STATUS_FEATURES_OK  0x08
+#define VIRTIO_STATUS_FAILED       0x80
+
+// Transport feature bits
+#define VIRTIO_RING_F_INDIRECT_DESC  (1u << 28)
+#define VIRTIO_RING_F_EVENT_IDX      (1u << 29)
+
+// ISR status bits
+#define VIRTIO_ISR_QUEUE   0x01
+#define VIRTIO_ISR_CONFIG  0x02
+
+// Descriptor flags
+#define VIRTQ_DESC_F_NEXT      1
+#define VIRTQ_DESC_F_WRITE     2  // Device writes (otherwise device reads)
+#define VIRTQ_DESC_F_INDIRECT  4  // Buffer holds a descriptor table
+
+// Ring flags
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 1
+#define VIRTQ_USED_F_NO_NOTIFY     1
+
+// Legacy queues are laid out with this alignment
+#define VIRTIO_PCI_VRING_ALIGN 4096
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) virtq_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];    // Followed by used_event
+} __attribute__((packed)) virtq_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed)) virtq_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[];  // Followed by avail_event
+} __attribute__((packed)) virtq_used_t;
+
+typedef struct virtio_device {
+    pci_device_t pci;
+    uint16_t io_base;
+    uint8_t irq;
+    uint32_t features;      // Negotiated feature bits
+    uint16_t config_base;   // Offset of the device config, moves with MSI-X
+    int vector;             // MSI-X vector of all queues, -1 for INTx
+    pci_msix_t msix;
+} virtio_device_t;
+
+// One buffer of a descriptor chain
+typedef struct {
+    void* addr;
+    uint32_t len;
+    int write;              // 1 if the device writes into it
+} virtio_sg_t;
+
+typedef struct virtqueue {
+    virtio_device_t* vdev;
+    uint16_t index;
+    uint16_t size;
+    virtq_desc_t* desc;
+    virtq_avail_t* avail;
+    virtq_used_t* used;
+    uint16_t free_head;     // First free descriptor (linked through next)
+    uint16_t num_free;
+    uint16_t last_used_idx; // Next used ring entry to consume
+    uint16_t pending;       // Buffers added since the last notify
+    void** cookies;         // Caller token per chain head
+    void* mem;              // Ring memory
+    uint32_t notifies;      // Doorbell writes (VM exits)
+    uint32_t suppressed;    // Kicks the device said it did not need
+} virtqueue_t;
+
+// Reset the device, enable bus mastering and set ACKNOWLEDGE|DRIVER
+int virtio_pci_init(virtio_device_t* vdev, const pci_device_t* pci);
+
+// Accept the subset of device features the driver understands
+uint32_t virtio_negotiate_features(virtio_device_t* vdev, uint32_t supported);
+
+// Route every queue to one exclusive MSI-X vector running handler. Call
+// before the queues are set up and the device config is read. Returns -1
+// if the device or the APIC cannot, in which case INTx stays in use. ISR
+// need not be read on this vector.
+int virtio_enable_msix(virtio_device_t* vdev, irq_handler_t handler);
+
+// Undo virtio_enable_msix() when a probe fails
+void virtio_disable_msix(virtio_device_t* vdev);
+
+void virtio_add_status(virtio_device_t* vdev, uint8_t status);
+uint8_t virtio_read_isr(virtio_device_t* vdev);
+
+uint8_t virtio_config_read8(virtio_device_t* vdev, uint16_t offset);
+uint16_t virtio_config_read16(virtio_device_t* vdev, uint16_t offset);
+uint32_t virtio_config_read32(virtio_device_t* vdev, uint16_t offset);
+uint64_t virtio_config_read64(virtio_device_t* vdev, uint16_t offset);
+
+// Allocate and register queue number 'index'. Returns 0 on success.
+int virtqueue_setup(virtio_device_t* vdev, virtqueue_t* vq, uint16_t index);
+
+// Add a descriptor chain. Returns the head index, or -1 if the ring is full.
+int virtqueue_add(virtqueue_t* vq, const virtio_sg_t* sg, int count, void* cookie);
+
+// Add a chain described by an indirect table (uses one ring descriptor)
+int virtqueue_add_indirect(virtqueue_t* vq, virtq_desc_t* table, int count, void* cookie);
+
+// Publish added buffers and notify the device if it wants to be notified.
+// With VIRTIO_RING_F_EVENT_IDX the device names the avail index it wants
+// to hear about, otherwise it sets VIRTQ_USED_F_NO_NOTIFY while busy.
+void virtqueue_kick(virtqueue_t* vq);
+
+// Pop one completed chain. Returns its cookie, or NULL if none is ready.
+void* virtqueue_get_used(virtqueue_t* vq, uint32_t* len);
+
+// Nonzero if a completed chain is waiting
+int virtqueue_has_used(virtqueue_t* vq);
+
+// Suppress or re-enable used buffer interrupts for this queue. Returns
+// nonzero from enable if completions arrived meanwhile, which would not
+// raise an interrupt of their own.
+void virtqueue_disable_intr(virtqueue_t* vq);
+int virtqueue_enable_intr(virtqueue_t* vq);
+
+#endif // VIRTIO_H
@@ -0,0 +1,74 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+#include "virtio.h"
+#include "block.h"
+
+// virtio-blk feature bits
+#define VIRTIO_BLK_F_SIZE_MAX  (1u << 1)
+#define VIRTIO_BLK_F_SEG_MAX   (1u << 2)
+#define VIRTIO_BLK_F_RO        (1u << 5)
+
+// Device config offsets
+#define VIRTIO_BLK_CFG_CAPACITY  0x00  // 64-bit, in 512 byte sectors
+#define VIRTIO_BLK_CFG_SIZE_MAX  0x08
+#define VIRTIO_BLK_CFG_SEG_MAX   0x0C
+
+// Request types and status
+#define VIRTIO_BLK_T_IN   0
+#define VIRTIO_BLK_T_OUT  1
+#define VIRTIO_BLK_S_OK   0
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) virtio_blk_req_hdr_t;
+
+#define VIRTIO_BLK_MAX_DEVICES   4
+#define VIRTIO_BLK_MAX_INFLIGHT  64    // Slots per device (bitmap in a uint64_t)
+#define VIRTIO_BLK_MAX_SEGMENTS  32
+#define VIRTIO_BLK_MAX_SECTORS   1024  // 512KB per request
+
+// Per in-flight request state: header, status byte and indirect table
+typedef struct {
+    virtq_desc_t table[VIRTIO_BLK_MAX_SEGMENTS + 2] __attribute__((aligned(16)));
+    virtio_blk_req_hdr_t hdr;
+    volatile uint8_t status;
+    block_request_t* req;
+} virtio_blk_slot_t;
+
+typedef struct {
+    virtio_device_t vdev;
+    virtqueue_t vq;
+    virtio_blk_slot_t* slots;
+    uint64_t free_slots;       // Bit set = slot available
+    int indirect;              // VIRTIO_RING_F_INDIRECT_DESC negotiated
+    int read_only;
+    uint32_t interrupts;
+    block_device_t blk;
+} virtio_blk_t;
+
+// Find all virtio-blk PCI functions and register them as vda, vdb, ...
+int virtio_blk_init(void);
+
+#endif // VIRTIO_BLK_H
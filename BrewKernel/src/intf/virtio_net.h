@@ -0,0 +1,140 @@
+/*
+ * Brew Kernel
+ * Copyright (C) 2024-2026 boreddevnl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VIRTIO_NET_H
+#define VIRTIO_NET_H
+
+#include <stdint.h>
+#include "virtio.h"
+#include "netdev.h"
+#include "pbuf.h"
+
+// virtio-net feature bits
+#define VIRTIO_NET_F_CSUM        (1u << 0)   // Device completes partial TX checksums
+#define VIRTIO_NET_F_GUEST_CSUM  (1u << 1)   // Device marks RX checksums it verified
+#define VIRTIO_NET_F_MAC         (1u << 5)
+#define VIRTIO_NET_F_MRG_RXBUF   (1u << 15)  // Frames may span several RX buffers
+#define VIRTIO_NET_F_STATUS      (1u << 16)
+#define VIRTIO_NET_F_CTRL_VQ     (1u << 17)
+#define VIRTIO_NET_F_MQ          (1u << 22)
+#define VIRTIO_F_ANY_LAYOUT      (1u << 27)  // Header may share a buffer with data
+
+// Device config offsets
+#define VIRTIO_NET_CFG_MAC        0x00
+#define VIRTIO_NET_CFG_STATUS     0x06
+#define VIRTIO_NET_CFG_MAX_PAIRS  0x08
+
+#define VIRTIO_NET_S_LINK_UP  1
+
+// Header flags
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM  1   // csum_start/csum_offset are valid
+#define VIRTIO_NET_HDR_F_DATA_VALID  2   // RX: checksum already verified
+#define VIRTIO_NET_HDR_GSO_NONE      0
+
+// Control queue commands
+#define VIRTIO_NET_CTRL_MQ              4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+#define VIRTIO_NET_OK                   0
+
+// Precedes every frame. num_buffers is only present with MRG_RXBUF.
+typedef struct {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t num_buffers;
+} __attribute__((packed)) virtio_net_hdr_t;
+
+#define VIRTIO_NET_HDR_SIZE      10
+#define VIRTIO_NET_HDR_MRG_SIZE  12
+
+#define VIRTIO_NET_MAX_PAIRS     4
+#define VIRTIO_NET_TX_COPYBREAK  256   // Shorter by_ref segments are copied anyway
+#define VIRTIO_NET_TX_SPINS      1000000
+#define VIRTIO_NET_JUMBO_RESERVE 64    // Jumbo pbufs for merged frames
+
+// One in-flight TX chain: its header and the pbuf holding the copied parts
+typedef struct {
+    virtio_net_hdr_t hdr;
+    pbuf_t* p;
+    uint8_t by_ref;          // Also points into caller memory
+} virtio_net_tx_slot_t;
+
+typedef struct {
+    virtqueue_t vq;
+    virtio_net_tx_slot_t* slots;
+    uint16_t* free_slots;    // Stack of unused slot numbers
+    uint16_t free_count;
+    uint16_t by_ref_inflight;
+} virtio_net_txq_t;
+
+typedef struct {
+    virtqueue_t vq;
+} virtio_net_rxq_t;
+
+typedef struct {
+    virtio_device_t vdev;
+    virtio_net_rxq_t rxq[VIRTIO_NET_MAX_PAIRS];
+    virtio_net_txq_t txq[VIRTIO_NET_MAX_PAIRS];
+    virtqueue_t ctrlq;
+    uint16_t pairs;          // Queue pairs in use
+    uint16_t max_pairs;      // Queue pairs the device offers
+    uint16_t hdr_size;       // 12 with mergeable RX buffers, else 10
+    uint8_t mrg_rxbuf;
+    uint8_t csum_offload;    // VIRTIO_NET_F_CSUM negotiated
+    uint8_t guest_csum;      // VIRTIO_NET_F_GUEST_CSUM negotiated
+    uint8_t irq_enabled;
+    uint8_t irq;
+    volatile uint8_t poll_pending;
+    uint16_t mtu;
+    uint16_t frame_max;
+    uint16_t tx_hold;
+    mac_address_t mac_address;
+
+    // Control queue command buffers
+    uint8_t ctrl_hdr[2];           // Class, command
+    uint16_t ctrl_data;
+    volatile uint8_t ctrl_ack;
+
+    // Statistics
+    uint32_t stat_irqs;
+    uint32_t stat_polls;
+    uint32_t stat_rx_frames;
+    uint32_t stat_rx_merged;       // Frames that spanned several buffers
+    uint32_t stat_rx_dropped;
+    uint32_t stat_rx_starved;      // Refills that found the pool empty
+    uint32_t stat_rx_csum_ok;
+    uint32_t stat_tx_frames;
+    uint32_t stat_tx_csum_hw;
+    uint32_t stat_tx_ring_full;
+    uint32_t stat_tx_sg_refs;
+} virtio_net_t;
+
+// Find the first virtio-net PCI function and bring it up. Returns 0 on success.
+int virtio_net_init(void);
+
+// Device state, or NULL if no virtio-net device is running
+virtio_net_t* virtio_net_get_device(void);
+
+// Doorbell writes and notifications the event index saved, over all queues
+void virtio_net_get_kick_stats(uint32_t* notifies, uint32_t* suppressed);
+
+extern const netdev_ops_t virtio_net_netdev_ops;
+
+#endif // VIRTIO_NET_H